@@ -0,0 +1,65 @@
+import unittest
+import subprocess
+import os
+import shutil
+import tempfile
+import time
+
+PLUGINS = {
+    '10_first'  : 'sleep 2; echo first',
+    '10_second' : 'sleep 2; echo second',
+    '20_third'  : 'echo third',
+    '30_slow'   : 'sleep 30; echo overslept',
+}
+
+class TestRunPlugins(unittest.TestCase):
+
+    def setUp(self):
+        self.plugins_dir = tempfile.mkdtemp()
+        for name, script in PLUGINS.items():
+            path = os.path.join(self.plugins_dir, name)
+            with open(path, 'w') as plugin:
+                plugin.write('#!/bin/bash\n%s\n' % script)
+            os.chmod(path, 0o755)
+
+        self.env = {
+            'PATH'              : os.environ['PATH'],
+            'RSTRNT_PLUGINS_DIR': self.plugins_dir,
+            'RSTRNT_LOGGING'    : '4',
+        }
+
+    def tearDown(self):
+        shutil.rmtree(self.plugins_dir)
+
+    def run_plugins(self, **env):
+        self.env.update(env)
+        start = time.monotonic()
+        output = subprocess.check_output(['./../run_plugins'], env=self.env,
+                                         stderr=subprocess.STDOUT)
+        return output.decode(), time.monotonic() - start
+
+    def test_groups_run_at_once(self):
+        output, elapsed = self.run_plugins(RSTRNT_DISABLED='30_slow')
+
+        self.assertLess(elapsed, 4)
+        self.assertLess(output.index('first'), output.index('third'))
+        self.assertLess(output.index('second'), output.index('third'))
+        self.assertRegex(output, r'Plugin 10_first finished in [23]s with status 0')
+
+    def test_plugin_budget(self):
+        output, elapsed = self.run_plugins(RSTRNT_PLUGIN_TIMEOUT='3')
+
+        self.assertLess(elapsed, 10)
+        self.assertIn('third', output)
+        self.assertNotIn('overslept', output)
+        self.assertIn('Plugin 30_slow stopped after its budget of 3s', output)
+
+    def test_bad_budgets_ignored(self):
+        output, elapsed = self.run_plugins(RSTRNT_PLUGIN_TIMEOUT='3s',
+                                           RSTRNT_PLUGINS_TIMEOUT='08',
+                                           RSTRNT_DISABLED='30_slow')
+
+        self.assertIn('Ignoring RSTRNT_PLUGIN_TIMEOUT=3s', output)
+        self.assertNotIn('RSTRNT_PLUGINS_TIMEOUT', output)
+        self.assertNotIn('integer expression expected', output)
+        self.assertIn('third', output)
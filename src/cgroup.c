@@ -0,0 +1,289 @@
+/*
+    This file is part of Restraint.
+
+    Restraint is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Restraint is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Restraint.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <gio/gio.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include "cgroup.h"
+
+static const gchar *controllers[] = { "cpu", "memory", "io", "pids", NULL };
+
+typedef struct {
+    const gchar *name;
+    gsize offset;
+} StatField;
+
+static const StatField stat_fields[] = {
+    { "cpu_usage_usec", G_STRUCT_OFFSET (RstrntCgroupStats, cpu_usage_usec) },
+    { "cpu_user_usec", G_STRUCT_OFFSET (RstrntCgroupStats, cpu_user_usec) },
+    { "cpu_system_usec", G_STRUCT_OFFSET (RstrntCgroupStats, cpu_system_usec) },
+    { "memory_peak", G_STRUCT_OFFSET (RstrntCgroupStats, memory_peak) },
+    { "io_rbytes", G_STRUCT_OFFSET (RstrntCgroupStats, io_rbytes) },
+    { "io_wbytes", G_STRUCT_OFFSET (RstrntCgroupStats, io_wbytes) },
+    { "pids_peak", G_STRUCT_OFFSET (RstrntCgroupStats, pids_peak) },
+    { NULL, 0 }
+};
+
+#define STAT_FIELD(stats, field) \
+    G_STRUCT_MEMBER (gint64, (stats), (field)->offset)
+
+static gchar *
+read_file (const gchar *cgroup, const gchar *file)
+{
+    gchar *filename = g_build_filename (cgroup, file, NULL);
+    gchar *contents = NULL;
+
+    g_file_get_contents (filename, &contents, NULL, NULL);
+    g_free (filename);
+
+    return contents;
+}
+
+/*
+ * Enables whichever of our controllers cgroup has on its children, one
+ * at a time as one missing must not keep the others off.
+ */
+static void
+enable_controllers (const gchar *cgroup)
+{
+    gchar *available = read_file (cgroup, "cgroup.controllers");
+    gchar **names;
+
+    if (available == NULL) {
+        return;
+    }
+    names = g_strsplit_set (g_strstrip (available), " ", -1);
+    for (const gchar **controller = controllers; *controller != NULL; controller++) {
+        gchar *enable;
+
+        if (!g_strv_contains ((const gchar * const *) names, *controller)) {
+            continue;
+        }
+        enable = g_strdup_printf ("+%s", *controller);
+        if (!rstrnt_cgroup_set (cgroup, "cgroup.subtree_control", enable, NULL)) {
+            g_debug ("Unable to enable %s controller in %s", *controller, cgroup);
+        }
+        g_free (enable);
+    }
+    g_strfreev (names);
+    g_free (available);
+}
+
+gchar *
+rstrnt_cgroup_create (const gchar *mount,
+                      const gchar *name,
+                      GError **error)
+{
+    gchar *controllers_file = g_build_filename (mount, "cgroup.controllers", NULL);
+    gchar *slice = g_build_filename (mount, CGROUP_SLICE, NULL);
+    gchar *cgroup = NULL;
+    gboolean cgroup2;
+
+    g_return_val_if_fail (error == NULL || *error == NULL, NULL);
+
+    cgroup2 = g_file_test (controllers_file, G_FILE_TEST_EXISTS);
+    g_free (controllers_file);
+    if (!cgroup2) {
+        g_set_error (error, G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED,
+                     "%s is not a cgroup2 hierarchy", mount);
+        goto out;
+    }
+
+    enable_controllers (mount);
+    if (g_mkdir (slice, 0755) < 0 && errno != EEXIST) {
+        g_set_error (error, G_FILE_ERROR, g_file_error_from_errno (errno),
+                     "Failed to create %s: %s", slice, g_strerror (errno));
+        goto out;
+    }
+    enable_controllers (slice);
+
+    cgroup = g_build_filename (slice, name, NULL);
+    // Peaks can't be reset, so a leaf from before a restart is replaced.
+    g_rmdir (cgroup);
+    if (g_mkdir (cgroup, 0755) < 0 && errno != EEXIST) {
+        g_set_error (error, G_FILE_ERROR, g_file_error_from_errno (errno),
+                     "Failed to create %s: %s", cgroup, g_strerror (errno));
+        g_clear_pointer (&cgroup, g_free);
+    }
+
+out:
+    g_free (slice);
+    return cgroup;
+}
+
+gboolean
+rstrnt_cgroup_set (const gchar *cgroup,
+                   const gchar *file,
+                   const gchar *value,
+                   GError **error)
+{
+    gchar *filename = g_build_filename (cgroup, file, NULL);
+    gsize length = strlen (value);
+    gboolean success = FALSE;
+    gint fd;
+
+    g_return_val_if_fail (error == NULL || *error == NULL, FALSE);
+
+    // Interface files take a value in a single write, and are never created
+    // or truncated.
+    fd = g_open (filename, O_WRONLY, 0);
+    if (fd >= 0) {
+        success = write (fd, value, length) == (gssize) length;
+    }
+    if (!success) {
+        g_set_error (error, G_FILE_ERROR, g_file_error_from_errno (errno),
+                     "Failed to write %s to %s: %s", value, filename,
+                     g_strerror (errno));
+    }
+    if (fd >= 0) {
+        close (fd);
+    }
+    g_free (filename);
+
+    return success;
+}
+
+static gint64
+read_single_value (const gchar *cgroup, const gchar *file)
+{
+    gchar *contents = read_file (cgroup, file);
+    gint64 value = -1;
+
+    if (contents != NULL && g_ascii_isdigit (contents[0])) {
+        value = g_ascii_strtoll (contents, NULL, 10);
+    }
+    g_free (contents);
+
+    return value;
+}
+
+/* cpu.stat is "key value" per line. */
+static void
+read_cpu_stat (const gchar *cgroup, RstrntCgroupStats *stats)
+{
+    gchar *contents = read_file (cgroup, "cpu.stat");
+    gchar **lines;
+
+    if (contents == NULL) {
+        return;
+    }
+    lines = g_strsplit (contents, "\n", -1);
+    for (gchar **line = lines; *line != NULL; line++) {
+        gchar **pair = g_strsplit (*line, " ", 2);
+
+        if (g_strv_length (pair) == 2) {
+            gint64 value = g_ascii_strtoll (pair[1], NULL, 10);
+
+            if (g_strcmp0 (pair[0], "usage_usec") == 0) {
+                stats->cpu_usage_usec = value;
+            } else if (g_strcmp0 (pair[0], "user_usec") == 0) {
+                stats->cpu_user_usec = value;
+            } else if (g_strcmp0 (pair[0], "system_usec") == 0) {
+                stats->cpu_system_usec = value;
+            }
+        }
+        g_strfreev (pair);
+    }
+    g_strfreev (lines);
+    g_free (contents);
+}
+
+/* io.stat is a line of key=value pairs per device, summed here. */
+static void
+read_io_stat (const gchar *cgroup, RstrntCgroupStats *stats)
+{
+    gchar *contents = read_file (cgroup, "io.stat");
+    gchar **words;
+
+    if (contents == NULL) {
+        return;
+    }
+    stats->io_rbytes = 0;
+    stats->io_wbytes = 0;
+    words = g_strsplit_set (contents, " \n", -1);
+    for (gchar **word = words; *word != NULL; word++) {
+        if (g_str_has_prefix (*word, "rbytes=")) {
+            stats->io_rbytes += g_ascii_strtoll (*word + strlen ("rbytes="), NULL, 10);
+        } else if (g_str_has_prefix (*word, "wbytes=")) {
+            stats->io_wbytes += g_ascii_strtoll (*word + strlen ("wbytes="), NULL, 10);
+        }
+    }
+    g_strfreev (words);
+    g_free (contents);
+}
+
+void
+rstrnt_cgroup_read_stats (const gchar *cgroup,
+                          RstrntCgroupStats *stats)
+{
+    for (const StatField *field = stat_fields; field->name != NULL; field++) {
+        STAT_FIELD (stats, field) = -1;
+    }
+
+    read_cpu_stat (cgroup, stats);
+    // memory.peak and pids.peak are only in newer kernels
+    stats->memory_peak = read_single_value (cgroup, "memory.peak");
+    read_io_stat (cgroup, stats);
+    stats->pids_peak = read_single_value (cgroup, "pids.peak");
+}
+
+gchar *
+rstrnt_cgroup_stats_format (const RstrntCgroupStats *stats)
+{
+    GString *formatted = g_string_new (NULL);
+
+    for (const StatField *field = stat_fields; field->name != NULL; field++) {
+        if (STAT_FIELD (stats, field) < 0) {
+            continue;
+        }
+        g_string_append_printf (formatted, "%s%s=%" G_GINT64_FORMAT,
+                                formatted->len > 0 ? " " : "", field->name,
+                                STAT_FIELD (stats, field));
+    }
+
+    return g_string_free (formatted, FALSE);
+}
+
+GHashTable *
+rstrnt_cgroup_stats_table (const RstrntCgroupStats *stats)
+{
+    GHashTable *table = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                               NULL, g_free);
+
+    for (const StatField *field = stat_fields; field->name != NULL; field++) {
+        if (STAT_FIELD (stats, field) < 0) {
+            continue;
+        }
+        g_hash_table_insert (table, (gpointer) field->name,
+                             g_strdup_printf ("%" G_GINT64_FORMAT,
+                                              STAT_FIELD (stats, field)));
+    }
+
+    return table;
+}
+
+void
+rstrnt_cgroup_remove (const gchar *cgroup)
+{
+    if (g_rmdir (cgroup) < 0) {
+        g_debug ("Leaving %s in place: %s", cgroup, g_strerror (errno));
+    }
+}
@@ -0,0 +1,100 @@
+/*
+    This file is part of Restraint.
+
+    Restraint is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Restraint is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Restraint.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef _RESTRAINT_CGROUP_H
+#define _RESTRAINT_CGROUP_H
+
+#include <glib.h>
+
+#define CGROUP_MOUNT "/sys/fs/cgroup"
+#define CGROUP_SLICE "restraint.slice"
+
+/* What a cgroup used, -1 where the kernel doesn't account it. */
+typedef struct {
+    gint64 cpu_usage_usec;
+    gint64 cpu_user_usec;
+    gint64 cpu_system_usec;
+    gint64 memory_peak;
+    gint64 io_rbytes;
+    gint64 io_wbytes;
+    gint64 pids_peak;
+} RstrntCgroupStats;
+
+/**
+ * rstrnt_cgroup_create:
+ * @mount: where cgroup2 is mounted, usually %CGROUP_MOUNT.
+ * @name: name of the leaf.
+ * @error: return location for a #GError.
+ *
+ * Creates the leaf @name under %CGROUP_SLICE, enabling the cpu, memory, io
+ * and pids controllers on the way where the kernel has them.  A leaf left
+ * over from an earlier run is replaced if it is empty.
+ *
+ * Returns: the path of the leaf, or %NULL with G_IO_ERROR_NOT_SUPPORTED
+ * if @mount isn't cgroup2.
+ */
+gchar *rstrnt_cgroup_create (const gchar *mount,
+                             const gchar *name,
+                             GError **error);
+
+/**
+ * rstrnt_cgroup_set:
+ * @cgroup: path of the cgroup.
+ * @file: interface file, such as "memory.max".
+ * @value: what to write to it.
+ * @error: return location for a #GError.
+ */
+gboolean rstrnt_cgroup_set (const gchar *cgroup,
+                            const gchar *file,
+                            const gchar *value,
+                            GError **error);
+
+/**
+ * rstrnt_cgroup_read_stats:
+ * @cgroup: path of the cgroup.
+ * @stats: filled in from cpu.stat, memory.peak, io.stat and pids.peak.
+ */
+void rstrnt_cgroup_read_stats (const gchar *cgroup,
+                               RstrntCgroupStats *stats);
+
+/**
+ * rstrnt_cgroup_stats_format:
+ * @stats: stats read by rstrnt_cgroup_read_stats().
+ *
+ * Returns: the known stats as space separated name=value pairs.
+ */
+gchar *rstrnt_cgroup_stats_format (const RstrntCgroupStats *stats);
+
+/**
+ * rstrnt_cgroup_stats_table:
+ * @stats: stats read by rstrnt_cgroup_read_stats().
+ *
+ * Returns: the known stats by name, with static keys and allocated values,
+ * for adding to a form.
+ */
+GHashTable *rstrnt_cgroup_stats_table (const RstrntCgroupStats *stats);
+
+/**
+ * rstrnt_cgroup_remove:
+ * @cgroup: path of the cgroup.
+ *
+ * Removes the cgroup unless processes are still in it, as when a task
+ * leaves a daemon running for a later one.
+ */
+void rstrnt_cgroup_remove (const gchar *cgroup);
+
+#endif
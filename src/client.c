@@ -19,7 +19,9 @@
 
 #include <glib.h>
 #include <glib/gstdio.h>
+#include <glib-unix.h>
 #include <gio/gio.h>
+#include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <errno.h>
@@ -29,14 +31,19 @@
 #include <libxml/xpath.h>
 #include <libxml/relaxng.h>
 #include <libxml/tree.h>
+#include <libsoup/soup.h>
 #include <unistd.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/wait.h>
 #include <fcntl.h>
 #include "client.h"
+#include "common.h"
 #include "errors.h"
 #include "xml.h"
 #include "process.h"
+#include "report.h"
+#include "stall.h"
 
 #define TIMESTRLEN 26
 
@@ -50,11 +57,15 @@ static void restraint_free_recipe_data(RecipeData *recipe_data)
     if (recipe_data->tasks != NULL) {
         g_hash_table_destroy(recipe_data->tasks);
     }
+    if (recipe_data->task_nodes != NULL) {
+        g_hash_table_destroy(recipe_data->task_nodes);
+    }
 
     g_string_free(recipe_data->body, TRUE);
     g_clear_object (&recipe_data->cancellable);
     g_free (recipe_data->rhost);
     g_free (recipe_data->connect_uri);
+    rstrnt_frame_reader_free (recipe_data->frame_reader);
 
     g_slice_free(RecipeData, recipe_data);
 }
@@ -71,6 +82,8 @@ static void restraint_free_app_data(AppData *app_data)
     g_clear_error(&app_data->error);
     g_free(app_data->run_dir);
     g_free(app_data->rsh_cmd);
+    rstrnt_journal_close(app_data->journal);
+    rstrnt_log_writer_free(app_data->log_writer);
 
     if (app_data->result_states_to != NULL) {
         g_hash_table_destroy(app_data->result_states_to);
@@ -146,28 +159,6 @@ json_to_hashtable (struct json_object *jobj) {
     return form_data_set;
 }
 
-static void
-update_chunk (gchar *filename, const gchar *data, gsize size, goffset offset)
-{
-    gint fd = g_open(filename, O_WRONLY | O_CREAT, 0644);
-    if (fd < 0) {
-        g_warning("Failed to open %s: %s", filename, strerror(errno));
-        return;
-    }
-
-    if (lseek (fd, offset, SEEK_SET) < 0) {
-        g_warning("Failed to seek %s to %" G_GOFFSET_FORMAT ": %s", filename, offset,
-                   strerror(errno));
-    } else {
-        ssize_t written = write (fd, data, size);
-        g_warn_if_fail(written == size);
-    }
-
-    if (g_close(fd, NULL) < 0) {
-        g_warning("Failed to close %s: %s", filename, strerror(errno));
-    }
-}
-
 static void
 init_result_hash (AppData *app_data)
 {
@@ -238,21 +229,24 @@ result_to_id (const gchar *result, GHashTable *states)
 }
 
 static void
-record_result (xmlNodePtr recipe_node_ptr,
-               xmlNodePtr task_node_ptr,
+record_result (RecipeData *recipe_data,
+               TaskNodes *task_nodes,
                const gchar *result_id,
                const gchar *result,
                const gchar *message,
                const gchar *path,
-               const gchar *score,
-               AppData *app_data,
-               const gchar *rhost)
+               const gchar *score)
 {
-    gchar *trunc_host = g_strndup (rhost, 20);
-    xmlNodePtr results_node_ptr = first_child_with_name(task_node_ptr,
-                                                        "results", TRUE);
+    AppData *app_data = recipe_data->app_data;
+    xmlNodePtr recipe_node_ptr = recipe_data->recipe_node_ptr;
+    xmlNodePtr task_node_ptr = task_nodes->task_node_ptr;
+
+    if (task_nodes->results_node_ptr == NULL) {
+        task_nodes->results_node_ptr = first_child_with_name(task_node_ptr,
+                                                             "results", TRUE);
+    }
     // record result under results_node_ptr
-    xmlNodePtr result_node_ptr = xmlNewTextChild (results_node_ptr,
+    xmlNodePtr result_node_ptr = xmlNewTextChild (task_nodes->results_node_ptr,
                                                   NULL,
                                                   (xmlChar *) "result",
                                                   (xmlChar *) message);
@@ -261,10 +255,16 @@ record_result (xmlNodePtr recipe_node_ptr,
     xmlSetProp (result_node_ptr, (xmlChar *)"result", (xmlChar *) result);
 
     // add a logs node
-    xmlNewTextChild (result_node_ptr,
-                     NULL,
-                     (xmlChar *) "logs",
-                     NULL);
+    xmlNodePtr logs_node_ptr = xmlNewTextChild (result_node_ptr,
+                                                NULL,
+                                                (xmlChar *) "logs",
+                                                NULL);
+    // Logs go to the first result with a given id.
+    if (result_id != NULL &&
+            !g_hash_table_contains (task_nodes->result_logs, result_id)) {
+        g_hash_table_insert (task_nodes->result_logs, g_strdup (result_id),
+                             logs_node_ptr);
+    }
 
     if (score)
         xmlSetProp (result_node_ptr, (xmlChar *)"score", (xmlChar *) score);
@@ -283,41 +283,196 @@ record_result (xmlNodePtr recipe_node_ptr,
         xmlSetProp (recipe_node_ptr, (xmlChar*)"result",
                     (xmlChar*)result);
 
-    if (app_data->verbose == 1) {
-        // FIXME - read the terminal width and base this value off that.
-        gint offset = (gint) strlen (path) - 43;
-        const gchar *offset_path = NULL;
-        if (offset < 0) {
-            offset_path = path;
-        } else {
-            offset_path = &path[offset];
-        }
-        g_print ("[%-20s] %10s [%-43s] %s", 
-                 trunc_host, result_id,
-                 offset_path, result);
-        if (score != NULL) {
-            g_print (" Score: %s", score);
-        }
-        g_print ("\n");
-        if (message) {
-            g_print ("[%-20s]           %s\n", trunc_host, message);
-        }
-    }
     xmlFree(recipe_result);
     xmlFree(task_result);
-    g_free(trunc_host);
 }
 
 static void
+print_result (AppData *app_data,
+              const gchar *rhost,
+              const gchar *result_id,
+              const gchar *result,
+              const gchar *message,
+              const gchar *path,
+              const gchar *score)
+{
+    if (app_data->verbose != 1) {
+        return;
+    }
+
+    gchar *trunc_host = g_strndup (rhost, 20);
+    // FIXME - read the terminal width and base this value off that.
+    gint offset = (gint) strlen (path) - 43;
+    const gchar *offset_path = NULL;
+    if (offset < 0) {
+        offset_path = path;
+    } else {
+        offset_path = &path[offset];
+    }
+    g_print ("[%-20s] %10s [%-43s] %s", 
+             trunc_host, result_id,
+             offset_path, result);
+    if (score != NULL) {
+        g_print (" Score: %s", score);
+    }
+    g_print ("\n");
+    if (message) {
+        g_print ("[%-20s]           %s\n", trunc_host, message);
+    }
+    g_free(trunc_host);
+}
+
+static gboolean
+has_result (TaskNodes *task_nodes, const gchar *result_id)
+{
+    return result_id != NULL &&
+           g_hash_table_contains (task_nodes->result_logs, result_id);
+}
+
+static gboolean
 put_doc (xmlDocPtr xml_doc, gchar *filename)
 {
     FILE *outxml = fopen(filename, "w");
     if (outxml == NULL) {
         g_warning("Failed to open %s: %s", filename, strerror(errno));
-        return;
+        return FALSE;
+    }
+    gboolean success = xmlDocFormatDump (outxml, xml_doc, 1) >= 0;
+    if (fclose (outxml) != 0) {
+        success = FALSE;
+    }
+    if (!success) {
+        g_warning("Failed to write %s", filename);
+    }
+    return success;
+}
+
+/*
+ * Write index.html and junit.xml from the job as it stands, straight
+ * from the document rather than through xsltproc and job.xml.
+ */
+static void
+write_reports (AppData *app_data)
+{
+    GError *gerror = NULL;
+    gchar *filename;
+
+    filename = g_build_filename (app_data->run_dir, REPORT_HTML_FILENAME, NULL);
+    if (!rstrnt_report_write_html (app_data->xml_doc, filename, &gerror)) {
+        g_printerr ("%s\n", gerror->message);
+        g_clear_error (&gerror);
+    }
+    g_free (filename);
+
+    filename = g_build_filename (app_data->run_dir, REPORT_JUNIT_FILENAME, NULL);
+    if (!rstrnt_report_write_junit (app_data->xml_doc, filename, &gerror)) {
+        g_printerr ("%s\n", gerror->message);
+        g_clear_error (&gerror);
+    }
+    g_free (filename);
+}
+
+/*
+ * Write job.xml out in full.  It goes to a temporary file first so that
+ * a crash half way through leaves the previous checkpoint in place, which
+ * together with the journal is still enough to rebuild the job.
+ */
+static gboolean
+checkpoint_job (AppData *app_data)
+{
+    GError *error = NULL;
+    gchar *filename = g_build_filename (app_data->run_dir, "job.xml", NULL);
+    gchar *tmp_filename = g_strdup_printf ("%s.tmp", filename);
+
+    gboolean success = put_doc (app_data->xml_doc, tmp_filename);
+    if (success && g_rename (tmp_filename, filename) < 0) {
+        g_warning ("Failed to rename %s to %s: %s", tmp_filename, filename,
+                   g_strerror (errno));
+        success = FALSE;
+    }
+
+    // Everything in the journal is in job.xml now.
+    if (success && app_data->journal != NULL &&
+            !rstrnt_journal_truncate (app_data->journal, &error)) {
+        g_warning ("%s", error->message);
+        g_clear_error (&error);
+    }
+
+    if (app_data->live_report) {
+        write_reports (app_data);
+    }
+
+    g_free (tmp_filename);
+    g_free (filename);
+    return success;
+}
+
+static gboolean
+checkpoint_timeout_cb (gpointer user_data)
+{
+    AppData *app_data = (AppData *) user_data;
+
+    if (rstrnt_journal_get_records (app_data->journal) > 0) {
+        checkpoint_job (app_data);
+    }
+    return G_SOURCE_CONTINUE;
+}
+
+static struct json_object *
+journal_new_record (const gchar *op,
+                    const gchar *recipe_id,
+                    const gchar *task_id)
+{
+    struct json_object *record = json_object_new_object ();
+
+    json_object_object_add (record, "op", json_object_new_string (op));
+    json_object_object_add (record, "recipe", json_object_new_string (recipe_id));
+    json_object_object_add (record, "task", json_object_new_string (task_id));
+    return record;
+}
+
+static void
+journal_record_add (struct json_object *record,
+                    const gchar *key,
+                    const gchar *value)
+{
+    if (value != NULL) {
+        json_object_object_add (record, key, json_object_new_string (value));
+    }
+}
+
+static const gchar *
+journal_record_get (struct json_object *record, const gchar *key)
+{
+    struct json_object *value = NULL;
+
+    if (!json_object_object_get_ex (record, key, &value) ||
+            json_object_get_type (value) != json_type_string) {
+        return NULL;
     }
-    xmlDocFormatDump (outxml, xml_doc, 1);
-    fclose (outxml);
+    return json_object_get_string (value);
+}
+
+/*
+ * Append @record (consumed) to the journal.  Returns FALSE if it could not
+ * be written, in which case the caller should fall back to writing out
+ * job.xml if the change must not be lost.
+ */
+static gboolean
+journal_record (AppData *app_data, struct json_object *record)
+{
+    GError *error = NULL;
+    gboolean success = FALSE;
+
+    if (app_data->journal != NULL) {
+        success = rstrnt_journal_append (app_data->journal, record, &error);
+        if (!success) {
+            g_warning ("%s", error->message);
+            g_clear_error (&error);
+        }
+    }
+    json_object_put (record);
+    return success;
 }
 
 void
@@ -329,6 +484,19 @@ remote_process_finish (gint pid_result,
     RecipeData *recipe_data = (RecipeData *) user_data;
     AppData *app_data = recipe_data->app_data;
 
+    // A restraintd which doesn't know --framing fails parsing its options
+    // without ever answering, talk JSON to it instead.
+    if (recipe_data->framing_offered &&
+            recipe_data->framing != RSTRNT_FRAMING_BINARY &&
+            WIFEXITED (pid_result) &&
+            WEXITSTATUS (pid_result) == PARSE_ARGS_FAILED) {
+        g_print ("restraintd on %s doesn't support binary framing, "
+                 "falling back to json\n", recipe_data->connect_uri);
+        recipe_data->framing_rejected = TRUE;
+        g_idle_add (run_recipe_handler, recipe_data);
+        return;
+    }
+
     // If we get an error on the first connection then we simply abort
     if (app_data->started && ! tasks_finished(app_data->xml_doc, recipe_data->recipe_node_ptr, (xmlChar *)"task")
                           && ! g_cancellable_is_cancelled(recipe_data->cancellable)
@@ -357,12 +525,13 @@ remote_process_finish (gint pid_result,
 void
 tasks_results_cb (const char *path,
                   GHashTable *headers,
-                  struct json_object *json_body,
+                  GHashTable *body,
+                  const gchar *data,
+                  gsize data_length,
                   gpointer user_data)
 {
     RecipeData *recipe_data = (RecipeData*) user_data;
     AppData *app_data = recipe_data->app_data;
-    GHashTable *body;
     gchar *task_id = NULL;
     gchar *recipe_id = NULL;
     gchar **entries = NULL;
@@ -376,24 +545,32 @@ tasks_results_cb (const char *path,
     app_data->started = TRUE;
 
     // Lookup our task
-    xmlNodePtr task_node_ptr = g_hash_table_lookup(recipe_data->tasks,
-                                                   task_id);
-    if (!task_node_ptr) {
+    TaskNodes *task_nodes = g_hash_table_lookup(recipe_data->task_nodes,
+                                                task_id);
+    if (!task_nodes) {
         goto cleanup;
     }
 
     // Record results
-    body = json_to_hashtable (json_body);
     gchar *result = g_hash_table_lookup (body, "result");
     gchar *message = g_hash_table_lookup (body, "message");
     gchar *result_path = g_hash_table_lookup (body, "path");
     gchar *score = g_hash_table_lookup (body, "score");
 
     // Record the result
-    record_result(recipe_data->recipe_node_ptr, task_node_ptr, transaction_id, result, message,
-                  result_path, score, app_data, (const gchar *) recipe_data->rhost);
+    record_result(recipe_data, task_nodes, transaction_id, result, message,
+                  result_path, score);
+    print_result(app_data, (const gchar *) recipe_data->rhost, transaction_id,
+                 result, message, result_path, score);
+
+    struct json_object *record = journal_new_record ("result", recipe_id, task_id);
+    journal_record_add (record, "transaction-id", transaction_id);
+    journal_record_add (record, "result", result);
+    journal_record_add (record, "message", message);
+    journal_record_add (record, "path", result_path);
+    journal_record_add (record, "score", score);
+    journal_record (app_data, record);
 
-    g_hash_table_destroy(body);
 cleanup:
     g_free (task_id);
     g_free (recipe_id);
@@ -418,17 +595,16 @@ watchdog_timeout_cb (gpointer user_data)
 void
 watchdog_cb (const char *path,
              GHashTable *headers,
-             struct json_object *json_body,
+             GHashTable *body,
+             const gchar *data,
+             gsize data_length,
              gpointer user_data)
 {
     RecipeData *recipe_data = (RecipeData*) user_data;
-    GHashTable *body;
 
-    body = json_to_hashtable (json_body);
     gchar *seconds_string = g_hash_table_lookup (body, "seconds");
     guint64 max_time = 0;
     max_time = g_ascii_strtoull(seconds_string, NULL, 10); // XXX check errno
-    g_hash_table_destroy(body);
     if (recipe_data->timeout_handler_id != 0) {
         g_source_remove (recipe_data->timeout_handler_id);
     }
@@ -442,7 +618,9 @@ watchdog_cb (const char *path,
 void
 recipe_start_cb (const char *path,
                  GHashTable *headers,
-                 struct json_object *json_body,
+                 GHashTable *body,
+                 const gchar *data,
+                 gsize data_length,
                  gpointer user_data)
 {
     RecipeData *recipe_data = (RecipeData*) user_data;
@@ -459,15 +637,84 @@ static gchar *format_datetime(time_t time) {
     return timestr;
 }
 
+static void
+update_task_status (RecipeData *recipe_data,
+                    TaskNodes *task_nodes,
+                    const gchar *transaction_id,
+                    const gchar *status,
+                    const gchar *message,
+                    const gchar *version,
+                    const gchar *stime_string,
+                    const gchar *etime_string,
+                    gboolean replay)
+{
+    xmlNodePtr task_node_ptr = task_nodes->task_node_ptr;
+
+    if (version) {
+        xmlSetProp (task_node_ptr, (xmlChar *)"version", (xmlChar *) version);
+    }
+    time_t stime = 0;
+    time_t etime = 0;
+    if (stime_string) {
+        stime = atoll(stime_string);
+        if (stime > 0) {
+            gchar *stimestr = format_datetime(stime);
+            xmlSetProp (task_node_ptr, (xmlChar *)"start_time", (xmlChar*)stimestr);
+            g_free(stimestr);
+        }
+    }
+
+    if (etime_string) {
+        etime = atoll(etime_string);
+        if (etime > 0) {
+            gchar *etimestr = format_datetime(etime);
+            xmlSetProp (task_node_ptr, (xmlChar *)"end_time", (xmlChar*)etimestr);
+            g_free(etimestr);
+        }
+    }
+
+    if  (stime > 0 && etime > stime) {
+        time_t duration = etime - stime;
+        gchar *dstr = g_strdup_printf("%02ld", duration);
+        xmlSetProp (task_node_ptr, (xmlChar *)"duration", (xmlChar*)dstr);
+        g_free(dstr);
+    }
+
+    // If message is passed then record a result with that.  A replayed
+    // record may already be in job.xml if we went down right after a
+    // checkpoint.
+    if (message && !(replay && has_result (task_nodes, transaction_id))) {
+        record_result(recipe_data,
+                      task_nodes,
+                      transaction_id,
+                      "WARN",
+                      message,
+                      "/",
+                      NULL);
+    }
+
+    xmlSetProp (task_node_ptr, (xmlChar *)"status", (xmlChar *) status);
+    xmlChar *recipe_status = xmlGetNoNsProp(
+            recipe_data->recipe_node_ptr, (xmlChar*)"status");
+
+    // If recipe status is not already "Aborted" then record push
+    // task status to recipe.
+    if (g_strcmp0((const gchar*)recipe_status, "Aborted") != 0)
+        xmlSetProp(recipe_data->recipe_node_ptr, (xmlChar*)"status",
+                   (xmlChar*)status);
+    xmlFree(recipe_status);
+}
+
 void
 tasks_status_cb (const char *path,
                  GHashTable *headers,
-                 struct json_object *json_body,
+                 GHashTable *body,
+                 const gchar *data,
+                 gsize data_length,
                  gpointer user_data)
 {
     RecipeData *recipe_data = (RecipeData*) user_data;
     AppData *app_data = recipe_data->app_data;
-    GHashTable *body;
     gchar *task_id = NULL;
     gchar *recipe_id = NULL;
     gchar **entries = NULL;
@@ -483,45 +730,18 @@ tasks_status_cb (const char *path,
     app_data->started = TRUE;
 
     // Lookup our task
-    xmlNodePtr task_node_ptr = g_hash_table_lookup(recipe_data->tasks,
-                                                   task_id);
-    if (!task_node_ptr) {
+    TaskNodes *task_nodes = g_hash_table_lookup(recipe_data->task_nodes,
+                                                task_id);
+    if (!task_nodes) {
         goto cleanup;
     }
+    xmlNodePtr task_node_ptr = task_nodes->task_node_ptr;
 
-    body = json_to_hashtable (json_body);
     gchar *status = g_hash_table_lookup (body, "status");
     gchar *message = g_hash_table_lookup (body, "message");
     gchar *version = g_hash_table_lookup (body, "version");
-    if (version) {
-        xmlSetProp (task_node_ptr, (xmlChar *)"version", (xmlChar *) version);
-    }
-    time_t stime = 0;
-    time_t etime = 0;
-    if (g_hash_table_contains(body, "stime")) {
-        stime = atoll(g_hash_table_lookup(body, "stime"));
-        if (stime > 0) {
-            gchar *stimestr = format_datetime(stime);
-            xmlSetProp (task_node_ptr, (xmlChar *)"start_time", (xmlChar*)stimestr);
-            g_free(stimestr);
-        }
-    }
-
-    if (g_hash_table_contains(body, "etime")) {
-        etime = atoll(g_hash_table_lookup(body, "etime"));
-        if (etime > 0) {
-            gchar *etimestr = format_datetime(etime);
-            xmlSetProp (task_node_ptr, (xmlChar *)"end_time", (xmlChar*)etimestr);
-            g_free(etimestr);
-        }
-    }
-
-    if  (stime > 0 && etime > stime) {
-        time_t duration = etime - stime;
-        gchar *dstr = g_strdup_printf("%02ld", duration);
-        xmlSetProp (task_node_ptr, (xmlChar *)"duration", (xmlChar*)dstr);
-        g_free(dstr);
-    }
+    gchar *stime = g_hash_table_lookup (body, "stime");
+    gchar *etime = g_hash_table_lookup (body, "etime");
 
     if (app_data->verbose < 2) {
         xmlChar *task_name = xmlGetNoNsProp(task_node_ptr,
@@ -547,37 +767,27 @@ tasks_status_cb (const char *path,
         xmlFree (task_name);
         xmlFree (task_result);
     }
-    // If message is passed then record a result with that.
+
+    update_task_status (recipe_data, task_nodes, transaction_id, status,
+                        message, version, stime, etime, FALSE);
     if (message) {
-        record_result(recipe_data->recipe_node_ptr,
-                      task_node_ptr,
-                      transaction_id,
-                      "WARN",
-                      message,
-                      "/",
-                      NULL,
-                      app_data,
-                      (const gchar *) recipe_data->rhost);
+        print_result (app_data, (const gchar *) recipe_data->rhost,
+                      transaction_id, "WARN", message, "/", NULL);
     }
 
-    xmlSetProp (task_node_ptr, (xmlChar *)"status", (xmlChar *) status);
-    xmlChar *recipe_status = xmlGetNoNsProp(
-            recipe_data->recipe_node_ptr, (xmlChar*)"status");
-
-    // If recipe status is not already "Aborted" then record push
-    // task status to recipe.
-    if (g_strcmp0((const gchar*)recipe_status, "Aborted") != 0)
-        xmlSetProp(recipe_data->recipe_node_ptr, (xmlChar*)"status",
-                   (xmlChar*)status);
-    xmlFree(recipe_status);
-
-    // Write out the current version of the results xml.
-    gchar *filename = g_build_filename(app_data->run_dir, "job.xml",
-                                       NULL);
-    put_doc (app_data->xml_doc, filename);
+    struct json_object *record = journal_new_record ("status", recipe_id, task_id);
+    journal_record_add (record, "transaction-id", transaction_id);
+    journal_record_add (record, "status", status);
+    journal_record_add (record, "message", message);
+    journal_record_add (record, "version", version);
+    journal_record_add (record, "stime", stime);
+    journal_record_add (record, "etime", etime);
 
-    g_free(filename);
-    g_hash_table_destroy(body);
+    // job.xml itself is only written out every checkpoint_interval
+    // seconds, unless the journal is unavailable.
+    if (!journal_record (app_data, record)) {
+        checkpoint_job (app_data);
+    }
 
 cleanup:
     g_free (task_id);
@@ -586,10 +796,73 @@ cleanup:
     g_free (trunc_host);
 }
 
+static gboolean
+has_log (xmlNodePtr logs_node_ptr, const gchar *path)
+{
+    gboolean found = FALSE;
+
+    for (xmlNodePtr child = logs_node_ptr->children; child != NULL && !found;
+            child = child->next) {
+        if (child->type != XML_ELEMENT_NODE) {
+            continue;
+        }
+        xmlChar *log_path = xmlGetNoNsProp (child, (xmlChar *) "path");
+        found = g_strcmp0 ((gchar *) log_path, path) == 0;
+        xmlFree (log_path);
+    }
+    return found;
+}
+
+/*
+ * Record a log under the logs node of a task, or of one of its results
+ * when @result_id is given.
+ */
+static void
+record_task_log (TaskNodes *task_nodes,
+                 const gchar *result_id,
+                 const gchar *log_path,
+                 const gchar *short_path,
+                 gboolean replay)
+{
+    xmlNodePtr logs_node_ptr = NULL;
+
+    if (result_id == NULL) {
+        logs_node_ptr = task_nodes->logs_node_ptr;
+    } else {
+        logs_node_ptr = g_hash_table_lookup (task_nodes->result_logs,
+                                             result_id);
+    }
+
+    if (logs_node_ptr == NULL) {
+        return;
+    }
+    if (!(replay && has_log (logs_node_ptr, log_path))) {
+        record_log (logs_node_ptr, log_path, short_path);
+    }
+}
+
+static void
+journal_task_log (AppData *app_data,
+                  const gchar *recipe_id,
+                  const gchar *task_id,
+                  const gchar *result_id,
+                  const gchar *log_path,
+                  const gchar *short_path)
+{
+    struct json_object *record = journal_new_record ("log", recipe_id, task_id);
+
+    journal_record_add (record, "result-id", result_id);
+    journal_record_add (record, "path", log_path);
+    journal_record_add (record, "filename", short_path);
+    journal_record (app_data, record);
+}
+
 void
 tasks_logs_cb (const char *path,
                GHashTable *headers,
-               struct json_object *json_body,
+               GHashTable *body,
+               const gchar *data,
+               gsize data_length,
                gpointer user_data)
 {
     RecipeData *recipe_data = (RecipeData*) user_data;
@@ -600,8 +873,6 @@ tasks_logs_cb (const char *path,
     gchar **lines = NULL;
     gint i = 0;
     gchar *trunc_host = NULL;
-    gchar *body_data = NULL;
-    gsize body_length;
 
     // Pull some values out of the path.
     entries = g_strsplit (path, "/", 0);
@@ -611,9 +882,9 @@ tasks_logs_cb (const char *path,
     app_data->started = TRUE;
 
     // Lookup our task
-    xmlNodePtr task_node_ptr = g_hash_table_lookup(recipe_data->tasks,
-                                                   task_id);
-    if (!task_node_ptr) {
+    TaskNodes *task_nodes = g_hash_table_lookup(recipe_data->task_nodes,
+                                                task_id);
+    if (!task_nodes) {
         goto cleanup;
     }
 
@@ -621,22 +892,18 @@ tasks_logs_cb (const char *path,
     goffset end;
     goffset total_length;
     gchar *short_path = NULL;
+    const gchar *result_id = NULL;
     gchar *log_path = g_strjoinv ("/", &entries[1]);
     gchar *filename = g_strdup_printf("%s/%s", app_data->run_dir,
                                       log_path);
 
-    gchar *logs_xpath = NULL;
     if (g_strcmp0 (entries[5], "logs") == 0) {
         gchar *fpath = g_strjoinv ("/", &entries[6]);
-        logs_xpath = g_strdup_printf("task[@id='%s']/logs", task_id);
         short_path = g_uri_unescape_string(fpath, NULL);
         g_free(fpath);
     } else {
-        // We shouldn't have to specify recipe and task id since we
-        // are searching from recipe node.
         gchar *fpath = g_strjoinv ("/", &entries[8]);
-        logs_xpath = g_strdup_printf("task[@id='%s']/results/result[@id='%s']/logs",
-                                     task_id, entries[6]);
+        result_id = entries[6];
         short_path = g_uri_unescape_string(fpath, NULL);
         g_free(fpath);
     }
@@ -644,13 +911,8 @@ tasks_logs_cb (const char *path,
     gboolean content_range = headers_get_content_range(
             headers, &start, &end, &total_length);
 
-    gchar *basedir = g_path_get_dirname (filename);
-    g_mkdir_with_parents (basedir, 0755 /* drwxr-xr-x */);
-    g_free (basedir);
-
-    body_data = (gchar *) g_base64_decode (json_object_get_string(json_body), &body_length);
     if (content_range) {
-        if (body_length != (end - start + 1)) {
+        if (data_length != (end - start + 1)) {
             g_warning("Content length does not match range length");
             goto logs_cleanup;
         }
@@ -658,43 +920,30 @@ tasks_logs_cb (const char *path,
             g_warning("Total length is smaller than range end");
             goto logs_cleanup;
         }
-        if (total_length > 0 && access( filename, F_OK ) != -1 ) {
-            int result = truncate ((const char *)filename, total_length);
-            g_warn_if_fail(result == 0);
-        }
         if (start == 0) {
             // Record log in xml
-            xmlXPathObjectPtr logs_node_ptrs = get_node_set(
-                    app_data->xml_doc, recipe_data->recipe_node_ptr,
-                    (xmlChar*)logs_xpath);
-            if (logs_node_ptrs) {
-                record_log(logs_node_ptrs->nodesetval->nodeTab[0],
-                           log_path, short_path);
-            }
-            xmlXPathFreeObject (logs_node_ptrs);
+            record_task_log (task_nodes, result_id, log_path, short_path,
+                             FALSE);
+            journal_task_log (app_data, recipe_id, task_id, result_id,
+                              log_path, short_path);
         }
-        update_chunk (filename, body_data, body_length, start);
+        rstrnt_log_writer_write (app_data->log_writer, filename, data,
+                                 data_length, start,
+                                 total_length > 0 ? total_length : -1);
     } else {
-        if (access( filename, F_OK ) != -1 ) {
-            int result = truncate ((const char *)filename, body_length);
-            g_warn_if_fail(result == 0);
-        }
         // Record log in xml
-        xmlXPathObjectPtr logs_node_ptrs = get_node_set(app_data->xml_doc,
-                recipe_data->recipe_node_ptr, (xmlChar *)logs_xpath);
-        if (logs_node_ptrs) {
-            record_log (logs_node_ptrs->nodesetval->nodeTab[0], log_path,
-                        short_path);
-        }
-        xmlXPathFreeObject (logs_node_ptrs);
-        update_chunk (filename, body_data, body_length, (goffset) 0);
+        record_task_log (task_nodes, result_id, log_path, short_path, FALSE);
+        journal_task_log (app_data, recipe_id, task_id, result_id,
+                          log_path, short_path);
+        rstrnt_log_writer_write (app_data->log_writer, filename, data,
+                                 data_length, 0, data_length);
     }
     trunc_host = g_strndup ((const gchar *) recipe_data->rhost, 20);
     const gchar *log_level_char = g_hash_table_lookup (headers, "log-level");
-    if (log_level_char) {
+    if (log_level_char && data) {
         gint log_level = g_ascii_strtoll (log_level_char, NULL, 0);
         if (app_data->verbose >= log_level) {
-            lines = g_strsplit_set (body_data, "\r\n", 0);
+            lines = g_strsplit_set (data, "\r\n", 0);
             for (i = 0; lines[i] != NULL; i++) {
                 if (strlen(lines[i]) > 0) {
                     g_print ("[%-20s] %s\n", trunc_host, lines[i]);
@@ -705,10 +954,8 @@ tasks_logs_cb (const char *path,
     }
 logs_cleanup:
     g_free (short_path);
-    g_free (logs_xpath);
     g_free (log_path);
     g_free (filename);
-    g_free (body_data);
 
 cleanup:
     g_free (task_id);
@@ -756,24 +1003,63 @@ struct json_object * find_object (struct json_object *jobj, const char *key) {
         return tmp;
 }
 
+static void
+print_remote_text (RecipeData *recipe_data, const gchar *text)
+{
+    gchar *trunc_host = g_strndup (recipe_data->rhost, 20);
+    g_print ("[%-20s] %s", trunc_host, text);
+    g_free (trunc_host);
+}
+
+static void
+dispatch_message (RecipeData *recipe_data,
+                  GHashTable *headers,
+                  GHashTable *body,
+                  const gchar *data,
+                  gsize data_length)
+{
+    AppData *app_data = recipe_data->app_data;
+    RegexCallback callback;
+    const gchar *rstrnt_path = g_hash_table_lookup (headers, "rstrnt-path");
+
+    // rstrnt_path must be defined in order to dispatch
+    if (!rstrnt_path) {
+        g_message("Invalid message! rstrnt-path not defined");
+        return;
+    }
+    callback = process_path (app_data->regexes, rstrnt_path);
+    if (callback) {
+        // Valid message, reset connection retries.
+        app_data->conn_retries = 0;
+        callback (rstrnt_path,
+                  headers,
+                  body,
+                  data,
+                  data_length,
+                  recipe_data);
+    } else {
+        g_message ("no registered callback matches %s", rstrnt_path);
+    }
+}
+
 void
 handle_message (const char *message,
                 gpointer user_data)
 {
     RecipeData *recipe_data = (RecipeData*) user_data;
-    AppData *app_data = recipe_data->app_data;
-    RegexCallback callback;
     GHashTable *headers;
-    char *rstrnt_path = NULL;
+    GHashTable *body = NULL;
+    gchar *data = NULL;
+    gsize data_length = 0;
+    const gchar *rstrnt_path = NULL;
     struct json_object *jobj, *json_headers, *json_body;
 
     jobj = json_tokener_parse(message);
     json_headers = find_object(jobj, "headers");
 
     if (json_headers == NULL) {
-        gchar *trunc_host = g_strndup (recipe_data->rhost, 20);
-        g_print ("[%-20s] %s", trunc_host, message);
-        g_free (trunc_host);
+        print_remote_text (recipe_data, message);
+        json_object_put (jobj);
         return;
     }
 
@@ -781,38 +1067,121 @@ handle_message (const char *message,
     headers = json_to_hashtable(json_headers);
     rstrnt_path = g_hash_table_lookup (headers, "rstrnt-path");
 
-    // rstrnt_path must be defined in order to dispatch
-    if (!rstrnt_path) {
-        g_message("Invalid message! rstrnt-path not defined");
-        return;
-    }
-    callback = process_path (app_data->regexes, rstrnt_path);
-    if (callback) {
-        // Valid message, reset connection retries.
-        app_data->conn_retries = 0;
-        callback (rstrnt_path,
-                  headers,
-                  json_body,
-                  user_data);
+    if (rstrnt_path && g_strrstr (rstrnt_path, "/logs/")) {
+        // Log bodies are base64 encoded, decode them in a copy so
+        // there is room for the NUL terminator.
+        data = g_strdup (json_object_get_string (json_body));
+        if (data != NULL) {
+            g_base64_decode_inplace (data, &data_length);
+            data[data_length] = '\0';
+        }
+    } else if (json_body != NULL) {
+        body = json_to_hashtable (json_body);
     } else {
-        g_message ("no registered callback matches %s", rstrnt_path);
+        body = g_hash_table_new (g_str_hash, g_str_equal);
     }
 
+    dispatch_message (recipe_data, headers, body, data, data_length);
+
+    if (body != NULL) {
+        g_hash_table_destroy (body);
+    }
+    g_free (data);
     json_object_put (jobj);
     g_hash_table_destroy(headers);
 }
 
+static void
+handle_frame (RstrntFrame *frame, RecipeData *recipe_data)
+{
+    const gchar *rstrnt_path = g_hash_table_lookup (frame->headers,
+                                                    "rstrnt-path");
+    GHashTable *body = NULL;
+
+    // Anything restraintd g_print()s comes without a path.
+    if (rstrnt_path == NULL) {
+        print_remote_text (recipe_data, frame->body);
+        return;
+    }
+
+    if (g_strrstr (rstrnt_path, "/logs/") == NULL) {
+        body = soup_form_decode (frame->body);
+    }
+
+    dispatch_message (recipe_data, frame->headers, body, frame->body,
+                      frame->body_length);
+
+    if (body != NULL) {
+        g_hash_table_destroy (body);
+    }
+}
+
+static gboolean
+remote_frame_io (GIOChannel *io, RecipeData *recipe_data)
+{
+    GError *tmp_error = NULL;
+    RstrntFrame *frame;
+    gchar buf[IO_BUFFER_SIZE];
+    gsize bytes_read;
+
+    switch (g_io_channel_read_chars (io, buf, IO_BUFFER_SIZE, &bytes_read,
+                                     &tmp_error)) {
+      case G_IO_STATUS_NORMAL:
+        rstrnt_frame_reader_feed (recipe_data->frame_reader, buf, bytes_read);
+        while ((frame = rstrnt_frame_reader_next (recipe_data->frame_reader,
+                                                  &tmp_error)) != NULL) {
+            handle_frame (frame, recipe_data);
+            rstrnt_frame_free (frame);
+        }
+        if (tmp_error) {
+            g_warning ("Invalid message from %s: %s", recipe_data->rhost,
+                       tmp_error->message);
+            g_clear_error (&tmp_error);
+            return FALSE;
+        }
+        return TRUE;
+
+      case G_IO_STATUS_ERROR:
+         g_warning ("IO Error: %s", tmp_error->message);
+         g_clear_error (&tmp_error);
+         return FALSE;
+
+      case G_IO_STATUS_EOF:
+         return FALSE;
+
+      case G_IO_STATUS_AGAIN:
+         return TRUE;
+
+      default:
+         g_return_val_if_reached(FALSE);
+         break;
+    }
+    return FALSE;
+}
+
 gboolean
 remote_io_callback (GIOChannel *io, GIOCondition condition, gpointer user_data) {
+    RecipeData *recipe_data = (RecipeData *) user_data;
     GError *tmp_error = NULL;
 
     gchar *s;
     gsize bytes_read;
 
     if (condition & G_IO_IN) {
+        if (recipe_data->framing == RSTRNT_FRAMING_BINARY) {
+            return remote_frame_io (io, recipe_data);
+        }
         switch (g_io_channel_read_line(io, &s, &bytes_read, NULL, &tmp_error)) {
           case G_IO_STATUS_NORMAL:
-            handle_message(s, user_data);
+            if (recipe_data->framing_offered &&
+                    g_strcmp0 (s, FRAME_BINARY_HANDSHAKE) == 0) {
+                // restraintd accepted, frames follow from here on. What
+                // the channel has buffered already is read as frames.
+                recipe_data->framing = RSTRNT_FRAMING_BINARY;
+                recipe_data->frame_reader = rstrnt_frame_reader_new ();
+            } else {
+                handle_message(s, user_data);
+            }
             g_free(s);
             return TRUE;
 
@@ -915,11 +1284,58 @@ copy_task_nodes(xmlNodeSetPtr nodeset, xmlDocPtr orig_xml_doc,
 }
 
 static void
-parse_task_nodes (xmlNodeSetPtr nodeset, GHashTable *tasks)
+task_nodes_free (gpointer data)
+{
+    TaskNodes *task_nodes = (TaskNodes *) data;
+
+    g_hash_table_destroy (task_nodes->result_logs);
+    g_slice_free (TaskNodes, task_nodes);
+}
+
+static TaskNodes *
+index_task_node (xmlNodePtr task_node_ptr)
+{
+    TaskNodes *task_nodes = g_slice_new0 (TaskNodes);
+
+    task_nodes->task_node_ptr = task_node_ptr;
+    task_nodes->logs_node_ptr = first_child_with_name (task_node_ptr,
+                                                       "logs", FALSE);
+    task_nodes->results_node_ptr = first_child_with_name (task_node_ptr,
+                                                          "results", FALSE);
+    task_nodes->result_logs = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                                     g_free, NULL);
+
+    // Results are already there when continuing a job with --run.
+    if (task_nodes->results_node_ptr == NULL) {
+        return task_nodes;
+    }
+    for (xmlNodePtr child = task_nodes->results_node_ptr->children;
+            child != NULL; child = child->next) {
+        if (child->type != XML_ELEMENT_NODE ||
+                g_strcmp0 ((gchar *) child->name, "result") != 0) {
+            continue;
+        }
+        xmlChar *id = xmlGetNoNsProp (child, (xmlChar *) "id");
+        xmlNodePtr logs_node_ptr = first_child_with_name (child, "logs", FALSE);
+        if (id != NULL && logs_node_ptr != NULL &&
+                !g_hash_table_contains (task_nodes->result_logs, id)) {
+            g_hash_table_insert (task_nodes->result_logs,
+                                 g_strdup ((gchar *) id), logs_node_ptr);
+        }
+        xmlFree (id);
+    }
+    return task_nodes;
+}
+
+static void
+parse_task_nodes (xmlNodeSetPtr nodeset, GHashTable *tasks,
+                  GHashTable *task_nodes)
 {
     for (gint i=0; i < nodeset->nodeNr; i++) {
         xmlChar *id = xmlGetNoNsProp (nodeset->nodeTab[i], (xmlChar *)"id");
         g_hash_table_insert (tasks, id, nodeset->nodeTab[i]);
+        g_hash_table_insert (task_nodes, g_strdup ((gchar *) id),
+                             index_task_node (nodeset->nodeTab[i]));
     }
 }
 
@@ -1037,11 +1453,21 @@ run_recipe_handler (gpointer user_data)
     xmlBufferPtr buffer = xmlBufferCreate();
     gssize size = xmlNodeDump(buffer, app_data->xml_doc, recipe_data->recipe_node_ptr, 0, 1);
 
-    command = g_strdup_printf ("%s %s -- %s --port %d --stdin",
+    // Every connection starts out as JSON lines until restraintd
+    // confirms the framing offered.
+    recipe_data->framing = RSTRNT_FRAMING_JSON;
+    recipe_data->framing_offered = app_data->framing == RSTRNT_FRAMING_BINARY &&
+                                   !recipe_data->framing_rejected;
+    rstrnt_frame_reader_free (recipe_data->frame_reader);
+    recipe_data->frame_reader = NULL;
+
+    command = g_strdup_printf ("%s %s -- %s --port %d --stdin%s",
                                app_data->rsh_cmd,
                                recipe_data->connect_uri,
                                app_data->restraint_path,
-                               app_data->restraint_port);
+                               app_data->restraint_port,
+                               recipe_data->framing_offered ?
+                               " --framing " FRAME_OPTION_BINARY : "");
 
     g_print ("Connecting to host: %s, recipe id:%d\n",
              recipe_data->connect_uri, recipe_data->recipe_id);
@@ -1058,6 +1484,8 @@ run_recipe_handler (gpointer user_data)
                   size,
                   TRUE,
                   recipe_data->cancellable,
+                  NULL,
+                  NULL,
                   recipe_data);
 
     g_free (command);
@@ -1596,9 +2024,12 @@ parse_new_job (AppData *app_data)
         }
         recipe_data->tasks = g_hash_table_new_full(g_str_hash, g_str_equal,
                                                    xmlFree, NULL);
+        recipe_data->task_nodes = g_hash_table_new_full(g_str_hash, g_str_equal,
+                                                        g_free, task_nodes_free);
 
         // record each task in a hash table
-        parse_task_nodes(task_nodes->nodesetval, recipe_data->tasks);
+        parse_task_nodes(task_nodes->nodesetval, recipe_data->tasks,
+                         recipe_data->task_nodes);
         xmlXPathFreeObject (task_nodes);
     }
     g_hash_table_foreach_remove(app_data->recipes,
@@ -1609,6 +2040,132 @@ parse_new_job (AppData *app_data)
     g_free (filename);
 }
 
+static void
+replay_journal_record (struct json_object *record, gpointer user_data)
+{
+    AppData *app_data = (AppData *) user_data;
+    const gchar *op = journal_record_get (record, "op");
+    const gchar *recipe_id = journal_record_get (record, "recipe");
+    const gchar *task_id = journal_record_get (record, "task");
+    const gchar *transaction_id = journal_record_get (record, "transaction-id");
+    RecipeData *recipe_data = NULL;
+    TaskNodes *task_nodes = NULL;
+
+    if (recipe_id != NULL) {
+        recipe_data = g_hash_table_lookup (app_data->recipes, recipe_id);
+    }
+    if (recipe_data != NULL && recipe_data->task_nodes != NULL &&
+            task_id != NULL) {
+        task_nodes = g_hash_table_lookup (recipe_data->task_nodes, task_id);
+    }
+    if (task_nodes == NULL) {
+        g_warning ("Ignoring journal record for unknown task %s in recipe %s",
+                   task_id, recipe_id);
+        return;
+    }
+
+    if (g_strcmp0 (op, "status") == 0) {
+        update_task_status (recipe_data, task_nodes, transaction_id,
+                            journal_record_get (record, "status"),
+                            journal_record_get (record, "message"),
+                            journal_record_get (record, "version"),
+                            journal_record_get (record, "stime"),
+                            journal_record_get (record, "etime"),
+                            TRUE);
+    } else if (g_strcmp0 (op, "result") == 0) {
+        if (!has_result (task_nodes, transaction_id)) {
+            record_result (recipe_data, task_nodes, transaction_id,
+                           journal_record_get (record, "result"),
+                           journal_record_get (record, "message"),
+                           journal_record_get (record, "path"),
+                           journal_record_get (record, "score"));
+        }
+    } else if (g_strcmp0 (op, "log") == 0) {
+        record_task_log (task_nodes,
+                         journal_record_get (record, "result-id"),
+                         journal_record_get (record, "path"),
+                         journal_record_get (record, "filename"),
+                         TRUE);
+    } else {
+        g_warning ("Ignoring unknown journal record %s", op);
+    }
+}
+
+/*
+ * Stop journaling.  The journal is removed if job.xml has just been
+ * @checkpointed, otherwise it is kept for the next --run to replay.
+ */
+static void
+close_journal (AppData *app_data, gboolean checkpointed)
+{
+    if (app_data->journal == NULL) {
+        return;
+    }
+
+    if (app_data->checkpoint_handler_id != 0) {
+        g_source_remove (app_data->checkpoint_handler_id);
+        app_data->checkpoint_handler_id = 0;
+    }
+
+    if (checkpointed) {
+        gchar *filename = g_build_filename (app_data->run_dir,
+                                            JOURNAL_FILENAME, NULL);
+        g_unlink (filename);
+        g_free (filename);
+    }
+
+    rstrnt_journal_close (app_data->journal);
+    app_data->journal = NULL;
+}
+
+/*
+ * Replay anything a previous client left behind in the journal on top of
+ * job.xml, then journal this run unless --checkpoint-interval is 0.  A
+ * journal this run doesn't keep is removed once job.xml has what was in it.
+ */
+static void
+open_journal (AppData *app_data)
+{
+    GError *error = NULL;
+    gchar *filename = g_build_filename (app_data->run_dir, JOURNAL_FILENAME,
+                                        NULL);
+    gboolean checkpointed = TRUE;
+
+    if (app_data->checkpoint_interval == 0 &&
+            !g_file_test (filename, G_FILE_TEST_EXISTS)) {
+        g_free (filename);
+        return;
+    }
+
+    app_data->journal = rstrnt_journal_open (filename, &error);
+    if (app_data->journal == NULL) {
+        g_warning ("%s, job.xml will be written on every status change",
+                   error->message);
+        g_clear_error (&error);
+        g_free (filename);
+        return;
+    }
+
+    gint replayed = rstrnt_journal_replay (filename, replay_journal_record,
+                                           app_data, &error);
+    if (replayed < 0) {
+        g_warning ("Unable to replay %s: %s", filename, error->message);
+        g_clear_error (&error);
+        checkpointed = FALSE;
+    } else if (replayed > 0) {
+        g_print ("Recovered %d updates from %s\n", replayed, filename);
+        checkpointed = checkpoint_job (app_data);
+    }
+
+    if (app_data->checkpoint_interval == 0) {
+        close_journal (app_data, checkpointed);
+    } else {
+        app_data->checkpoint_handler_id = g_timeout_add_seconds (
+                app_data->checkpoint_interval, checkpoint_timeout_cb, app_data);
+    }
+    g_free (filename);
+}
+
 static gboolean
 callback_parse_verbose (const gchar *option_name, const gchar *value,
         gpointer user_data, GError **error)
@@ -1618,23 +2175,14 @@ callback_parse_verbose (const gchar *option_name, const gchar *value,
     return TRUE;
 }
 
-void
-pretty_results (gchar* run_dir)
+static void
+copy_bootstrap (const gchar *run_dir)
 {
-    gchar* cmdline = NULL;
     gchar *bootstrap_src = "/usr/share/restraint/client/bootstrap/bootstrap.min.css";
     gchar *bootstrap = NULL;
-    gchar* job2html = "/usr/share/restraint/client/job2html.xml";
-    gchar* jobxml = NULL;
-    gchar* std_out = NULL;
     gchar *contents = NULL;
     gsize length;
-    gchar* std_err = NULL;
-    gint exitstat;
     GError *gerror = NULL;
-    gchar* results_filename = NULL;
-    gint results_fd;
-    gssize results_len;
     gboolean success = FALSE;
 
     success = g_file_get_contents (bootstrap_src,
@@ -1660,53 +2208,20 @@ pretty_results (gchar* run_dir)
         goto cleanup;
     }
 
-    jobxml = g_build_filename (run_dir, "job.xml", NULL);
-    cmdline = g_strdup_printf("xsltproc %s %s", job2html, jobxml);
-
-    if (!g_spawn_command_line_sync(cmdline, &std_out, &std_err, &exitstat,
-                                   &gerror)) {
-        g_printerr("cannot spawn '%s': %s\n", cmdline, gerror->message);
-        goto cleanup;
-    }
-    if (exitstat != 0) {
-        g_printerr("xsltproc error: %s\n", std_err);
-        goto cleanup;
-    }
+cleanup:
+    g_clear_error (&gerror);
+    g_free (bootstrap);
+    g_free (contents);
+}
 
-    results_filename = g_build_filename (run_dir, "index.html", NULL);
-    results_fd = g_open(results_filename,
-                        O_WRONLY | O_CREAT, S_IRUSR | S_IWUSR);
-    if (results_fd == -1) {
-        g_printerr("Error opening %s for writing\n", results_filename);
-        goto cleanup;
-    }
-    length = strlen(std_out);
-    results_len = write(results_fd, std_out, length);
-    if(!g_close(results_fd, &gerror)) {
-        g_printerr("cannot close %s: %s\n", results_filename, gerror->message);
-        goto cleanup;
-    }
-    if (results_len != length) {
-        g_printerr("Error writing to %s\n", results_filename);
+void
+pretty_results (AppData *app_data)
+{
+    copy_bootstrap (app_data->run_dir);
+    // With --live-report the last checkpoint has already written them.
+    if (!app_data->live_report) {
+        write_reports (app_data);
     }
-
-cleanup:
-    if (gerror != NULL)
-        g_error_free(gerror);
-    if (results_filename != NULL)
-        g_free (results_filename);
-    if (jobxml != NULL)
-        g_free (jobxml);
-    if (bootstrap != NULL)
-        g_free (bootstrap);
-    if (contents != NULL)
-        g_free (contents);
-    if (cmdline != NULL)
-        g_free (cmdline);
-    if (std_out != NULL)
-        g_free (std_out);
-    if (std_err != NULL)
-        g_free (std_err);
 }
 
 static gchar **
@@ -1813,12 +2328,16 @@ int main(int argc, char *argv[]) {
     gboolean novalid = FALSE;
     gchar **hostarr = NULL;
     gint timeout = 5;
+    gchar *framing = NULL;
+    gint stall_threshold = STALL_THRESHOLD;
+    gint checkpoint_interval = DEFAULT_CHECKPOINT_INTERVAL;
 
     AppData *app_data = g_slice_new0 (AppData);
     app_data->rsh_cmd = NULL;
     app_data->restraint_path = "restraintd";
     app_data->restraint_port = 0;
     app_data->max_retries = CONN_RETRIES;
+    app_data->framing = RSTRNT_FRAMING_BINARY;
 
     init_result_hash (app_data);
     app_data->recipes = g_hash_table_new_full(g_str_hash, g_str_equal,
@@ -1848,6 +2367,19 @@ int main(int argc, char *argv[]) {
             "specify the restraintd to run on the remote machine", NULL },
         { "timeout", 0, 0, G_OPTION_ARG_INT, &timeout,
             "Specify timeout in minutes when rsh option not used [Default: 5].", NULL },
+        { "checkpoint-interval", 0, 0, G_OPTION_ARG_INT, &checkpoint_interval,
+            "Write job.xml out every SECONDS, journaling changes in between. "
+            "0 writes it on every task status change [Default: 60].", "SECONDS" },
+        { "framing", 0, 0, G_OPTION_ARG_STRING, &framing,
+            "Framing of the messages from restraintd, json or binary. "
+            "binary falls back to json for older restraintd [Default: binary].",
+            "FRAMING" },
+        { "live-report", 0, 0, G_OPTION_ARG_NONE, &app_data->live_report,
+            "Refresh index.html and junit.xml every time job.xml is "
+            "written, not only at the end.", NULL },
+        { "stall-threshold", 0, 0, G_OPTION_ARG_INT, &stall_threshold,
+            "Report main loop iterations longer than this many milliseconds, "
+            "0 disables [Default: 500].", "MS" },
         { NULL }
     };
     GOptionGroup *option_group = g_option_group_new("main",
@@ -1865,6 +2397,19 @@ int main(int argc, char *argv[]) {
             &app_data->error);
     g_option_context_free(context);
 
+    if (parse_succeeded && framing != NULL) {
+        parse_succeeded = rstrnt_framing_parse (framing, &app_data->framing,
+                                                &app_data->error);
+    }
+    g_free (framing);
+    if (parse_succeeded && checkpoint_interval < 0) {
+        g_set_error (&app_data->error, RESTRAINT_ERROR, RESTRAINT_CMDLINE_ERROR,
+                     "--checkpoint-interval must be 0 or more, not %d",
+                     checkpoint_interval);
+        parse_succeeded = FALSE;
+    }
+    app_data->checkpoint_interval = checkpoint_interval;
+
     /* -t, --host option parsing */
     if (hostarr != NULL) {
         guint recipe_id = 1;
@@ -1904,9 +2449,16 @@ int main(int argc, char *argv[]) {
     // Read in run_dir/job.xml
     parse_new_job (app_data);
 
+    // Bring job.xml up to date from the journal of an interrupted run
+    // and start journaling this one.
+    open_journal (app_data);
+
     // If all tasks are finished then quit.
     if (tasks_finished(app_data->xml_doc, NULL, (xmlChar *) "//task")) {
         g_printerr ("All tasks are finished\n");
+        if (app_data->journal != NULL) {
+            close_journal (app_data, checkpoint_job (app_data));
+        }
         goto cleanup;
     }
 
@@ -1932,21 +2484,43 @@ int main(int argc, char *argv[]) {
     app_data->regexes = register_path (app_data->regexes,
                                        "/recipes/[[:alnum:]]+/tasks/[[:digit:]]+/results/[[:digit:]]+/logs/",
                                        tasks_logs_cb);
+    // index.html is refreshed as the job runs, so it needs its stylesheet
+    // from the start.
+    if (app_data->live_report) {
+        copy_bootstrap (app_data->run_dir);
+    }
+
+    // The rsh command stays in our foreground group so that it can prompt
+    // on the terminal and Ctrl-C reaches it.
+    process_set_own_group (FALSE);
+
+    // Log chunks are written out by a thread of their own
+    app_data->log_writer = rstrnt_log_writer_new (LOG_WRITER_MAX_OPEN,
+                                                  &app_data->error);
+    if (app_data->log_writer == NULL) {
+        goto cleanup;
+    }
+
+    // Stalls are reported as they end, the histogram on SIGUSR1
+    rstrnt_stall_monitor_start (MAX (stall_threshold, 0), "restraint");
+
     // Create and enter the main loop
     app_data->loop = g_main_loop_new(NULL, FALSE);
     g_main_loop_run(app_data->loop);
 
-    gchar *filename = g_build_filename (app_data->run_dir, "job.xml", NULL);
-    put_doc (app_data->xml_doc, filename);
-    g_free (filename);
+    // Wait for the last log chunks to hit the disk.
+    rstrnt_log_writer_free (app_data->log_writer);
+    app_data->log_writer = NULL;
+
+    close_journal (app_data, checkpoint_job (app_data));
+
+    // write index.html and junit.xml
+    pretty_results (app_data);
 
     // We're done.
     xmlFreeDoc(app_data->xml_doc);
     xmlCleanupParser();
 
-    // convert job.xml to index.html
-    pretty_results(app_data->run_dir);
-
 cleanup:
 
     g_strfreev (hostarr);
@@ -21,20 +21,40 @@
 #include <libxml/parser.h>
 #include <regex.h>
 #include <json.h>
+#include "frame.h"
+#include "journal.h"
+#include "log_writer.h"
 
 #define DEFAULT_DELAY 60
 #define CONN_RETRIES 15
+#define DEFAULT_CHECKPOINT_INTERVAL 60
 
 struct _AppData;
 
+/*
+ * body holds the decoded form fields of the message, data the raw
+ * (NUL terminated) content for logs, in which case body is NULL.
+ */
 typedef void (*RegexCallback) (const char *path,
                                GHashTable *headers,
-                               struct json_object *body,
+                               GHashTable *body,
+                               const gchar *data,
+                               gsize data_length,
                                gpointer user_data);
 
+typedef struct {
+    xmlNodePtr task_node_ptr;
+    xmlNodePtr logs_node_ptr;
+    xmlNodePtr results_node_ptr;
+    // result id -> <logs> node of that result
+    GHashTable *result_logs;
+} TaskNodes;
+
 typedef struct {
     xmlNodePtr recipe_node_ptr;
     GHashTable *tasks;
+    // task id -> TaskNodes, saves searching the job for every log chunk
+    GHashTable *task_nodes;
     guint recipe_id;
     struct _AppData *app_data;
     GString *body;
@@ -42,6 +62,12 @@ typedef struct {
     guint timeout_handler_id;
     gchar *rhost;
     gchar *connect_uri;
+    // Framing in use on the current connection to restraintd
+    RstrntFraming framing;
+    gboolean framing_offered;
+    // restraintd exited rejecting --framing, it predates it
+    gboolean framing_rejected;
+    RstrntFrameReader *frame_reader;
 } RecipeData;
 
 typedef struct {
@@ -65,6 +91,12 @@ typedef struct _AppData {
     gchar *rsh_cmd;
     gchar *restraint_path;
     guint restraint_port;
+    RstrntFraming framing;
+    RstrntJournal *journal;
+    RstrntLogWriter *log_writer;
+    guint checkpoint_interval;
+    guint checkpoint_handler_id;
+    gboolean live_report;
 } AppData;
 
 #endif
@@ -1,7 +1,10 @@
 #define _POSIX_C_SOURCE 200112L
 #include <arpa/inet.h>
 #include <errno.h>
+#include <fcntl.h>
 #include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -18,32 +21,69 @@
 #define USOCKET_PATH "/tmp/rstrntsync.sock"
 #define PORT 6776
 #define BUFSIZE 256
+#define BACKLOG SOMAXCONN
+#define BARRIER_RETRY 60
 #define _STR_HELPER(x)    #x
 #define STR(x)            _STR_HELPER(x)
 
 struct sdata {
   GHashTable *events;
-  GSList *wlist;
+  GHashTable *waiters;
 };
 
-struct wentry {
-  char *event;
+/*
+ * A connection to the daemon. The event name is read into buf without
+ * blocking, then either set (local) or waited on (remote). A remote
+ * connection waiting on an event sits in the GQueue of waiters for it,
+ * link pointing at its place there.
+ */
+struct sconn {
+  struct sdata *sd;
   int sockfd;
+  guint watch_id;
+  gboolean local;
+  GString *buf;
+  gchar *event;
+  GList *link;
 };
 
-static void wentry_free(struct wentry *w)
+static void sconn_free(struct sconn *c)
+{
+  if (c->link) {
+    GQueue *waiting = g_hash_table_lookup(c->sd->waiters, c->event);
+    g_queue_delete_link(waiting, c->link);
+    if (g_queue_is_empty(waiting)) {
+      g_hash_table_remove(c->sd->waiters, c->event);
+    }
+  }
+  if (c->watch_id) {
+    g_source_remove(c->watch_id);
+  }
+  close(c->sockfd);
+  g_string_free(c->buf, TRUE);
+  g_free(c->event);
+  g_free(c);
+}
+
+static void queue_free(GQueue *waiting)
 {
-  g_free(w->event);
-  close(w->sockfd);
-  g_free(w);
+  // Only when the daemon exits, the connections go with it.
+  while (!g_queue_is_empty(waiting)) {
+    struct sconn *c = g_queue_pop_head(waiting);
+    c->link = NULL;
+    sconn_free(c);
+  }
+  g_queue_free(waiting);
 }
 
 static void usage(char *ename)
 {
   g_print("usage:\n"
           "\t%s set <event>\n"
-          "\t%s block <event> <host> [timeout]\n",
-          ename, ename);
+          "\t%s block <event> <host> [timeout]\n"
+          "\t%s barrier -s <event> [-s <event>] [--any] [--timeout <secs>]"
+          " [--retry <secs>] <host> [<host> ...]\n",
+          ename, ename, ename);
 }
 
 static gboolean quit_loop(gpointer data)
@@ -59,127 +99,185 @@ static gboolean on_term_signal(gpointer data)
   return FALSE;
 }
 
+static void reply(struct sconn *c)
+{
+  send(c->sockfd, c->event, strlen(c->event) + 1, MSG_NOSIGNAL);
+}
+
 /*
- * handle_rconn
- * ------------
- * Handles receipt of 'block' operations.
- * If a set operation was previous called, respond back to client.
- * If set operation not previously called, put this client
- *   on a pending list so we can respond back when the 'set'
- *   comes in.
- * Before we do any of this checking, make sure there are no
- * stale 'blocked clients' sockets since these can timeout
- * and go away.
+ * setevent_local
+ * --------------
+ * Handles receipt of 'set' operations.
+ * This stores the 'set state' and acknowledges back to the
+ * clients 'blocked' waiting for it, which are then dropped.
  */
-static gboolean handle_rconn(GIOChannel *source, GIOCondition condition,
-                             gpointer data)
+static void setevent_local(struct sdata *sd, const gchar *event)
 {
-  struct sdata *sd = (struct sdata*)data;
-  int sockfd = g_io_channel_unix_get_fd(source);
-  ssize_t rcv = 0;
-  ssize_t bytes_sent = 0;
-  char buf[BUFSIZE];
-  int rsock;
-  struct sockaddr addr;
-  unsigned int len = sizeof(addr);
-  GSList *rlist = NULL;
+  gpointer key, waiting;
 
-  if ((rsock = accept(sockfd, &addr, &len)) < 0) {
-    perror("Failed to accept connection");
-    return TRUE;
-  }
+  g_hash_table_add(sd->events, g_strdup(event));
 
-  rcv = recv(rsock, buf, BUFSIZE, 0);
-  if (rcv < 0) {
-    perror("Failed to receive");
-    close(rsock);
-    return TRUE;
-  }
-  buf[rcv < BUFSIZE ? rcv : BUFSIZE - 1] = '\0';
-  /* Verify current sockets are still active */
-  for (GSList *l = sd->wlist; l; l = g_slist_next(l)) {
-    struct wentry *w = (struct wentry*)l->data;
-    bytes_sent = send(w->sockfd, "PING", 5, MSG_NOSIGNAL);
-    if (bytes_sent == -1) {
-        rlist = g_slist_prepend(rlist, w);
-    }
+  if (!g_hash_table_lookup_extended(sd->waiters, event, &key, &waiting)) {
+    return;
   }
-  for (GSList *l = rlist; l; l = g_slist_next(l)) {
-    sd->wlist = g_slist_remove(sd->wlist, l->data);
-    wentry_free((struct wentry*)l->data);
+  g_hash_table_steal(sd->waiters, event);
+  g_free(key);
+  while (!g_queue_is_empty(waiting)) {
+    struct sconn *c = g_queue_pop_head(waiting);
+    c->link = NULL;
+    reply(c);
+    sconn_free(c);
   }
-  g_slist_free(rlist);
+  g_queue_free(waiting);
+}
 
-  /* Now check for match */
-  if (g_hash_table_contains(sd->events, buf)) {
-    send(rsock, buf, rcv, MSG_NOSIGNAL);
-    close(rsock);
-  } else {
-    struct wentry *w = g_new0(struct wentry, 1);
-    w->event = g_strdup(buf);
-    w->sockfd = rsock;
-    sd->wlist = g_slist_prepend(sd->wlist, w);
-  }
+/*
+ * block_remote
+ * ------------
+ * Handles receipt of 'block' operations.
+ * If a set operation was previously called, respond back to client.
+ * If not, queue the client on the waiters for the event so we can
+ * respond back when the 'set' comes in.
+ */
+static gboolean block_remote(struct sconn *c)
+{
+  struct sdata *sd = c->sd;
+  GQueue *waiting;
 
+  if (g_hash_table_contains(sd->events, c->event)) {
+    reply(c);
+    return FALSE;
+  }
+  waiting = g_hash_table_lookup(sd->waiters, c->event);
+  if (waiting == NULL) {
+    waiting = g_queue_new();
+    g_hash_table_insert(sd->waiters, g_strdup(c->event), waiting);
+  }
+  g_queue_push_tail(waiting, c);
+  c->link = g_queue_peek_tail_link(waiting);
   return TRUE;
 }
 
+/* The event name has been read, the first len bytes of buf. */
+static gboolean event_received(struct sconn *c, gsize len)
+{
+  c->event = g_strndup(c->buf->str, MIN(len, BUFSIZE - 1));
+  g_string_truncate(c->buf, 0);
+  if (c->local) {
+    setevent_local(c->sd, c->event);
+    return FALSE;
+  }
+  return block_remote(c);
+}
+
 /*
- * handle_lconn
- * ------------
- *
- * This handles receipt of 'set' operations.
- * This stores the 'set state' which is transmitted by the client.
- * Afterwards, it checks to determine if there are clients
- * 'blocked' waiting for this 'state' to be 'set'.
- * If there are, we acknowledge back to those clients and
- * remove it from the 'block pending' list.
+ * handle_read
+ * -----------
+ * Reads what is there of the event name, which ends at a NUL, when
+ * the client closes or at BUFSIZE. Once a remote client is waiting,
+ * anything more it sends is dropped, and it is dropped itself when
+ * it hangs up.
  */
-static gboolean handle_lconn(GIOChannel *source, GIOCondition condition,
-                             gpointer data)
+static gboolean handle_read(GIOChannel *source, GIOCondition condition,
+                            gpointer data)
 {
-  struct sdata *sd = (struct sdata*)data;
-  int sockfd = g_io_channel_unix_get_fd(source);
-  int rsock;
-  struct sockaddr addr;
-  unsigned int len = sizeof(addr);
-  ssize_t rcv = 0;
+  struct sconn *c = (struct sconn*)data;
   char buf[BUFSIZE];
+  ssize_t rcv;
 
-  if ((rsock = accept(sockfd, &addr, &len)) < 0) {
-    perror("Failed to accept connection");
-    return TRUE;
+  for (;;) {
+    rcv = recv(c->sockfd, buf, BUFSIZE, 0);
+    if (rcv < 0 && errno == EINTR) {
+      continue;
+    }
+    if (rcv < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+      if (condition & (G_IO_HUP | G_IO_ERR)) {
+        break;
+      }
+      return TRUE;
+    }
+    if (rcv <= 0) {
+      // Closed or failed, a local client may have left off the NUL
+      if (rcv == 0 && c->event == NULL && c->buf->len > 0) {
+        event_received(c, c->buf->len);
+      }
+      break;
+    }
+    if (c->event != NULL) {
+      continue;
+    }
+    g_string_append_len(c->buf, buf, rcv);
+    gsize len = strnlen(c->buf->str, c->buf->len);
+    if (len == c->buf->len && len < BUFSIZE - 1) {
+      continue;
+    }
+    if (!event_received(c, len)) {
+      break;
+    }
   }
 
-  rcv = recv(rsock, buf, BUFSIZE, 0);
-  if (rcv < 0) {
-    perror("Failed to receive");
-    close(rsock);
-    return TRUE;
-  }
-  buf[rcv < BUFSIZE ? rcv : BUFSIZE - 1] = '\0';
-  g_hash_table_add(sd->events, g_strdup(buf));
+  c->watch_id = 0;
+  sconn_free(c);
+  return FALSE;
+}
 
-  close(rsock);
+static void set_keepalive(int sockfd)
+{
+  int on = 1;
+
+  // A host rebooting under us would otherwise leave us waiting forever,
+  // whichever end of the connection we are.
+  setsockopt(sockfd, SOL_SOCKET, SO_KEEPALIVE, &on, sizeof(on));
+#ifdef TCP_KEEPIDLE
+  int idle = 30, interval = 10, count = 3;
+  setsockopt(sockfd, IPPROTO_TCP, TCP_KEEPIDLE, &idle, sizeof(idle));
+  setsockopt(sockfd, IPPROTO_TCP, TCP_KEEPINTVL, &interval, sizeof(interval));
+  setsockopt(sockfd, IPPROTO_TCP, TCP_KEEPCNT, &count, sizeof(count));
+#endif
+}
 
-  GSList *rlist = NULL;
-  for (GSList *l = sd->wlist; l; l = g_slist_next(l)) {
-    struct wentry *w = (struct wentry*)l->data;
-    if (g_strcmp0(w->event, buf) == 0) {
-      send(w->sockfd, buf, rcv, MSG_NOSIGNAL);
-      rlist = g_slist_prepend(rlist, w);
+static gboolean handle_accept(int sockfd, struct sdata *sd, gboolean local)
+{
+  int csock;
+  struct sconn *c;
+  GIOChannel *chan;
+
+  while ((csock = accept(sockfd, NULL, NULL)) >= 0) {
+    fcntl(csock, F_SETFL, fcntl(csock, F_GETFL) | O_NONBLOCK);
+    if (!local) {
+      set_keepalive(csock);
     }
-  }
 
-  for (GSList *l = rlist; l; l = g_slist_next(l)) {
-    sd->wlist = g_slist_remove(sd->wlist, l->data);
-    wentry_free((struct wentry*)l->data);
+    c = g_new0(struct sconn, 1);
+    c->sd = sd;
+    c->sockfd = csock;
+    c->local = local;
+    c->buf = g_string_sized_new(BUFSIZE);
+    chan = g_io_channel_unix_new(csock);
+    c->watch_id = g_io_add_watch(chan, G_IO_IN | G_IO_HUP | G_IO_ERR,
+                                 handle_read, c);
+    g_io_channel_unref(chan);
+  }
+  if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+    perror("Failed to accept connection");
   }
-  g_slist_free(rlist);
-
   return TRUE;
 }
 
+static gboolean handle_rconn(GIOChannel *source, GIOCondition condition,
+                             gpointer data)
+{
+  return handle_accept(g_io_channel_unix_get_fd(source),
+                       (struct sdata*)data, FALSE);
+}
+
+static gboolean handle_lconn(GIOChannel *source, GIOCondition condition,
+                             gpointer data)
+{
+  return handle_accept(g_io_channel_unix_get_fd(source),
+                       (struct sdata*)data, TRUE);
+}
+
 static void setevent(int sockfd, char *event)
 {
   send(sockfd, event, strlen(event) + 1, 0);
@@ -205,7 +303,8 @@ static int listen_local(void)
     return -1;
   }
 
-  if (listen(sockfd, 5)) {
+  fcntl(sockfd, F_SETFL, fcntl(sockfd, F_GETFL) | O_NONBLOCK);
+  if (listen(sockfd, BACKLOG)) {
     perror("Failed to listen to local socket");
     close(sockfd);
     return -1;
@@ -222,6 +321,9 @@ static int listen_remote(void)
     perror("Failed to open remote socket");
     return -1;
   }
+  // The daemon closes waiters itself, leaving them in TIME_WAIT
+  int on = 1;
+  setsockopt(sockfd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
 
   saddr.sin_family = AF_INET;
   saddr.sin_port = htons(PORT);
@@ -233,7 +335,8 @@ static int listen_remote(void)
     return -1;
   }
 
-  if (listen(sockfd, 5)) {
+  fcntl(sockfd, F_SETFL, fcntl(sockfd, F_GETFL) | O_NONBLOCK);
+  if (listen(sockfd, BACKLOG)) {
     perror("Failed to listen to remote socket");
     close(sockfd);
     return -1;
@@ -255,6 +358,8 @@ void handler(void)
   struct sdata *sd = g_new0(struct sdata, 1);
   sd->events = g_hash_table_new_full(g_str_hash, g_str_equal,
                                      g_free, NULL);
+  sd->waiters = g_hash_table_new_full(g_str_hash, g_str_equal,
+                                      g_free, (GDestroyNotify)queue_free);
   int lsock, rsock;
 
   signal(SIGPIPE, SIG_IGN);
@@ -281,7 +386,7 @@ void handler(void)
   g_main_loop_run(mloop);
 
   g_hash_table_destroy(sd->events);
-  g_slist_free_full(sd->wlist, (GDestroyNotify)wentry_free);
+  g_hash_table_destroy(sd->waiters);
   g_free(sd);
   close(rsock);
 rerror:
@@ -291,6 +396,349 @@ lerror:
   return;
 }
 
+/*
+ * barrier
+ * -------
+ * Waits until every host, or with --any one of them, has set one of the
+ * events.  A block request is kept open to each host for each event, all
+ * of them at once from one main loop, so the wait ends as soon as the
+ * last event is set rather than after polling the hosts in turn.  Hosts
+ * that can't be reached, or drop the connection, are retried with a
+ * backoff doubling up to --retry seconds.
+ */
+struct barrier;
+
+struct peer {
+  char *host;
+  gboolean reached;
+};
+
+struct bconn {
+  struct barrier *b;
+  struct peer *peer;
+  char *event;
+  int sockfd;
+  guint watch_id;
+  guint retry_id;
+  guint backoff;
+  struct addrinfo *addrs;
+  struct addrinfo *addr;
+  GString *buf;
+};
+
+struct barrier {
+  GMainLoop *loop;
+  GPtrArray *peers;
+  GPtrArray *conns;
+  gboolean any;
+  guint retry;
+  guint reached;
+  int result;
+};
+
+static void bconn_connect(struct bconn *c);
+
+static void bconn_close(struct bconn *c)
+{
+  if (c->watch_id) {
+    g_source_remove(c->watch_id);
+    c->watch_id = 0;
+  }
+  if (c->retry_id) {
+    g_source_remove(c->retry_id);
+    c->retry_id = 0;
+  }
+  if (c->sockfd >= 0) {
+    close(c->sockfd);
+    c->sockfd = -1;
+  }
+  if (c->addrs) {
+    freeaddrinfo(c->addrs);
+    c->addrs = NULL;
+    c->addr = NULL;
+  }
+  g_string_truncate(c->buf, 0);
+}
+
+static void bconn_free(struct bconn *c)
+{
+  bconn_close(c);
+  g_string_free(c->buf, TRUE);
+  g_free(c);
+}
+
+static gboolean bconn_retry_cb(gpointer data)
+{
+  struct bconn *c = (struct bconn*)data;
+
+  c->retry_id = 0;
+  bconn_connect(c);
+  return FALSE;
+}
+
+static void bconn_retry(struct bconn *c, const char *reason)
+{
+  bconn_close(c);
+  g_fprintf(stderr, "Waiting on %s for state %s: %s, retrying in %u seconds\n",
+            c->peer->host, c->event, reason, c->backoff);
+  c->retry_id = g_timeout_add_seconds(c->backoff, bconn_retry_cb, c);
+  c->backoff = MIN(c->backoff * 2, c->b->retry);
+}
+
+static void peer_reached(struct barrier *b, struct peer *peer)
+{
+  peer->reached = TRUE;
+  b->reached++;
+  for (guint i = 0; i < b->conns->len; i++) {
+    struct bconn *c = g_ptr_array_index(b->conns, i);
+    if (c->peer == peer) {
+      bconn_close(c);
+    }
+  }
+  if (b->any || b->reached == b->peers->len) {
+    b->result = 0;
+    g_main_loop_quit(b->loop);
+  }
+}
+
+/*
+ * Replies are NUL terminated, and are either the event or a PING the
+ * daemon probes waiting clients with.
+ */
+static gboolean bconn_read_cb(GIOChannel *source, GIOCondition condition,
+                              gpointer data)
+{
+  struct bconn *c = (struct bconn*)data;
+  char buf[BUFSIZE];
+  ssize_t rcv;
+  gsize start = 0;
+
+  rcv = recv(c->sockfd, buf, sizeof(buf), 0);
+  if (rcv < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) {
+    return TRUE;
+  }
+  if (rcv <= 0) {
+    c->watch_id = 0;
+    bconn_retry(c, rcv == 0 ? "connection closed" : strerror(errno));
+    return FALSE;
+  }
+  g_string_append_len(c->buf, buf, rcv);
+  for (gsize i = 0; i < c->buf->len; i++) {
+    if (c->buf->str[i] != '\0') {
+      continue;
+    }
+    if (g_strcmp0(c->buf->str + start, c->event) == 0) {
+      c->watch_id = 0;
+      peer_reached(c->b, c->peer);
+      return FALSE;
+    }
+    start = i + 1;
+  }
+  g_string_erase(c->buf, 0, start);
+  if (c->buf->len >= BUFSIZE) {
+    c->watch_id = 0;
+    bconn_retry(c, "reply too long");
+    return FALSE;
+  }
+  return TRUE;
+}
+
+static void bconn_connected(struct bconn *c)
+{
+  GIOChannel *channel;
+
+  freeaddrinfo(c->addrs);
+  c->addrs = NULL;
+  c->addr = NULL;
+
+  if (send(c->sockfd, c->event, strlen(c->event) + 1, MSG_NOSIGNAL) <= 0) {
+    bconn_retry(c, strerror(errno));
+    return;
+  }
+  c->backoff = 1;
+  channel = g_io_channel_unix_new(c->sockfd);
+  c->watch_id = g_io_add_watch(channel, G_IO_IN | G_IO_HUP | G_IO_ERR,
+                               bconn_read_cb, c);
+  g_io_channel_unref(channel);
+}
+
+static gboolean bconn_connect_cb(GIOChannel *source, GIOCondition condition,
+                                 gpointer data)
+{
+  struct bconn *c = (struct bconn*)data;
+  int err = 0;
+  socklen_t len = sizeof(err);
+
+  c->watch_id = 0;
+  if (getsockopt(c->sockfd, SOL_SOCKET, SO_ERROR, &err, &len) < 0) {
+    err = errno;
+  }
+  if (err == 0) {
+    bconn_connected(c);
+  } else {
+    // On to the host's next address
+    close(c->sockfd);
+    c->sockfd = -1;
+    c->addr = c->addr->ai_next;
+    errno = err;
+    bconn_connect(c);
+  }
+  return FALSE;
+}
+
+static void bconn_connect(struct bconn *c)
+{
+  int err = 0;
+
+  if (c->addrs == NULL) {
+    struct addrinfo hints;
+    int gai_ret;
+
+    memset(&hints, 0, sizeof(struct addrinfo));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags |= AI_NUMERICSERV;
+    hints.ai_protocol = IPPROTO_TCP;
+    if ((gai_ret = getaddrinfo(c->peer->host, STR(PORT), &hints, &c->addrs)) != 0) {
+      c->addrs = NULL;
+      bconn_retry(c, gai_strerror(gai_ret));
+      return;
+    }
+    c->addr = c->addrs;
+  }
+
+  for (; c->addr != NULL; c->addr = c->addr->ai_next) {
+    struct addrinfo *rp = c->addr;
+    GIOChannel *channel;
+
+    c->sockfd = socket(rp->ai_family, rp->ai_socktype, rp->ai_protocol);
+    if (c->sockfd == -1) {
+      err = errno;
+      continue;
+    }
+    fcntl(c->sockfd, F_SETFL, fcntl(c->sockfd, F_GETFL) | O_NONBLOCK);
+    set_keepalive(c->sockfd);
+    if (connect(c->sockfd, rp->ai_addr, rp->ai_addrlen) == 0) {
+      bconn_connected(c);
+      return;
+    }
+    if (errno == EINPROGRESS) {
+      channel = g_io_channel_unix_new(c->sockfd);
+      c->watch_id = g_io_add_watch(channel, G_IO_OUT | G_IO_HUP | G_IO_ERR,
+                                   bconn_connect_cb, c);
+      g_io_channel_unref(channel);
+      return;
+    }
+    err = errno;
+    close(c->sockfd);
+    c->sockfd = -1;
+  }
+  bconn_retry(c, strerror(err ? err : errno));
+}
+
+static gboolean barrier_timeout(gpointer data)
+{
+  struct barrier *b = (struct barrier*)data;
+
+  for (guint i = 0; i < b->peers->len; i++) {
+    struct peer *peer = g_ptr_array_index(b->peers, i);
+    if (!peer->reached) {
+      g_fprintf(stderr, "Server %s not reported state for Multihost Sync\n",
+                peer->host);
+    }
+  }
+  b->result = 1;
+  g_main_loop_quit(b->loop);
+  return FALSE;
+}
+
+static int barrier(int argc, char **argv)
+{
+  gchar **events = NULL;
+  gchar **hosts = NULL;
+  gint timeout = 0;
+  gint retry = BARRIER_RETRY;
+  gboolean any = FALSE;
+  GError *error = NULL;
+  struct barrier b = { NULL, NULL, NULL, FALSE, 0, 0, 1 };
+  guint timeout_id = 0;
+
+  GOptionEntry entries[] = {
+    { "state", 's', 0, G_OPTION_ARG_STRING_ARRAY, &events,
+      "State to wait for, any of them if repeated", "STATE" },
+    { "any", 0, 0, G_OPTION_ARG_NONE, &any,
+      "Return when any host has reached the state", NULL },
+    { "timeout", 0, 0, G_OPTION_ARG_INT, &timeout,
+      "Fail after this many seconds, 0 waits forever", "SECONDS" },
+    { "retry", 0, 0, G_OPTION_ARG_INT, &retry,
+      "Most seconds to wait before reconnecting to a host", "SECONDS" },
+    { G_OPTION_REMAINING, 0, 0, G_OPTION_ARG_STRING_ARRAY, &hosts,
+      NULL, "HOST..." },
+    { NULL }
+  };
+  GOptionContext *context = g_option_context_new(NULL);
+  g_option_context_set_summary(context,
+          "Wait until hosts have set a state with rstrnt-sync set.");
+  g_option_context_add_main_entries(context, entries, NULL);
+  gboolean parse_succeeded = g_option_context_parse(context, &argc, &argv, &error);
+  g_option_context_free(context);
+
+  if (!parse_succeeded || events == NULL || hosts == NULL) {
+    if (error) {
+      g_fprintf(stderr, "%s\n", error->message);
+      g_clear_error(&error);
+    }
+    g_strfreev(events);
+    g_strfreev(hosts);
+    return 1;
+  }
+
+  b.loop = g_main_loop_new(NULL, FALSE);
+  b.peers = g_ptr_array_new();
+  b.conns = g_ptr_array_new_with_free_func((GDestroyNotify)bconn_free);
+  b.any = any;
+  b.retry = MAX(retry, 1);
+  for (gchar **host = hosts; *host != NULL; host++) {
+    struct peer *peer = g_new0(struct peer, 1);
+    peer->host = *host;
+    g_ptr_array_add(b.peers, peer);
+    for (gchar **event = events; *event != NULL; event++) {
+      struct bconn *c = g_new0(struct bconn, 1);
+      c->b = &b;
+      c->peer = peer;
+      c->event = *event;
+      c->sockfd = -1;
+      c->backoff = 1;
+      c->buf = g_string_new(NULL);
+      g_ptr_array_add(b.conns, c);
+    }
+  }
+
+  signal(SIGPIPE, SIG_IGN);
+  for (guint i = 0; i < b.conns->len; i++) {
+    bconn_connect(g_ptr_array_index(b.conns, i));
+  }
+  if (timeout > 0) {
+    timeout_id = g_timeout_add_seconds(timeout, barrier_timeout, &b);
+  }
+
+  g_main_loop_run(b.loop);
+
+  if (timeout_id && b.result == 0) {
+    g_source_remove(timeout_id);
+  }
+  g_ptr_array_free(b.conns, TRUE);
+  for (guint i = 0; i < b.peers->len; i++) {
+    g_free(g_ptr_array_index(b.peers, i));
+  }
+  g_ptr_array_free(b.peers, TRUE);
+  g_main_loop_unref(b.loop);
+  g_strfreev(events);
+  g_strfreev(hosts);
+
+  return b.result;
+}
+
 int main(int argc, char **argv)
 {
   if (argc < 3) {
@@ -298,6 +746,10 @@ int main(int argc, char **argv)
     return 1;
   }
 
+  if (g_strcmp0(argv[1], "barrier") == 0) {
+    return barrier(argc - 1, argv + 1);
+  }
+
   if (g_strcmp0(argv[1], "set") == 0) {
     int sockfd = socket(AF_UNIX, SOCK_STREAM, 0);
     struct sockaddr_un saddr;
@@ -124,6 +124,10 @@ upload_watchdog (WatchdogAppData *app_data, GError **error)
     SoupMessage *server_msg = soup_message_new_from_uri ("POST", watchdog_uri);
     form_seconds = g_strdup_printf ("%" G_GUINT64_FORMAT, app_data->seconds);
     g_hash_table_insert (data_table, "seconds", form_seconds);
+    // Tells restraintd which of the tasks running this is for
+    if (app_data->s.task_id) {
+        g_hash_table_insert (data_table, "task_id", app_data->s.task_id);
+    }
     form_data = soup_form_encode_hash (data_table);
     g_free (form_seconds);
     soup_message_set_request (server_msg, "application/x-www-form-urlencoded",
@@ -32,6 +32,9 @@
 #define is_key_file_not_found_error(e) (G_KEY_FILE_ERROR_KEY_NOT_FOUND == e->code \
                                         || G_KEY_FILE_ERROR_GROUP_NOT_FOUND == e->code)
 
+static guint64 config_writes = 0;
+static gint64 config_write_usec = 0;
+
 /*
  * Returns the content of file into a new GKeyFile structure.
  *
@@ -274,6 +277,7 @@ restraint_config_set (gchar *config_file, const gchar *section,
     gsize length;
     g_autoptr (GKeyFile) keyfile = NULL;
     GError *tmp_error = NULL;
+    gint64 start = g_get_monotonic_time ();
 
     restraint_mkdir_parent (config_file);
 
@@ -336,8 +340,18 @@ restraint_config_set (gchar *config_file, const gchar *section,
     if (!g_file_set_contents (config_file, s_data, length,  &tmp_error))
         goto error;
 
+    config_writes++;
+    config_write_usec += g_get_monotonic_time () - start;
+
     return;
 
   error:
     g_propagate_error (gerror, tmp_error);
 }
+
+void
+restraint_config_get_write_stats (guint64 *writes, gint64 *usec)
+{
+    *writes = config_writes;
+    *usec = config_write_usec;
+}
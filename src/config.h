@@ -29,5 +29,7 @@ gchar **restraint_config_get_keys (gchar *config_file, gchar *section, GError **
 void restraint_config_set (gchar *config_file, const gchar *section,
                            const gchar *key, GError **gerror, GType type, ...);
 void restraint_config_trunc (gchar *config_file, GError **error);
+// Writes by restraint_config_set () and the time they took
+void restraint_config_get_write_stats (guint64 *writes, gint64 *usec);
 
 #endif
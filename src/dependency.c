@@ -219,6 +219,8 @@ dependency_batch_rpms(DependencyData *dependency_data)
                          0,
                          FALSE,
                          dependency_data->cancellable,
+                         NULL,
+                         NULL,
                          dependency_data);
             g_free (command);
         } else {
@@ -243,6 +245,8 @@ dependency_batch_rpms(DependencyData *dependency_data)
                          0,
                          FALSE,
                          dependency_data->cancellable,
+                         NULL,
+                         NULL,
                          dependency_data);
             g_free (command);
         } else {
@@ -332,6 +336,8 @@ dependency_soft_rpm(DependencyData *dependency_data)
                      0,
                      FALSE,
                      dependency_data->cancellable,
+                     NULL,
+                     NULL,
                      dependency_data);
         g_free (command);
     } else {
@@ -370,6 +376,8 @@ dependency_single_rpm(DependencyData *dependency_data)
                      0,
                      FALSE,
                      dependency_data->cancellable,
+                     NULL,
+                     NULL,
                      dependency_data);
         g_free (command);
     } else {
@@ -20,6 +20,7 @@
 #include "cmd_utils.h"
 #include "env.h"
 #include "param.h"
+#include "preamble.h"
 
 static void get_recipe_members(GSList **hosts, GList *rolehosts)
 {
@@ -151,6 +152,10 @@ void build_env(gchar *restraint_url, guint port, Task *task) {
     g_list_foreach(task->recipe->params, (GFunc) build_param_var, env);
     // Override with task level params
     g_list_foreach(task->params, (GFunc) build_param_var, env);
+    // What the standard task_run.d plugins would have exported
+    if (task->app_data != NULL && task->app_data->native_preamble) {
+        rstrnt_preamble_env (env);
+    }
     // Leave four NULL slots for PLUGIN variables.
     g_ptr_array_add(env, NULL);
     g_ptr_array_add(env, NULL);
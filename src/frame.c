@@ -0,0 +1,237 @@
+/*
+    This file is part of Restraint.
+
+    Restraint is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Restraint is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Restraint.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <glib.h>
+#include <string.h>
+#include "errors.h"
+#include "frame.h"
+
+struct _RstrntFrameReader {
+    GByteArray *buffer;
+    // bytes at the start of buffer which have already been consumed
+    gsize offset;
+    gboolean failed;
+};
+
+gboolean
+rstrnt_framing_parse (const gchar *option,
+                      RstrntFraming *framing,
+                      GError **error)
+{
+    if (g_strcmp0 (option, FRAME_OPTION_JSON) == 0) {
+        *framing = RSTRNT_FRAMING_JSON;
+    } else if (g_strcmp0 (option, FRAME_OPTION_BINARY) == 0) {
+        *framing = RSTRNT_FRAMING_BINARY;
+    } else {
+        g_set_error (error, RESTRAINT_ERROR, RESTRAINT_CMDLINE_ERROR,
+                     "Unknown framing '%s', expected %s or %s",
+                     option, FRAME_OPTION_JSON, FRAME_OPTION_BINARY);
+        return FALSE;
+    }
+    return TRUE;
+}
+
+static void
+append_uint32 (GByteArray *array, guint32 value)
+{
+    guint32 be_value = GUINT32_TO_BE (value);
+
+    g_byte_array_append (array, (const guint8 *) &be_value, sizeof (be_value));
+}
+
+static guint32
+read_uint32 (const guint8 *data)
+{
+    guint32 be_value;
+
+    memcpy (&be_value, data, sizeof (be_value));
+    return GUINT32_FROM_BE (be_value);
+}
+
+GByteArray *
+rstrnt_frame_encode (const gchar * const *names,
+                     const gchar * const *values,
+                     const gchar *body,
+                     gsize body_length)
+{
+    GByteArray *frame;
+    gsize header_length = 0;
+
+    g_return_val_if_fail (body_length <= FRAME_MAX_BODY_LENGTH, NULL);
+
+    for (gint i = 0; names[i] != NULL; i++) {
+        header_length += strlen (names[i]) + strlen (values[i]) + 2;
+    }
+    g_return_val_if_fail (header_length <= FRAME_MAX_HEADER_LENGTH, NULL);
+
+    frame = g_byte_array_sized_new (FRAME_PREFIX_LENGTH + header_length +
+                                    body_length);
+    append_uint32 (frame, header_length);
+    append_uint32 (frame, body_length);
+    for (gint i = 0; names[i] != NULL; i++) {
+        // Append the strings including their NUL terminators.
+        g_byte_array_append (frame, (const guint8 *) names[i],
+                             strlen (names[i]) + 1);
+        g_byte_array_append (frame, (const guint8 *) values[i],
+                             strlen (values[i]) + 1);
+    }
+    if (body_length > 0) {
+        g_byte_array_append (frame, (const guint8 *) body, body_length);
+    }
+
+    return frame;
+}
+
+void
+rstrnt_frame_free (RstrntFrame *frame)
+{
+    if (frame == NULL) {
+        return;
+    }
+    g_hash_table_destroy (frame->headers);
+    g_free (frame->body);
+    g_slice_free (RstrntFrame, frame);
+}
+
+RstrntFrameReader *
+rstrnt_frame_reader_new (void)
+{
+    RstrntFrameReader *reader = g_slice_new0 (RstrntFrameReader);
+
+    reader->buffer = g_byte_array_new ();
+    return reader;
+}
+
+void
+rstrnt_frame_reader_free (RstrntFrameReader *reader)
+{
+    if (reader == NULL) {
+        return;
+    }
+    g_byte_array_free (reader->buffer, TRUE);
+    g_slice_free (RstrntFrameReader, reader);
+}
+
+void
+rstrnt_frame_reader_feed (RstrntFrameReader *reader,
+                          const gchar *data,
+                          gsize length)
+{
+    g_return_if_fail (reader != NULL);
+
+    // Drop what has been consumed before growing the buffer, frames are
+    // small enough that this doesn't move much.
+    if (reader->offset > 0) {
+        g_byte_array_remove_range (reader->buffer, 0, reader->offset);
+        reader->offset = 0;
+    }
+    g_byte_array_append (reader->buffer, (const guint8 *) data, length);
+}
+
+static GHashTable *
+parse_headers (const gchar *data, gsize length, GError **error)
+{
+    GHashTable *headers = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                                 g_free, g_free);
+    const gchar *end = data + length;
+
+    while (data < end) {
+        const gchar *name = data;
+        const gchar *name_end = memchr (name, '\0', end - name);
+        const gchar *value;
+        const gchar *value_end;
+
+        if (name_end == NULL) {
+            goto error;
+        }
+        value = name_end + 1;
+        value_end = memchr (value, '\0', end - value);
+        if (value_end == NULL) {
+            goto error;
+        }
+        g_hash_table_replace (headers, g_strdup (name), g_strdup (value));
+        data = value_end + 1;
+    }
+    return headers;
+
+error:
+    g_set_error (error, RESTRAINT_ERROR, RESTRAINT_PARSE_ERROR_BAD_SYNTAX,
+                 "Frame header is not a list of name/value pairs");
+    g_hash_table_destroy (headers);
+    return NULL;
+}
+
+RstrntFrame *
+rstrnt_frame_reader_next (RstrntFrameReader *reader, GError **error)
+{
+    RstrntFrame *frame;
+    GHashTable *headers;
+    const guint8 *data;
+    gsize available;
+    guint32 header_length;
+    guint32 body_length;
+
+    g_return_val_if_fail (reader != NULL, NULL);
+
+    if (reader->failed) {
+        g_set_error (error, RESTRAINT_ERROR, RESTRAINT_PARSE_ERROR_BAD_SYNTAX,
+                     "Frame stream is out of sync");
+        return NULL;
+    }
+
+    data = reader->buffer->data + reader->offset;
+    available = reader->buffer->len - reader->offset;
+    if (available < FRAME_PREFIX_LENGTH) {
+        return NULL;
+    }
+
+    header_length = read_uint32 (data);
+    body_length = read_uint32 (data + 4);
+    if (header_length > FRAME_MAX_HEADER_LENGTH ||
+            body_length > FRAME_MAX_BODY_LENGTH) {
+        reader->failed = TRUE;
+        g_set_error (error, RESTRAINT_ERROR, RESTRAINT_PARSE_ERROR_BAD_SYNTAX,
+                     "Frame too large: header %u bytes, body %u bytes",
+                     header_length, body_length);
+        return NULL;
+    }
+    if (available < FRAME_PREFIX_LENGTH + header_length + body_length) {
+        return NULL;
+    }
+
+    data += FRAME_PREFIX_LENGTH;
+    headers = parse_headers ((const gchar *) data, header_length, error);
+    if (headers == NULL) {
+        reader->failed = TRUE;
+        return NULL;
+    }
+
+    frame = g_slice_new0 (RstrntFrame);
+    frame->headers = headers;
+    frame->body_length = body_length;
+    frame->body = g_malloc (body_length + 1);
+    memcpy (frame->body, data + header_length, body_length);
+    frame->body[body_length] = '\0';
+
+    reader->offset += FRAME_PREFIX_LENGTH + header_length + body_length;
+    if (reader->offset == reader->buffer->len) {
+        g_byte_array_set_size (reader->buffer, 0);
+        reader->offset = 0;
+    }
+
+    return frame;
+}
@@ -0,0 +1,110 @@
+/*
+    This file is part of Restraint.
+
+    Restraint is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Restraint is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Restraint.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef _RESTRAINT_FRAME_H
+#define _RESTRAINT_FRAME_H
+
+#include <glib.h>
+
+/*
+ * Framing of the messages restraintd writes to STDOUT when it is run by
+ * the restraint client with --stdin.
+ *
+ * The default is one JSON object per line.  When the client passes
+ * "--framing binary" restraintd answers with FRAME_BINARY_HANDSHAKE as a
+ * line of its own and everything after it is a sequence of frames:
+ *
+ *   uint32  header length (network byte order)
+ *   uint32  body length (network byte order)
+ *   header  name NUL value NUL ... pairs
+ *   body    raw request body, not encoded in any way
+ *
+ * Text which isn't a message (g_print output) is sent as a frame with no
+ * rstrnt-path header.
+ */
+#define FRAME_OPTION_JSON "json"
+#define FRAME_OPTION_BINARY "binary"
+#define FRAME_BINARY_HANDSHAKE "rstrnt-framing: binary\n"
+
+#define FRAME_PREFIX_LENGTH 8
+#define FRAME_MAX_HEADER_LENGTH (64 * 1024)
+#define FRAME_MAX_BODY_LENGTH (64 * 1024 * 1024)
+
+typedef enum {
+    RSTRNT_FRAMING_JSON,
+    RSTRNT_FRAMING_BINARY,
+} RstrntFraming;
+
+typedef struct {
+    // name -> value, both owned by the table
+    GHashTable *headers;
+    // NUL terminated for convenience, body_length doesn't include it
+    gchar *body;
+    gsize body_length;
+} RstrntFrame;
+
+typedef struct _RstrntFrameReader RstrntFrameReader;
+
+gboolean rstrnt_framing_parse (const gchar *option,
+                               RstrntFraming *framing,
+                               GError **error);
+
+/**
+ * rstrnt_frame_encode:
+ * @names: (array zero-terminated=1): header names.
+ * @values: (array zero-terminated=1): header values, one per name.
+ * @body: the raw body.
+ * @body_length: length of @body.
+ *
+ * Returns: (transfer full): the frame, ready to be written out.
+ */
+GByteArray *rstrnt_frame_encode (const gchar * const *names,
+                                 const gchar * const *values,
+                                 const gchar *body,
+                                 gsize body_length);
+
+void rstrnt_frame_free (RstrntFrame *frame);
+
+RstrntFrameReader *rstrnt_frame_reader_new (void);
+
+void rstrnt_frame_reader_free (RstrntFrameReader *reader);
+
+/**
+ * rstrnt_frame_reader_feed:
+ * @reader: a frame reader.
+ * @data: bytes read from the stream, frames may be split anywhere.
+ * @length: length of @data.
+ */
+void rstrnt_frame_reader_feed (RstrntFrameReader *reader,
+                               const gchar *data,
+                               gsize length);
+
+/**
+ * rstrnt_frame_reader_next:
+ * @reader: a frame reader.
+ * @error: return location for a #GError.
+ *
+ * Once a frame has been rejected the stream can't be resynchronized and
+ * every following call fails as well.
+ *
+ * Returns: (transfer full) (nullable): the next complete frame, or %NULL
+ *   if more data is needed or @error is set.
+ */
+RstrntFrame *rstrnt_frame_reader_next (RstrntFrameReader *reader,
+                                       GError **error);
+
+#endif
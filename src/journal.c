@@ -0,0 +1,186 @@
+/*
+    This file is part of Restraint.
+
+    Restraint is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Restraint is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Restraint.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#define _XOPEN_SOURCE 500
+
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include "journal.h"
+
+struct _RstrntJournal {
+    gchar *filename;
+    gint fd;
+    guint records;
+};
+
+RstrntJournal *
+rstrnt_journal_open (const gchar *filename, GError **error)
+{
+    RstrntJournal *journal;
+    gint fd;
+
+    g_return_val_if_fail (filename != NULL, NULL);
+
+    fd = g_open (filename, O_WRONLY | O_CREAT | O_APPEND, 0644);
+    if (fd < 0) {
+        g_set_error (error, G_FILE_ERROR, g_file_error_from_errno (errno),
+                     "Failed to open %s: %s", filename, g_strerror (errno));
+        return NULL;
+    }
+    fcntl (fd, F_SETFD, FD_CLOEXEC);
+
+    journal = g_slice_new0 (RstrntJournal);
+    journal->filename = g_strdup (filename);
+    journal->fd = fd;
+
+    return journal;
+}
+
+gboolean
+rstrnt_journal_append (RstrntJournal *journal,
+                       struct json_object *record,
+                       GError **error)
+{
+    g_return_val_if_fail (journal != NULL, FALSE);
+
+    const gchar *json_text = json_object_to_json_string_ext (record,
+                                                   JSON_C_TO_STRING_PLAIN);
+    // Build the whole line first so that it goes out in a single write.
+    gchar *line = g_strconcat (json_text, "\n", NULL);
+    gsize length = strlen (line);
+    ssize_t written;
+
+    do {
+        written = write (journal->fd, line, length);
+    } while (written < 0 && errno == EINTR);
+    g_free (line);
+
+    if (written < 0) {
+        g_set_error (error, G_FILE_ERROR, g_file_error_from_errno (errno),
+                     "Failed to write to %s: %s", journal->filename,
+                     g_strerror (errno));
+        return FALSE;
+    }
+    if ((gsize) written != length) {
+        g_set_error (error, G_FILE_ERROR, G_FILE_ERROR_NOSPC,
+                     "Short write to %s", journal->filename);
+        return FALSE;
+    }
+
+    journal->records++;
+    return TRUE;
+}
+
+gboolean
+rstrnt_journal_truncate (RstrntJournal *journal, GError **error)
+{
+    g_return_val_if_fail (journal != NULL, FALSE);
+
+    if (ftruncate (journal->fd, 0) < 0) {
+        g_set_error (error, G_FILE_ERROR, g_file_error_from_errno (errno),
+                     "Failed to truncate %s: %s", journal->filename,
+                     g_strerror (errno));
+        return FALSE;
+    }
+
+    journal->records = 0;
+    return TRUE;
+}
+
+guint
+rstrnt_journal_get_records (RstrntJournal *journal)
+{
+    g_return_val_if_fail (journal != NULL, 0);
+
+    return journal->records;
+}
+
+void
+rstrnt_journal_close (RstrntJournal *journal)
+{
+    if (journal == NULL) {
+        return;
+    }
+
+    if (g_close (journal->fd, NULL) < 0) {
+        g_warning ("Failed to close %s: %s", journal->filename,
+                   g_strerror (errno));
+    }
+    g_free (journal->filename);
+    g_slice_free (RstrntJournal, journal);
+}
+
+gint
+rstrnt_journal_replay (const gchar *filename,
+                       RstrntJournalReplayFunc replay_func,
+                       gpointer user_data,
+                       GError **error)
+{
+    gchar *contents = NULL;
+    gchar **lines = NULL;
+    gsize length;
+    gint replayed = 0;
+    GError *tmp_error = NULL;
+
+    g_return_val_if_fail (filename != NULL, -1);
+    g_return_val_if_fail (replay_func != NULL, -1);
+
+    if (!g_file_get_contents (filename, &contents, &length, &tmp_error)) {
+        if (g_error_matches (tmp_error, G_FILE_ERROR, G_FILE_ERROR_NOENT)) {
+            g_clear_error (&tmp_error);
+            return 0;
+        }
+        g_propagate_error (error, tmp_error);
+        return -1;
+    }
+
+    lines = g_strsplit (contents, "\n", 0);
+    for (gint i = 0; lines[i] != NULL; i++) {
+        struct json_object *record;
+
+        if (lines[i][0] == '\0') {
+            continue;
+        }
+        // A line which isn't followed by a newline was being written when
+        // we went down, don't trust it even if it happens to parse.
+        if (lines[i + 1] == NULL) {
+            g_warning ("Ignoring incomplete record at the end of %s",
+                       filename);
+            break;
+        }
+        record = json_tokener_parse (lines[i]);
+        if (record == NULL ||
+                json_object_get_type (record) != json_type_object) {
+            g_warning ("Ignoring corrupt record %d and everything after it in %s",
+                       replayed + 1, filename);
+            json_object_put (record);
+            break;
+        }
+        replay_func (record, user_data);
+        json_object_put (record);
+        replayed++;
+    }
+
+    g_strfreev (lines);
+    g_free (contents);
+
+    return replayed;
+}
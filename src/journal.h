@@ -0,0 +1,92 @@
+/*
+    This file is part of Restraint.
+
+    Restraint is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Restraint is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Restraint.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef _RESTRAINT_JOURNAL_H
+#define _RESTRAINT_JOURNAL_H
+
+#include <glib.h>
+#include <json.h>
+
+#define JOURNAL_FILENAME "job.journal"
+
+typedef struct _RstrntJournal RstrntJournal;
+
+typedef void (*RstrntJournalReplayFunc) (struct json_object *record,
+                                         gpointer user_data);
+
+/**
+ * rstrnt_journal_open:
+ * @filename: path of the journal file, created if it doesn't exist.
+ * @error: return location for a #GError.
+ *
+ * Opens the journal for appending.  Every record is written with a
+ * single write() so a crash can at worst lose or truncate the last
+ * record, which rstrnt_journal_replay() will then skip.
+ */
+RstrntJournal *rstrnt_journal_open (const gchar *filename, GError **error);
+
+/**
+ * rstrnt_journal_append:
+ * @journal: an open journal.
+ * @record: (transfer none): the record to append, serialized as a single
+ *   line of plain JSON.
+ *
+ * Returns: %TRUE if the whole record was written.
+ */
+gboolean rstrnt_journal_append (RstrntJournal *journal,
+                                struct json_object *record,
+                                GError **error);
+
+/**
+ * rstrnt_journal_truncate:
+ * @journal: an open journal.
+ *
+ * Discards every record.  Called once the state the records describe has
+ * been checkpointed somewhere else (job.xml).
+ */
+gboolean rstrnt_journal_truncate (RstrntJournal *journal, GError **error);
+
+/**
+ * rstrnt_journal_get_records:
+ * @journal: an open journal.
+ *
+ * Returns: the number of records appended since the last truncate.
+ */
+guint rstrnt_journal_get_records (RstrntJournal *journal);
+
+void rstrnt_journal_close (RstrntJournal *journal);
+
+/**
+ * rstrnt_journal_replay:
+ * @filename: path of the journal file.
+ * @replay_func: called for each complete record, in the order in which
+ *   they were appended.
+ * @user_data: (closure): extra argument for @replay_func.
+ * @error: return location for a #GError.
+ *
+ * A missing journal is not an error, it simply has no records.  Replay
+ * stops at the first record which can't be parsed, which is what a crash
+ * in the middle of rstrnt_journal_append() leaves behind.
+ *
+ * Returns: the number of records replayed, or -1 on error.
+ */
+gint rstrnt_journal_replay (const gchar *filename,
+                            RstrntJournalReplayFunc replay_func,
+                            gpointer user_data,
+                            GError **error);
+
+#endif
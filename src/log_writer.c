@@ -0,0 +1,257 @@
+/*
+    This file is part of Restraint.
+
+    Restraint is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Restraint is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Restraint.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#define _XOPEN_SOURCE 500
+
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include "log_writer.h"
+
+typedef struct {
+    gchar *filename;
+    gint fd;
+} OpenLog;
+
+typedef struct {
+    gchar *filename;
+    gchar *data;
+    gsize length;
+    goffset offset;
+    goffset truncate_length;
+} LogChunk;
+
+/*
+ * Everything but the thread pool is only touched from the writer thread,
+ * so none of it needs locking.
+ */
+struct _RstrntLogWriter {
+    GThreadPool *thread_pool;
+    guint max_open;
+    // filename -> link in lru
+    GHashTable *open_logs;
+    // OpenLog, most recently written first
+    GQueue lru;
+    // directories known to exist
+    GHashTable *dirs;
+};
+
+static void
+open_log_close (OpenLog *open_log)
+{
+    if (g_close (open_log->fd, NULL) < 0) {
+        g_warning ("Failed to close %s: %s", open_log->filename,
+                   g_strerror (errno));
+    }
+    g_free (open_log->filename);
+    g_slice_free (OpenLog, open_log);
+}
+
+static void
+log_chunk_free (LogChunk *chunk)
+{
+    g_free (chunk->filename);
+    g_free (chunk->data);
+    g_slice_free (LogChunk, chunk);
+}
+
+static gint
+open_log_file (RstrntLogWriter *writer, const gchar *filename, gboolean *created)
+{
+    gint fd;
+
+    *created = FALSE;
+    fd = g_open (filename, O_WRONLY, 0);
+    if (fd < 0 && errno == ENOENT) {
+        gchar *dirname = g_path_get_dirname (filename);
+
+        if (!g_hash_table_contains (writer->dirs, dirname)) {
+            if (g_mkdir_with_parents (dirname, 0755 /* drwxr-xr-x */) < 0) {
+                g_warning ("Failed to create %s: %s", dirname,
+                           g_strerror (errno));
+            }
+            g_hash_table_add (writer->dirs, g_strdup (dirname));
+        }
+        g_free (dirname);
+
+        fd = g_open (filename, O_WRONLY | O_CREAT, 0644);
+        *created = TRUE;
+    }
+    if (fd < 0) {
+        g_warning ("Failed to open %s: %s", filename, g_strerror (errno));
+        return -1;
+    }
+    fcntl (fd, F_SETFD, FD_CLOEXEC);
+
+    return fd;
+}
+
+/*
+ * Returns the fd of filename, opening it if it isn't open already and
+ * closing the least recently written file if there are too many open.
+ */
+static gint
+get_log_fd (RstrntLogWriter *writer, const gchar *filename, gboolean *created)
+{
+    GList *link = g_hash_table_lookup (writer->open_logs, filename);
+    OpenLog *open_log;
+    gint fd;
+
+    *created = FALSE;
+    if (link != NULL) {
+        g_queue_unlink (&writer->lru, link);
+        g_queue_push_head_link (&writer->lru, link);
+        return ((OpenLog *) link->data)->fd;
+    }
+
+    fd = open_log_file (writer, filename, created);
+    if (fd < 0) {
+        return -1;
+    }
+
+    if (writer->lru.length >= writer->max_open) {
+        open_log = g_queue_pop_tail (&writer->lru);
+        g_hash_table_remove (writer->open_logs, open_log->filename);
+        open_log_close (open_log);
+    }
+
+    open_log = g_slice_new0 (OpenLog);
+    open_log->filename = g_strdup (filename);
+    open_log->fd = fd;
+    g_queue_push_head (&writer->lru, open_log);
+    g_hash_table_insert (writer->open_logs, open_log->filename,
+                         writer->lru.head);
+
+    return fd;
+}
+
+static void
+write_chunk_func (gpointer data, gpointer user_data)
+{
+    LogChunk *chunk = data;
+    RstrntLogWriter *writer = user_data;
+    gboolean created;
+    gsize written = 0;
+    gint fd;
+
+    fd = get_log_fd (writer, chunk->filename, &created);
+    if (fd < 0) {
+        goto out;
+    }
+
+    // A file which didn't exist has nothing to cut.
+    if (chunk->truncate_length >= 0 && !created &&
+            ftruncate (fd, chunk->truncate_length) < 0) {
+        g_warning ("Failed to truncate %s: %s", chunk->filename,
+                   g_strerror (errno));
+    }
+
+    while (written < chunk->length) {
+        ssize_t ret = pwrite (fd, chunk->data + written,
+                              chunk->length - written,
+                              chunk->offset + written);
+        if (ret < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            g_warning ("Failed to write %s at %" G_GOFFSET_FORMAT ": %s",
+                       chunk->filename, chunk->offset + written,
+                       g_strerror (errno));
+            break;
+        }
+        written += ret;
+    }
+
+out:
+    log_chunk_free (chunk);
+}
+
+RstrntLogWriter *
+rstrnt_log_writer_new (guint max_open, GError **error)
+{
+    RstrntLogWriter *writer;
+
+    g_return_val_if_fail (max_open > 0, NULL);
+
+    writer = g_slice_new0 (RstrntLogWriter);
+    writer->max_open = max_open;
+    writer->open_logs = g_hash_table_new (g_str_hash, g_str_equal);
+    writer->dirs = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                          g_free, NULL);
+    g_queue_init (&writer->lru);
+
+    // A single thread keeps chunks of the same file in order.
+    writer->thread_pool = g_thread_pool_new (write_chunk_func, writer, 1,
+                                             FALSE, error);
+    if (writer->thread_pool == NULL) {
+        rstrnt_log_writer_free (writer);
+        return NULL;
+    }
+
+    return writer;
+}
+
+void
+rstrnt_log_writer_write (RstrntLogWriter *writer,
+                         const gchar *filename,
+                         const gchar *data,
+                         gsize length,
+                         goffset offset,
+                         goffset truncate_length)
+{
+    LogChunk *chunk;
+
+    g_return_if_fail (writer != NULL);
+    g_return_if_fail (filename != NULL);
+
+    chunk = g_slice_new0 (LogChunk);
+    chunk->filename = g_strdup (filename);
+    if (length > 0) {
+        chunk->data = g_malloc (length);
+        memcpy (chunk->data, data, length);
+    }
+    chunk->length = length;
+    chunk->offset = offset;
+    chunk->truncate_length = truncate_length;
+
+    (void) g_thread_pool_push (writer->thread_pool, chunk, NULL);
+}
+
+void
+rstrnt_log_writer_free (RstrntLogWriter *writer)
+{
+    OpenLog *open_log;
+
+    if (writer == NULL) {
+        return;
+    }
+
+    // Let the queued chunks be written before closing anything.
+    if (writer->thread_pool != NULL) {
+        g_thread_pool_free (writer->thread_pool, FALSE, TRUE);
+    }
+
+    while ((open_log = g_queue_pop_head (&writer->lru)) != NULL) {
+        open_log_close (open_log);
+    }
+    g_hash_table_destroy (writer->open_logs);
+    g_hash_table_destroy (writer->dirs);
+    g_slice_free (RstrntLogWriter, writer);
+}
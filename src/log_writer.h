@@ -0,0 +1,60 @@
+/*
+    This file is part of Restraint.
+
+    Restraint is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Restraint is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Restraint.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef _RESTRAINT_LOG_WRITER_H
+#define _RESTRAINT_LOG_WRITER_H
+
+#include <glib.h>
+
+/* Log files kept open between chunks, least recently written closed first */
+#define LOG_WRITER_MAX_OPEN 64
+
+/*
+ * Writes the log chunks the restraint client receives into the run
+ * directory.  Chunks are written in the order they are queued by a single
+ * thread of its own, so the main loop never waits on the disk.
+ */
+typedef struct _RstrntLogWriter RstrntLogWriter;
+
+RstrntLogWriter *rstrnt_log_writer_new (guint max_open, GError **error);
+
+/**
+ * rstrnt_log_writer_write:
+ * @writer: a log writer.
+ * @filename: the log file, it and its directory are created as needed.
+ * @data: (transfer none): the chunk, copied before returning.
+ * @length: length of @data.
+ * @offset: where in the file the chunk goes.
+ * @truncate_length: size to cut an existing file to before writing the
+ *   chunk, or -1 to leave it as is.
+ */
+void rstrnt_log_writer_write (RstrntLogWriter *writer,
+                              const gchar *filename,
+                              const gchar *data,
+                              gsize length,
+                              goffset offset,
+                              goffset truncate_length);
+
+/**
+ * rstrnt_log_writer_free:
+ * @writer: (nullable): a log writer.
+ *
+ * Waits for every queued chunk to be written and closes the files.
+ */
+void rstrnt_log_writer_free (RstrntLogWriter *writer);
+
+#endif
@@ -15,7 +15,10 @@
   along with Restraint.  If not, see <http://www.gnu.org/licenses/>.
 */
 
+#include <errno.h>
 #include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
 #include <gio/gunixoutputstream.h>
 #include "logging.h"
 #include "task.h"
@@ -40,6 +43,8 @@ typedef struct
 {
     GFile *file;
     GOutputStream *output_stream;
+    /* Written by splice (), which refuses files open for appending */
+    gint splice_fd;
 } RstrntLogData;
 
 typedef struct
@@ -91,6 +96,8 @@ rstrnt_log_data_destroy (gpointer data)
 
     g_clear_object (&log_data->output_stream);
     g_clear_object (&log_data->file);
+    if (log_data->splice_fd != -1)
+        close (log_data->splice_fd);
 
     g_free (log_data);
 }
@@ -128,6 +135,7 @@ rstrnt_log_data_new (GFile   *file,
 
     data->file = g_object_ref (file);
     data->output_stream = g_unix_output_stream_new(fd, TRUE);
+    data->splice_fd = -1;
     fcntl(fd, F_SETFD, FD_CLOEXEC);
 
     if (NULL == data->output_stream)
@@ -253,7 +261,15 @@ rstrnt_on_log_uploaded (SoupSession *session,
                         SoupMessage *msg,
                         gpointer     user_data)
 {
-    g_debug ("%s(): response code: %u", __func__, msg->status_code);
+    if (SOUP_STATUS_IS_SUCCESSFUL (msg->status_code))
+    {
+        g_debug ("%s(): response code: %u", __func__, msg->status_code);
+    }
+    else
+    {
+        g_warning ("%s(): Log upload failed: %u %s", __func__,
+                   msg->status_code, msg->reason_phrase);
+    }
 
     g_mapped_file_unref (user_data);
 }
@@ -622,6 +638,99 @@ rstrnt_log_manager_get_instance (void)
     return once.retval;
 }
 
+GHashTable *
+rstrnt_log_manager_get_backlog (RstrntLogManager *self)
+{
+    GHashTable *backlog;
+    GHashTableIter iter;
+    gpointer task_id;
+    gpointer data;
+
+    backlog = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+
+    g_hash_table_iter_init (&iter, self->logs);
+    while (g_hash_table_iter_next (&iter, &task_id, &data))
+    {
+        RstrntTaskLogData *task_log_data = data;
+
+        g_hash_table_insert (backlog, g_strdup (task_id),
+                             GUINT_TO_POINTER (g_thread_pool_unprocessed (task_log_data->thread_pool)));
+    }
+
+    return backlog;
+}
+
+gchar *
+rstrnt_log_get_tail_path (const RstrntTask *task,
+                          RstrntLogType     type)
+{
+    g_return_val_if_fail (NULL != task, NULL);
+
+    return g_strdup_printf ("%s/%s/%s.tail", LOG_MANAGER_DIR, task->task_id,
+                            RSTRNT_LOG_TYPE_TASK == type ? "task" : "harness");
+}
+
+guint64
+rstrnt_log_get_size (const RstrntTask *task,
+                     RstrntLogType     type)
+{
+    g_autofree char *path = NULL;
+    struct stat st;
+
+    g_return_val_if_fail (NULL != task, 0);
+
+    path = g_strdup_printf ("%s/%s/%s.log", LOG_MANAGER_DIR, task->task_id,
+                            RSTRNT_LOG_TYPE_TASK == type ? "task" : "harness");
+    if (stat (path, &st) == -1)
+    {
+        return 0;
+    }
+
+    return st.st_size;
+}
+
+gint
+rstrnt_log_get_splice_fd (const RstrntTask  *task,
+                          RstrntLogType      type,
+                          GError           **error)
+{
+    RstrntLogManager *manager;
+    RstrntTaskLogData *data;
+    RstrntLogData *log_data;
+    g_autofree char *path = NULL;
+
+    g_return_val_if_fail (NULL != task, -1);
+
+    manager = rstrnt_log_manager_get_instance ();
+    data = rstrnt_log_manager_get_task_data (manager, task, error);
+    if (NULL == data)
+    {
+        return -1;
+    }
+    log_data = rstrnt_task_log_get_data (data, type);
+    if (log_data->splice_fd != -1)
+    {
+        return log_data->splice_fd;
+    }
+
+    path = g_file_get_path (log_data->file);
+    log_data->splice_fd = open (path, O_WRONLY);
+    if (log_data->splice_fd < 0 || lseek (log_data->splice_fd, 0, SEEK_END) < 0)
+    {
+        g_set_error (error, G_FILE_ERROR, g_file_error_from_errno (errno),
+                     "Failed to open %s for splicing: %s", path, g_strerror (errno));
+        if (log_data->splice_fd != -1)
+        {
+            close (log_data->splice_fd);
+            log_data->splice_fd = -1;
+        }
+        return -1;
+    }
+    fcntl (log_data->splice_fd, F_SETFD, FD_CLOEXEC);
+
+    return log_data->splice_fd;
+}
+
 gboolean
 rstrnt_log_manager_enabled (RstrntServerAppData *app_data)
 {
@@ -31,6 +31,7 @@ typedef enum
 {
     RSTRNT_LOG_TYPE_TASK,
     RSTRNT_LOG_TYPE_HARNESS,
+    RSTRNT_LOG_TYPES,
 } RstrntLogType;
 
 typedef struct RstrntServerAppData RstrntServerAppData;
@@ -56,8 +57,31 @@ void              rstrnt_close_logs               (const RstrntTask *task);
 
 RstrntLogManager *rstrnt_log_manager_get_instance (void);
 
+/* Writes waiting in each task's writer thread, by task id. */
+GHashTable       *rstrnt_log_manager_get_backlog  (RstrntLogManager *self);
+
 const gchar      *rstrnt_log_type_get_path        (RstrntLogType type);
 
+/*
+ * Where the tail held back of type's log is saved, beside the log.  The
+ * directory is left for whoever saves the tail to create.
+ */
+gchar            *rstrnt_log_get_tail_path        (const RstrntTask  *task,
+                                                   RstrntLogType      type);
+
+/* Bytes the log manager has written to type's log so far. */
+guint64           rstrnt_log_get_size             (const RstrntTask  *task,
+                                                   RstrntLogType      type);
+
+/*
+ * A descriptor for splice () to write type's log through, at its end.
+ * Nothing else may write that log while it is used, as the writer thread
+ * appends through a descriptor of its own.
+ */
+gint              rstrnt_log_get_splice_fd        (const RstrntTask  *task,
+                                                   RstrntLogType      type,
+                                                   GError           **error);
+
 gboolean          rstrnt_log_manager_enabled      (RstrntServerAppData *app_data);
 
 #endif
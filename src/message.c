@@ -17,16 +17,84 @@
 
 #include <glib.h>
 #include <libsoup/soup.h>
+#include <fcntl.h>
 #include <time.h>
 #include <stdint.h>
 #include <json.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include "frame.h"
 #include "message.h"
 
 static GQueue *message_queue = NULL;
 static gboolean queue_active = FALSE;
+static RstrntFraming stdout_framing = RSTRNT_FRAMING_JSON;
+static MessageStats message_stats;
+
+static const gchar *message_kind_names[] = {
+    [MESSAGE_KIND_TASK_LOG] = "taskout",
+    [MESSAGE_KIND_HARNESS_LOG] = "harness",
+    [MESSAGE_KIND_LOG] = "log",
+    [MESSAGE_KIND_RESULT] = "result",
+    [MESSAGE_KIND_STATUS] = "status",
+    [MESSAGE_KIND_WATCHDOG] = "watchdog",
+    [MESSAGE_KIND_OTHER] = "other",
+};
 
 static gboolean message_handler (gpointer data);
 
+static MessageKind
+message_kind (SoupMessage *msg)
+{
+    const gchar *path = soup_uri_get_path (soup_message_get_uri (msg));
+
+    if (g_str_has_suffix (path, "/logs/taskout.log")) {
+        return MESSAGE_KIND_TASK_LOG;
+    } else if (g_str_has_suffix (path, "/logs/harness.log")) {
+        return MESSAGE_KIND_HARNESS_LOG;
+    } else if (strstr (path, "/logs/") != NULL) {
+        return MESSAGE_KIND_LOG;
+    } else if (strstr (path, "/results/") != NULL) {
+        return MESSAGE_KIND_RESULT;
+    } else if (g_str_has_suffix (path, "/status")) {
+        return MESSAGE_KIND_STATUS;
+    } else if (g_str_has_suffix (path, "/watchdog")) {
+        return MESSAGE_KIND_WATCHDOG;
+    }
+    return MESSAGE_KIND_OTHER;
+}
+
+/* Counts a message as it goes out, retries included. */
+static void
+message_account (SoupMessage *msg)
+{
+    MessageKind kind = message_kind (msg);
+
+    message_stats.requests[kind]++;
+    message_stats.bytes[kind] += msg->request_body->length;
+}
+
+const gchar *
+restraint_message_kind_name (MessageKind kind)
+{
+    return message_kind_names[kind];
+}
+
+void
+restraint_message_get_stats (MessageStats *stats)
+{
+    *stats = message_stats;
+    stats->queue_length = 0;
+    stats->queue_age = 0;
+    if (message_queue != NULL && !g_queue_is_empty (message_queue)) {
+        MessageData *oldest = g_queue_peek_head (message_queue);
+
+        stats->queue_length = g_queue_get_length (message_queue);
+        stats->queue_age = g_get_monotonic_time () - oldest->queued_at;
+    }
+}
+
 static gboolean
 message_finish (gpointer user_data)
 {
@@ -55,6 +123,7 @@ message_complete (SoupSession *sesison, SoupMessage *msg, gpointer user_data)
     if (SOUP_STATUS_IS_SUCCESSFUL (message_data->msg->status_code) ||
         SOUP_STATUS_IS_CLIENT_ERROR (message_data->msg->status_code)) {
         delay = 2;
+        message_stats.retry_delay = 0;
         if (message_data->finish_callback) {
             message_data->finish_callback (message_data->session,
                                            message_data->msg,
@@ -74,6 +143,8 @@ message_complete (SoupSession *sesison, SoupMessage *msg, gpointer user_data)
         if (delay > 625) {
             delay = 625;
         }
+        message_stats.retries++;
+        message_stats.retry_delay = delay;
         gchar *uri = soup_uri_to_string(soup_message_get_uri(message_data->msg), TRUE);
         g_warning("%s: Unable to send %s, delaying %d seconds..",
                   message_data->msg->reason_phrase,
@@ -103,6 +174,7 @@ message_handler (gpointer data)
         queue_active = FALSE;
     } else {
         MessageData *message_data = g_queue_pop_head (message_queue);
+        message_account (message_data->msg);
         soup_session_queue_message (message_data->session,
                                     message_data->msg,
                                     message_complete,
@@ -127,6 +199,7 @@ restraint_queue_message (SoupSession *session,
     message_data->session = session;
     message_data->user_data = user_data;
     message_data->finish_callback = finish_callback;
+    message_data->queued_at = g_get_monotonic_time ();
 
     // Initialize the queue if needed
     if (!message_queue) {
@@ -170,6 +243,108 @@ restraint_close_message (gpointer msg_data)
         exit(0);
 }
 
+static void
+soup_append_frame_header (const char *name, const char *value, gpointer user_data)
+{
+    GPtrArray **headers = (GPtrArray **) user_data;
+    g_ptr_array_add (headers[0], (gpointer) name);
+    g_ptr_array_add (headers[1], (gpointer) value);
+}
+
+/* Returns FALSE if the frame could not be written, as when it is too large. */
+static gboolean
+write_frame (GPtrArray *names, GPtrArray *values,
+             const gchar *body, gsize body_length)
+{
+    GByteArray *frame;
+    gboolean written = TRUE;
+
+    if (body_length > FRAME_MAX_BODY_LENGTH) {
+        g_warning ("Not writing a %" G_GSIZE_FORMAT " byte body, frames take %d at most",
+                   body_length, FRAME_MAX_BODY_LENGTH);
+        return FALSE;
+    }
+    g_ptr_array_add (names, NULL);
+    g_ptr_array_add (values, NULL);
+    frame = rstrnt_frame_encode ((const gchar * const *) names->pdata,
+                                 (const gchar * const *) values->pdata,
+                                 body, body_length);
+    if (frame == NULL) {
+        return FALSE;
+    }
+    if (fwrite (frame->data, 1, frame->len, stdout) != frame->len) {
+        g_warning ("Failed to write %u byte frame", frame->len);
+        written = FALSE;
+    }
+    fflush (stdout);
+    g_byte_array_free (frame, TRUE);
+
+    return written;
+}
+
+static void
+restraint_stdout_print (const gchar *string)
+{
+    GPtrArray *names = g_ptr_array_new ();
+    GPtrArray *values = g_ptr_array_new ();
+
+    write_frame (names, values, string, strlen (string));
+    g_ptr_array_free (names, TRUE);
+    g_ptr_array_free (values, TRUE);
+}
+
+void
+restraint_stdout_set_framing (RstrntFraming framing)
+{
+    stdout_framing = framing;
+    if (framing == RSTRNT_FRAMING_BINARY) {
+        gint null_fd = open ("/dev/null", O_WRONLY);
+
+        // The client reads our STDERR with STDOUT, as rsh and ssh pass it
+        // on.  Raw bytes there, from libxml2 or anything we spawn, would
+        // break the frames for good.
+        if (null_fd != -1) {
+            dup2 (null_fd, STDERR_FILENO);
+            close (null_fd);
+        }
+        // Confirm the switch to the client, after this line nothing
+        // but frames may go to STDOUT, so wrap g_print output too.
+        fputs (FRAME_BINARY_HANDSHAKE, stdout);
+        fflush (stdout);
+        g_set_print_handler (restraint_stdout_print);
+    }
+}
+
+static gboolean
+stdout_message_frame (SoupMessage *msg, const gchar *path,
+                      const gchar *transaction_id, SoupBuffer *request)
+{
+    GPtrArray *names = g_ptr_array_new ();
+    GPtrArray *values = g_ptr_array_new ();
+    GPtrArray *headers[2] = { names, values };
+    gboolean written;
+
+    soup_message_headers_foreach (msg->request_headers,
+                                  soup_append_frame_header, headers);
+    if (transaction_id != NULL) {
+        g_ptr_array_add (names, "transaction-id");
+        g_ptr_array_add (values, (gpointer) transaction_id);
+    }
+    g_ptr_array_add (names, "rstrnt-path");
+    g_ptr_array_add (values, (gpointer) path);
+    g_ptr_array_add (names, "rstrnt-method");
+    g_ptr_array_add (values, (gpointer) msg->method);
+
+    // The body goes out as is, logs don't need base64 and forms are
+    // decoded by the client.
+    written = write_frame (names, values, request->data, request->length);
+
+    g_ptr_array_free (names, TRUE);
+    g_ptr_array_free (values, TRUE);
+
+    return written;
+}
+
 void
 restraint_stdout_message (SoupSession *session,
                           SoupMessage *msg,
@@ -192,8 +367,33 @@ restraint_stdout_message (SoupSession *session,
     message_data->msg = msg;
     message_data->user_data = user_data;
     message_data->finish_callback = finish_callback;
+    message_account (msg);
+
+    if (client_data != NULL && stdout_framing == RSTRNT_FRAMING_BINARY) {
+        SoupURI *uri = soup_message_get_uri (msg);
+        const gchar *path = soup_uri_get_path (uri);
+        gchar *transaction_id_string = NULL;
+
+        if (g_strcmp0 (msg->method, "POST") == 0) {
+            transaction_id_string = g_strdup_printf("%jd", (intmax_t) transaction_id);
+
+            gchar *location_url = g_strdup_printf ("%s%s", path, transaction_id_string);
+            soup_message_headers_append (msg->response_headers, "Location", location_url);
+            g_free (location_url);
 
-    if (client_data != NULL) {
+            transaction_id++;
+        }
+        SoupBuffer *request = soup_message_body_flatten (msg->request_body);
+        // The caller sees an error rather than its message going nowhere
+        if (stdout_message_frame (msg, path, transaction_id_string, request)) {
+            soup_message_set_status (msg, SOUP_STATUS_OK);
+        } else {
+            soup_message_set_status_full (msg, SOUP_STATUS_REQUEST_ENTITY_TOO_LARGE,
+                                          "Message not written to the client");
+        }
+        soup_buffer_free (request);
+        g_free (transaction_id_string);
+    } else if (client_data != NULL) {
         struct json_object *jobj;
         struct json_object *jobj_headers;
         struct json_object *jobj_body;
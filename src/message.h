@@ -18,6 +18,8 @@
 #ifndef _RESTRAINT_MESSAGE_H
 #define _RESTRAINT_MESSAGE_H
 
+#include "frame.h"
+
 typedef void (*MessageFinishCallback)   (SoupSession *session,
                                          SoupMessage *msg,
                                          gpointer user_data);
@@ -35,6 +37,8 @@ typedef struct {
     SoupMessage *client_msg;
     SoupServer *server;
     gpointer user_data;
+    /* Task the request is for, when it is for one */
+    gpointer task;
 } ClientData;
 
 typedef struct {
@@ -48,8 +52,34 @@ typedef struct {
     MessageFinishCallback finish_callback;
     // Delay requeue by this many seconds.
     guint delay;
+    // Monotonic time it was queued at, kept across retries.
+    gint64 queued_at;
 } MessageData;
 
+/* What a message is for, going by the path it is sent to. */
+typedef enum {
+    MESSAGE_KIND_TASK_LOG,
+    MESSAGE_KIND_HARNESS_LOG,
+    MESSAGE_KIND_LOG,
+    MESSAGE_KIND_RESULT,
+    MESSAGE_KIND_STATUS,
+    MESSAGE_KIND_WATCHDOG,
+    MESSAGE_KIND_OTHER,
+    MESSAGE_KINDS,
+} MessageKind;
+
+typedef struct {
+    // Messages waiting to be sent, and for how long in usec the oldest has.
+    guint queue_length;
+    gint64 queue_age;
+    // Messages sent and their body bytes, counting each retry.
+    guint64 requests[MESSAGE_KINDS];
+    guint64 bytes[MESSAGE_KINDS];
+    guint64 retries;
+    // Seconds the last failed message is held back, 0 once one succeeds.
+    guint retry_delay;
+} MessageStats;
+
 void restraint_queue_message (SoupSession *session,
                               SoupMessage *msg,
                               gpointer msg_data,
@@ -64,5 +94,14 @@ void restraint_stdout_message (SoupSession *session,
                                GCancellable *cancellable,
                                gpointer user_data);
 
+/*
+ * Select how restraint_stdout_message() writes messages.  Switching to
+ * RSTRNT_FRAMING_BINARY announces it to the client first.
+ */
+void restraint_stdout_set_framing (RstrntFraming framing);
+
 void restraint_close_message (gpointer msg_data);
+
+void restraint_message_get_stats (MessageStats *stats);
+const gchar *restraint_message_kind_name (MessageKind kind);
 #endif
@@ -42,12 +42,25 @@ typedef struct _MetadataData {
     void *user_data;
 } MetadataData;
 
+/*
+ * A cache entry is the parsed metadata as a GVariant, with the size and
+ * checksum of the file it was parsed from.  mtimes aren't trusted as
+ * fetching a task again resets them.
+ */
+#define METADATA_CACHE_VERSION 2
+#define METADATA_CACHE_TYPE "(ustsmsmsasasasa(ss)xbbbmsms)"
+
+static gchar *metadata_cache_dir = METADATA_CACHE_DIR;
+static gboolean metadata_cache_dir_set = FALSE;
+
 void
 restraint_metadata_free (MetaData *metadata)
 {
     if (metadata) {
         g_free(metadata->name);
         g_free(metadata->entry_point);
+        g_free(metadata->memory_max);
+        g_free(metadata->cpu_max);
         g_slist_free_full (metadata->dependencies, g_free);
         g_slist_free_full (metadata->softdependencies, g_free);
         g_slist_free_full (metadata->repodeps, g_free);
@@ -56,6 +69,199 @@ restraint_metadata_free (MetaData *metadata)
     }
 }
 
+void
+restraint_metadata_set_cache_dir (const gchar *dir)
+{
+    if (metadata_cache_dir_set) {
+        g_free (metadata_cache_dir);
+    }
+    metadata_cache_dir = g_strdup (dir);
+    metadata_cache_dir_set = TRUE;
+}
+
+/* One entry for each task path, osmajor and file parsed. */
+static gchar *
+metadata_cache_filename (const gchar *path, const gchar *osmajor,
+                         const gchar *source)
+{
+    gchar *key = g_strjoin ("\n", path, osmajor ? osmajor : "", source, NULL);
+    gchar *checksum = g_compute_checksum_for_string (G_CHECKSUM_SHA256, key, -1);
+    gchar *filename = g_build_filename (metadata_cache_dir, checksum, NULL);
+
+    g_free (checksum);
+    g_free (key);
+    return filename;
+}
+
+static gchar *
+metadata_cache_checksum (const gchar *path, const gchar *source, guint64 *size)
+{
+    gchar *filename = g_build_filename (path, source, NULL);
+    gchar *contents = NULL;
+    gsize length;
+    gchar *checksum = NULL;
+
+    if (g_file_get_contents (filename, &contents, &length, NULL)) {
+        checksum = g_compute_checksum_for_data (G_CHECKSUM_SHA256,
+                                                (const guchar *) contents,
+                                                length);
+        *size = length;
+    }
+    g_free (contents);
+    g_free (filename);
+    return checksum;
+}
+
+static GVariant *
+metadata_strings_to_variant (GSList *strings)
+{
+    GVariantBuilder builder;
+
+    g_variant_builder_init (&builder, G_VARIANT_TYPE ("as"));
+    for (GSList *item = strings; item != NULL; item = item->next) {
+        g_variant_builder_add (&builder, "s", item->data);
+    }
+    return g_variant_builder_end (&builder);
+}
+
+static GSList *
+metadata_strings_from_strv (gchar **strv)
+{
+    GSList *strings = NULL;
+
+    for (gchar **string = strv; *string != NULL; string++) {
+        strings = g_slist_prepend (strings, *string);
+    }
+    // The strings now belong to the list.
+    g_free (strv);
+    return g_slist_reverse (strings);
+}
+
+static void
+metadata_cache_store (const gchar *path, const gchar *osmajor,
+                      const gchar *source, MetaData *metadata)
+{
+    GVariantBuilder envvars;
+    GVariant *entry;
+    gchar *filename;
+    gchar *checksum;
+    guint64 size;
+    GError *error = NULL;
+
+    if (metadata == NULL || metadata_cache_dir == NULL) {
+        return;
+    }
+    checksum = metadata_cache_checksum (path, source, &size);
+    if (checksum == NULL) {
+        return;
+    }
+
+    g_variant_builder_init (&envvars, G_VARIANT_TYPE ("a(ss)"));
+    for (GSList *item = metadata->envvars; item != NULL; item = item->next) {
+        Param *param = item->data;
+        g_variant_builder_add (&envvars, "(ss)", param->name, param->value);
+    }
+    entry = g_variant_ref_sink (
+        g_variant_new ("(ustsmsms@as@as@asa(ss)xbbbmsms)",
+                       METADATA_CACHE_VERSION, source,
+                       size, checksum, metadata->name, metadata->entry_point,
+                       metadata_strings_to_variant (metadata->dependencies),
+                       metadata_strings_to_variant (metadata->softdependencies),
+                       metadata_strings_to_variant (metadata->repodeps),
+                       &envvars, metadata->max_time,
+                       metadata->nolocalwatchdog, metadata->use_pty,
+                       metadata->parallel, metadata->memory_max,
+                       metadata->cpu_max));
+
+    filename = metadata_cache_filename (path, osmajor, source);
+    if (g_mkdir_with_parents (metadata_cache_dir, 0755) < 0 ||
+        !g_file_set_contents (filename, g_variant_get_data (entry),
+                              g_variant_get_size (entry), &error)) {
+        // Only costs a parse next time.
+        g_debug ("Unable to cache metadata of %s: %s", path,
+                 error != NULL ? error->message : g_strerror (errno));
+        g_clear_error (&error);
+    }
+
+    g_free (filename);
+    g_free (checksum);
+    g_variant_unref (entry);
+}
+
+static MetaData *
+metadata_cache_lookup (const gchar *path, const gchar *osmajor,
+                       const gchar *source)
+{
+    gchar *filename;
+    gchar *contents = NULL;
+    gsize length;
+    GVariant *entry = NULL;
+    MetaData *metadata = NULL;
+    guint32 version;
+    const gchar *entry_source;
+    guint64 entry_size, size;
+    const gchar *entry_checksum;
+    gchar *checksum = NULL;
+    gchar **dependencies, **softdependencies, **repodeps;
+    GVariantIter *envvars;
+    gchar *name, *value;
+
+    if (metadata_cache_dir == NULL) {
+        return NULL;
+    }
+    filename = metadata_cache_filename (path, osmajor, source);
+    if (!g_file_get_contents (filename, &contents, &length, NULL)) {
+        goto out;
+    }
+    // Not trusted, GVariant copes with whatever is in the file.
+    entry = g_variant_ref_sink (
+        g_variant_new_from_data (G_VARIANT_TYPE (METADATA_CACHE_TYPE),
+                                 contents, length, FALSE, g_free, contents));
+    contents = NULL;
+
+    g_variant_get_child (entry, 0, "u", &version);
+    g_variant_get_child (entry, 1, "&s", &entry_source);
+    g_variant_get_child (entry, 2, "t", &entry_size);
+    g_variant_get_child (entry, 3, "&s", &entry_checksum);
+    if (version != METADATA_CACHE_VERSION || g_strcmp0 (entry_source, source) != 0) {
+        goto out;
+    }
+    checksum = metadata_cache_checksum (path, source, &size);
+    if (checksum == NULL || size != entry_size ||
+        g_strcmp0 (checksum, entry_checksum) != 0) {
+        goto out;
+    }
+
+    metadata = g_slice_new0 (MetaData);
+    g_variant_get (entry, "(ustsmsms^as^as^asa(ss)xbbbmsms)",
+                   NULL, NULL, NULL, NULL,
+                   &metadata->name, &metadata->entry_point,
+                   &dependencies, &softdependencies, &repodeps, &envvars,
+                   &metadata->max_time, &metadata->nolocalwatchdog,
+                   &metadata->use_pty, &metadata->parallel,
+                   &metadata->memory_max, &metadata->cpu_max);
+    metadata->dependencies = metadata_strings_from_strv (dependencies);
+    metadata->softdependencies = metadata_strings_from_strv (softdependencies);
+    metadata->repodeps = metadata_strings_from_strv (repodeps);
+    while (g_variant_iter_next (envvars, "(ss)", &name, &value)) {
+        Param *param = restraint_param_new ();
+        param->name = name;
+        param->value = value;
+        metadata->envvars = g_slist_prepend (metadata->envvars, param);
+    }
+    metadata->envvars = g_slist_reverse (metadata->envvars);
+    g_variant_iter_free (envvars);
+
+out:
+    if (entry != NULL) {
+        g_variant_unref (entry);
+    }
+    g_free (contents);
+    g_free (checksum);
+    g_free (filename);
+    return metadata;
+}
+
 MetaData *
 restraint_parse_metadata (gchar *filename,
                           gchar *locale,
@@ -251,6 +457,40 @@ restraint_parse_metadata (gchar *filename,
     }
     g_clear_error (&tmp_error);
 
+    metadata->parallel = g_key_file_get_boolean (keyfile,
+                                                 "restraint",
+                                                 "parallel",
+                                                 &tmp_error);
+
+    if (tmp_error && tmp_error->code != G_KEY_FILE_ERROR_KEY_NOT_FOUND) {
+        g_propagate_error(error, tmp_error);
+        goto error;
+    }
+    g_clear_error (&tmp_error);
+
+    // Limits for the task's cgroup, written as is to memory.max and cpu.max
+    metadata->memory_max = g_key_file_get_locale_string (keyfile,
+                                                         "restraint",
+                                                         "memory_max",
+                                                         locale,
+                                                         &tmp_error);
+    if (tmp_error && tmp_error->code != G_KEY_FILE_ERROR_KEY_NOT_FOUND) {
+        g_propagate_error(error, tmp_error);
+        goto error;
+    }
+    g_clear_error (&tmp_error);
+
+    metadata->cpu_max = g_key_file_get_locale_string (keyfile,
+                                                      "restraint",
+                                                      "cpu_max",
+                                                      locale,
+                                                      &tmp_error);
+    if (tmp_error && tmp_error->code != G_KEY_FILE_ERROR_KEY_NOT_FOUND) {
+        g_propagate_error(error, tmp_error);
+        goto error;
+    }
+    g_clear_error (&tmp_error);
+
     g_key_file_free(keyfile);
 
     return metadata;
@@ -510,14 +750,41 @@ static void mktinfo_cb(gint pid_result, gboolean localwatchdog,
     if (error || !file_exists(testinfo_file)) {
         mtdata->finish_cb(mtdata->user_data, error);
     } else {
-        restraint_get_metadata(mtdata->path, mtdata->osmajor, mtdata->metadata,
-                               mtdata->cancellable, mtdata->finish_cb,
-                               mtdata->io_callback, mtdata->user_data);
+        *mtdata->metadata = restraint_parse_testinfo(testinfo_file, &error);
+        // Keyed on the Makefile, so next time make isn't run at all.
+        metadata_cache_store(mtdata->path, mtdata->osmajor, "Makefile",
+                             *mtdata->metadata);
+        mtdata->finish_cb(mtdata->user_data, error);
     }
     g_free (testinfo_file);
     g_slice_free(MetadataData, mtdata);
 }
 
+/* Parses source in path, or takes it from the cache. */
+static MetaData *
+metadata_parse_cached (char *path, char *osmajor, const gchar *source,
+                       GError **error)
+{
+    gchar *filename;
+    MetaData *metadata;
+
+    metadata = metadata_cache_lookup(path, osmajor, source);
+    if (metadata != NULL) {
+        return metadata;
+    }
+
+    filename = g_build_filename(path, source, NULL);
+    if (g_strcmp0(source, "metadata") == 0) {
+        metadata = restraint_parse_metadata(filename, osmajor, error);
+    } else {
+        metadata = restraint_parse_testinfo(filename, error);
+    }
+    metadata_cache_store(path, osmajor, source, metadata);
+    g_free(filename);
+
+    return metadata;
+}
+
 gboolean restraint_get_metadata(char *path, char *osmajor, MetaData **metadata,
                                 GCancellable *cancellable,
                                 metadata_cb finish_cb,
@@ -530,12 +797,17 @@ gboolean restraint_get_metadata(char *path, char *osmajor, MetaData **metadata,
 
     if (file_exists(metadata_file)) {
         ret = FALSE;
-        *metadata = restraint_parse_metadata(metadata_file, osmajor, &error);
+        *metadata = metadata_parse_cached(path, osmajor, "metadata", &error);
         finish_cb(user_data, error);
     } else if (file_exists(testinfo_file)) {
         ret = TRUE;
-        *metadata = restraint_parse_testinfo(testinfo_file, &error);
+        *metadata = metadata_parse_cached(path, osmajor, "testinfo.desc",
+                                          &error);
         finish_cb(user_data, error);
+    } else if ((*metadata = metadata_cache_lookup(path, osmajor,
+                                                  "Makefile")) != NULL) {
+        ret = TRUE;
+        finish_cb(user_data, NULL);
     } else {
         ret = TRUE;
 
@@ -551,7 +823,7 @@ gboolean restraint_get_metadata(char *path, char *osmajor, MetaData **metadata,
 
         process_run(command, NULL, path, FALSE, 0,
                     NULL, mktinfo_io_callback, mktinfo_cb,
-                    NULL, 0, FALSE, cancellable, mtdata);
+                    NULL, 0, FALSE, cancellable, NULL, NULL, mtdata);
     }
 
     g_free (testinfo_file);
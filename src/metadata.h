@@ -38,13 +38,29 @@ typedef struct {
     gboolean nolocalwatchdog;
     /* Use pty when running task */
     gboolean use_pty;
+    /* The task can run alongside other parallel tasks, with --task-slots */
+    gboolean parallel;
+    /* memory.max and cpu.max of the task's cgroup, NULL to leave unlimited */
+    gchar *memory_max;
+    gchar *cpu_max;
 } MetaData;
 
 typedef void (*metadata_cb) (gpointer user_data, GError *error);
 
+#define METADATA_CACHE_DIR "/var/lib/restraint/metadata"
+
 MetaData* restraint_parse_metadata (gchar *filename, gchar *locale, GError **error);
 MetaData* restraint_parse_testinfo (gchar *filename, GError **error);
 void restraint_metadata_free (MetaData *metadata);
+
+/*
+ * restraint_get_metadata() keeps what it parses in dir, by task path and
+ * the contents of the file it came from, so that a task resumed after a
+ * reboot or another task in the same directory doesn't parse it again or
+ * run make testinfo.desc.  NULL turns the cache off, it defaults to
+ * METADATA_CACHE_DIR.
+ */
+void restraint_metadata_set_cache_dir (const gchar *dir);
 gboolean restraint_get_metadata(char *path, char *osmajor, MetaData **metadata,
                                 GCancellable *cancellable,
                                 metadata_cb finish_cb, GIOFunc io_callback,
@@ -0,0 +1,240 @@
+/*
+    This file is part of Restraint.
+
+    Restraint is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Restraint is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Restraint.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <glib.h>
+#include <stdlib.h>
+#include <string.h>
+#include "metrics.h"
+
+static const gchar *metric_types[] = {
+    [RSTRNT_METRIC_COUNTER] = "counter",
+    [RSTRNT_METRIC_GAUGE] = "gauge",
+    [RSTRNT_METRIC_SUMMARY] = "summary",
+    [RSTRNT_METRIC_HISTOGRAM] = "histogram",
+};
+
+static const gdouble summary_quantiles[] = { 0.5, 0.9, 0.99 };
+
+typedef struct {
+    RstrntSummary *summary;
+    gint64 due;
+    guint interval;
+} LoopProbe;
+
+void
+rstrnt_metrics_describe (GString *out,
+                         const gchar *name,
+                         RstrntMetricType type,
+                         const gchar *help)
+{
+    g_string_append_printf (out, "# HELP %s %s\n", name, help);
+    g_string_append_printf (out, "# TYPE %s %s\n", name, metric_types[type]);
+}
+
+static void
+append_value (GString *out, gdouble value)
+{
+    gchar buffer[G_ASCII_DTOSTR_BUF_SIZE];
+
+    // Never the locale's decimal point
+    g_string_append (out, g_ascii_dtostr (buffer, sizeof (buffer), value));
+}
+
+void
+rstrnt_metrics_append (GString *out,
+                       const gchar *name,
+                       const gchar *label,
+                       const gchar *label_value,
+                       gdouble value)
+{
+    g_string_append (out, name);
+    if (label != NULL) {
+        g_string_append_printf (out, "{%s=\"", label);
+        for (const gchar *c = label_value; *c != '\0'; c++) {
+            switch (*c) {
+                case '\\':
+                    g_string_append (out, "\\\\");
+                    break;
+                case '"':
+                    g_string_append (out, "\\\"");
+                    break;
+                case '\n':
+                    g_string_append (out, "\\n");
+                    break;
+                default:
+                    g_string_append_c (out, *c);
+            }
+        }
+        g_string_append (out, "\"}");
+    }
+    g_string_append_c (out, ' ');
+    append_value (out, value);
+    g_string_append_c (out, '\n');
+}
+
+void
+rstrnt_summary_observe (RstrntSummary *summary,
+                        gdouble value)
+{
+    summary->samples[summary->next] = value;
+    summary->next = (summary->next + 1) % METRICS_SUMMARY_SAMPLES;
+    summary->count++;
+    summary->sum += value;
+}
+
+static gint
+compare_samples (const void *a, const void *b)
+{
+    gdouble first = *(const gdouble *) a;
+    gdouble second = *(const gdouble *) b;
+
+    return (first > second) - (first < second);
+}
+
+gdouble
+rstrnt_summary_quantile (const RstrntSummary *summary,
+                         gdouble quantile)
+{
+    gsize n_samples = MIN (summary->count, METRICS_SUMMARY_SAMPLES);
+    gdouble sorted[METRICS_SUMMARY_SAMPLES];
+    gsize rank;
+
+    if (n_samples == 0) {
+        return 0;
+    }
+
+    // Nearest rank over whatever is in the ring, which order doesn't matter
+    memcpy (sorted, summary->samples, n_samples * sizeof (gdouble));
+    qsort (sorted, n_samples, sizeof (gdouble), compare_samples);
+    rank = (gsize) (quantile * n_samples);
+    if (rank < quantile * n_samples) {
+        rank++;
+    }
+
+    return sorted[rank > 0 ? rank - 1 : 0];
+}
+
+void
+rstrnt_metrics_append_summary (GString *out,
+                               const gchar *name,
+                               const RstrntSummary *summary)
+{
+    gchar *sum_name = g_strconcat (name, "_sum", NULL);
+    gchar *count_name = g_strconcat (name, "_count", NULL);
+
+    for (gsize i = 0; i < G_N_ELEMENTS (summary_quantiles); i++) {
+        gchar quantile[G_ASCII_DTOSTR_BUF_SIZE];
+
+        g_ascii_formatd (quantile, sizeof (quantile), "%g", summary_quantiles[i]);
+        rstrnt_metrics_append (out, name, "quantile", quantile,
+                               rstrnt_summary_quantile (summary,
+                                                        summary_quantiles[i]));
+    }
+    rstrnt_metrics_append (out, sum_name, NULL, NULL, summary->sum);
+    rstrnt_metrics_append (out, count_name, NULL, NULL, summary->count);
+
+    g_free (count_name);
+    g_free (sum_name);
+}
+
+RstrntHistogram *
+rstrnt_histogram_new (const gdouble *bounds,
+                      guint n_bounds)
+{
+    RstrntHistogram *histogram = g_slice_new0 (RstrntHistogram);
+
+    histogram->bounds = bounds;
+    histogram->n_bounds = n_bounds;
+    histogram->counts = g_new0 (guint64, n_bounds + 1);
+
+    return histogram;
+}
+
+void
+rstrnt_histogram_observe (RstrntHistogram *histogram,
+                          gdouble value)
+{
+    guint bucket = 0;
+
+    while (bucket < histogram->n_bounds && value > histogram->bounds[bucket]) {
+        bucket++;
+    }
+    histogram->counts[bucket]++;
+    histogram->count++;
+    histogram->sum += value;
+}
+
+void
+rstrnt_histogram_free (RstrntHistogram *histogram)
+{
+    g_free (histogram->counts);
+    g_slice_free (RstrntHistogram, histogram);
+}
+
+void
+rstrnt_metrics_append_histogram (GString *out,
+                                 const gchar *name,
+                                 const RstrntHistogram *histogram)
+{
+    gchar *bucket_name = g_strconcat (name, "_bucket", NULL);
+    gchar *sum_name = g_strconcat (name, "_sum", NULL);
+    gchar *count_name = g_strconcat (name, "_count", NULL);
+    guint64 cumulative = 0;
+
+    for (guint i = 0; i < histogram->n_bounds; i++) {
+        gchar bound[G_ASCII_DTOSTR_BUF_SIZE];
+
+        cumulative += histogram->counts[i];
+        g_ascii_formatd (bound, sizeof (bound), "%g", histogram->bounds[i]);
+        rstrnt_metrics_append (out, bucket_name, "le", bound, cumulative);
+    }
+    rstrnt_metrics_append (out, bucket_name, "le", "+Inf", histogram->count);
+    rstrnt_metrics_append (out, sum_name, NULL, NULL, histogram->sum);
+    rstrnt_metrics_append (out, count_name, NULL, NULL, histogram->count);
+
+    g_free (count_name);
+    g_free (sum_name);
+    g_free (bucket_name);
+}
+
+static gboolean
+loop_probe_callback (gpointer user_data)
+{
+    LoopProbe *probe = user_data;
+    gint64 now = g_get_monotonic_time ();
+
+    rstrnt_summary_observe (probe->summary,
+                            MAX (now - probe->due, 0) / (gdouble) G_USEC_PER_SEC);
+    // The timeout is rearmed from when it is dispatched
+    probe->due = now + probe->interval * 1000;
+
+    return G_SOURCE_CONTINUE;
+}
+
+guint
+rstrnt_metrics_probe_loop (RstrntSummary *summary,
+                           guint interval)
+{
+    LoopProbe *probe = g_new0 (LoopProbe, 1);
+
+    probe->summary = summary;
+    probe->interval = interval;
+    probe->due = g_get_monotonic_time () + interval * 1000;
+
+    return g_timeout_add_full (G_PRIORITY_DEFAULT, interval,
+                               loop_probe_callback, probe, g_free);
+}
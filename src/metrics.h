@@ -0,0 +1,142 @@
+/*
+    This file is part of Restraint.
+
+    Restraint is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Restraint is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Restraint.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef _RESTRAINT_METRICS_H
+#define _RESTRAINT_METRICS_H
+
+#include <glib.h>
+
+#define METRICS_CONTENT_TYPE "text/plain; version=0.0.4"
+// Quantiles are taken over this many of the latest observations.
+#define METRICS_SUMMARY_SAMPLES 1024
+
+typedef enum {
+    RSTRNT_METRIC_COUNTER,
+    RSTRNT_METRIC_GAUGE,
+    RSTRNT_METRIC_SUMMARY,
+    RSTRNT_METRIC_HISTOGRAM,
+} RstrntMetricType;
+
+typedef struct {
+    gdouble samples[METRICS_SUMMARY_SAMPLES];
+    guint next;
+    guint64 count;
+    gdouble sum;
+} RstrntSummary;
+
+typedef struct {
+    // Upper bounds of the buckets, ascending
+    const gdouble *bounds;
+    guint n_bounds;
+    // Observations per bucket, not cumulative, the last one above all bounds
+    guint64 *counts;
+    guint64 count;
+    gdouble sum;
+} RstrntHistogram;
+
+/**
+ * rstrnt_metrics_describe:
+ * @out: where the metrics are being written.
+ * @name: name of the metric.
+ * @type: its type.
+ * @help: what it measures.
+ *
+ * Appends the HELP and TYPE lines which must come before the samples of
+ * @name in the Prometheus text format.
+ */
+void rstrnt_metrics_describe (GString *out,
+                              const gchar *name,
+                              RstrntMetricType type,
+                              const gchar *help);
+
+/**
+ * rstrnt_metrics_append:
+ * @out: where the metrics are being written.
+ * @name: name of the metric.
+ * @label: name of its label, or %NULL for none.
+ * @label_value: value of the label, escaped here.
+ * @value: the sample.
+ */
+void rstrnt_metrics_append (GString *out,
+                            const gchar *name,
+                            const gchar *label,
+                            const gchar *label_value,
+                            gdouble value);
+
+void rstrnt_summary_observe (RstrntSummary *summary,
+                             gdouble value);
+
+/**
+ * rstrnt_summary_quantile:
+ * @summary: a #RstrntSummary.
+ * @quantile: between 0 and 1.
+ *
+ * Returns: the @quantile of the latest observations, 0 when there are
+ * none.
+ */
+gdouble rstrnt_summary_quantile (const RstrntSummary *summary,
+                                 gdouble quantile);
+
+/**
+ * rstrnt_metrics_append_summary:
+ * @out: where the metrics are being written.
+ * @name: name of the metric.
+ * @summary: its observations.
+ *
+ * Appends the 0.5, 0.9 and 0.99 quantiles of @summary along with its
+ * _sum and _count.
+ */
+void rstrnt_metrics_append_summary (GString *out,
+                                    const gchar *name,
+                                    const RstrntSummary *summary);
+
+RstrntHistogram *rstrnt_histogram_new (const gdouble *bounds,
+                                       guint n_bounds);
+
+void rstrnt_histogram_observe (RstrntHistogram *histogram,
+                               gdouble value);
+
+void rstrnt_histogram_free (RstrntHistogram *histogram);
+
+/**
+ * rstrnt_metrics_append_histogram:
+ * @out: where the metrics are being written.
+ * @name: name of the metric.
+ * @histogram: its observations.
+ *
+ * Appends the cumulative _bucket samples of @histogram, ending with the
+ * +Inf one, along with its _sum and _count.
+ */
+void rstrnt_metrics_append_histogram (GString *out,
+                                      const gchar *name,
+                                      const RstrntHistogram *histogram);
+
+/**
+ * rstrnt_metrics_probe_loop:
+ * @summary: where to observe the latency.
+ * @interval: milliseconds between probes.
+ *
+ * Observes in seconds how late a timeout on the default main context is
+ * dispatched, which is how long anything ready in the main loop waits
+ * behind the sources being dispatched.
+ *
+ * Returns: the source id of the probe.
+ */
+guint rstrnt_metrics_probe_loop (RstrntSummary *summary,
+                                 guint interval);
+
+#endif
@@ -31,3 +31,6 @@ void restraint_param_free(Param *param) {
     g_slice_free(Param, param);
 }
 
+void restraint_param_free_interned(Param *param) {
+    g_slice_free(Param, param);
+}
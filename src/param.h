@@ -28,4 +28,6 @@ typedef struct {
 
 Param *restraint_param_new(void);
 void restraint_param_free(Param *param);
+/* For a param whose name and value belong to a GStringChunk */
+void restraint_param_free_interned(Param *param);
 #endif
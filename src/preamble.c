@@ -0,0 +1,320 @@
+/*
+    This file is part of Restraint.
+
+    Restraint is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Restraint is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Restraint.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <string.h>
+#include <sys/utsname.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "preamble.h"
+
+#ifndef LOGINCTL
+#define LOGINCTL "loginctl"
+#endif
+
+#define LINGER_DIR "/var/lib/systemd/linger"
+#define REDHAT_RELEASE "/etc/redhat-release"
+#define SELINUX_ENFORCE "/sys/fs/selinux/enforce"
+#define UNCONFINED_PREFIX "unconfined_u:unconfined_r:unconfined_t:"
+#define UNCONFINED_CONTEXT UNCONFINED_PREFIX "s0-s0:c0.c1023"
+
+/* The value of name in env, or NULL */
+static const gchar *
+env_get (GPtrArray *env, const gchar *name)
+{
+    gsize length = strlen (name);
+
+    for (guint i = 0; i < env->len; i++) {
+        const gchar *var = env->pdata[i];
+
+        if (var != NULL && strncmp (var, name, length) == 0 && var[length] == '=') {
+            return var + length + 1;
+        }
+    }
+    return NULL;
+}
+
+static void
+env_set (GPtrArray *env, const gchar *name, const gchar *value)
+{
+    const gchar *old = env_get (env, name);
+
+    if (old != NULL) {
+        g_ptr_array_remove (env, (gpointer) (old - strlen (name) - 1));
+    }
+    g_ptr_array_add (env, g_strdup_printf ("%s=%s", name, value));
+}
+
+/* Sets name unless it has a value already, as 25_environment did */
+static void
+env_default (GPtrArray *env, const gchar *name, const gchar *value)
+{
+    const gchar *old = env_get (env, name);
+
+    if ((old == NULL || *old == '\0') && value != NULL) {
+        env_set (env, name, value);
+    }
+}
+
+gchar *
+rstrnt_preamble_os_major (const gchar *release)
+{
+    g_autofree gchar *line = g_strndup (release, strcspn (release, "\n"));
+    GString *major;
+    gchar *found;
+    gchar *digits;
+
+    // The last "release" followed by a space, as the greedy sed matched
+    found = g_strrstr (line, "release ");
+    if (found == NULL) {
+        return NULL;
+    }
+    major = g_string_new_len (line, found - line);
+    digits = found + strlen ("release ");
+    while (g_ascii_isdigit (*digits)) {
+        g_string_append_c (major, *digits++);
+    }
+
+    for (gchar *c = major->str; *c != '\0';) {
+        if (g_ascii_isspace (*c)) {
+            memmove (c, c + 1, strlen (c));
+        } else {
+            c++;
+        }
+    }
+    major->len = strlen (major->str);
+
+    return g_string_free (major, FALSE);
+}
+
+static void
+preamble_environment (GPtrArray *env)
+{
+    struct utsname uts;
+    g_autofree gchar *release = NULL;
+    g_autofree gchar *os_major = NULL;
+
+    env_default (env, "HOSTNAME", g_get_host_name ());
+    if (uname (&uts) == 0) {
+        env_default (env, "RSTRNT_OSARCH", uts.machine);
+    }
+    if (g_file_get_contents (REDHAT_RELEASE, &release, NULL, NULL)) {
+        os_major = rstrnt_preamble_os_major (release);
+        env_default (env, "RSTRNT_OSMAJOR", os_major);
+    }
+}
+
+#define LINGER_WAIT 10000  /* Milliseconds for logind to make the runtime dir */
+#define LINGER_POLL 100  /* Milliseconds */
+
+typedef struct {
+    gchar *runtime_dir; /* Waited for once loginctl has enabled linger */
+    guint waited;
+    PreambleCallback callback;
+    gpointer user_data;
+} LingerData;
+
+static gchar *
+linger_runtime_dir (void)
+{
+    return g_strdup_printf ("/run/user/%u", (guint) getuid ());
+}
+
+/* Whether linger is to be flipped, as RSTRNT_DISABLE_LINGER is set and it's on */
+static gboolean
+linger_change (GPtrArray *env, gboolean *lingering)
+{
+    g_autofree gchar *linger = g_build_filename (LINGER_DIR, g_get_user_name (), NULL);
+    const gchar *disable = env_get (env, "RSTRNT_DISABLE_LINGER");
+
+    *lingering = g_file_test (linger, G_FILE_TEST_EXISTS);
+    return (disable != NULL && *disable != '\0') == *lingering;
+}
+
+static void
+linger_data_finish (LingerData *data)
+{
+    data->callback (data->user_data);
+    g_free (data->runtime_dir);
+    g_slice_free (LingerData, data);
+}
+
+static gboolean
+linger_poll (gpointer user_data)
+{
+    LingerData *data = (LingerData *) user_data;
+
+    if (!g_file_test (data->runtime_dir, G_FILE_TEST_IS_DIR)) {
+        data->waited += LINGER_POLL;
+        if (data->waited < LINGER_WAIT) {
+            return G_SOURCE_CONTINUE;
+        }
+        g_warning ("%s did not appear after enabling linger", data->runtime_dir);
+    }
+    linger_data_finish (data);
+    return G_SOURCE_REMOVE;
+}
+
+static void
+linger_exited (GPid pid, gint status, gpointer user_data)
+{
+    LingerData *data = (LingerData *) user_data;
+
+    g_spawn_close_pid (pid);
+    if (!WIFEXITED (status) || WEXITSTATUS (status) != 0) {
+        g_warning ("loginctl failed to change linger, status %d", status);
+        g_clear_pointer (&data->runtime_dir, g_free);
+    }
+    if (data->runtime_dir == NULL ||
+            g_file_test (data->runtime_dir, G_FILE_TEST_IS_DIR)) {
+        linger_data_finish (data);
+        return;
+    }
+    g_timeout_add (LINGER_POLL, linger_poll, data);
+}
+
+/*
+ * Lets the user's session bus start without a login, as 05_linger did.
+ * The environment is set up here; rstrnt_preamble_linger () runs loginctl.
+ */
+static void
+preamble_linger (GPtrArray *env)
+{
+    g_autofree gchar *loginctl = g_find_program_in_path (LOGINCTL);
+    g_autofree gchar *runtime_dir = NULL;
+    gboolean lingering;
+
+    if (loginctl == NULL) {
+        return;
+    }
+    if (linger_change (env, &lingering) && lingering) {
+        return;
+    }
+    runtime_dir = linger_runtime_dir ();
+    env_set (env, "XDG_RUNTIME_DIR", runtime_dir);
+}
+
+gboolean
+rstrnt_preamble_linger (GPtrArray *env, PreambleCallback callback, gpointer user_data)
+{
+    g_autofree gchar *loginctl = NULL;
+    const gchar *argv[] = { NULL, NULL, g_get_user_name (), NULL };
+    LingerData *data;
+    GError *error = NULL;
+    gboolean lingering;
+    GPid pid;
+
+    g_return_val_if_fail (env != NULL, FALSE);
+    g_return_val_if_fail (callback != NULL, FALSE);
+
+    loginctl = g_find_program_in_path (LOGINCTL);
+    if (loginctl == NULL || !linger_change (env, &lingering)) {
+        return FALSE;
+    }
+    argv[0] = loginctl;
+    argv[1] = lingering ? "disable-linger" : "enable-linger";
+    if (!g_spawn_async (NULL, (gchar **) argv, NULL,
+                        G_SPAWN_DO_NOT_REAP_CHILD | G_SPAWN_STDOUT_TO_DEV_NULL |
+                        G_SPAWN_STDERR_TO_DEV_NULL,
+                        NULL, NULL, &pid, &error)) {
+        g_warning ("Failed to run %s: %s", argv[1], error->message);
+        g_clear_error (&error);
+        return FALSE;
+    }
+
+    data = g_slice_new0 (LingerData);
+    data->runtime_dir = lingering ? NULL : linger_runtime_dir ();
+    data->callback = callback;
+    data->user_data = user_data;
+    g_child_watch_add (pid, linger_exited, data);
+    return TRUE;
+}
+
+static void
+preamble_beakerlib (GPtrArray *env)
+{
+    const gchar *testid = env_get (env, "TESTID");
+
+    env_set (env, "BEAKERLIB_COMMAND_REPORT_RESULT", "/usr/bin/rstrnt-report-result --rhts");
+    env_set (env, "BEAKERLIB_COMMAND_SUBMIT_LOG", "/usr/bin/rstrnt-report-log");
+
+    // Whatever beakerlib kept from before is stale unless the task rebooted
+    if (testid != NULL && g_strcmp0 (env_get (env, "REBOOTCOUNT"), "0") == 0) {
+        g_autofree gchar *dir = g_strdup_printf ("/var/tmp/beakerlib-%s", testid);
+        GDir *entries = g_dir_open (dir, 0, NULL);
+        const gchar *name;
+
+        if (entries == NULL) {
+            return;
+        }
+        while ((name = g_dir_read_name (entries)) != NULL) {
+            gchar *path;
+
+            if (name[0] == '.') {
+                continue;
+            }
+            path = g_build_filename (dir, name, NULL);
+            g_unlink (path);
+            g_free (path);
+        }
+        g_dir_close (entries);
+    }
+}
+
+void
+rstrnt_preamble_env (GPtrArray *env)
+{
+    g_return_if_fail (env != NULL);
+
+    preamble_linger (env);
+    preamble_beakerlib (env);
+    preamble_environment (env);
+    env_set (env, "RSTRNT_NATIVE_PLUGINS", PREAMBLE_PLUGINS);
+}
+
+/* The context 20_unconfined switched to, if SELinux is on and we're not in it */
+static const gchar *
+unconfined_context (void)
+{
+    g_autofree gchar *current = NULL;
+
+    if (!g_file_test (SELINUX_ENFORCE, G_FILE_TEST_EXISTS)) {
+        return NULL;
+    }
+    if (g_file_get_contents ("/proc/self/attr/current", &current, NULL, NULL) &&
+        g_str_has_prefix (current, UNCONFINED_PREFIX)) {
+        return NULL;
+    }
+    return UNCONFINED_CONTEXT;
+}
+
+const ProcessPreamble *
+rstrnt_preamble_get (gboolean plugins)
+{
+    static ProcessPreamble task_preamble = { .setsid = TRUE, .reset_oom_score = TRUE };
+    static ProcessPreamble plugin_preamble = { .setsid = TRUE };
+    static gsize initialized = 0;
+
+    if (g_once_init_enter (&initialized)) {
+        task_preamble.exec_context = unconfined_context ();
+        plugin_preamble.exec_context = task_preamble.exec_context;
+        g_once_init_leave (&initialized, 1);
+    }
+
+    return plugins ? &plugin_preamble : &task_preamble;
+}
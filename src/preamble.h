@@ -0,0 +1,77 @@
+/*
+    This file is part of Restraint.
+
+    Restraint is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Restraint is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Restraint.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef _RESTRAINT_PREAMBLE_H
+#define _RESTRAINT_PREAMBLE_H
+
+#include <glib.h>
+
+#include "process.h"
+
+/* The task_run.d plugins whose work restraintd does with --native-preamble */
+#define PREAMBLE_PLUGINS "05_linger 10_bash_login 15_beakerlib 20_unconfined " \
+                         "25_environment 35_oom_adj"
+
+/**
+ * rstrnt_preamble_env:
+ * @env: the task's environment, as built so far.
+ *
+ * Does what 05_linger and 15_beakerlib did before the task ran and adds
+ * what they and 25_environment exported to @env.  RSTRNT_NATIVE_PLUGINS
+ * tells run_task_plugins to skip them.
+ */
+void rstrnt_preamble_env (GPtrArray *env);
+
+typedef void (*PreambleCallback) (gpointer user_data);
+
+/**
+ * rstrnt_preamble_linger:
+ * @env: the task's environment, from rstrnt_preamble_env().
+ * @callback: called once loginctl has finished and, when it enabled
+ *   linger, logind has made the XDG_RUNTIME_DIR @env points at.
+ * @user_data: passed to @callback.
+ *
+ * Enables or disables linger for the user, as 05_linger did, without
+ * holding up the main loop.  The task must not run before @callback.
+ *
+ * Returns: %TRUE if @callback will be called, %FALSE if linger was
+ * left as it was.
+ */
+gboolean rstrnt_preamble_linger (GPtrArray *env, PreambleCallback callback,
+                                 gpointer user_data);
+
+/**
+ * rstrnt_preamble_get:
+ * @plugins: %TRUE for plugins, which keep restraintd's OOM score
+ *   adjustment as they did with 35_oom_adj.
+ *
+ * Returns: what 10_bash_login, 20_unconfined and 35_oom_adj did to the
+ * process, for process_run().
+ */
+const ProcessPreamble *rstrnt_preamble_get (gboolean plugins);
+
+/**
+ * rstrnt_preamble_os_major:
+ * @release: contents of /etc/redhat-release.
+ *
+ * Returns: RSTRNT_OSMAJOR as 25_environment guessed it, such as
+ * "RedHatEnterpriseLinux9" from "Red Hat Enterprise Linux release 9.2
+ * (Plow)", or %NULL.
+ */
+gchar *rstrnt_preamble_os_major (const gchar *release);
+
+#endif
@@ -15,19 +15,69 @@
     along with Restraint.  If not, see <http://www.gnu.org/licenses/>.
 */
 
+#define _GNU_SOURCE
+
 #include <glib.h>
 #include <glib/gstdio.h>
+#include <glib-unix.h>
 #include <stdlib.h>
 #include <errno.h>
 #include <sys/types.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
 #include <unistd.h>
 #include <pty.h>
+#include <utmp.h>
 #include <fcntl.h>
 #include <stdio.h>
+#include <string.h>
 #include <signal.h>
+#include <sched.h>
+#include <pthread.h>
 #include "common.h"
 #include "process.h"
 
+/* The child only runs the preamble below on it before exec */
+#define SPAWN_STACK_SIZE (64 * 1024)
+
+/* Default search path of execvp() when the environment has no PATH */
+#define SPAWN_DEFAULT_PATH "/bin:/usr/bin"
+
+/*
+ * Everything the spawn preamble needs, prepared by the parent.  The child
+ * shares the parent's memory until it execs, so it can neither allocate
+ * nor take locks, and it reports why it couldn't exec through here.
+ */
+typedef struct {
+    gchar **argv;
+    gchar **envp;
+    // Full paths to try in order, as execvp() would search PATH
+    gchar **candidates;
+    // /bin/sh with the command's arguments, for scripts without #!
+    gchar **sh_argv;
+    const gchar *path;
+    gchar *banner;
+    gsize banner_length;
+    gint stdin_fd;
+    gint out_fd;
+    gint pty_slave;
+    gint max_fd;
+    gboolean own_group;
+    // cgroup.procs of the cgroup to run in, or -1
+    gint cgroup_fd;
+    gboolean setsid;
+    gboolean reset_oom_score;
+    const gchar *exec_context;
+    sigset_t mask;
+    gint chdir_errno;
+    gint exec_errno;
+} SpawnPreamble;
+
+static ProcessLauncher process_launcher = PROCESS_LAUNCHER_SPAWN;
+static gboolean process_own_group = TRUE;
+static guint processes_running = 0;
+static guint64 processes_started = 0;
+
 GQuark restraint_process_error (void)
 {
     return g_quark_from_static_string("restraint-process-error-quark");
@@ -101,6 +151,9 @@ process_free (ProcessData *process_data)
                               process_data->cancel_handler);
     g_return_if_fail (process_data != NULL);
     g_clear_error (&process_data->error);
+    if (process_data->pidfd != -1) {
+        close (process_data->pidfd);
+    }
     g_strfreev (process_data->command);
     g_slice_free (ProcessData, process_data);
 }
@@ -146,12 +199,15 @@ process_io_cb (GIOChannel *io, GIOCondition condition, gpointer user_data)
  * STDIN file descriptor is returned in fd_in. If use_pty is TRUE, fd_in
  * set to -1.
  *
+ * If own_group is TRUE, the child leads a process group of its own.
+ *
  * Return values as in fork ().
  */
 pid_t
 restraint_fork (gint     *fd_out,
                 gint     *fd_in,
-                gboolean  use_pty)
+                gboolean  use_pty,
+                gboolean  own_group)
 {
     gint  pipe_in[2];  /* Child reads, parent writes */
     gint  pipe_out[2]; /* Parent reads, child writes */
@@ -184,6 +240,10 @@ restraint_fork (gint     *fd_out,
 
     pid = fork ();
 
+    // Both sides set the group, so that it exists whichever runs first.
+    if (pid >= 0 && own_group)
+        setpgid (pid, pid);
+
     if (pid == 0) {
         gint child_stdin;
 
@@ -228,6 +288,515 @@ restraint_fork (gint     *fd_out,
     return pid;
 }
 
+void
+process_set_launcher (ProcessLauncher launcher)
+{
+    process_launcher = launcher;
+}
+
+void
+process_set_own_group (gboolean own_group)
+{
+    process_own_group = own_group;
+}
+
+void
+process_get_counts (guint *running, guint64 *started)
+{
+    *running = processes_running;
+    *started = processes_started;
+}
+
+gssize
+process_splice (gint fd, gint out_fd, gint tee_fd, gsize length)
+{
+    gssize copied;
+    gssize moved = 0;
+
+    if (tee_fd == -1) {
+        return splice (fd, NULL, out_fd, NULL, length,
+                       SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+    }
+
+    // tee () leaves the bytes in fd, so exactly those are moved after it
+    copied = tee (fd, tee_fd, length, SPLICE_F_NONBLOCK);
+    while (moved < copied) {
+        gssize ret = splice (fd, NULL, out_fd, NULL, copied - moved,
+                             SPLICE_F_MOVE);
+        if (ret < 0 && errno == EINTR) {
+            continue;
+        }
+        if (ret <= 0) {
+            return moved > 0 ? moved : -1;
+        }
+        moved += ret;
+    }
+
+    return copied;
+}
+
+static gboolean
+write_all (gint fd, const gchar *data, gsize length)
+{
+    while (length > 0) {
+        ssize_t ret = write (fd, data, length);
+        if (ret < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return FALSE;
+        }
+        data += ret;
+        length -= ret;
+    }
+    return TRUE;
+}
+
+/* Async-signal-safe, for the preamble */
+static void
+write_file (const gchar *filename, const gchar *data, gsize length)
+{
+    gint fd = open (filename, O_WRONLY);
+
+    if (fd != -1) {
+        write_all (fd, data, length);
+        close (fd);
+    }
+}
+
+/*
+ * Puts the next exec back in the default context, as setexeccon (NULL)
+ * does, with a write of nothing.  Async-signal-safe.
+ */
+static void
+reset_exec_context (void)
+{
+    gint fd = open ("/proc/self/attr/exec", O_WRONLY);
+
+    if (fd != -1) {
+        while (write (fd, NULL, 0) == -1 && errno == EINTR) {
+        }
+        close (fd);
+    }
+}
+
+/* Applies what is asked of the process in preamble, in the child */
+static void
+apply_preamble (gboolean reset_oom_score, const gchar *exec_context)
+{
+    if (reset_oom_score) {
+        write_file ("/proc/self/oom_score_adj", "0", 1);
+    }
+    // Left in the default context if policy refuses this one
+    if (exec_context != NULL) {
+        write_file ("/proc/self/attr/exec", exec_context, strlen (exec_context));
+    }
+}
+
+static void
+close_inherited_fds (gint max_fd)
+{
+#ifdef SYS_close_range
+    if (syscall (SYS_close_range, 3, ~0U, 0) == 0) {
+        return;
+    }
+#endif
+    for (gint fd = 3; fd < max_fd; fd++) {
+        close (fd);
+    }
+}
+
+/* Tries the candidates as execvp() would, returning why none ran */
+static gint
+spawn_exec (SpawnPreamble *spawn)
+{
+    gboolean eacces = FALSE;
+
+    errno = ENOENT;
+    for (gchar **candidate = spawn->candidates; *candidate != NULL; candidate++) {
+        execve (*candidate, spawn->argv, spawn->envp);
+        if (errno == EACCES) {
+            eacces = TRUE;
+        } else if (errno == ENOEXEC) {
+            spawn->sh_argv[1] = *candidate;
+            execve (spawn->sh_argv[0], spawn->sh_argv, spawn->envp);
+            break;
+        } else if (errno != ENOENT && errno != ENOTDIR && errno != ESTALE &&
+                   errno != ENODEV && errno != ETIMEDOUT) {
+            break;
+        }
+    }
+    return eacces ? EACCES : errno;
+}
+
+/*
+ * Runs in the child between clone() and exec.  Only async-signal-safe
+ * calls on memory the parent prepared are allowed here.
+ */
+static int
+spawn_preamble (void *user_data)
+{
+    SpawnPreamble *spawn = user_data;
+    struct sigaction action;
+
+    // Reset every handler, and the ignored signals, before letting signals
+    // through again; see reset_signal_handlers().
+    memset (&action, 0, sizeof (action));
+    action.sa_handler = SIG_DFL;
+    for (gint sig = 1; sig < NSIG; sig++) {
+        sigaction (sig, &action, NULL);
+    }
+    sigprocmask (SIG_SETMASK, &spawn->mask, NULL);
+
+    if (spawn->pty_slave != -1) {
+        if (login_tty (spawn->pty_slave) != 0) {
+            _exit (1);
+        }
+    } else {
+        if (spawn->setsid) {
+            setsid ();
+        } else if (spawn->own_group) {
+            setpgid (0, 0);
+        }
+        dup2 (spawn->stdin_fd, STDIN_FILENO);
+        dup2 (spawn->out_fd, STDOUT_FILENO);
+        dup2 (spawn->out_fd, STDERR_FILENO);
+    }
+    if (spawn->cgroup_fd != -1) {
+        write_all (spawn->cgroup_fd, "0", 1);
+    }
+    apply_preamble (spawn->reset_oom_score, spawn->exec_context);
+    close_inherited_fds (spawn->max_fd);
+
+    if (spawn->path != NULL && chdir (spawn->path) == -1) {
+        spawn->chdir_errno = errno;
+        _exit (INVALID_COMMAND_PATH);
+    }
+
+    write_all (STDOUT_FILENO, spawn->banner, spawn->banner_length);
+
+    spawn->exec_errno = spawn_exec (spawn);
+    // Like 20_unconfined, fall back to the default context if the
+    // transition is refused
+    if (spawn->exec_errno == EACCES && spawn->exec_context != NULL) {
+        reset_exec_context ();
+        spawn->exec_errno = spawn_exec (spawn);
+    }
+    _exit (SPAWN_COMMAND_FAILED);
+}
+
+/*
+ * The files execvp() would try for command, in order.  The search uses
+ * the PATH of the environment the command gets, and relative entries are
+ * left relative so that they resolve after the chdir.
+ */
+static gchar **
+spawn_candidates (const gchar *command, gchar **envp)
+{
+    GPtrArray *candidates = g_ptr_array_new ();
+    const gchar *search_path = NULL;
+    gchar **dirs;
+
+    if (command == NULL || *command == '\0') {
+        g_ptr_array_add (candidates, NULL);
+        return (gchar **) g_ptr_array_free (candidates, FALSE);
+    }
+    if (strchr (command, '/') != NULL) {
+        g_ptr_array_add (candidates, g_strdup (command));
+        g_ptr_array_add (candidates, NULL);
+        return (gchar **) g_ptr_array_free (candidates, FALSE);
+    }
+
+    for (gchar **env = envp; env != NULL && *env != NULL; env++) {
+        if (g_str_has_prefix (*env, "PATH=")) {
+            search_path = *env + strlen ("PATH=");
+            break;
+        }
+    }
+    dirs = g_strsplit (search_path != NULL ? search_path : SPAWN_DEFAULT_PATH,
+                       ":", -1);
+    for (gchar **dir = dirs; *dir != NULL; dir++) {
+        if (**dir == '\0') {
+            g_ptr_array_add (candidates, g_strdup (command));
+        } else {
+            g_ptr_array_add (candidates, g_build_filename (*dir, command, NULL));
+        }
+    }
+    g_strfreev (dirs);
+
+    g_ptr_array_add (candidates, NULL);
+    return (gchar **) g_ptr_array_free (candidates, FALSE);
+}
+
+/* Spawn wrapper with IO redirection, the fd arguments are as for
+ * restraint_fork ().
+ *
+ * Rather than copying all of restraintd with fork () the child shares its
+ * memory, like vfork (), only until it execs, so the cost doesn't grow
+ * with restraintd's size.  Returns the pid of the child, or -1.
+ */
+static pid_t
+restraint_spawn (ProcessData *process_data,
+                 const gchar **envp,
+                 gint        *fd_out,
+                 gint        *fd_in,
+                 gboolean     use_pty,
+                 gint         cgroup_fd,
+                 const ProcessPreamble *preamble)
+{
+    SpawnPreamble spawn = {
+        .stdin_fd = -1,
+        .out_fd = -1,
+        .pty_slave = -1,
+    };
+    gint  pipe_in[2] = { -1, -1 };  /* Child reads, parent writes */
+    gint  pipe_out[2] = { -1, -1 }; /* Parent reads, child writes */
+    gint  pty_master = -1;
+    gint  saved_errno;
+    gchar *command;
+    gchar *stack;
+    sigset_t all_signals;
+    pid_t pid;
+
+    if (use_pty) {
+        struct winsize win = {
+            .ws_col = 80,
+            .ws_row = 24,
+            .ws_xpixel = 480,
+            .ws_ypixel = 192,
+        };
+
+        if (openpty (&pty_master, &spawn.pty_slave, NULL, NULL, &win) == -1)
+            return -1;
+        spawn.out_fd = spawn.pty_slave;
+        if (fd_in != NULL)
+            *fd_in = -1;
+    } else {
+        if (pipe (pipe_out) == -1)
+            return -1;
+        if (fd_in != NULL && pipe (pipe_in) == -1) {
+            saved_errno = errno;
+            close (pipe_out[0]);
+            close (pipe_out[1]);
+            errno = saved_errno;
+            return -1;
+        }
+        spawn.out_fd = pipe_out[1];
+        spawn.stdin_fd = fd_in != NULL ? pipe_in[0] : open ("/dev/null", O_RDONLY);
+    }
+
+    spawn.argv = process_data->command;
+    spawn.envp = envp != NULL ? (gchar **) envp : environ;
+    spawn.candidates = spawn_candidates (spawn.argv[0], spawn.envp);
+    spawn.sh_argv = g_new0 (gchar *, g_strv_length (spawn.argv) + 2);
+    spawn.sh_argv[0] = "/bin/sh";
+    for (guint i = 1; spawn.argv[0] != NULL && spawn.argv[i] != NULL; i++) {
+        spawn.sh_argv[i + 1] = spawn.argv[i];
+    }
+    spawn.path = process_data->path;
+    command = g_strjoinv (" ", spawn.argv);
+    spawn.banner = g_strdup_printf ("use_pty:%s %s\n",
+                                    use_pty ? "TRUE" : "FALSE", command);
+    spawn.banner_length = strlen (spawn.banner);
+    spawn.max_fd = sysconf (_SC_OPEN_MAX);
+    spawn.own_group = process_own_group;
+    spawn.cgroup_fd = cgroup_fd;
+    if (preamble != NULL) {
+        spawn.setsid = preamble->setsid;
+        spawn.reset_oom_score = preamble->reset_oom_score;
+        spawn.exec_context = preamble->exec_context;
+    }
+    stack = g_malloc (SPAWN_STACK_SIZE);
+
+    // Nothing may run a handler of ours on the child's stack before the
+    // preamble has reset them, the child restores the mask itself.
+    sigfillset (&all_signals);
+    pthread_sigmask (SIG_SETMASK, &all_signals, &spawn.mask);
+    pid = clone (spawn_preamble, stack + SPAWN_STACK_SIZE,
+                 CLONE_VM | CLONE_VFORK | SIGCHLD, &spawn);
+    saved_errno = errno;
+    pthread_sigmask (SIG_SETMASK, &spawn.mask, NULL);
+
+    // The child is gone by now if it failed, tell whoever reads its output
+    // why, as it would have itself.
+    if (pid > 0 && spawn.chdir_errno != 0) {
+        gchar *message = g_strdup_printf ("Failed to chdir() to %s: %s\n",
+                                          spawn.path,
+                                          g_strerror (spawn.chdir_errno));
+        write_all (spawn.out_fd, message, strlen (message));
+        g_free (message);
+    } else if (pid > 0 && spawn.exec_errno != 0) {
+        gchar *message = g_strdup_printf ("Failed to exec() %s, %s error:%s\n",
+                                          spawn.argv[0], spawn.path,
+                                          g_strerror (spawn.exec_errno));
+        write_all (spawn.out_fd, message, strlen (message));
+        g_free (message);
+    }
+
+    if (use_pty) {
+        close (spawn.pty_slave);
+        if (pid > 0)
+            *fd_out = pty_master;
+        else
+            close (pty_master);
+    } else {
+        close (pipe_out[1]);
+        if (spawn.stdin_fd != -1)
+            close (spawn.stdin_fd);
+        if (pid > 0) {
+            *fd_out = pipe_out[0];
+            if (fd_in != NULL)
+                *fd_in = pipe_in[1];
+        } else {
+            close (pipe_out[0]);
+            if (fd_in != NULL)
+                close (pipe_in[1]);
+        }
+    }
+
+    g_free (stack);
+    g_free (spawn.banner);
+    g_free (command);
+    g_free (spawn.sh_argv);
+    g_strfreev (spawn.candidates);
+
+    errno = saved_errno;
+    return pid;
+}
+
+/* Runs command in a child of a full fork () of restraintd, for
+ * PROCESS_LAUNCHER_FORK.  Returns the pid of the child, or -1.
+ */
+static pid_t
+restraint_fork_exec (ProcessData *process_data,
+                     const gchar **envp,
+                     gint        *fd_out,
+                     gint        *fd_in,
+                     gboolean     use_pty,
+                     gint         cgroup_fd,
+                     const ProcessPreamble *preamble)
+{
+    gboolean new_session = preamble != NULL && preamble->setsid;
+    pid_t pid = restraint_fork (fd_out, fd_in, use_pty,
+                                process_own_group && !new_session);
+
+    if (pid == 0) {
+        /* Child process. */
+
+        if (new_session && !use_pty)
+            setsid ();
+
+        if (cgroup_fd != -1) {
+            if (!write_all (cgroup_fd, "0", 1))
+                g_warning ("Failed to join cgroup: %s\n", g_strerror (errno));
+            close (cgroup_fd);
+        }
+        if (preamble != NULL)
+            apply_preamble (preamble->reset_oom_score, preamble->exec_context);
+
+        // Flush any input that hasn't been read
+        if (fflush (stdin) != 0)
+            g_warning ("Failed to flush stdin: %s\n", g_strerror (errno));
+
+        setbuf (stdout, NULL);
+        setbuf (stderr, NULL);
+
+        if (process_data->path && (chdir (process_data->path) == -1)) {
+            /* command_path was supplied and we failed to chdir to it. */
+            g_warning ("Failed to chdir() to %s: %s\n", process_data->path, g_strerror (errno));
+            exit (INVALID_COMMAND_PATH);
+        }
+        if (envp)
+            environ = (gchar **) envp;
+
+        // Print the command being executed.
+        gchar *pcommand = g_strjoinv (" ", (gchar **) process_data->command);
+        printf ("use_pty:%s %s\n", use_pty ? "TRUE" : "FALSE", pcommand);
+        g_free (pcommand);
+
+        /* Spawn the command */
+        execvp (*process_data->command, (gchar **) process_data->command);
+        if (errno == EACCES && preamble != NULL && preamble->exec_context != NULL) {
+            reset_exec_context ();
+            execvp (*process_data->command, (gchar **) process_data->command);
+        }
+        g_warning ("Failed to exec() %s, %s error:%s\n",
+                   *process_data->command,
+                   process_data->path,
+                   g_strerror (errno));
+        exit (SPAWN_COMMAND_FAILED);
+    }
+
+    return pid;
+}
+
+/* pidfd_open(2) and pidfd_send_signal(2) have no wrappers in older glibc. */
+static gint
+process_pidfd_open (pid_t pid)
+{
+#ifdef SYS_pidfd_open
+    return syscall (SYS_pidfd_open, pid, 0);
+#else
+    errno = ENOSYS;
+    return -1;
+#endif
+}
+
+/*
+ * Sends sig to the process and, when it leads its own group, to everything
+ * it started which stayed in the group.  Only call this before the process
+ * is reaped: until then neither its pid nor its group id can be reused.
+ */
+static gint
+process_signal (ProcessData *process_data, gint sig)
+{
+    if (process_data->own_group) {
+        kill (-process_data->pid, sig);
+    }
+#ifdef SYS_pidfd_send_signal
+    if (process_data->pidfd != -1) {
+        return syscall (SYS_pidfd_send_signal, process_data->pidfd, sig, NULL, 0);
+    }
+#endif
+    return kill (process_data->pid, sig);
+}
+
+/*
+ * The pidfd becomes readable when the process exits.  It stays a zombie
+ * until reaped here, so nothing else can have been given its pid.
+ */
+static gboolean
+process_pidfd_callback (gint fd, GIOCondition condition, gpointer user_data)
+{
+    ProcessData *process_data = (ProcessData *) user_data;
+    gint status = 0;
+    pid_t ret;
+
+    // Whatever the process left running in its group goes with it, killed
+    // or not.  Strays would hold the pty open and keep process_io_finish ()
+    // waiting for them.
+    if (process_data->own_group) {
+        kill (-process_data->pid, SIGKILL);
+    }
+
+    do {
+        ret = waitpid (process_data->pid, &status, WNOHANG);
+    } while (ret == -1 && errno == EINTR);
+    if (ret == 0) {
+        return G_SOURCE_CONTINUE;
+    }
+    if (ret == -1) {
+        g_warning ("Failed to reap %i: %s", process_data->pid, g_strerror (errno));
+        status = W_EXITCODE (255, 0);
+    }
+
+    close (process_data->pidfd);
+    process_data->pidfd = -1;
+    process_data->pid_handler_id = 0;
+    process_pid_callback (process_data->pid, status, process_data);
+    return G_SOURCE_REMOVE;
+}
+
 void
 process_run (const gchar *command,
              const gchar **envp,
@@ -241,10 +810,13 @@ process_run (const gchar *command,
              gssize content_size,
              gboolean buffer,
              GCancellable *cancellable,
+             const gchar *cgroup,
+             const ProcessPreamble *preamble,
              gpointer user_data)
 {
     ProcessData *process_data;
     gint        *process_stdin;
+    gint         cgroup_fd = -1;
     guint64      timeout;
 
     /* Passing content_input is not supported with PTY */
@@ -264,6 +836,11 @@ process_run (const gchar *command,
 
     process_data->fd_in = -1;
     process_data->fd_out = -1;
+    process_data->pidfd = -1;
+    // login_tty () makes a pty's process a session leader, and so a group
+    // one, as setsid () does
+    process_data->own_group = use_pty || process_own_group ||
+                              (preamble != NULL && preamble->setsid);
 
     if (fflush (stdout) != 0)
         g_warning ("Failed to flush stdout: %s\n", g_strerror (errno));
@@ -277,7 +854,31 @@ process_run (const gchar *command,
     else
         process_stdin = NULL;
 
-    process_data->pid = restraint_fork (&process_data->fd_out, process_stdin, use_pty);
+    // The child moves itself in before exec, so that all it starts is in
+    // there too.  Accounting is best effort, the command runs regardless.
+    if (cgroup != NULL) {
+        gchar *procs = g_build_filename (cgroup, "cgroup.procs", NULL);
+
+        cgroup_fd = g_open (procs, O_WRONLY, 0);
+        if (cgroup_fd < 0)
+            g_warning ("Failed to open %s: %s", procs, g_strerror (errno));
+        g_free (procs);
+    }
+
+    if (process_launcher == PROCESS_LAUNCHER_FORK) {
+        process_data->pid = restraint_fork_exec (process_data, envp,
+                                                 &process_data->fd_out,
+                                                 process_stdin, use_pty,
+                                                 cgroup_fd, preamble);
+    } else {
+        process_data->pid = restraint_spawn (process_data, envp,
+                                             &process_data->fd_out,
+                                             process_stdin, use_pty,
+                                             cgroup_fd, preamble);
+    }
+
+    if (cgroup_fd != -1)
+        close (cgroup_fd);
 
     if (process_data->pid < 0) {
         /* Failed to fork */
@@ -286,41 +887,13 @@ process_run (const gchar *command,
                      "Failed to fork: %s", g_strerror (errno));
         g_idle_add (process_pid_finish, process_data);
         return;
-    } else if (process_data->pid == 0) {
-        /* Child process. */
-
-        // Flush any input that hasn't been read
-        if (fflush (stdin) != 0)
-            g_warning ("Failed to flush stdin: %s\n", g_strerror (errno));
-
-        setbuf (stdout, NULL);
-        setbuf (stderr, NULL);
-
-        if (process_data->path && (chdir (process_data->path) == -1)) {
-            /* command_path was supplied and we failed to chdir to it. */
-            g_warning ("Failed to chdir() to %s: %s\n", process_data->path, g_strerror (errno));
-            exit (INVALID_COMMAND_PATH);
-        }
-        if (envp)
-            environ = (gchar **) envp;
-
-        // Print the command being executed.
-        gchar *pcommand = g_strjoinv (" ", (gchar **) process_data->command);
-        printf ("use_pty:%s %s\n", use_pty ? "TRUE" : "FALSE", pcommand);
-        g_free (pcommand);
-
-        /* Spawn the command */
-        if (execvp (*process_data->command, (gchar **) process_data->command) == -1) {
-            g_warning ("Failed to exec() %s, %s error:%s\n",
-                       *process_data->command,
-                       process_data->path,
-                       g_strerror (errno));
-            exit (SPAWN_COMMAND_FAILED);
-        }
     }
 
     /* Parent process. */
 
+    // Opened before anything can reap the child, so it refers to it alone.
+    process_data->pidfd = process_pidfd_open (process_data->pid);
+
     // If we get the cancel signal kill any running process
     if (process_data->cancellable) {
         process_data->cancel_handler = g_cancellable_connect (process_data->cancellable,
@@ -376,13 +949,27 @@ process_run (const gchar *command,
                                                    process_io_cb,
                                                    process_data,
                                                    process_io_finish);
+        g_source_set_name_by_id (process_data->io_handler_id, "process_io_cb");
     }
-    // Monitor pid for return code
-    process_data->pid_handler_id = g_child_watch_add_full (G_PRIORITY_DEFAULT,
+    processes_started++;
+    processes_running++;
+
+    // Monitor pid for return code, the child watch is for kernels without
+    // pidfds.
+    if (process_data->pidfd != -1) {
+        process_data->pid_handler_id = g_unix_fd_add_full (G_PRIORITY_DEFAULT,
+                                                   process_data->pidfd,
+                                                   G_IO_IN,
+                                                   process_pidfd_callback,
+                                                   process_data,
+                                                   NULL);
+    } else {
+        process_data->pid_handler_id = g_child_watch_add_full (G_PRIORITY_DEFAULT,
                                                    process_data->pid,
                                                    process_pid_callback,
                                                    process_data,
                                                    NULL);
+    }
 }
 
 void
@@ -392,6 +979,7 @@ process_pid_callback (GPid pid, gint status, gpointer user_data)
 
     process_data->pid_result = status;
     process_data->pid = 0;
+    processes_running--;
     if (process_data->fd_out != -1 ) {
         close (process_data->fd_out);
         process_data->fd_out = -1;
@@ -444,8 +1032,8 @@ process_kill (gpointer user_data)
         return;
     }
 
-    // Kill process pid
-    if (kill (process_data->pid, SIGKILL) == 0) {
+    // Kill process pid and its group
+    if (process_signal (process_data, SIGKILL) == 0) {
         process_data->localwatchdog = TRUE;
     } else {
         g_warning("Local watchdog expired! But we failed to kill %i with %i", process_data->pid, SIGKILL);
@@ -24,6 +24,8 @@
 
 /* Used for process IO callbacks */
 #define IO_BUFFER_SIZE 8192
+/* Most output moved by one process_splice (), the default pipe capacity */
+#define SPLICE_BUFFER_SIZE (8 * IO_BUFFER_SIZE)
 
 typedef void (*ProcessTimeoutCallback) (gpointer user_data,
                                         guint64 *time_remain);
@@ -40,6 +42,26 @@ typedef enum {
     RESTRAINT_PROCESS_FORK_ERROR,
 } RestraintProcessError;
 
+typedef enum {
+    // clone () sharing restraintd's memory until exec, like vfork ()
+    PROCESS_LAUNCHER_SPAWN,
+    // full fork () of restraintd
+    PROCESS_LAUNCHER_FORK,
+} ProcessLauncher;
+
+/*
+ * What the standard task_run.d plugins did to the command's process, done
+ * by restraintd itself before it execs the command.
+ */
+typedef struct {
+    // A session of its own, as setsid in 10_bash_login
+    gboolean setsid;
+    // The default OOM score adjustment rather than restraintd's, as 35_oom_adj
+    gboolean reset_oom_score;
+    // SELinux context to exec the command in, as 20_unconfined, or NULL
+    const gchar *exec_context;
+} ProcessPreamble;
+
 typedef struct {
     // Command to run
     gchar **command;
@@ -50,6 +72,10 @@ typedef struct {
     guint64 max_time;
     // pid of our forked process
     pid_t pid;
+    // pidfd of pid, or -1 if the kernel has none
+    gint pidfd;
+    // TRUE if pid leads a process group of its own
+    gboolean own_group;
     // file descriptors of our pty
     gint fd_out;
     gint fd_in;
@@ -91,6 +117,8 @@ process_run (const gchar *command,
                       gssize content_size,
                       gboolean buffer,
                       GCancellable *cancellable,
+                      const gchar *cgroup,
+                      const ProcessPreamble *preamble,
                       gpointer user_data);
 //gboolean process_io_callback (GIOChannel *io, GIOCondition condition, gpointer user_data);
 void process_pid_callback (GPid pid, gint status, gpointer user_data);
@@ -98,6 +126,17 @@ gboolean process_pid_finish (gpointer user_data);
 gboolean process_timeout_callback (gpointer user_data);
 //gboolean process_heartbeat_callback (gpointer user_data);
 void process_free (ProcessData *process_data);
+void process_set_launcher (ProcessLauncher launcher);
+void process_set_own_group (gboolean own_group);
+// Children still to be reaped, and all started so far
+void process_get_counts (guint *running, guint64 *started);
+/*
+ * Moves up to length bytes of output waiting in the pipe fd to out_fd
+ * without copying them through restraintd. Unless tee_fd is -1, the same
+ * bytes are also copied into the pipe tee_fd. Returns what splice () does:
+ * the bytes moved, 0 once the writers are gone or -1 with errno set.
+ */
+gssize process_splice (gint fd, gint out_fd, gint tee_fd, gsize length);
 
 extern char **environ;
 int    kill(pid_t, int);
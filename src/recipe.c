@@ -16,6 +16,7 @@
 */
 
 #include <glib.h>
+#include <glib/gstdio.h>
 #include <gio/gio.h>
 #include <libsoup/soup.h>
 #include <libxml/tree.h>
@@ -68,59 +69,6 @@ static xmlNodePtr find_recipe(xmlDocPtr doc) {
         RESTRAINT_RECIPE_PARSE_ERROR_UNRECOGNISED, \
         message, ##__VA_ARGS__)
 
-static Param *parse_param(xmlNode *param_node, GError **error) {
-    g_return_val_if_fail(param_node != NULL, NULL);
-    g_return_val_if_fail(error == NULL || *error == NULL, NULL);
-
-    Param *param = restraint_param_new();
-
-    xmlChar *param_name = xmlGetNoNsProp(param_node, (xmlChar *)"name");
-    if (param_name == NULL) {
-        unrecognised("'param' element without 'name' attribute");
-        goto error;
-    }
-    param->name = g_strdup((gchar *)param_name);
-    xmlFree(param_name);
-
-    xmlChar *param_value = xmlGetNoNsProp(param_node, (xmlChar *)"value");
-    if (param_value == NULL) {
-        unrecognised("'param' element without 'value' attribute");
-        goto error;
-    }
-    param->value = g_strdup((gchar *)param_value);
-    xmlFree(param_value);
-    return param;
-
-error:
-    restraint_param_free(param);
-    return NULL;
-}
-
-static GList *parse_params(xmlNode *params_node, GError **error) {
-
-    GError *tmp_error = NULL;
-    GList *params = NULL;
-    xmlNode *child = params_node->children;
-    while (child != NULL) {
-        if (child->type == XML_ELEMENT_NODE &&
-                g_strcmp0((gchar *)child->name, "param") == 0) {
-            Param *param = parse_param(child, &tmp_error);
-            /* Empty param element is an error */
-            if (param == NULL) {
-                g_propagate_error(error, tmp_error);
-                goto error;
-            }
-            params = g_list_prepend(params, param);
-        }
-        child = child->next;
-    }
-    params = g_list_reverse(params);
-    return params;
-error:
-    g_list_free_full(params, (GDestroyNotify) restraint_param_free);
-    return NULL;
-}
-
 static GPtrArray *parse_role_system(xmlNode *system_node, GError **error) {
     GPtrArray *systems;
     systems = g_ptr_array_new_with_free_func((GDestroyNotify) g_free);
@@ -199,139 +147,6 @@ error:
     return NULL;
 }
 
-static Task *parse_task(xmlNode *task_node, Recipe *recipe, GError **error) {
-    g_return_val_if_fail(task_node != NULL, NULL);
-    g_return_val_if_fail(error == NULL || *error == NULL, NULL);
-    GError *tmp_error = NULL;
-
-    Task *task = restraint_task_new();
-    g_return_val_if_fail(task != NULL, NULL);
-
-    task->recipe = recipe;
-    xmlChar *task_name = xmlGetNoNsProp(task_node, (xmlChar *)"name");
-    task->name = g_strdup((gchar *)task_name);
-    xmlFree (task_name);
-
-    xmlChar *keepchanges = xmlGetNoNsProp(task_node, (xmlChar *)"keepchanges");
-    if (g_strcmp0((gchar *)keepchanges, "yes") == 0) {
-        task->keepchanges = TRUE;
-    }
-    xmlFree(keepchanges);
-
-    xmlChar *task_id = xmlGetNoNsProp(task_node, (xmlChar *)"id");
-    if (task_id == NULL) {
-        unrecognised("<task/> without id");
-        goto error;
-    }
-    task->task_id = g_strdup((gchar *)task_id);
-    xmlFree(task_id);
-
-    gchar *suffix = g_strconcat("tasks/", task->task_id, "/", NULL);
-    task->task_uri = soup_uri_new_with_base(recipe->recipe_uri, suffix);
-    g_free(suffix);
-
-    xmlNode *fetch = first_child_with_name(task_node, "fetch", FALSE);
-    if (fetch != NULL) {
-        task->fetch_method = TASK_FETCH_UNPACK;
-        xmlChar *url = xmlGetNoNsProp(fetch, (xmlChar *)"url");
-        if (url == NULL) {
-            unrecognised("Task %s has 'fetch' element with 'url' attribute",
-                    task->task_id);
-            goto error;
-        }
-        task->fetch.url = soup_uri_new((char *)url);
-
-        if (task->fetch.url == NULL) {
-            unrecognised("'%s' from task %s is not a valid url", url,
-                         task->task_id);
-            xmlFree(url);
-            goto error;
-        }
-        xmlFree(url);
-
-        xmlChar *ssl_verify = xmlGetNoNsProp(fetch, (xmlChar *)"ssl_verify");
-        if (ssl_verify == NULL || g_strcmp0((char*)ssl_verify, "off") != 0) {
-            task->ssl_verify = TRUE;
-        } else {
-            task->ssl_verify = FALSE;
-        }
-        xmlFree(ssl_verify);
-
-        task->path = g_build_filename(task->recipe->base_path,
-                task->fetch.url->host,
-                task->fetch.url->path,
-                task->fetch.url->fragment,
-                NULL);
-    } else {
-        task->fetch_method = TASK_FETCH_INSTALL_PACKAGE;
-        xmlNode *rpm = first_child_with_name(task_node, "rpm", FALSE);
-        if (rpm == NULL) {
-            unrecognised("Task %s has neither 'url' attribute nor 'rpm' element",
-                    task->task_id);
-            goto error;
-        }
-        xmlChar *rpm_name = xmlGetNoNsProp(rpm, (xmlChar *)"name");
-        if (rpm_name == NULL) {
-            unrecognised("Task %s has 'rpm' element without 'name' attribute",
-                    task->task_id);
-            goto error;
-        }
-        task->fetch.package_name = g_strdup((gchar *)rpm_name);
-        xmlFree(rpm_name);
-        xmlChar *rpm_path = xmlGetNoNsProp(rpm, (xmlChar *)"path");
-        if (rpm_path == NULL) {
-            unrecognised("Task %s has 'rpm' element without 'path' attribute",
-                    task->task_id);
-            goto error;
-        }
-        task->path = g_strdup((gchar *)rpm_path);
-        xmlFree(rpm_path);
-    }
-
-    xmlNode *params_node = first_child_with_name(task_node, "params", FALSE);
-    if (params_node != NULL) {
-        task->params = parse_params(params_node, &tmp_error);
-        /* params could be empty, but if parsing causes an error then fail */
-        if (tmp_error != NULL) {
-            g_propagate_prefixed_error(error, tmp_error,
-                    "Task %s has ", task->task_id);
-            goto error;
-        }
-    }
-
-    xmlNode *roles_node = first_child_with_name(task_node, "roles", FALSE);
-    if (roles_node != NULL) {
-        task->roles = parse_roles(roles_node, &tmp_error);
-        /* roles could be empty, but if parsing causes an error then fail */
-        if (tmp_error != NULL) {
-            g_propagate_prefixed_error(error, tmp_error,
-                    "Task %s has ", task->task_id);
-            goto error;
-        }
-    }
-
-    xmlChar *status = xmlGetNoNsProp(task_node, (xmlChar *)"status");
-    if (g_strcmp0((gchar *)status, "Running") == 0) {
-        // We can't rely on the server because it "starts" the first task 
-        // If we pay attention to that then we won't install the task
-        // Update watchdog or install dependencies.
-        g_warning ("Ignoring Server Running state\n");
-        //task->started = TRUE;
-    } else if (g_strcmp0((gchar *)status, "Completed") == 0 ||
-            g_strcmp0((gchar *)status, "Aborted") == 0 ||
-            g_strcmp0((gchar *)status, "Cancelled") == 0) {
-        task->started = TRUE;
-        task->finished = TRUE;
-    }
-    xmlFree(status);
-
-    return task;
-
-error:
-    restraint_task_free(task);
-    return NULL;
-}
-
 void restraint_recipe_update_roles(Recipe *recipe, xmlDoc *doc, GError **error) {
     g_return_if_fail(recipe != NULL);
     g_return_if_fail(doc != NULL);
@@ -384,6 +199,284 @@ void restraint_recipe_update_roles(Recipe *recipe, xmlDoc *doc, GError **error)
     g_warn_if_fail(!tasks);
 }
 
+/* A <roles/> element read by SAX */
+typedef struct {
+    gint depth; /* Of the <roles/>, 0 outside one */
+    GList *roles;
+    Role *role;
+    GPtrArray *systems;
+} SaxRoles;
+
+typedef struct {
+    Task *task;
+    GList *roles;
+} TaskRoles;
+
+/*
+ * What restraint_recipe_update_roles () would take from the document, read
+ * by SAX.  The recipe is chosen as find_recipe () does, and the <task/>
+ * elements are matched to the recipe's tasks in order.
+ */
+typedef struct {
+    Recipe *recipe;
+    RecipeRolesCallback callback;
+    gpointer user_data;
+    gint depth;
+    gint recipe_depth; /* Of the recipe being read, 0 outside it */
+    gboolean recipe_found;
+    gboolean recipe_has_id; /* Found a <recipe id=""/>, not a <guestrecipe/> */
+    GList *next_task;
+    Task *task; /* Of the <task/> being read, NULL outside one */
+    SaxRoles roles;
+    gboolean recipe_roles_read;
+    GList *recipe_roles;
+    GList *task_roles; /* TaskRoles * */
+    GError *error;
+} RolesParse;
+
+static void
+task_roles_free (TaskRoles *task_roles)
+{
+    g_list_free_full (task_roles->roles, (GDestroyNotify) restraint_role_free);
+    g_slice_free (TaskRoles, task_roles);
+}
+
+static void
+sax_roles_clear (SaxRoles *roles)
+{
+    g_clear_pointer (&roles->role, restraint_role_free);
+    if (roles->systems != NULL) {
+        g_ptr_array_free (roles->systems, TRUE);
+        roles->systems = NULL;
+    }
+    g_list_free_full (roles->roles, (GDestroyNotify) restraint_role_free);
+    roles->roles = NULL;
+    roles->depth = 0;
+}
+
+static void
+roles_parse_reset (RolesParse *parse)
+{
+    sax_roles_clear (&parse->roles);
+    g_list_free_full (parse->recipe_roles, (GDestroyNotify) restraint_role_free);
+    g_list_free_full (parse->task_roles, (GDestroyNotify) task_roles_free);
+    parse->recipe_roles = parse->task_roles = NULL;
+    parse->recipe_roles_read = FALSE;
+    parse->task = NULL;
+    parse->next_task = parse->recipe->tasks;
+}
+
+/* The value of a SAX2 attribute, which comes as localname/prefix/URI/value/end */
+static gchar *
+sax_attribute (const xmlChar **atts, gint n_atts, const gchar *name)
+{
+    for (gint i = 0; i < n_atts; i++, atts += 5) {
+        if (atts[1] == NULL && g_strcmp0 ((const gchar *) atts[0], name) == 0) {
+            return g_strndup ((const gchar *) atts[3], atts[4] - atts[3]);
+        }
+    }
+    return NULL;
+}
+
+/* Reads the <role/> and <system/> elements of the <roles/> at roles->depth */
+static void
+sax_roles_start (SaxRoles *roles, gint depth, const gchar *name,
+                 const xmlChar **atts, gint n_atts, GError **error)
+{
+    gchar *value;
+
+    if (depth == roles->depth + 1 && g_strcmp0 (name, "role") == 0) {
+        value = sax_attribute (atts, n_atts, "value");
+        if (value == NULL) {
+            unrecognised ("'role' element without 'value' attribute");
+        } else {
+            roles->role = restraint_role_new ();
+            roles->role->value = value;
+            roles->systems = g_ptr_array_new_with_free_func (g_free);
+        }
+    } else if (roles->role != NULL && depth == roles->depth + 2 &&
+               g_strcmp0 (name, "system") == 0) {
+        value = sax_attribute (atts, n_atts, "value");
+        if (value == NULL) {
+            unrecognised ("'system' element without 'value' attribute");
+        } else {
+            g_ptr_array_add (roles->systems, value);
+        }
+    }
+}
+
+/* TRUE once the <roles/> has ended, its roles then taken into *result */
+static gboolean
+sax_roles_end (SaxRoles *roles, gint depth, GList **result)
+{
+    if (roles->role != NULL && depth == roles->depth + 1) {
+        g_ptr_array_add (roles->systems, NULL);
+        roles->role->systems = g_strjoinv (" ", (gchar **) roles->systems->pdata);
+        g_ptr_array_free (roles->systems, TRUE);
+        roles->systems = NULL;
+        roles->roles = g_list_prepend (roles->roles, roles->role);
+        roles->role = NULL;
+    } else if (depth == roles->depth) {
+        *result = g_list_reverse (roles->roles);
+        roles->roles = NULL;
+        roles->depth = 0;
+        return TRUE;
+    }
+    return FALSE;
+}
+
+static void
+roles_start_element (void *user_data, const xmlChar *xml_name,
+                     const xmlChar *prefix, const xmlChar *uri,
+                     gint n_namespaces, const xmlChar **namespaces,
+                     gint n_atts, gint n_defaulted, const xmlChar **atts)
+{
+    RolesParse *parse = user_data;
+    const gchar *name = (const gchar *) xml_name;
+    GError **error = &parse->error;
+    g_autofree gchar *id = NULL;
+    gint depth = ++parse->depth;
+
+    if (parse->error != NULL) {
+        return;
+    }
+    if (parse->recipe_depth == 0) {
+        if (g_strcmp0 (name, "recipe") == 0) {
+            id = sax_attribute (atts, n_atts, "id");
+        }
+        if ((id != NULL && !parse->recipe_has_id) ||
+            (g_strcmp0 (name, "guestrecipe") == 0 && !parse->recipe_found)) {
+            roles_parse_reset (parse);
+            parse->recipe_depth = depth;
+            parse->recipe_found = TRUE;
+            parse->recipe_has_id = g_strcmp0 (name, "recipe") == 0;
+        }
+        return;
+    }
+
+    if (depth == parse->recipe_depth + 1 && g_strcmp0 (name, "task") == 0) {
+        if (parse->next_task == NULL) {
+            unrecognised ("more <task/> elements than tasks");
+        } else {
+            parse->task = parse->next_task->data;
+            parse->next_task = parse->next_task->next;
+        }
+    } else if (parse->roles.depth != 0) {
+        sax_roles_start (&parse->roles, depth, name, atts, n_atts, error);
+    } else if (g_strcmp0 (name, "roles") == 0 &&
+               depth == parse->recipe_depth + (parse->task != NULL ? 2 : 1)) {
+        parse->roles.depth = depth;
+    }
+
+    if (parse->error != NULL) {
+        if (parse->task != NULL) {
+            g_prefix_error (error, "Task %s has ", parse->task->task_id);
+        } else {
+            g_prefix_error (error, "Recipe %s has ", parse->recipe->recipe_id);
+        }
+    }
+}
+
+static void
+roles_end_element (void *user_data, const xmlChar *xml_name,
+                   const xmlChar *prefix, const xmlChar *uri)
+{
+    RolesParse *parse = user_data;
+    gint depth = parse->depth--;
+    GList *roles;
+
+    if (parse->error != NULL || parse->recipe_depth == 0) {
+        return;
+    }
+
+    if (parse->roles.depth != 0) {
+        if (!sax_roles_end (&parse->roles, depth, &roles)) {
+            return;
+        }
+        if (parse->task != NULL) {
+            TaskRoles *task_roles = g_slice_new (TaskRoles);
+
+            task_roles->task = parse->task;
+            task_roles->roles = roles;
+            parse->task_roles = g_list_prepend (parse->task_roles, task_roles);
+        } else {
+            g_list_free_full (parse->recipe_roles, (GDestroyNotify) restraint_role_free);
+            parse->recipe_roles = roles;
+            parse->recipe_roles_read = TRUE;
+        }
+    } else if (depth == parse->recipe_depth + 1 && parse->task != NULL) {
+        parse->task = NULL;
+    } else if (depth == parse->recipe_depth) {
+        parse->recipe_depth = 0;
+    }
+}
+
+static xmlSAXHandler roles_sax = {
+    .initialized = XML_SAX2_MAGIC,
+    .startElementNs = roles_start_element,
+    .endElementNs = roles_end_element,
+};
+
+static void
+roles_refreshed (GError *error, gboolean modified, gpointer user_data)
+{
+    RolesParse *parse = user_data;
+    Recipe *recipe = parse->recipe;
+
+    if (error == NULL && modified && parse->error == NULL && !parse->recipe_found) {
+        g_set_error (&parse->error, RESTRAINT_RECIPE_PARSE_ERROR,
+                     RESTRAINT_RECIPE_PARSE_ERROR_UNRECOGNISED,
+                     "<recipe/> element not found");
+    }
+
+    if (parse->error != NULL) {
+        // So that the next refresh fetches it again, rather than a 304
+        restraint_xml_validators_clear (&recipe->roles_validators);
+        parse->callback (parse->error, FALSE, parse->user_data);
+    } else if (error != NULL) {
+        parse->callback (error, FALSE, parse->user_data);
+    } else {
+        if (modified) {
+            if (parse->recipe_roles_read) {
+                g_list_free_full (recipe->roles, (GDestroyNotify) restraint_role_free);
+                recipe->roles = parse->recipe_roles;
+                parse->recipe_roles = NULL;
+            }
+            for (GList *item = parse->task_roles; item != NULL; item = item->next) {
+                TaskRoles *task_roles = item->data;
+
+                g_list_free_full (task_roles->task->roles,
+                                  (GDestroyNotify) restraint_role_free);
+                task_roles->task->roles = task_roles->roles;
+                task_roles->roles = NULL;
+            }
+        }
+        parse->callback (NULL, modified, parse->user_data);
+    }
+
+    roles_parse_reset (parse);
+    g_clear_error (&parse->error);
+    g_slice_free (RolesParse, parse);
+}
+
+void
+restraint_recipe_refresh_roles (Recipe *recipe, const gchar *recipe_url,
+                                RecipeRolesCallback callback, gpointer user_data)
+{
+    g_return_if_fail (recipe != NULL);
+    g_return_if_fail (recipe_url != NULL);
+    g_return_if_fail (callback != NULL);
+
+    RolesParse *parse = g_slice_new0 (RolesParse);
+
+    parse->recipe = recipe;
+    parse->callback = callback;
+    parse->user_data = user_data;
+    parse->next_task = recipe->tasks;
+    restraint_xml_sax_from_url (soup_session, recipe_url, &recipe->roles_validators,
+                                &roles_sax, parse, roles_refreshed, parse);
+}
+
 void restraint_recipe_free(Recipe *recipe) {
     g_return_if_fail(recipe != NULL);
     g_free(recipe->recipe_id);
@@ -397,110 +490,688 @@ void restraint_recipe_free(Recipe *recipe) {
     g_free(recipe->base_path);
     soup_uri_free(recipe->recipe_uri);
     g_list_free_full(recipe->tasks, (GDestroyNotify) restraint_task_free);
-    g_list_free_full(recipe->params, (GDestroyNotify) restraint_param_free);
+    if (recipe->strings != NULL) {
+        g_list_free_full(recipe->params, (GDestroyNotify) restraint_param_free_interned);
+        g_string_chunk_free(recipe->strings);
+    } else {
+        g_list_free_full(recipe->params, (GDestroyNotify) restraint_param_free);
+    }
     g_list_free_full(recipe->roles, (GDestroyNotify) restraint_role_free);
+    g_free(recipe->task_phase_usec);
+    restraint_xml_validators_clear(&recipe->roles_validators);
     g_slice_free(Recipe, recipe);
 }
 
-static Recipe *
-recipe_parse (xmlDoc *doc, SoupURI *recipe_uri, GError **error, gchar **cfg_file)
-{
-    g_return_val_if_fail(doc != NULL, NULL);
-    g_return_val_if_fail(error == NULL || *error == NULL, NULL);
+/*
+ * The recipe to run, built by SAX as the document is read, so that no
+ * xmlDoc of it is ever kept.  The recipe is chosen as find_recipe () does,
+ * and only the first <fetch/>, <rpm/>, <params/> and <roles/> of a task
+ * count, as with first_child_with_name ().
+ */
+typedef struct {
+    AppData *app_data;
+    SoupURI *recipe_uri; /* NULL when there is no recipe_url */
+    gchar *owner; /* Of the root <job/> */
+    gchar *checkpoint_file;
+    gchar *cfg_file;
+    gint depth;
+    gint recipe_depth; /* Of the recipe being read, 0 outside it */
+    gboolean recipe_has_id; /* Found a <recipe id=""/>, not a <guestrecipe/> */
+    Recipe *recipe;
+    gint order; /* Of the next task */
+    Task *task; /* Of the <task/> being read, NULL outside one */
+    gboolean task_fetch;
+    gboolean task_rpm;
+    gboolean task_params;
+    gboolean task_roles;
+    gchar *rpm_name;
+    gchar *rpm_path;
+    gint params_depth; /* Of the <params/> being read, 0 outside one */
+    GList *params;
+    SaxRoles roles;
+    GError *error;
+} RecipeParse;
 
-    GError *tmp_error = NULL;
-    gint i = 0;
-    Recipe *result = g_slice_new0(Recipe);
+static void
+recipe_parse_task_clear (RecipeParse *parse)
+{
+    g_clear_pointer (&parse->task, restraint_task_free);
+    g_clear_pointer (&parse->rpm_name, g_free);
+    g_clear_pointer (&parse->rpm_path, g_free);
+    parse->task_fetch = parse->task_rpm = FALSE;
+    parse->task_params = parse->task_roles = FALSE;
+}
 
-    xmlNode *job = xmlDocGetRootElement(doc);
-    if (job == NULL) {
-        unrecognised("Invalid XML Document");
-        goto error;
-    }
+static void
+recipe_parse_clear (RecipeParse *parse)
+{
+    recipe_parse_task_clear (parse);
+    g_list_free_full (parse->params, (GDestroyNotify) restraint_param_free_interned);
+    parse->params = NULL;
+    parse->params_depth = 0;
+    sax_roles_clear (&parse->roles);
+    g_clear_pointer (&parse->recipe, restraint_recipe_free);
+    g_clear_error (&parse->error);
+}
 
-    xmlNodePtr recipe = find_recipe(doc);
-    if (recipe == NULL) {
-        unrecognised("<recipe/> element not found");
-        goto error;
+static void
+recipe_parse_free (RecipeParse *parse)
+{
+    recipe_parse_clear (parse);
+    if (parse->recipe_uri != NULL) {
+        soup_uri_free (parse->recipe_uri);
     }
+    g_free (parse->owner);
+    g_free (parse->checkpoint_file);
+    g_free (parse->cfg_file);
+    g_slice_free (RecipeParse, parse);
+}
 
-    result->job_id = get_attribute(recipe, "job_id");
-    result->recipe_set_id = get_attribute(recipe, "recipe_set_id");
-    result->recipe_id = get_attribute(recipe, "id");
-    result->osarch = get_attribute(recipe, "arch");
-    result->osdistro = get_attribute(recipe, "distro");
-    result->osmajor = get_attribute(recipe, "family");
-    result->osvariant = get_attribute(recipe, "variant");
-    result->owner = get_attribute(job, "owner");
+/* Starts on a recipe, dropping any read so far in favour of it */
+static void
+recipe_parse_begin (RecipeParse *parse, const xmlChar **atts, gint n_atts)
+{
+    Recipe *recipe;
+    GError *tmp_error = NULL;
 
-    if (recipe_uri == NULL) {
+    recipe_parse_clear (parse);
+    parse->order = 0;
+    recipe = parse->recipe = g_slice_new0 (Recipe);
+    recipe->strings = g_string_chunk_new (4096);
+    recipe->job_id = sax_attribute (atts, n_atts, "job_id");
+    recipe->recipe_set_id = sax_attribute (atts, n_atts, "recipe_set_id");
+    recipe->recipe_id = sax_attribute (atts, n_atts, "id");
+    recipe->osarch = sax_attribute (atts, n_atts, "arch");
+    recipe->osdistro = sax_attribute (atts, n_atts, "distro");
+    recipe->osmajor = sax_attribute (atts, n_atts, "family");
+    recipe->osvariant = sax_attribute (atts, n_atts, "variant");
+    recipe->owner = g_strdup (parse->owner);
+
+    if (parse->recipe_uri == NULL) {
         gchar *tmp_str;
 
-        tmp_str = get_attribute (job, "checkpoint_file");
-        *cfg_file = g_build_filename (ETC_PATH, tmp_str, NULL);
-        g_free (tmp_str);
+        g_free (parse->cfg_file);
+        parse->cfg_file = g_build_filename (ETC_PATH, parse->checkpoint_file, NULL);
 
         // Hack to make soup_uri_new happy.
-        tmp_str = g_strdup_printf ("http://localhost/recipes/%s/", result->recipe_id);
-        recipe_uri = soup_uri_new (tmp_str);
+        tmp_str = g_strdup_printf ("http://localhost/recipes/%s/", recipe->recipe_id);
+        recipe->recipe_uri = soup_uri_new (tmp_str);
         g_free (tmp_str);
+    } else {
+        recipe->recipe_uri = soup_uri_copy (parse->recipe_uri);
     }
-    result->recipe_uri = recipe_uri;
 
     // Gather the location in which to install tasks
-    result->base_path = get_install_dir(INSTALL_CONFIG_FILE, &tmp_error);
+    recipe->base_path = get_install_dir (INSTALL_CONFIG_FILE, &tmp_error);
     if (tmp_error != NULL) {
-        g_warning("* Fail getting task install path. Using default. Error: %s",
-                  tmp_error->message);
-        g_clear_error(&tmp_error);
+        g_warning ("* Fail getting task install path. Using default. Error: %s",
+                   tmp_error->message);
+        g_clear_error (&tmp_error);
     }
 
+    // Hosted recipes install apart, as fetching a task clears its path
+    if (parse->app_data->hosted && recipe->recipe_id != NULL) {
+        gchar *base_path = recipe->base_path;
 
-    GList *tasks = NULL;
-    xmlNode *child = recipe->children;
-    while (child != NULL) {
-        if (child->type == XML_ELEMENT_NODE &&
-                g_strcmp0((gchar *)child->name, "task") == 0) {
-            Task *task = parse_task(child, result, &tmp_error);
-            if (task == NULL) {
-                g_propagate_error(error, tmp_error);
-                goto error;
-            }
-            /* link task to recipe for additional attributes */
-            task->recipe = result;
-            task->order = i++*2;
-            tasks = g_list_prepend(tasks, task);
-        } else
-        if (child->type == XML_ELEMENT_NODE &&
-                g_strcmp0((gchar *)child->name, "params") == 0) {
-            result->params = parse_params(child, &tmp_error);
-            /* params could be empty, but if parsing causes an error then fail */
-            if (tmp_error != NULL) {
-                g_propagate_prefixed_error(error, tmp_error,
-                                 "Recipe %s has ", result->recipe_id);
-                goto error;
-            }
-        } else
-        if (child->type == XML_ELEMENT_NODE &&
-                g_strcmp0((gchar *)child->name, "roles") == 0) {
-            result->roles = parse_roles(child, &tmp_error);
-            /* roles could be empty, but if parsing causes an error then fail */
-            if (tmp_error != NULL) {
-                g_propagate_prefixed_error(error, tmp_error,
-                                 "Recipe %s has ", result->recipe_id);
-                goto error;
+        recipe->base_path = g_build_filename (base_path, recipe->recipe_id, NULL);
+        g_free (base_path);
+    }
+}
+
+static void
+recipe_parse_task (RecipeParse *parse, const xmlChar **atts, gint n_atts)
+{
+    GError **error = &parse->error;
+    Task *task;
+    gchar *task_id, *suffix, *keepchanges, *status;
+
+    task_id = sax_attribute (atts, n_atts, "id");
+    if (task_id == NULL) {
+        unrecognised ("<task/> without id");
+        return;
+    }
+    task = parse->task = restraint_task_new ();
+    task->recipe = parse->recipe;
+    task->task_id = task_id;
+    task->name = sax_attribute (atts, n_atts, "name");
+    task->order = parse->order++ * 2;
+
+    keepchanges = sax_attribute (atts, n_atts, "keepchanges");
+    task->keepchanges = g_strcmp0 (keepchanges, "yes") == 0;
+    g_free (keepchanges);
+
+    suffix = g_strconcat ("tasks/", task->task_id, "/", NULL);
+    task->task_uri = soup_uri_new_with_base (parse->recipe->recipe_uri, suffix);
+    g_free (suffix);
+
+    status = sax_attribute (atts, n_atts, "status");
+    if (g_strcmp0 (status, "Running") == 0) {
+        // We can't rely on the server because it "starts" the first task
+        // If we pay attention to that then we won't install the task
+        // Update watchdog or install dependencies.
+        g_warning ("Ignoring Server Running state\n");
+    } else if (g_strcmp0 (status, "Completed") == 0 ||
+            g_strcmp0 (status, "Aborted") == 0 ||
+            g_strcmp0 (status, "Cancelled") == 0) {
+        task->started = TRUE;
+        task->finished = TRUE;
+    }
+    g_free (status);
+}
+
+static void
+recipe_parse_fetch (RecipeParse *parse, const xmlChar **atts, gint n_atts)
+{
+    GError **error = &parse->error;
+    Task *task = parse->task;
+    g_autofree gchar *url = sax_attribute (atts, n_atts, "url");
+    g_autofree gchar *ssl_verify = NULL;
+
+    task->fetch_method = TASK_FETCH_UNPACK;
+    if (url == NULL) {
+        unrecognised ("Task %s has 'fetch' element with 'url' attribute",
+                      task->task_id);
+        return;
+    }
+    task->fetch.url = soup_uri_new (url);
+    if (task->fetch.url == NULL) {
+        unrecognised ("'%s' from task %s is not a valid url", url, task->task_id);
+        return;
+    }
+
+    ssl_verify = sax_attribute (atts, n_atts, "ssl_verify");
+    task->ssl_verify = g_strcmp0 (ssl_verify, "off") != 0;
+    task->path = g_build_filename (parse->recipe->base_path,
+                                   task->fetch.url->host,
+                                   task->fetch.url->path,
+                                   task->fetch.url->fragment,
+                                   NULL);
+}
+
+/* A task without a <fetch/> is installed from its <rpm/> */
+static void
+recipe_parse_task_end (RecipeParse *parse)
+{
+    GError **error = &parse->error;
+    Task *task = parse->task;
+
+    if (!parse->task_fetch) {
+        task->fetch_method = TASK_FETCH_INSTALL_PACKAGE;
+        if (!parse->task_rpm) {
+            unrecognised ("Task %s has neither 'url' attribute nor 'rpm' element",
+                          task->task_id);
+        } else if (parse->rpm_name == NULL) {
+            unrecognised ("Task %s has 'rpm' element without 'name' attribute",
+                          task->task_id);
+        } else if (parse->rpm_path == NULL) {
+            unrecognised ("Task %s has 'rpm' element without 'path' attribute",
+                          task->task_id);
+        } else {
+            task->fetch.package_name = g_steal_pointer (&parse->rpm_name);
+            task->path = g_steal_pointer (&parse->rpm_path);
+        }
+    }
+
+    if (parse->error == NULL) {
+        parse->recipe->tasks = g_list_prepend (parse->recipe->tasks, task);
+        parse->task = NULL;
+    }
+    recipe_parse_task_clear (parse);
+}
+
+/* Param names and values go into the recipe's strings, each kept once */
+static void
+recipe_parse_param (RecipeParse *parse, const xmlChar **atts, gint n_atts)
+{
+    GError **error = &parse->error;
+    GStringChunk *strings = parse->recipe->strings;
+    g_autofree gchar *name = sax_attribute (atts, n_atts, "name");
+    g_autofree gchar *value = sax_attribute (atts, n_atts, "value");
+    Param *param;
+
+    if (name == NULL) {
+        unrecognised ("'param' element without 'name' attribute");
+        return;
+    }
+    if (value == NULL) {
+        unrecognised ("'param' element without 'value' attribute");
+        return;
+    }
+    param = restraint_param_new ();
+    param->name = g_string_chunk_insert_const (strings, name);
+    param->value = g_string_chunk_insert_const (strings, value);
+    parse->params = g_list_prepend (parse->params, param);
+}
+
+static void
+recipe_start_element (void *user_data, const xmlChar *xml_name,
+                      const xmlChar *prefix, const xmlChar *uri,
+                      gint n_namespaces, const xmlChar **namespaces,
+                      gint n_atts, gint n_defaulted, const xmlChar **atts)
+{
+    RecipeParse *parse = user_data;
+    const gchar *name = (const gchar *) xml_name;
+    g_autofree gchar *id = NULL;
+    gint depth = ++parse->depth;
+
+    if (depth == 1) {
+        parse->owner = sax_attribute (atts, n_atts, "owner");
+        parse->checkpoint_file = sax_attribute (atts, n_atts, "checkpoint_file");
+    }
+    if (parse->recipe_depth == 0) {
+        if (g_strcmp0 (name, "recipe") == 0) {
+            id = sax_attribute (atts, n_atts, "id");
+        }
+        if ((id != NULL && !parse->recipe_has_id) ||
+            (g_strcmp0 (name, "guestrecipe") == 0 && parse->recipe == NULL)) {
+            recipe_parse_begin (parse, atts, n_atts);
+            parse->recipe_depth = depth;
+            parse->recipe_has_id = id != NULL;
+        }
+        return;
+    }
+    if (parse->error != NULL) {
+        return;
+    }
+
+    if (parse->params_depth != 0) {
+        if (depth == parse->params_depth + 1 && g_strcmp0 (name, "param") == 0) {
+            recipe_parse_param (parse, atts, n_atts);
+        }
+    } else if (parse->roles.depth != 0) {
+        sax_roles_start (&parse->roles, depth, name, atts, n_atts, &parse->error);
+    } else if (depth == parse->recipe_depth + 1) {
+        if (g_strcmp0 (name, "task") == 0) {
+            recipe_parse_task (parse, atts, n_atts);
+        } else if (g_strcmp0 (name, "params") == 0) {
+            parse->params_depth = depth;
+        } else if (g_strcmp0 (name, "roles") == 0) {
+            parse->roles.depth = depth;
+        }
+        return;
+    } else if (parse->task != NULL && depth == parse->recipe_depth + 2) {
+        if (g_strcmp0 (name, "fetch") == 0 && !parse->task_fetch) {
+            parse->task_fetch = TRUE;
+            recipe_parse_fetch (parse, atts, n_atts);
+        } else if (g_strcmp0 (name, "rpm") == 0 && !parse->task_rpm) {
+            parse->task_rpm = TRUE;
+            parse->rpm_name = sax_attribute (atts, n_atts, "name");
+            parse->rpm_path = sax_attribute (atts, n_atts, "path");
+        } else if (g_strcmp0 (name, "params") == 0 && !parse->task_params) {
+            parse->task_params = TRUE;
+            parse->params_depth = depth;
+        } else if (g_strcmp0 (name, "roles") == 0 && !parse->task_roles) {
+            parse->task_roles = TRUE;
+            parse->roles.depth = depth;
+        }
+        return;
+    }
+
+    // What went wrong in <params/> or <roles/>
+    if (parse->error != NULL) {
+        if (parse->task != NULL) {
+            g_prefix_error (&parse->error, "Task %s has ", parse->task->task_id);
+        } else {
+            g_prefix_error (&parse->error, "Recipe %s has ", parse->recipe->recipe_id);
+        }
+    }
+}
+
+static void
+recipe_end_element (void *user_data, const xmlChar *xml_name,
+                    const xmlChar *prefix, const xmlChar *uri)
+{
+    RecipeParse *parse = user_data;
+    Recipe *recipe = parse->recipe;
+    gint depth = parse->depth--;
+    GList *list;
+
+    if (parse->recipe_depth == 0) {
+        return;
+    }
+    if (depth == parse->recipe_depth) {
+        recipe->tasks = g_list_reverse (recipe->tasks);
+        parse->recipe_depth = 0;
+        return;
+    }
+    if (parse->error != NULL) {
+        return;
+    }
+
+    if (depth == parse->params_depth) {
+        list = g_list_reverse (parse->params);
+        parse->params = NULL;
+        parse->params_depth = 0;
+        if (parse->task != NULL) {
+            parse->task->params = list;
+        } else {
+            g_list_free_full (recipe->params, (GDestroyNotify) restraint_param_free_interned);
+            recipe->params = list;
+        }
+    } else if (parse->roles.depth != 0) {
+        if (sax_roles_end (&parse->roles, depth, &list)) {
+            GList **roles = parse->task != NULL ? &parse->task->roles : &recipe->roles;
+
+            g_list_free_full (*roles, (GDestroyNotify) restraint_role_free);
+            *roles = list;
+        }
+    } else if (depth == parse->recipe_depth + 1 && parse->task != NULL) {
+        recipe_parse_task_end (parse);
+    }
+}
+
+static xmlSAXHandler recipe_sax = {
+    .initialized = XML_SAX2_MAGIC,
+    .startElementNs = recipe_start_element,
+    .endElementNs = recipe_end_element,
+};
+/*
+ * A snapshot is the parsed recipe as a GVariant, so that restraintd can
+ * resume after a reboot without fetching and parsing the recipe again.
+ * Task state in the config is still read for the task being resumed.
+ */
+#define RECIPE_SNAPSHOT_VERSION 1
+#define RECIPE_SNAPSHOT_TASK_TYPE "(smssusbbia(ss)a(ss)bb)"
+#define RECIPE_SNAPSHOT_TYPE "(usmsmsmsmsmsmsmsmsmsa(ss)a(ss)a" \
+                             RECIPE_SNAPSHOT_TASK_TYPE ")"
+
+static void
+snapshot_build_params (GVariantBuilder *builder, GList *params)
+{
+    g_variant_builder_init (builder, G_VARIANT_TYPE ("a(ss)"));
+    for (GList *item = params; item != NULL; item = item->next) {
+        Param *param = item->data;
+        g_variant_builder_add (builder, "(ss)", param->name, param->value);
+    }
+}
+
+static void
+snapshot_build_roles (GVariantBuilder *builder, GList *roles)
+{
+    g_variant_builder_init (builder, G_VARIANT_TYPE ("a(ss)"));
+    for (GList *item = roles; item != NULL; item = item->next) {
+        Role *role = item->data;
+        g_variant_builder_add (builder, "(ss)", role->value, role->systems);
+    }
+}
+
+static GList *
+snapshot_read_params (GStringChunk *strings, GVariantIter *iter)
+{
+    GList *params = NULL;
+    const gchar *name, *value;
+
+    while (g_variant_iter_next (iter, "(&s&s)", &name, &value)) {
+        Param *param = restraint_param_new ();
+        param->name = g_string_chunk_insert_const (strings, name);
+        param->value = g_string_chunk_insert_const (strings, value);
+        params = g_list_prepend (params, param);
+    }
+    g_variant_iter_free (iter);
+    return g_list_reverse (params);
+}
+
+static GList *
+snapshot_read_roles (GVariantIter *iter)
+{
+    GList *roles = NULL;
+    gchar *value, *systems;
+
+    while (g_variant_iter_next (iter, "(ss)", &value, &systems)) {
+        Role *role = restraint_role_new ();
+        role->value = value;
+        role->systems = systems;
+        roles = g_list_prepend (roles, role);
+    }
+    g_variant_iter_free (iter);
+    return g_list_reverse (roles);
+}
+
+gboolean
+restraint_recipe_snapshot_save (Recipe *recipe, const gchar *recipe_url,
+                                const gchar *filename, GError **error)
+{
+    GVariantBuilder params, roles, tasks;
+    GVariant *snapshot;
+    gboolean ret;
+
+    g_return_val_if_fail (recipe != NULL, FALSE);
+    g_return_val_if_fail (recipe_url != NULL, FALSE);
+    g_return_val_if_fail (error == NULL || *error == NULL, FALSE);
+
+    g_variant_builder_init (&tasks, G_VARIANT_TYPE ("a" RECIPE_SNAPSHOT_TASK_TYPE));
+    for (GList *item = recipe->tasks; item != NULL; item = item->next) {
+        Task *task = item->data;
+        GVariantBuilder task_params, task_roles;
+        gchar *fetch;
+
+        if (task->fetch_method == TASK_FETCH_UNPACK) {
+            fetch = soup_uri_to_string (task->fetch.url, FALSE);
+        } else {
+            fetch = g_strdup (task->fetch.package_name);
+        }
+        snapshot_build_params (&task_params, task->params);
+        snapshot_build_roles (&task_roles, task->roles);
+        g_variant_builder_add (&tasks, RECIPE_SNAPSHOT_TASK_TYPE,
+                               task->task_id, task->name, task->path,
+                               task->fetch_method, fetch, task->keepchanges,
+                               task->ssl_verify, task->order, &task_params,
+                               &task_roles, task->started, task->finished);
+        g_free (fetch);
+    }
+    snapshot_build_params (&params, recipe->params);
+    snapshot_build_roles (&roles, recipe->roles);
+
+    snapshot = g_variant_ref_sink (
+        g_variant_new (RECIPE_SNAPSHOT_TYPE, RECIPE_SNAPSHOT_VERSION,
+                       recipe_url, recipe->recipe_id, recipe->job_id,
+                       recipe->recipe_set_id, recipe->osdistro,
+                       recipe->osmajor, recipe->osvariant, recipe->osarch,
+                       recipe->owner, recipe->base_path, &params, &roles,
+                       &tasks));
+
+    ret = g_file_set_contents (filename, g_variant_get_data (snapshot),
+                               g_variant_get_size (snapshot), error);
+    g_variant_unref (snapshot);
+
+    return ret;
+}
+
+Recipe *
+restraint_recipe_snapshot_load (const gchar *filename, const gchar *recipe_url,
+                                GError **error)
+{
+    gchar *contents;
+    gsize length;
+    GVariant *snapshot;
+    guint32 version;
+    const gchar *snapshot_url;
+    GVariantIter *params, *roles, *tasks;
+    Recipe *recipe = NULL;
+    gchar *task_id, *name, *path, *fetch;
+    guint32 fetch_method;
+    gboolean keepchanges, ssl_verify, started, finished;
+    gint32 order;
+
+    g_return_val_if_fail (recipe_url != NULL, NULL);
+    g_return_val_if_fail (error == NULL || *error == NULL, NULL);
+
+    if (!g_file_get_contents (filename, &contents, &length, error)) {
+        return NULL;
+    }
+    snapshot = g_variant_ref_sink (
+        g_variant_new_from_data (G_VARIANT_TYPE (RECIPE_SNAPSHOT_TYPE),
+                                 contents, length, FALSE, g_free, contents));
+
+    g_variant_get_child (snapshot, 0, "u", &version);
+    g_variant_get_child (snapshot, 1, "&s", &snapshot_url);
+    if (version != RECIPE_SNAPSHOT_VERSION) {
+        unrecognised ("Snapshot %s is version %u, not %u", filename, version,
+                      RECIPE_SNAPSHOT_VERSION);
+        goto out;
+    }
+    if (g_strcmp0 (snapshot_url, recipe_url) != 0) {
+        unrecognised ("Snapshot %s is of recipe %s", filename, snapshot_url);
+        goto out;
+    }
+
+    recipe = g_slice_new0 (Recipe);
+    g_variant_get (snapshot, RECIPE_SNAPSHOT_TYPE, NULL, NULL,
+                   &recipe->recipe_id, &recipe->job_id, &recipe->recipe_set_id,
+                   &recipe->osdistro, &recipe->osmajor, &recipe->osvariant,
+                   &recipe->osarch, &recipe->owner, &recipe->base_path,
+                   &params, &roles, &tasks);
+    recipe->recipe_uri = soup_uri_new (recipe_url);
+    recipe->strings = g_string_chunk_new (4096);
+    recipe->params = snapshot_read_params (recipe->strings, params);
+    recipe->roles = snapshot_read_roles (roles);
+
+    while (g_variant_iter_next (tasks, RECIPE_SNAPSHOT_TASK_TYPE, &task_id,
+                                &name, &path, &fetch_method, &fetch,
+                                &keepchanges, &ssl_verify, &order, &params,
+                                &roles, &started, &finished)) {
+        Task *task = restraint_task_new ();
+        gchar *suffix = g_strconcat ("tasks/", task_id, "/", NULL);
+
+        task->recipe = recipe;
+        task->task_id = task_id;
+        task->task_uri = soup_uri_new_with_base (recipe->recipe_uri, suffix);
+        task->name = name;
+        task->path = path;
+        task->fetch_method = fetch_method;
+        if (task->fetch_method == TASK_FETCH_UNPACK) {
+            task->fetch.url = soup_uri_new (fetch);
+            g_free (fetch);
+        } else {
+            task->fetch.package_name = fetch;
+        }
+        task->keepchanges = keepchanges;
+        task->ssl_verify = ssl_verify;
+        task->order = order;
+        task->params = snapshot_read_params (recipe->strings, params);
+        task->roles = snapshot_read_roles (roles);
+        task->started = started;
+        task->finished = finished;
+        recipe->tasks = g_list_prepend (recipe->tasks, task);
+        g_free (suffix);
+
+        if (task->fetch_method == TASK_FETCH_UNPACK && task->fetch.url == NULL) {
+            unrecognised ("Snapshot %s has an invalid url for task %s",
+                          filename, task->task_id);
+            g_clear_pointer (&recipe, restraint_recipe_free);
+            break;
+        }
+    }
+    g_variant_iter_free (tasks);
+    if (recipe != NULL) {
+        recipe->tasks = g_list_reverse (recipe->tasks);
+    }
+
+out:
+    g_variant_unref (snapshot);
+    return recipe;
+}
+
+void
+restraint_recipe_checkpoint (Recipe *recipe, const gchar *recipe_url,
+                             const gchar *filename)
+{
+    GError *error = NULL;
+
+    if (recipe == NULL || recipe_url == NULL) {
+        return;
+    }
+    if (!restraint_recipe_snapshot_save (recipe, recipe_url, filename, &error)) {
+        // Only costs a fetch on the next resume.
+        g_warning ("* Unable to save recipe snapshot: %s", error->message);
+        g_clear_error (&error);
+    }
+}
+
+typedef struct {
+    AppData *app_data;
+    gchar *recipe_url;
+} RecipeRefreshData;
+
+/* Marks the tasks the lab controller has finished, by id. */
+static void
+recipe_update_finished (Recipe *recipe, xmlDoc *doc)
+{
+    xmlNodePtr recipe_node = find_recipe (doc);
+
+    if (recipe_node == NULL) {
+        return;
+    }
+    for (xmlNode *child = recipe_node->children; child != NULL; child = child->next) {
+        gchar *task_id, *status;
+
+        if (child->type != XML_ELEMENT_NODE ||
+                g_strcmp0 ((gchar *)child->name, "task") != 0) {
+            continue;
+        }
+        task_id = get_attribute (child, "id");
+        status = get_attribute (child, "status");
+        if (g_strcmp0 (status, "Completed") == 0 ||
+                g_strcmp0 (status, "Aborted") == 0 ||
+                g_strcmp0 (status, "Cancelled") == 0) {
+            for (GList *item = recipe->tasks; item != NULL; item = item->next) {
+                Task *task = item->data;
+
+                if (g_strcmp0 (task->task_id, task_id) == 0) {
+                    task->started = TRUE;
+                    task->finished = TRUE;
+                }
             }
         }
-        child = child->next;
+        g_free (status);
+        g_free (task_id);
     }
-    tasks = g_list_reverse(tasks);
+}
 
-    result->tasks = tasks;
-    return result;
+static void
+recipe_refresh_completed (GError *error, xmlDoc *doc, gpointer user_data)
+{
+    RecipeRefreshData *refresh_data = (RecipeRefreshData *) user_data;
+    AppData *app_data = refresh_data->app_data;
+    GError *tmp_error = NULL;
 
-error:
-    restraint_recipe_free(result);
-    return NULL;
+    if (error) {
+        g_printerr ("* Refreshing recipe failed, continuing from snapshot: %s\n",
+                    error->message);
+    } else if (app_data->recipe == NULL ||
+               g_strcmp0 (app_data->recipe_url, refresh_data->recipe_url) != 0) {
+        // The recipe finished before the lab controller answered.
+    } else {
+        restraint_recipe_update_roles (app_data->recipe, doc, &tmp_error);
+        if (tmp_error) {
+            g_printerr ("* Refreshing recipe failed, continuing from snapshot: %s\n",
+                        tmp_error->message);
+            g_clear_error (&tmp_error);
+        } else {
+            recipe_update_finished (app_data->recipe, doc);
+            restraint_recipe_checkpoint (app_data->recipe, app_data->recipe_url,
+                                         app_data->snapshot_file);
+        }
+    }
+
+    if (doc) {
+        xmlFreeDoc (doc);
+    }
+    restraint_app_data_unref (refresh_data->app_data);
+    g_free (refresh_data->recipe_url);
+    g_slice_free (RecipeRefreshData, refresh_data);
+}
+
+/* Fetches the recipe behind the tasks resumed from the snapshot. */
+static void
+recipe_refresh_start (AppData *app_data)
+{
+    RecipeRefreshData *refresh_data = g_slice_new0 (RecipeRefreshData);
+
+    refresh_data->app_data = restraint_app_data_ref (app_data);
+    refresh_data->recipe_url = g_strdup (app_data->recipe_url);
+    restraint_xml_parse_from_url (soup_session, app_data->recipe_url,
+                                  recipe_refresh_completed, refresh_data);
 }
 
 static gboolean fetch_retry (gpointer user_data)
@@ -512,70 +1183,111 @@ static gboolean fetch_retry (gpointer user_data)
     return FALSE;
 }
 
+static RecipeParse *
+recipe_parse_new (AppData *app_data)
+{
+    RecipeParse *parse = g_slice_new0 (RecipeParse);
+
+    parse->app_data = app_data;
+    if (app_data->recipe_url) {
+        parse->recipe_uri = soup_uri_new (app_data->recipe_url);
+    }
+    return parse;
+}
+
 static void
-fetch_completed(GError *error, xmlDoc *doc, gpointer user_data)
+fetch_completed (GError *error, gboolean modified, gpointer user_data)
 {
-    AppData *app_data = (AppData *)user_data;
+    RecipeParse *parse = user_data;
+    AppData *app_data = parse->app_data;
 
     if (error) {
-        g_warn_if_fail(!doc);
         if (app_data->fetch_retries < RECIPE_FETCH_RETRIES) {
             g_print("* RETRY [%d]**:%s\n", ++app_data->fetch_retries,
                     error->message);
             g_timeout_add_seconds (RECIPE_FETCH_INTERVAL, fetch_retry, app_data);
         } else {
-            g_propagate_prefixed_error(&app_data->error, error,
+            g_propagate_prefixed_error(&app_data->error, g_error_copy (error),
                     "While fetching recipe XML: ");
             /* Set us back to idle so we can accept a valid recipe */
             app_data->state = RECIPE_COMPLETE;
         }
-        return;
+    } else if (parse->error == NULL && parse->recipe == NULL) {
+        g_set_error (&app_data->error, RESTRAINT_RECIPE_PARSE_ERROR,
+                     RESTRAINT_RECIPE_PARSE_ERROR_UNRECOGNISED,
+                     "<recipe/> element not found");
+        app_data->state = RECIPE_COMPLETE;
+    } else if (parse->error != NULL) {
+        g_propagate_error (&app_data->error, g_steal_pointer (&parse->error));
+        app_data->state = RECIPE_COMPLETE;
+    } else {
+        app_data->recipe = g_steal_pointer (&parse->recipe);
+        if (parse->cfg_file != NULL) {
+            g_free (app_data->config_file);
+            app_data->config_file = g_steal_pointer (&parse->cfg_file);
+        }
+        app_data->state = RECIPE_PARSE;
     }
 
-    g_warn_if_fail(!app_data->recipe_xmldoc);
-    app_data->recipe_xmldoc = doc;
-    app_data->state = RECIPE_PARSE;
+    recipe_parse_free (parse);
 }
 
 void
 restraint_recipe_parse_stream (GInputStream *stream, gpointer user_data)
 {
     AppData *app_data = (AppData *) user_data;
+    RecipeParse *parse = recipe_parse_new (app_data);
 
-    restraint_xml_parse_from_stream(stream, app_data->recipe_url, fetch_completed, app_data);
+    restraint_xml_sax_from_stream (stream, app_data->recipe_url, &recipe_sax, parse,
+                                   fetch_completed, parse);
 }
 
 gboolean
 recipe_handler (gpointer user_data)
 {
     AppData *app_data = (AppData *) user_data;
-    SoupURI *recipe_uri = NULL;
+    RecipeParse *parse;
     GString *message = g_string_new(NULL);
     gboolean result = TRUE;
+    GError *tmp_error = NULL;
 
     switch (app_data->state) {
+        case RECIPE_RESUME:
+            app_data->recipe = restraint_recipe_snapshot_load (app_data->snapshot_file,
+                                                               app_data->recipe_url,
+                                                               &tmp_error);
+            if (app_data->recipe) {
+                g_string_printf(message, "* Resuming recipe from snapshot\n");
+                app_data->tasks = app_data->recipe->tasks;
+                recipe_refresh_start (app_data);
+                app_data->state = RECIPE_RUN;
+            } else {
+                if (!g_error_matches (tmp_error, G_FILE_ERROR, G_FILE_ERROR_NOENT)) {
+                    g_string_printf(message, "* Not resuming from snapshot: %s\n",
+                                    tmp_error->message);
+                }
+                g_clear_error (&tmp_error);
+                app_data->state = RECIPE_FETCH;
+            }
+            break;
         case RECIPE_FETCH:
             if (!app_data->stdin && recipe_wait_on_beaker (app_data->recipe_url, "* Recipe fetch"))
                 break;
 
             g_string_printf(message, "* Fetching recipe: %s\n", app_data->recipe_url);
             app_data->state = RECIPE_FETCHING;
-            restraint_xml_parse_from_url(soup_session, app_data->recipe_url,
-                    fetch_completed, app_data);
+            parse = recipe_parse_new (app_data);
+            restraint_xml_sax_from_url (soup_session, app_data->recipe_url, NULL,
+                                        &recipe_sax, parse, fetch_completed, parse);
             // fetch_completed callback will move us to the next state
             break;
         case RECIPE_PARSE:
+            // fetch_completed has built the recipe as it was read
             g_string_printf(message, "* Parsing recipe\n");
-            if (app_data->recipe_url)
-                recipe_uri = soup_uri_new(app_data->recipe_url);
-            app_data->recipe = recipe_parse(app_data->recipe_xmldoc, recipe_uri,
-                                            &app_data->error, &app_data->config_file);
-            if (app_data->recipe && ! app_data->error) {
-                app_data->tasks = app_data->recipe->tasks;
-                app_data->state = RECIPE_RUN;
-            } else {
-                app_data->state = RECIPE_COMPLETE;
-            }
+            app_data->tasks = app_data->recipe->tasks;
+            restraint_recipe_checkpoint (app_data->recipe, app_data->recipe_url,
+                                         app_data->snapshot_file);
+            app_data->state = RECIPE_RUN;
             break;
         case RECIPE_RUN:
             if (app_data->recipe_url) {
@@ -586,10 +1298,7 @@ recipe_handler (gpointer user_data)
                                       G_TYPE_STRING,
                                       app_data->recipe_url);
             }
-            app_data->task_handler_id = g_idle_add_full(G_PRIORITY_DEFAULT_IDLE,
-                                                        task_handler,
-                                                        app_data,
-                                                        NULL);
+            restraint_tasks_run (app_data);
             g_string_printf(message, "* Running recipe\n");
             app_data->state = RECIPE_RUNNING;
             break;
@@ -601,13 +1310,21 @@ recipe_handler (gpointer user_data)
                 g_string_printf(message, "* WARNING **: %s\n", app_data->error->message);
             } else {
                 g_string_printf(message, "* Finished recipe\n");
+                if (app_data->recipe && app_data->recipe->task_phase_usec) {
+                    gchar *phases = restraint_task_phases_format (app_data->recipe->task_phase_usec);
+                    g_string_append_printf(message, "* Task phases: %s\n", phases);
+                    g_free(phases);
+                }
                 if (app_data->close_message && app_data->message_data) {
                     app_data->close_message (app_data->message_data);
                 }
             }
-            if (app_data->recipe_xmldoc) {
-                xmlFreeDoc(app_data->recipe_xmldoc);
-                app_data->recipe_xmldoc = NULL;
+            if (app_data->recipe_url) {
+                g_unlink (app_data->snapshot_file);
+                // A hosted recipe isn't resumed once it has finished
+                if (app_data->hosted) {
+                    g_unlink (app_data->config_file);
+                }
             }
             // free current recipe
             if (app_data->recipe) {
@@ -658,6 +1375,31 @@ recipe_handler_finish (gpointer user_data)
         soup_server_unpause_message (client_data->server, client_data->client_msg);
     }
     g_clear_error (&app_data->error);
+
+    // A hosted recipe is done with for good once it has completed
+    if (app_data->hosted && app_data->state == RECIPE_IDLE &&
+        app_data->hosted_done != NULL) {
+        app_data->hosted_done (app_data);
+    }
+}
+
+gpointer
+restraint_app_data_ref (gpointer app_data)
+{
+    AppData *data = (AppData *) app_data;
+
+    g_atomic_int_inc (&data->ref_count);
+    return app_data;
+}
+
+void
+restraint_app_data_unref (gpointer app_data)
+{
+    AppData *data = (AppData *) app_data;
+
+    if (g_atomic_int_dec_and_test (&data->ref_count) && data->free_func != NULL) {
+        data->free_func (data);
+    }
 }
 
 /*
@@ -23,13 +23,17 @@
 #include <libsoup/soup.h>
 #include <libxml/tree.h>
 
+#include "xml.h"
+
 #define RECIPE_FETCH_INTERVAL 10
 #define RECIPE_FETCH_RETRIES 12
+#define RECIPE_SNAPSHOT_FILE "/var/lib/restraint/recipe.snapshot"
 
 extern SoupSession *soup_session;
 
 typedef enum {
     RECIPE_IDLE,
+    RECIPE_RESUME,
     RECIPE_FETCH,
     RECIPE_FETCHING,
     RECIPE_PARSE,
@@ -53,6 +57,15 @@ typedef struct {
     GList *params; // list of Params
     GList *roles; // list of Roles
     SoupURI *recipe_uri;
+    /* Microseconds the tasks spent in each TaskPhase, summed */
+    gint64 *task_phase_usec;
+    /*
+     * The names and values of the params of the recipe and its tasks, each
+     * kept once however many tasks share it.  NULL if they own their own.
+     */
+    GStringChunk *strings;
+    /* Of the recipe the roles were last refreshed from */
+    RestraintXmlValidators roles_validators;
 } Recipe;
 
 #define RESTRAINT_RECIPE_PARSE_ERROR restraint_recipe_parse_error_quark()
@@ -64,8 +77,38 @@ typedef enum {
 gboolean recipe_handler (gpointer user_data);
 void restraint_recipe_parse_stream (GInputStream *stream, gpointer user_data);
 void restraint_recipe_update_roles(Recipe *recipe, xmlDoc *doc, GError **error);
+
+typedef void (*RecipeRolesCallback) (GError *error, gboolean modified, gpointer user_data);
+/*
+ * Fetches the recipe again, unless it did not change since the last
+ * refresh, and updates the recipe's and tasks' roles from it.  Only the
+ * <roles/> are picked out as the recipe is read; no xmlDoc is built.
+ * The callback does not own the error.
+ */
+void restraint_recipe_refresh_roles (Recipe *recipe, const gchar *recipe_url,
+                                     RecipeRolesCallback callback, gpointer user_data);
 void restraint_recipe_free(Recipe *recipe);
 void recipe_handler_finish (gpointer user_data);
+/*
+ * A hosted recipe's AppData is freed by its free_func once the last
+ * reference is dropped, so callbacks still pending when it finishes can
+ * use it.  The primary AppData has no free_func and lives for good.
+ */
+gpointer restraint_app_data_ref (gpointer app_data);
+void restraint_app_data_unref (gpointer app_data);
+
+/*
+ * A snapshot of the parsed recipe, with which tasks have started and
+ * finished, so restraintd can resume without fetching the recipe first.
+ * Loading fails unless the snapshot is of recipe_url.
+ */
+gboolean restraint_recipe_snapshot_save (Recipe *recipe, const gchar *recipe_url,
+                                         const gchar *filename, GError **error);
+Recipe *restraint_recipe_snapshot_load (const gchar *filename,
+                                        const gchar *recipe_url, GError **error);
+// Saves the snapshot to filename, warning if it can't
+void restraint_recipe_checkpoint (Recipe *recipe, const gchar *recipe_url,
+                                  const gchar *filename);
 gboolean recipe_wait_on_beaker (const gchar *recipe_url, const gchar *state_tag);
 
 #endif
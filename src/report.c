@@ -0,0 +1,867 @@
+/*
+    This file is part of Restraint.
+
+    Restraint is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Restraint is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Restraint.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+ * The reports used to come from running client/job2html.xml and
+ * client/job2junit.xml over job.xml with xsltproc, and tools compare
+ * against those, so the output here copies theirs exactly.  The
+ * stylesheets see job.xml as xmlDocFormatDump() wrote it, which means
+ * the indentation it added shows up in their output and in the string
+ * values they compare; it is reproduced here from the same rules rather
+ * than by reading the file back.
+ */
+
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <errno.h>
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <libxml/tree.h>
+#include "report.h"
+
+/* xmlsave stops indenting deeper than this many levels */
+#define REPORT_MAX_INDENT 30
+
+#define HTML_HEADER "<HTML xmlns=\"http://www.w3.org/TR/REC-html40\">" \
+    "<HEAD><meta http-equiv=\"Content-Type\" content=\"text/html; charset=UTF-8\">\n" \
+    "<TITLE>Beaker Recipe Results</TITLE>" \
+    "<LINK REL=\"stylesheet\" HREF=\"./bootstrap.min.css\"></LINK></HEAD><BODY>"
+#define HTML_FOOTER "</BODY></HTML>\n"
+
+#define HTML_RECIPE_HEADER "<table class=\"table table-condensed table-hover tasks\">" \
+    "<thead><tr><th>Run ID</th><th>Task</th>" \
+    "<th>StartTime<br></br>[FinishTime]<br></br>[Duration]</th>" \
+    "<th class=\"logs\">Logs</th><th>Status</th><th>Result</th><th>Score</th>" \
+    "</tr></thead>"
+
+typedef void (*ReportFunc) (FILE *out, xmlDocPtr job_doc);
+
+static gboolean
+is_element (xmlNodePtr node, const gchar *name)
+{
+    return node != NULL && node->type == XML_ELEMENT_NODE &&
+           g_strcmp0 ((gchar *) node->name, name) == 0;
+}
+
+static gchar *
+get_attribute (xmlNodePtr node, const gchar *name)
+{
+    return (gchar *) xmlGetNoNsProp (node, (xmlChar *) name);
+}
+
+static gboolean
+attribute_equals (xmlNodePtr node, const gchar *name,
+                  const gchar *value1, const gchar *value2)
+{
+    gchar *value = get_attribute (node, name);
+    gboolean equals = value != NULL && (g_strcmp0 (value, value1) == 0 ||
+                                        g_strcmp0 (value, value2) == 0);
+
+    xmlFree (value);
+    return equals;
+}
+
+/*
+ * xmlDocFormatDump() only indents the children of elements which don't
+ * have text of their own, and once it stops it doesn't start again
+ * further down.
+ */
+static gboolean
+has_text_children (xmlNodePtr node)
+{
+    for (xmlNodePtr child = node->children; child != NULL; child = child->next) {
+        if (child->type == XML_TEXT_NODE ||
+                child->type == XML_CDATA_SECTION_NODE ||
+                child->type == XML_ENTITY_REF_NODE) {
+            return TRUE;
+        }
+    }
+    return FALSE;
+}
+
+static gboolean
+children_indented (xmlNodePtr node, gboolean indented)
+{
+    return indented && node->children != NULL && !has_text_children (node);
+}
+
+static void
+write_indent (FILE *out, guint level)
+{
+    fputc ('\n', out);
+    for (guint i = 0; i < MIN (level, REPORT_MAX_INDENT); i++) {
+        fputs ("  ", out);
+    }
+}
+
+static void
+append_indent (GString *string, guint level)
+{
+    g_string_append_c (string, '\n');
+    for (guint i = 0; i < MIN (level, REPORT_MAX_INDENT); i++) {
+        g_string_append (string, "  ");
+    }
+}
+
+/* The XPath string value of node as it reads back from job.xml */
+static void
+append_string_value (GString *string, xmlNodePtr node, guint level,
+                     gboolean indented)
+{
+    gboolean indent = children_indented (node, indented);
+
+    if (node->type == XML_TEXT_NODE || node->type == XML_CDATA_SECTION_NODE) {
+        if (node->content != NULL) {
+            g_string_append (string, (gchar *) node->content);
+        }
+        return;
+    }
+    if (node->type != XML_ELEMENT_NODE) {
+        return;
+    }
+    for (xmlNodePtr child = node->children; child != NULL; child = child->next) {
+        if (indent) {
+            append_indent (string, level + 1);
+        }
+        append_string_value (string, child, level + 1, indent);
+    }
+    if (indent) {
+        append_indent (string, level);
+    }
+}
+
+/*
+ * XPath number(), which is stricter than strtod(): no leading '+', no hex
+ * and no inf or nan.
+ */
+static gdouble
+xpath_number (const gchar *string)
+{
+    const gchar *cur = string;
+    gboolean digits = FALSE;
+
+    if (string == NULL) {
+        return NAN;
+    }
+    while (g_ascii_isspace (*cur) && *cur != '\f' && *cur != '\v') {
+        cur++;
+    }
+    string = cur;
+    if (*cur == '-') {
+        cur++;
+    }
+    while (g_ascii_isdigit (*cur)) {
+        digits = TRUE;
+        cur++;
+    }
+    if (*cur == '.') {
+        cur++;
+        if (!digits && !g_ascii_isdigit (*cur)) {
+            return NAN;
+        }
+        while (g_ascii_isdigit (*cur)) {
+            cur++;
+        }
+    } else if (!digits && cur == string) {
+        return NAN;
+    }
+    if (*cur == 'e' || *cur == 'E') {
+        cur++;
+        if (*cur == '-' || *cur == '+') {
+            cur++;
+        }
+        while (g_ascii_isdigit (*cur)) {
+            cur++;
+        }
+    }
+    while (g_ascii_isspace (*cur) && *cur != '\f' && *cur != '\v') {
+        cur++;
+    }
+    if (*cur != '\0') {
+        return NAN;
+    }
+    // What is left is something strtod() reads the same way, or a lone
+    // sign which it reads as zero.
+    return g_ascii_strtod (string, NULL);
+}
+
+/* format-number(number, 'prefix00') */
+static void
+write_two_digits (FILE *out, gdouble number, const gchar *prefix)
+{
+    gchar digits[500];
+    gchar *pointer = digits + sizeof (digits) - 1;
+
+    if (isnan (number)) {
+        fputs ("NaN", out);
+        return;
+    }
+    if (isinf (number)) {
+        fputs (number < 0 ? "-Infinity" : "Infinity", out);
+        return;
+    }
+    if (number < 0) {
+        fputc ('-', out);
+    }
+    fputs (prefix, out);
+
+    number = floor (fabs (number) + 0.5);
+    *pointer = '\0';
+    for (guint i = 0; pointer > digits; i++) {
+        if (i >= 2 && number < 1.0) {
+            break;
+        }
+        *(--pointer) = '0' + (gint) fmod (number, 10.0);
+        number /= 10.0;
+    }
+    fputs (pointer, out);
+}
+
+static void
+write_duration (FILE *out, const gchar *duration)
+{
+    gdouble seconds = xpath_number (duration);
+
+    write_two_digits (out, floor (seconds / 3600), "");
+    write_two_digits (out, fmod (floor (seconds / 60), 60), ":");
+    write_two_digits (out, fmod (seconds, 60), ":");
+}
+
+static void
+write_html_text (FILE *out, const gchar *text)
+{
+    while (text != NULL && *text != '\0') {
+        gsize length = strcspn (text, "&<>");
+
+        fwrite (text, 1, length, out);
+        text += length;
+        switch (*text) {
+            case '&':
+                fputs ("&amp;", out);
+                break;
+            case '<':
+                fputs ("&lt;", out);
+                break;
+            case '>':
+                fputs ("&gt;", out);
+                break;
+            default:
+                return;
+        }
+        text++;
+    }
+}
+
+static void
+write_html_attribute_text (FILE *out, xmlNodePtr node, const gchar *name)
+{
+    gchar *value = get_attribute (node, name);
+
+    write_html_text (out, value);
+    xmlFree (value);
+}
+
+/*
+ * The HTML serializer escapes attributes like text, except that it leaves
+ * &{...} alone, and picks whichever quote the value doesn't use.
+ */
+static void
+write_html_attribute (FILE *out, const gchar *name, const gchar *value)
+{
+    GString *escaped = g_string_sized_new (strlen (value));
+    const gchar *quote = "\"";
+
+    for (const gchar *cur = value; *cur != '\0'; cur++) {
+        if (*cur == '&' && cur[1] == '{' && strchr (cur, '}') != NULL) {
+            const gchar *end = strchr (cur, '}');
+
+            g_string_append_len (escaped, cur, end - cur + 1);
+            cur = end;
+        } else if (*cur == '&') {
+            g_string_append (escaped, "&amp;");
+        } else if (*cur == '<') {
+            g_string_append (escaped, "&lt;");
+        } else if (*cur == '>') {
+            g_string_append (escaped, "&gt;");
+        } else if (*cur == '"' && strchr (value, '\'') != NULL) {
+            g_string_append (escaped, "&quot;");
+        } else {
+            g_string_append_c (escaped, *cur);
+        }
+    }
+    if (strchr (value, '"') != NULL && strchr (value, '\'') == NULL) {
+        quote = "'";
+    }
+
+    fprintf (out, " %s=%s%s%s", name, quote, escaped->str, quote);
+    g_string_free (escaped, TRUE);
+}
+
+static void html_node (FILE *out, xmlNodePtr node, guint level,
+                       gboolean indented);
+
+/* <xsl:apply-templates/> */
+static void
+html_children (FILE *out, xmlNodePtr node, guint level, gboolean indented)
+{
+    gboolean indent = children_indented (node, indented);
+
+    for (xmlNodePtr child = node->children; child != NULL; child = child->next) {
+        if (indent) {
+            write_indent (out, level + 1);
+        }
+        html_node (out, child, level + 1, indent);
+    }
+    if (indent) {
+        write_indent (out, level);
+    }
+}
+
+/* <xsl:apply-templates select="name"/> */
+static void
+html_select (FILE *out, xmlNodePtr node, const gchar *name, guint level,
+             gboolean indented)
+{
+    gboolean indent = children_indented (node, indented);
+
+    for (xmlNodePtr child = node->children; child != NULL; child = child->next) {
+        if (is_element (child, name)) {
+            html_node (out, child, level + 1, indent);
+        }
+    }
+}
+
+static void
+html_recipe (FILE *out, xmlNodePtr recipe, guint level, gboolean indented)
+{
+    fputs ("<table><tr><td>recipe ID</td><td>", out);
+    write_html_attribute_text (out, recipe, "id");
+    fputs ("</td></tr><tr>" HTML_RECIPE_HEADER, out);
+    html_children (out, recipe, level, indented);
+    fputs ("</table></tr></table>", out);
+}
+
+static void
+html_task (FILE *out, xmlNodePtr task, guint level, gboolean indented)
+{
+    gchar *duration = get_attribute (task, "duration");
+
+    fputs ("<tbody><tr><td class=\"task\">T:", out);
+    write_html_attribute_text (out, task, "id");
+    fputs ("</td><td class=\"task\">", out);
+    write_html_attribute_text (out, task, "name");
+    fputs ("</td><td class=\"task\">", out);
+    write_html_attribute_text (out, task, "start_time");
+    fputs ("<br></br>", out);
+    write_html_attribute_text (out, task, "end_time");
+    fputs ("<br></br>", out);
+    write_duration (out, duration);
+    fputs ("</td><td class=\"task logs\"><ul>", out);
+    html_select (out, task, "logs", level, indented);
+    fputs ("</ul></td><td class=\"task\">", out);
+    write_html_attribute_text (out, task, "status");
+    fputs ("</td><td class=\"task\">", out);
+    write_html_attribute_text (out, task, "result");
+    fputs ("</td><td class=\"task\"></td></tr>", out);
+    html_select (out, task, "results", level, indented);
+    fputs ("</tbody>", out);
+
+    xmlFree (duration);
+}
+
+static void
+html_result (FILE *out, xmlNodePtr result, guint level, gboolean indented)
+{
+    fputs ("<tr><td class=\"result\"></td><td class=\"result\">", out);
+    write_html_attribute_text (out, result, "path");
+    fputs ("</td><td style=\"white-space:nowrap;\" class=\"result\"></td>"
+           "<td class=\"result logs\"><ul>", out);
+    html_select (out, result, "logs", level, indented);
+    fputs ("</ul></td><td class=\"result\"></td><td class=\"result\">", out);
+    write_html_attribute_text (out, result, "result");
+    fputs ("</td><td class=\"result\">", out);
+    write_html_attribute_text (out, result, "score");
+    fputs ("</td></tr>", out);
+}
+
+static void
+html_log (FILE *out, xmlNodePtr log)
+{
+    gchar *path = get_attribute (log, "path");
+
+    fputs ("<li><a", out);
+    write_html_attribute (out, "href", path != NULL ? path : "");
+    fputs (" type=\"text/plain\">", out);
+    write_html_attribute_text (out, log, "filename");
+    fputs ("</a></li>", out);
+
+    xmlFree (path);
+}
+
+static void
+html_node (FILE *out, xmlNodePtr node, guint level, gboolean indented)
+{
+    switch (node->type) {
+        case XML_TEXT_NODE:
+        case XML_CDATA_SECTION_NODE:
+            write_html_text (out, (gchar *) node->content);
+            break;
+        case XML_ELEMENT_NODE:
+            if (is_element (node, "recipe") &&
+                    is_element (node->parent, "recipeSet") &&
+                    is_element (node->parent->parent, "job")) {
+                html_recipe (out, node, level, indented);
+            } else if (is_element (node, "task")) {
+                html_task (out, node, level, indented);
+            } else if (is_element (node, "result")) {
+                html_result (out, node, level, indented);
+            } else if (is_element (node, "log")) {
+                html_log (out, node);
+            } else {
+                html_children (out, node, level, indented);
+            }
+            break;
+        default:
+            break;
+    }
+}
+
+static void
+html_report (FILE *out, xmlDocPtr job_doc)
+{
+    fputs (HTML_HEADER, out);
+    for (xmlNodePtr child = job_doc->children; child != NULL; child = child->next) {
+        html_node (out, child, 0, TRUE);
+    }
+    fputs (HTML_FOOTER, out);
+}
+
+/* Attribute values as xmlsave writes them without an output encoding */
+static void
+write_xml_attribute (FILE *out, const gchar *name, const gchar *value)
+{
+    fprintf (out, " %s=\"", name);
+    for (const gchar *cur = value; cur != NULL && *cur != '\0'; cur++) {
+        switch (*cur) {
+            case '&':
+                fputs ("&amp;", out);
+                break;
+            case '<':
+                fputs ("&lt;", out);
+                break;
+            case '>':
+                fputs ("&gt;", out);
+                break;
+            case '"':
+                fputs ("&quot;", out);
+                break;
+            case '\t':
+                fputs ("&#9;", out);
+                break;
+            case '\n':
+                fputs ("&#10;", out);
+                break;
+            case '\r':
+                fputs ("&#13;", out);
+                break;
+            default:
+                if ((guchar) *cur < 0x80) {
+                    fputc (*cur, out);
+                } else {
+                    gunichar c = g_utf8_get_char_validated (cur, -1);
+
+                    if (c == (gunichar) -1 || c == (gunichar) -2) {
+                        fprintf (out, "&#x%X;", (guchar) *cur);
+                    } else {
+                        fprintf (out, "&#x%X;", c);
+                        cur = g_utf8_next_char (cur) - 1;
+                    }
+                }
+                break;
+        }
+    }
+    fputc ('"', out);
+}
+
+static void
+write_xml_attribute_from (FILE *out, const gchar *name, xmlNodePtr node,
+                          const gchar *attribute)
+{
+    gchar *value = get_attribute (node, attribute);
+
+    write_xml_attribute (out, name, value);
+    xmlFree (value);
+}
+
+/* The text of the logs template, as a CDATA section */
+static void
+write_junit_logs (FILE *out, xmlNodePtr node)
+{
+    GString *text = g_string_new ("\n  Logs:\n  ");
+    const gchar *start = NULL;
+    const gchar *end = NULL;
+
+    for (xmlNodePtr logs = node->children; logs != NULL; logs = logs->next) {
+        if (!is_element (logs, "logs")) {
+            continue;
+        }
+        for (xmlNodePtr log = logs->children; log != NULL; log = log->next) {
+            if (is_element (log, "log")) {
+                gchar *path = get_attribute (log, "path");
+
+                if (path != NULL) {
+                    g_string_append (text, path);
+                }
+                g_string_append_c (text, '\n');
+                xmlFree (path);
+            }
+        }
+    }
+
+    // A "]]>" in the text ends one section and starts another.
+    start = end = text->str;
+    while (*end != '\0') {
+        if (end[0] == ']' && end[1] == ']' && end[2] == '>') {
+            end += 2;
+            fputs ("<![CDATA[", out);
+            fwrite (start, 1, end - start, out);
+            fputs ("]]>", out);
+            start = end;
+        }
+        end++;
+    }
+    if (start != end) {
+        fputs ("<![CDATA[", out);
+        fwrite (start, 1, end - start, out);
+        fputs ("]]>", out);
+    }
+
+    g_string_free (text, TRUE);
+}
+
+/* <name message="{message}">logs</name> */
+static void
+write_junit_logs_element (FILE *out, xmlNodePtr result, const gchar *name,
+                          const gchar *type, guint level, gboolean indented)
+{
+    xmlNodePtr message = result->children;
+    GString *value = g_string_new (NULL);
+
+    while (message != NULL && !is_element (message, "message")) {
+        message = message->next;
+    }
+    if (message != NULL) {
+        append_string_value (value, message, level + 1,
+                             children_indented (result, indented));
+    }
+
+    fprintf (out, "<%s", name);
+    if (type != NULL) {
+        write_xml_attribute (out, "type", type);
+    }
+    write_xml_attribute (out, "message", value->str);
+    fputc ('>', out);
+    write_junit_logs (out, result);
+    fprintf (out, "</%s>", name);
+
+    g_string_free (value, TRUE);
+}
+
+static void
+junit_result (FILE *out, xmlNodePtr result, const gchar *classname,
+              const gchar *status, gboolean last, guint level,
+              gboolean indented)
+{
+    gchar *path = get_attribute (result, "path");
+    const gchar *name = NULL;
+    gboolean skipped = attribute_equals (result, "result", "SKIPPED", "Skipped");
+    gboolean failed = attribute_equals (result, "result", "FAIL", "Fail") ||
+                      attribute_equals (result, "result", "WARN", "Warn");
+
+    // substring-after(@path, $classname), or the whole path if that is empty
+    if (path != NULL && classname != NULL && *classname != '\0') {
+        name = strstr (path, classname);
+        if (name != NULL) {
+            name += strlen (classname);
+        }
+    }
+    if (name == NULL || *name == '\0') {
+        name = path;
+    }
+
+    write_indent (out, 2);
+    fputs ("<testcase", out);
+    write_xml_attribute (out, "classname", classname);
+    write_xml_attribute (out, "name", name);
+    fputc ('>', out);
+    write_indent (out, 3);
+    // The last result is the one an abort is reported against.
+    if (last && g_strcmp0 (status, "Aborted") == 0) {
+        write_junit_logs_element (out, result, "error", status,
+                                  level, indented);
+    } else if (skipped) {
+        fputs ("<skipped/>", out);
+    } else if (failed) {
+        write_junit_logs_element (out, result, last ? "error" : "failure",
+                                  NULL, level, indented);
+    } else {
+        fputs ("<system-out>", out);
+        write_junit_logs (out, result);
+        fputs ("</system-out>", out);
+    }
+    write_indent (out, 2);
+    fputs ("</testcase>", out);
+
+    xmlFree (path);
+}
+
+static void
+junit_task (FILE *out, xmlNodePtr task, guint level, gboolean indented)
+{
+    gchar *classname = get_attribute (task, "name");
+    gchar *status = get_attribute (task, "status");
+    gboolean indent = children_indented (task, indented);
+    xmlNodePtr last = NULL;
+    guint last_level = 0;
+    gboolean last_indented = FALSE;
+    GString *last_value = NULL;
+
+    write_indent (out, 2);
+    fputs ("<testcase", out);
+    write_xml_attribute (out, "classname", classname);
+    write_xml_attribute (out, "name", classname);
+    write_xml_attribute (out, "status", status);
+    write_xml_attribute_from (out, "timestamp", task, "start_time");
+    write_xml_attribute_from (out, "time", task, "duration");
+    fputc ('>', out);
+    write_indent (out, 3);
+    fputs ("<system-out>", out);
+    write_junit_logs (out, task);
+    fputs ("</system-out>", out);
+    write_indent (out, 2);
+    fputs ("</testcase>", out);
+
+    for (xmlNodePtr results = task->children; results != NULL; results = results->next) {
+        if (!is_element (results, "results")) {
+            continue;
+        }
+        for (xmlNodePtr result = results->children; result != NULL; result = result->next) {
+            if (is_element (result, "result")) {
+                last = result;
+                last_indented = children_indented (results, indent);
+            }
+        }
+    }
+    if (last == NULL) {
+        goto out;
+    }
+    last_level = level + 2;
+    last_value = g_string_new (NULL);
+    append_string_value (last_value, last, last_level, last_indented);
+
+    for (xmlNodePtr results = task->children; results != NULL; results = results->next) {
+        gboolean result_indented = children_indented (results, indent);
+
+        if (!is_element (results, "results")) {
+            continue;
+        }
+        for (xmlNodePtr result = results->children; result != NULL; result = result->next) {
+            gboolean is_last = result == last;
+
+            if (!is_element (result, "result")) {
+                continue;
+            }
+            // current() = $last compares string values, not nodes.
+            if (!is_last) {
+                GString *value = g_string_new (NULL);
+
+                append_string_value (value, result, last_level, result_indented);
+                is_last = g_string_equal (value, last_value);
+                g_string_free (value, TRUE);
+            }
+            junit_result (out, result, classname, status, is_last,
+                          last_level, result_indented);
+        }
+    }
+    g_string_free (last_value, TRUE);
+
+out:
+    xmlFree (status);
+    xmlFree (classname);
+}
+
+static void
+junit_recipe (FILE *out, xmlNodePtr recipe, guint level, gboolean indented)
+{
+    gboolean indent = children_indented (recipe, indented);
+    guint tests = 0;
+    guint errors = 0;
+    guint skipped = 0;
+    guint failures = 0;
+    gchar *count;
+
+    for (xmlNodePtr task = recipe->children; task != NULL; task = task->next) {
+        if (!is_element (task, "task")) {
+            continue;
+        }
+        tests++;
+        errors += attribute_equals (task, "status", "Aborted", NULL);
+        skipped += attribute_equals (task, "result", "SKIPPED", "Skipped");
+        failures += attribute_equals (task, "result", "FAIL", "Fail");
+        for (xmlNodePtr results = task->children; results != NULL; results = results->next) {
+            if (!is_element (results, "results")) {
+                continue;
+            }
+            for (xmlNodePtr result = results->children; result != NULL; result = result->next) {
+                if (!is_element (result, "result")) {
+                    continue;
+                }
+                tests++;
+                skipped += attribute_equals (result, "result", "SKIPPED", "Skipped");
+                failures += attribute_equals (result, "result", "FAIL", "Fail");
+            }
+        }
+    }
+
+    write_indent (out, 1);
+    fputs ("<testsuite", out);
+    write_xml_attribute_from (out, "id", recipe, "id");
+    write_xml_attribute_from (out, "name", recipe, "whiteboard");
+    count = g_strdup_printf ("%u", tests);
+    write_xml_attribute (out, "tests", count);
+    g_free (count);
+    count = g_strdup_printf ("%u", errors);
+    write_xml_attribute (out, "errors", count);
+    g_free (count);
+    count = g_strdup_printf ("%u", skipped);
+    write_xml_attribute (out, "skipped", count);
+    g_free (count);
+    count = g_strdup_printf ("%u", failures);
+    write_xml_attribute (out, "failures", count);
+    g_free (count);
+    if (tests == 0) {
+        fputs ("/>", out);
+        return;
+    }
+    fputc ('>', out);
+
+    for (xmlNodePtr task = recipe->children; task != NULL; task = task->next) {
+        if (is_element (task, "task")) {
+            junit_task (out, task, level + 1, indent);
+        }
+    }
+    write_indent (out, 1);
+    fputs ("</testsuite>", out);
+}
+
+static void
+junit_report (FILE *out, xmlDocPtr job_doc)
+{
+    gboolean empty = TRUE;
+
+    fputs ("<?xml version=\"1.0\"?>\n<testsuites", out);
+    for (xmlNodePtr job = job_doc->children; job != NULL; job = job->next) {
+        gboolean job_indent;
+
+        if (!is_element (job, "job")) {
+            continue;
+        }
+        job_indent = children_indented (job, TRUE);
+        for (xmlNodePtr recipe_set = job->children; recipe_set != NULL;
+                recipe_set = recipe_set->next) {
+            gboolean recipe_set_indent;
+
+            if (!is_element (recipe_set, "recipeSet")) {
+                continue;
+            }
+            recipe_set_indent = children_indented (recipe_set, job_indent);
+            for (xmlNodePtr recipe = recipe_set->children; recipe != NULL;
+                    recipe = recipe->next) {
+                if (!is_element (recipe, "recipe")) {
+                    continue;
+                }
+                if (empty) {
+                    fputc ('>', out);
+                    empty = FALSE;
+                }
+                junit_recipe (out, recipe, 2, recipe_set_indent);
+            }
+        }
+    }
+    fputs (empty ? "/>\n" : "\n</testsuites>\n", out);
+}
+
+static gboolean
+write_report (xmlDocPtr job_doc, const gchar *filename,
+              ReportFunc report_func, GError **error)
+{
+    gchar *tmp_filename = g_strdup_printf ("%s.tmp", filename);
+    gboolean success = FALSE;
+    FILE *out;
+
+    g_return_val_if_fail (job_doc != NULL, FALSE);
+
+    // Written aside and renamed, so a report being refreshed while the
+    // job runs is never seen half done.
+    out = g_fopen (tmp_filename, "w");
+    if (out == NULL) {
+        g_set_error (error, G_FILE_ERROR, g_file_error_from_errno (errno),
+                     "Failed to open %s: %s", tmp_filename, g_strerror (errno));
+        goto out;
+    }
+    report_func (out, job_doc);
+    if (ferror (out)) {
+        g_set_error (error, G_FILE_ERROR, g_file_error_from_errno (errno),
+                     "Failed to write %s: %s", tmp_filename, g_strerror (errno));
+        fclose (out);
+        g_remove (tmp_filename);
+        goto out;
+    }
+    if (fclose (out) != 0) {
+        g_set_error (error, G_FILE_ERROR, g_file_error_from_errno (errno),
+                     "Failed to write %s: %s", tmp_filename, g_strerror (errno));
+        g_remove (tmp_filename);
+        goto out;
+    }
+    if (g_rename (tmp_filename, filename) < 0) {
+        g_set_error (error, G_FILE_ERROR, g_file_error_from_errno (errno),
+                     "Failed to rename %s to %s: %s", tmp_filename, filename,
+                     g_strerror (errno));
+        g_remove (tmp_filename);
+        goto out;
+    }
+    success = TRUE;
+
+out:
+    g_free (tmp_filename);
+    return success;
+}
+
+gboolean
+rstrnt_report_write_html (xmlDocPtr job_doc, const gchar *filename,
+                          GError **error)
+{
+    return write_report (job_doc, filename, html_report, error);
+}
+
+gboolean
+rstrnt_report_write_junit (xmlDocPtr job_doc, const gchar *filename,
+                           GError **error)
+{
+    return write_report (job_doc, filename, junit_report, error);
+}
@@ -0,0 +1,53 @@
+/*
+    This file is part of Restraint.
+
+    Restraint is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Restraint is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Restraint.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef _RESTRAINT_REPORT_H
+#define _RESTRAINT_REPORT_H
+
+#include <glib.h>
+#include <libxml/tree.h>
+
+#define REPORT_HTML_FILENAME "index.html"
+#define REPORT_JUNIT_FILENAME "junit.xml"
+
+/**
+ * rstrnt_report_write_html:
+ * @job_doc: the client's job document.
+ * @filename: where to write the report, replaced atomically.
+ * @error: return location for a #GError.
+ *
+ * Writes the HTML results page, byte for byte what client/job2html.xml
+ * produces from job.xml, in a single pass over @job_doc.
+ */
+gboolean rstrnt_report_write_html (xmlDocPtr job_doc,
+                                   const gchar *filename,
+                                   GError **error);
+
+/**
+ * rstrnt_report_write_junit:
+ * @job_doc: the client's job document.
+ * @filename: where to write the report, replaced atomically.
+ * @error: return location for a #GError.
+ *
+ * Writes the JUnit XML report, byte for byte what client/job2junit.xml
+ * produces from job.xml, in a single pass over @job_doc.
+ */
+gboolean rstrnt_report_write_junit (xmlDocPtr job_doc,
+                                    const gchar *filename,
+                                    GError **error);
+
+#endif
@@ -0,0 +1,295 @@
+/*
+    This file is part of Restraint.
+
+    Restraint is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Restraint is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Restraint.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#define _GNU_SOURCE
+
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "retention.h"
+
+/* At the start of a saved tail, ahead of the ring */
+typedef struct {
+    guint64 dropped;
+    guint64 ring_start;
+    guint64 ring_length;
+} SavedHeader;
+
+struct RstrntRetention {
+    gsize head;
+    gsize tail;
+    guint64 written;
+    guint64 dropped;
+    gboolean finished;
+    /* The tail is a ring of tail bytes, allocated when first needed */
+    gchar *ring;
+    gsize ring_start;
+    gsize ring_length;
+    /* Where the ring is saved as it changes, with a path */
+    gchar *path;
+    gint fd;
+};
+
+RstrntRetention *
+rstrnt_retention_new (gsize head, gsize tail, guint64 written)
+{
+    RstrntRetention *retention = g_slice_new0 (RstrntRetention);
+
+    retention->head = head;
+    retention->tail = tail;
+    retention->written = written;
+    retention->fd = -1;
+
+    return retention;
+}
+
+static void
+saved_write (RstrntRetention *retention, const void *data, gsize length, off_t offset)
+{
+    while (length > 0) {
+        ssize_t ret = pwrite (retention->fd, data, length, offset);
+        if (ret <= 0) {
+            return;
+        }
+        data = (const gchar *) data + ret;
+        length -= ret;
+        offset += ret;
+    }
+}
+
+/* Reads back a ring saved before a reboot, if it fits this tail. */
+static void
+saved_load (RstrntRetention *retention)
+{
+    SavedHeader header;
+    struct stat st;
+
+    if (fstat (retention->fd, &st) == -1 ||
+        st.st_size != (off_t) (sizeof (header) + retention->tail) ||
+        pread (retention->fd, &header, sizeof (header), 0) != sizeof (header) ||
+        header.ring_start >= retention->tail || header.ring_length > retention->tail) {
+        return;
+    }
+    retention->ring = g_malloc (retention->tail);
+    if (pread (retention->fd, retention->ring, retention->tail,
+               sizeof (header)) != (ssize_t) retention->tail) {
+        g_clear_pointer (&retention->ring, g_free);
+        return;
+    }
+    retention->dropped = header.dropped;
+    retention->ring_start = header.ring_start;
+    retention->ring_length = header.ring_length;
+}
+
+static void
+saved_header_write (RstrntRetention *retention)
+{
+    SavedHeader header = { retention->dropped, retention->ring_start,
+                           retention->ring_length };
+
+    saved_write (retention, &header, sizeof (header), 0);
+}
+
+/* Creates the saved tail, and its directory, once there is a tail to save. */
+static void
+saved_open (RstrntRetention *retention)
+{
+    gchar *dir;
+
+    if (retention->fd != -1 || retention->path == NULL) {
+        return;
+    }
+    dir = g_path_get_dirname (retention->path);
+    if (g_mkdir_with_parents (dir, 0755) == 0) {
+        retention->fd = open (retention->path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    }
+    if (retention->fd == -1) {
+        g_warning ("Failed to save the log tail in %s: %s", retention->path,
+                   g_strerror (errno));
+        g_clear_pointer (&retention->path, g_free);
+    }
+    g_free (dir);
+}
+
+RstrntRetention *
+rstrnt_retention_new_saved (gsize head,
+                            gsize tail,
+                            guint64 written,
+                            const gchar *path)
+{
+    RstrntRetention *retention = rstrnt_retention_new (head, tail, written);
+
+    g_return_val_if_fail (path != NULL, retention);
+
+    retention->path = g_strdup (path);
+    // Only a log already past its head has a tail to pick up again.  The
+    // file is otherwise left alone until the log gets past its head.
+    if (written < head) {
+        g_unlink (path);
+        return retention;
+    }
+    retention->fd = open (path, O_RDWR | O_CLOEXEC);
+    if (retention->fd == -1) {
+        return retention;
+    }
+    saved_load (retention);
+    if (retention->ring == NULL && retention->dropped == 0 && ftruncate (retention->fd, 0) == -1) {
+        g_warning ("Failed to clear %s: %s", path, g_strerror (errno));
+    }
+
+    return retention;
+}
+
+/* Copies data to the end of the ring, which has room for it. */
+static void
+ring_append (RstrntRetention *retention, const gchar *data, gsize length)
+{
+    gsize end = (retention->ring_start + retention->ring_length) % retention->tail;
+    gsize first = MIN (length, retention->tail - end);
+
+    memcpy (retention->ring + end, data, first);
+    memcpy (retention->ring, data + first, length - first);
+    retention->ring_length += length;
+
+    if (retention->fd != -1) {
+        saved_write (retention, data, first, sizeof (SavedHeader) + end);
+        saved_write (retention, data + first, length - first, sizeof (SavedHeader));
+        saved_header_write (retention);
+    }
+}
+
+static void
+ring_take (RstrntRetention *retention, const gchar *data, gsize length)
+{
+    gsize overflow;
+
+    saved_open (retention);
+    if (retention->tail == 0) {
+        retention->dropped += length;
+        if (retention->fd != -1) {
+            saved_header_write (retention);
+        }
+        return;
+    }
+    if (retention->ring == NULL) {
+        retention->ring = g_malloc (retention->tail);
+        if (retention->fd != -1 &&
+            ftruncate (retention->fd, sizeof (SavedHeader) + retention->tail) == -1) {
+            g_warning ("Failed to size %s: %s", retention->path, g_strerror (errno));
+        }
+    }
+
+    // Only the last tail bytes of data can stay.
+    if (length > retention->tail) {
+        retention->dropped += length - retention->tail;
+        data += length - retention->tail;
+        length = retention->tail;
+    }
+    overflow = retention->ring_length + length;
+    if (overflow > retention->tail) {
+        overflow -= retention->tail;
+        retention->dropped += overflow;
+        retention->ring_start = (retention->ring_start + overflow) % retention->tail;
+        retention->ring_length -= overflow;
+    }
+    ring_append (retention, data, length);
+}
+
+gsize
+rstrnt_retention_feed (RstrntRetention *retention,
+                       const gchar *data,
+                       gsize length)
+{
+    gsize pass = length;
+
+    g_return_val_if_fail (retention != NULL, length);
+
+    if (retention->finished) {
+        return length;
+    }
+    if (retention->written + length > retention->head) {
+        pass = retention->written < retention->head ?
+               retention->head - retention->written : 0;
+        ring_take (retention, data + pass, length - pass);
+    }
+    retention->written += pass;
+
+    return pass;
+}
+
+gchar *
+rstrnt_retention_finish (RstrntRetention *retention, gsize *length)
+{
+    GString *out;
+    gsize first;
+
+    g_return_val_if_fail (retention != NULL, NULL);
+
+    retention->finished = TRUE;
+    if (retention->ring_length == 0 && retention->dropped == 0) {
+        if (retention->path != NULL) {
+            g_unlink (retention->path);
+        }
+        *length = 0;
+        return NULL;
+    }
+
+    out = g_string_sized_new (retention->ring_length + 128);
+    if (retention->dropped > 0) {
+        g_string_append_printf (out, "\n*** %" G_GUINT64_FORMAT " bytes of output "
+                                "dropped over the log limit, the last %"
+                                G_GSIZE_FORMAT " bytes follow ***\n",
+                                retention->dropped, retention->ring_length);
+    }
+    first = MIN (retention->ring_length, retention->tail - retention->ring_start);
+    g_string_append_len (out, retention->ring + retention->ring_start, first);
+    g_string_append_len (out, retention->ring, retention->ring_length - first);
+
+    g_clear_pointer (&retention->ring, g_free);
+    retention->ring_length = 0;
+    *length = out->len;
+    if (retention->path != NULL) {
+        g_unlink (retention->path);
+    }
+
+    return g_string_free (out, FALSE);
+}
+
+guint64
+rstrnt_retention_dropped (const RstrntRetention *retention)
+{
+    return retention->dropped;
+}
+
+void
+rstrnt_retention_free (RstrntRetention *retention)
+{
+    if (retention == NULL) {
+        return;
+    }
+    // A saved tail outlives restraintd, to be finished after a reboot
+    if (retention->fd != -1) {
+        close (retention->fd);
+    }
+    g_free (retention->path);
+    g_free (retention->ring);
+    g_slice_free (RstrntRetention, retention);
+}
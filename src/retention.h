@@ -0,0 +1,82 @@
+/*
+    This file is part of Restraint.
+
+    Restraint is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Restraint is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Restraint.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef _RESTRAINT_RETENTION_H
+#define _RESTRAINT_RETENTION_H
+
+#include <glib.h>
+
+/* What is kept of a log that goes over its budget. */
+typedef struct RstrntRetention RstrntRetention;
+
+/**
+ * rstrnt_retention_new:
+ * @head: bytes kept from the start of the log.
+ * @tail: bytes kept from the end of the log.
+ * @written: bytes already in the log, as when resuming after a reboot.
+ */
+RstrntRetention *rstrnt_retention_new (gsize head,
+                                       gsize tail,
+                                       guint64 written);
+
+/**
+ * rstrnt_retention_new_saved:
+ * @path: file the tail is kept in as well, so that a reboot or a restart
+ *   of restraintd doesn't lose it.
+ *
+ * Like rstrnt_retention_new(), picking up the tail saved in @path when
+ * @written is past @head.  @path, and its directory, are only created once
+ * the log gets past @head.  The file is removed once the log is finished.
+ */
+RstrntRetention *rstrnt_retention_new_saved (gsize head,
+                                             gsize tail,
+                                             guint64 written,
+                                             const gchar *path);
+
+/**
+ * rstrnt_retention_feed:
+ * @retention: a #RstrntRetention.
+ * @data: bytes logged.
+ * @length: length of @data.
+ *
+ * Takes the bytes past the head into the tail, dropping the oldest bytes
+ * of the tail once it is full.
+ *
+ * Returns: how many bytes from the start of @data go in the log now.
+ */
+gsize rstrnt_retention_feed (RstrntRetention *retention,
+                             const gchar *data,
+                             gsize length);
+
+/**
+ * rstrnt_retention_finish:
+ * @retention: a #RstrntRetention.
+ * @length: return location for the length of the result.
+ *
+ * Ends the log.  Whatever is logged afterwards goes straight through.
+ *
+ * Returns: the tail, after a marker with the number of bytes dropped if
+ * any were, or %NULL when there is nothing held back.
+ */
+gchar *rstrnt_retention_finish (RstrntRetention *retention,
+                                gsize *length);
+
+guint64 rstrnt_retention_dropped (const RstrntRetention *retention);
+
+void rstrnt_retention_free (RstrntRetention *retention);
+
+#endif
@@ -31,14 +31,19 @@
 #include "common.h"
 #include "config.h"
 #include "process.h"
+#include "preamble.h"
 #include "logging.h"
 #include "message.h"
 #include "server.h"
+#include "stall.h"
 
 SoupSession *soup_session;
 GMainLoop *loop;
 char *strsignal(int sig);
 
+/* The recipes hosted, the one from config.conf or STDIN first */
+static GList *recipes = NULL;
+
 static void
 copy_header (SoupURI *uri, const char *name, const char *value, gpointer dest_headers)
 {
@@ -91,6 +96,7 @@ static void restraint_free_app_data(AppData *app_data)
 
   g_free(app_data->recipe_url);
   g_free(app_data->config_file);
+  g_free(app_data->snapshot_file);
   g_free(app_data->restraint_url);
 
   if (app_data->recipe != NULL) {
@@ -100,9 +106,20 @@ static void restraint_free_app_data(AppData *app_data)
 
   g_clear_object (&app_data->cancellable);
   g_clear_error(&app_data->error);
+  g_free (app_data->loop_latency);
   g_slice_free(AppData, app_data);
 }
 
+/* Frees a request's ClientData, dropping its hold on the recipe. */
+static void
+server_client_data_free (ClientData *client_data)
+{
+    if (client_data->user_data != NULL) {
+        restraint_app_data_unref (client_data->user_data);
+    }
+    g_slice_free (ClientData, client_data);
+}
+
 gboolean
 server_io_callback (GIOChannel *io, GIOCondition condition, gpointer user_data) {
     //ProcessData *process_data = (ProcessData *) user_data;
@@ -127,7 +144,7 @@ server_io_callback (GIOChannel *io, GIOCondition condition, gpointer user_data)
             if (!app_data->stdin)
                 g_print ("%s", buf);
 
-            restraint_log_task (app_data, RSTRNT_LOG_TYPE_HARNESS, buf, bytes_read);
+            restraint_log_task (client_data->task, RSTRNT_LOG_TYPE_HARNESS, buf, bytes_read);
 
             return G_SOURCE_CONTINUE;
 
@@ -168,16 +185,15 @@ plugin_finish_callback (gint pid_result, gboolean localwatchdog, gpointer user_d
     }
     soup_server_unpause_message (client_data->server, client_data->client_msg);
 
-    g_slice_free(ClientData, client_data);
+    server_client_data_free (client_data);
 }
 
 static void
 server_msg_complete (SoupSession *session, SoupMessage *server_msg, gpointer user_data)
 {
     ClientData *client_data = (ClientData *) user_data;
-    AppData *app_data = (AppData *) client_data->user_data;
     SoupMessage *client_msg = client_data->client_msg;
-    Task *task = app_data->tasks->data;
+    Task *task = (Task *) client_data->task;
     GHashTable *table;
     gboolean no_plugins = FALSE;
     SoupMessageHeadersIter iter;
@@ -245,21 +261,236 @@ server_msg_complete (SoupSession *session, SoupMessage *server_msg, gpointer use
                          NULL,
                          0,
                          FALSE,
-                         app_data->cancellable,
+                         task->cancellable,
+                         NULL,
+                         restraint_task_preamble (task, TRUE),
                          client_data);
             g_free (command);
         }
         g_hash_table_destroy (table);
     } else {
         soup_server_unpause_message (client_data->server, client_msg);
-        g_slice_free (ClientData, client_data);
+        server_client_data_free (client_data);
     }
 
     // If no plugins are running we should return to the client right away.
     if (no_plugins) {
         soup_server_unpause_message (client_data->server, client_msg);
-        g_slice_free (ClientData, client_data);
+        server_client_data_free (client_data);
+    }
+}
+
+/*
+ * Finds the task a request is for.  The id follows "tasks" in the path, or
+ * comes as task_id in a watchdog form; requests with neither are for the
+ * only task running.  With tasks running in parallel they can't be told
+ * apart, so there is none and *ambiguous is set.
+ */
+static Task *
+server_find_task (AppData *app_data, SoupMessage *client_msg, const char *path,
+                  gboolean *ambiguous)
+{
+    gchar **splitpath = g_strsplit (path, "/", -1);
+    gchar *task_id = NULL;
+    Task *task = NULL;
+
+    for (gchar **part = splitpath; *part != NULL; part++) {
+        if (g_strcmp0 (*part, "tasks") == 0 && *(part + 1) != NULL) {
+            task_id = g_strdup (*(part + 1));
+            break;
+        }
+    }
+    if (task_id == NULL && g_str_has_suffix (path, "watchdog") &&
+            client_msg->request_body->data != NULL) {
+        GHashTable *form_data = soup_form_decode (client_msg->request_body->data);
+
+        task_id = g_strdup (g_hash_table_lookup (form_data, "task_id"));
+        g_hash_table_destroy (form_data);
+    }
+
+    *ambiguous = FALSE;
+    if (task_id != NULL) {
+        task = restraint_task_lookup (app_data, task_id);
+    } else if (app_data->running != NULL && app_data->running->next != NULL) {
+        *ambiguous = TRUE;
+    } else if (app_data->tasks != NULL) {
+        task = (Task *) app_data->tasks->data;
+    }
+
+    g_free (task_id);
+    g_strfreev (splitpath);
+    return task;
+}
+
+/*
+ * Finds the recipe a request is for by the id following "recipes" in the
+ * path.  With only one recipe hosted it takes every request, as before.
+ */
+static AppData *
+server_find_recipe (const char *path)
+{
+    gchar **splitpath;
+    AppData *found = NULL;
+
+    if (recipes->next == NULL) {
+        return (AppData *) recipes->data;
+    }
+
+    splitpath = g_strsplit (path, "/", -1);
+    for (gchar **part = splitpath; *part != NULL; part++) {
+        if (g_strcmp0 (*part, "recipes") != 0 || *(part + 1) == NULL) {
+            continue;
+        }
+        for (GList *item = recipes; item != NULL; item = item->next) {
+            AppData *app_data = (AppData *) item->data;
+
+            if (app_data->recipe != NULL &&
+                    g_strcmp0 (app_data->recipe->recipe_id, *(part + 1)) == 0) {
+                found = app_data;
+                break;
+            }
+        }
+        break;
+    }
+    g_strfreev (splitpath);
+    return found;
+}
+
+/* Forgets a hosted recipe which has finished. */
+static void
+server_recipe_done (gpointer user_data)
+{
+    AppData *app_data = (AppData *) user_data;
+
+    g_print ("* Done hosting recipe from %s\n", app_data->config_file);
+    recipes = g_list_remove (recipes, app_data);
+    restraint_app_data_unref (app_data);
+}
+
+/*
+ * Runs the recipe in config_file alongside the others.  It has all of the
+ * state of a recipe to itself, sharing only the HTTP server, the session
+ * and message queue, the metadata cache and the log writers.
+ */
+static AppData *
+server_recipe_host (AppData *primary, const gchar *config_file, GError **error)
+{
+    AppData *app_data;
+    gchar *recipe_url;
+    gchar *name;
+
+    recipe_url = restraint_config_get_string ((gchar *) config_file, "restraint",
+                                              "recipe_url", error);
+    if (recipe_url == NULL) {
+        if (error != NULL && *error == NULL) {
+            g_set_error (error, RESTRAINT_ERROR, RESTRAINT_PARSE_ERROR_BAD_SYNTAX,
+                         "No recipe_url in %s", config_file);
+        }
+        return NULL;
+    }
+
+    app_data = g_slice_new0 (AppData);
+    app_data->cancellable = g_cancellable_new ();
+    app_data->aborted = ABORTED_NONE;
+    app_data->port = primary->port;
+    app_data->restraint_url = g_strdup (primary->restraint_url);
+    app_data->task_slots = primary->task_slots;
+    app_data->uploader_interval = primary->uploader_interval;
+    app_data->log_head = primary->log_head;
+    app_data->log_tail = primary->log_tail;
+    app_data->native_preamble = primary->native_preamble;
+    app_data->queue_message = (QueueMessage) restraint_queue_message;
+    app_data->config_file = g_strdup (config_file);
+    name = g_path_get_basename (config_file);
+    app_data->snapshot_file = g_strdup_printf ("%s.%s", RECIPE_SNAPSHOT_FILE, name);
+    g_free (name);
+    app_data->hosted = TRUE;
+    app_data->hosted_done = server_recipe_done;
+    app_data->ref_count = 1;
+    app_data->free_func = (GDestroyNotify) restraint_free_app_data;
+    app_data->recipe_url = recipe_url;
+    app_data->state = RECIPE_RESUME;
+    app_data->recipe_handler_id = g_idle_add_full(G_PRIORITY_DEFAULT_IDLE,
+                                                  recipe_handler,
+                                                  app_data,
+                                                  recipe_handler_finish);
+    g_source_set_name_by_id (app_data->recipe_handler_id, "recipe_handler");
+    recipes = g_list_append (recipes, app_data);
+    g_print ("* Hosting recipe: %s\n", recipe_url);
+
+    return app_data;
+}
+
+/* Picks up the recipes left in RECIPES_DIR, as after a reboot. */
+static void
+server_recipes_load (AppData *primary)
+{
+    GPtrArray *files = get_dir_files (RECIPES_DIR, ".conf");
+
+    if (files == NULL) {
+        return;
     }
+    for (guint i = 0; i < files->len; i++) {
+        GError *error = NULL;
+
+        if (!server_recipe_host (primary, files->pdata[i], &error)) {
+            g_printerr ("* Not hosting recipe from %s: %s\n",
+                        (gchar *) files->pdata[i], error->message);
+            g_clear_error (&error);
+        }
+    }
+    g_ptr_array_free (files, TRUE);
+}
+
+/* POST /recipes with a recipe_url starts hosting that recipe. */
+static void
+server_recipe_add (AppData *primary, SoupMessage *client_msg)
+{
+    GHashTable *form_data;
+    const gchar *recipe_url;
+    gchar *checksum;
+    gchar *config_file;
+    GError *error = NULL;
+
+    if (g_strcmp0 (client_msg->method, "POST") != 0) {
+        soup_message_set_status (client_msg, SOUP_STATUS_METHOD_NOT_ALLOWED);
+        return;
+    }
+
+    form_data = soup_form_decode (client_msg->request_body->data);
+    recipe_url = g_hash_table_lookup (form_data, "recipe_url");
+    if (recipe_url == NULL) {
+        soup_message_set_status_full (client_msg, SOUP_STATUS_BAD_REQUEST, "No recipe_url");
+        goto cleanup;
+    }
+    for (GList *item = recipes; item != NULL; item = item->next) {
+        if (g_strcmp0 (((AppData *) item->data)->recipe_url, recipe_url) == 0) {
+            soup_message_set_status_full (client_msg, SOUP_STATUS_CONFLICT,
+                                          "Recipe Already Running");
+            goto cleanup;
+        }
+    }
+
+    // Written out first so that the recipe is resumed after a reboot
+    checksum = g_compute_checksum_for_string (G_CHECKSUM_SHA1, recipe_url, -1);
+    config_file = g_strdup_printf ("%s/%.16s.conf", RECIPES_DIR, checksum);
+    g_free (checksum);
+    restraint_config_set (config_file, "restraint", "recipe_url", &error,
+                          G_TYPE_STRING, recipe_url);
+    if (error == NULL) {
+        server_recipe_host (primary, config_file, &error);
+    }
+    if (error != NULL) {
+        soup_message_set_status_full (client_msg, SOUP_STATUS_INTERNAL_SERVER_ERROR,
+                                      error->message);
+        g_clear_error (&error);
+    } else {
+        soup_message_set_status (client_msg, SOUP_STATUS_CREATED);
+    }
+    g_free (config_file);
+
+cleanup:
+    g_hash_table_destroy (form_data);
 }
 
 static void
@@ -267,32 +498,46 @@ server_recipe_callback (SoupServer *server, SoupMessage *client_msg,
                      const char *path, GHashTable *query,
                      SoupClientContext *context, gpointer data)
 {
-    AppData *app_data = (AppData *) data;
+    AppData *app_data;
     SoupMessage *server_msg;
     SoupURI *server_uri;
     SoupMessageHeadersIter iter;
     const gchar *name, *value;
 
+    if (g_strcmp0 (path, "/recipes") == 0 || g_strcmp0 (path, "/recipes/") == 0) {
+        server_recipe_add ((AppData *) data, client_msg);
+        return;
+    }
+
+    app_data = server_find_recipe (path);
+    if (app_data == NULL || app_data->state == RECIPE_IDLE) {
+        soup_message_set_status_full (client_msg, SOUP_STATUS_BAD_REQUEST, "No Recipe Running");
+        return;
+    }
+
     ClientData *client_data = g_slice_new0 (ClientData);
     client_data->path = path;
-    client_data->user_data = app_data;
+    client_data->user_data = restraint_app_data_ref (app_data);
     client_data->client_msg = client_msg;
     client_data->server = server;
 
-    if (app_data->state == RECIPE_IDLE) {
-        soup_message_set_status_full (client_msg, SOUP_STATUS_BAD_REQUEST, "No Recipe Running");
-        g_slice_free (ClientData, client_data);
+    gboolean ambiguous;
+    Task *task = server_find_task (app_data, client_msg, path, &ambiguous);
+
+    // An abort may be for a task that is no longer running
+    if (task == NULL && !g_str_has_suffix (path, "status")) {
+        soup_message_set_status_full (client_msg, SOUP_STATUS_BAD_REQUEST,
+                                      ambiguous ? "No task_id with tasks running in parallel"
+                                                : "No Such Task Running");
+        server_client_data_free (client_data);
         return;
     }
-    // FIXME - make sure we have valid tasks first
-    Task *task = (Task *) app_data->tasks->data;
+    client_data->task = task;
 
     if (g_str_has_suffix (path, "/results/")) {
         server_uri = soup_uri_new_with_base (task->task_uri, "results/");
         server_msg = soup_message_new_from_uri ("POST", server_uri);
-        if (task != NULL) {
-            task->results_reported = TRUE;
-        }
+        task->results_reported = TRUE;
     } else if (g_strrstr (path, "/logs/") != NULL) {
         gchar *uri = soup_uri_to_string(task->task_uri, FALSE);
         gchar *log_url = swap_base(path, uri, "/recipes/");
@@ -335,9 +580,9 @@ server_recipe_callback (SoupServer *server, SoupMessage *client_msg,
         }
 
         // Update the number of watchdog seconds for External watchdog
-        // by increasing it by EWD_TIME
+        // by increasing it by EWD_TIME, enough for the other tasks running
         seconds_string = g_strdup_printf ("%" G_GUINT64_FORMAT,
-                                          (max_time + EWD_TIME));
+                                          restraint_task_watchdog_seconds (app_data, task, max_time));
         encoded_form = soup_form_encode ("seconds", seconds_string, NULL);
 
         g_free (seconds_string);
@@ -391,7 +636,7 @@ server_recipe_callback (SoupServer *server, SoupMessage *client_msg,
           goto status_cleanup;
         }
 
-        if (task_id != NULL && g_strcmp0(task_id, task->task_id) != 0) {
+        if (task_id != NULL && task == NULL) {
           soup_message_set_status_full(client_msg, SOUP_STATUS_BAD_REQUEST,
                                        "Wrong task id");
           goto status_cleanup;
@@ -399,7 +644,7 @@ server_recipe_callback (SoupServer *server, SoupMessage *client_msg,
 
         if (task_id != NULL && recipe_id != NULL) {
           app_data->aborted = ABORTED_TASK;
-          g_cancellable_cancel(app_data->cancellable);
+          g_cancellable_cancel(task->cancellable);
           soup_message_set_status (client_msg, SOUP_STATUS_OK);
         } else if (recipe_id != NULL) {
           app_data->aborted = ABORTED_RECIPE;
@@ -409,11 +654,11 @@ server_recipe_callback (SoupServer *server, SoupMessage *client_msg,
 
 status_cleanup:
         g_strfreev(splitpath);
-        g_slice_free (ClientData, client_data);
+        server_client_data_free (client_data);
         return;
     } else {
         soup_message_set_status_full (client_msg, SOUP_STATUS_BAD_REQUEST, "No Match, Invalid request");
-        g_slice_free (ClientData, client_data);
+        server_client_data_free (client_data);
         return;
     }
 
@@ -441,6 +686,124 @@ status_cleanup:
     soup_server_pause_message (server, client_msg);
 }
 
+static gchar *
+server_metrics_format (AppData *app_data)
+{
+    GString *out = g_string_new (NULL);
+    MessageStats message_stats;
+    guint64 config_writes;
+    gint64 config_write_usec;
+    guint running;
+    guint64 started;
+
+    restraint_message_get_stats (&message_stats);
+    rstrnt_metrics_describe (out, "restraintd_message_queue_length",
+                             RSTRNT_METRIC_GAUGE,
+                             "Messages waiting to be sent to the lab controller.");
+    rstrnt_metrics_append (out, "restraintd_message_queue_length", NULL, NULL,
+                           message_stats.queue_length);
+    rstrnt_metrics_describe (out, "restraintd_message_queue_age_seconds",
+                             RSTRNT_METRIC_GAUGE,
+                             "How long the oldest queued message has waited.");
+    rstrnt_metrics_append (out, "restraintd_message_queue_age_seconds", NULL, NULL,
+                           message_stats.queue_age / (gdouble) G_USEC_PER_SEC);
+    rstrnt_metrics_describe (out, "restraintd_message_requests_total",
+                             RSTRNT_METRIC_COUNTER,
+                             "Requests sent to the lab controller, retries included.");
+    for (MessageKind kind = 0; kind < MESSAGE_KINDS; kind++) {
+        rstrnt_metrics_append (out, "restraintd_message_requests_total", "type",
+                               restraint_message_kind_name (kind),
+                               message_stats.requests[kind]);
+    }
+    rstrnt_metrics_describe (out, "restraintd_message_bytes_total",
+                             RSTRNT_METRIC_COUNTER,
+                             "Request body bytes sent to the lab controller.");
+    for (MessageKind kind = 0; kind < MESSAGE_KINDS; kind++) {
+        rstrnt_metrics_append (out, "restraintd_message_bytes_total", "type",
+                               restraint_message_kind_name (kind),
+                               message_stats.bytes[kind]);
+    }
+    rstrnt_metrics_describe (out, "restraintd_message_retries_total",
+                             RSTRNT_METRIC_COUNTER,
+                             "Requests requeued after failing.");
+    rstrnt_metrics_append (out, "restraintd_message_retries_total", NULL, NULL,
+                           message_stats.retries);
+    rstrnt_metrics_describe (out, "restraintd_message_retry_delay_seconds",
+                             RSTRNT_METRIC_GAUGE,
+                             "Current backoff before a retry, 0 when the last request succeeded.");
+    rstrnt_metrics_append (out, "restraintd_message_retry_delay_seconds", NULL, NULL,
+                           message_stats.retry_delay);
+
+    if (rstrnt_log_manager_enabled (app_data)) {
+        GHashTable *backlog;
+        GHashTableIter iter;
+        gpointer task_id;
+        gpointer writes;
+
+        backlog = rstrnt_log_manager_get_backlog (rstrnt_log_manager_get_instance ());
+        rstrnt_metrics_describe (out, "restraintd_log_writer_backlog",
+                                 RSTRNT_METRIC_GAUGE,
+                                 "Log writes waiting for a task's writer thread.");
+        g_hash_table_iter_init (&iter, backlog);
+        while (g_hash_table_iter_next (&iter, &task_id, &writes)) {
+            rstrnt_metrics_append (out, "restraintd_log_writer_backlog", "task",
+                                   task_id, GPOINTER_TO_UINT (writes));
+        }
+        g_hash_table_destroy (backlog);
+    }
+
+    restraint_config_get_write_stats (&config_writes, &config_write_usec);
+    rstrnt_metrics_describe (out, "restraintd_config_writes_total",
+                             RSTRNT_METRIC_COUNTER,
+                             "Writes of the recipe state to its config file.");
+    rstrnt_metrics_append (out, "restraintd_config_writes_total", NULL, NULL,
+                           config_writes);
+    rstrnt_metrics_describe (out, "restraintd_config_write_seconds_total",
+                             RSTRNT_METRIC_COUNTER,
+                             "Time spent writing the config file.");
+    rstrnt_metrics_append (out, "restraintd_config_write_seconds_total", NULL, NULL,
+                           config_write_usec / (gdouble) G_USEC_PER_SEC);
+
+    rstrnt_metrics_describe (out, "restraintd_main_loop_latency_seconds",
+                             RSTRNT_METRIC_SUMMARY,
+                             "How late the main loop dispatches a due timeout.");
+    rstrnt_metrics_append_summary (out, "restraintd_main_loop_latency_seconds",
+                                   app_data->loop_latency);
+    rstrnt_stall_append_metrics (out, "restraintd");
+
+    process_get_counts (&running, &started);
+    rstrnt_metrics_describe (out, "restraintd_child_processes",
+                             RSTRNT_METRIC_GAUGE,
+                             "Tasks, plugins and fetches still running.");
+    rstrnt_metrics_append (out, "restraintd_child_processes", NULL, NULL, running);
+    rstrnt_metrics_describe (out, "restraintd_child_processes_started_total",
+                             RSTRNT_METRIC_COUNTER,
+                             "Child processes started.");
+    rstrnt_metrics_append (out, "restraintd_child_processes_started_total", NULL, NULL,
+                           started);
+
+    return g_string_free (out, FALSE);
+}
+
+static void
+server_metrics_callback (SoupServer *server, SoupMessage *client_msg,
+                         const char *path, GHashTable *query,
+                         SoupClientContext *context, gpointer data)
+{
+    AppData *app_data = (AppData *) data;
+    gchar *metrics;
+
+    if (g_strcmp0 (client_msg->method, "GET") != 0) {
+        soup_message_set_status (client_msg, SOUP_STATUS_METHOD_NOT_ALLOWED);
+        return;
+    }
+
+    metrics = server_metrics_format (app_data);
+    soup_message_set_response (client_msg, METRICS_CONTENT_TYPE,
+                               SOUP_MEMORY_TAKE, metrics, strlen (metrics));
+    soup_message_set_status (client_msg, SOUP_STATUS_OK);
+}
+
 static void
 client_disconnected (SoupMessage *client_msg, gpointer data)
 {
@@ -495,6 +858,8 @@ read_job_xml (AppData *app_data, SoupServer *soup_server)
     app_data->close_message = (CloseMessage) restraint_close_message;
     app_data->state = RECIPE_FETCHING;
 
+    restraint_stdout_set_framing (app_data->framing);
+
     GInputStream *stream = g_unix_input_stream_new (0, FALSE);
     // parse the xml from the stream
     restraint_recipe_parse_stream (stream, app_data);
@@ -504,12 +869,13 @@ read_job_xml (AppData *app_data, SoupServer *soup_server)
                                                   recipe_handler,
                                                   app_data,
                                                   recipe_handler_finish);
+    g_source_set_name_by_id (app_data->recipe_handler_id, "recipe_handler");
 }
 
 gboolean
 quit_loop_handler (gpointer user_data)
 {
-    printf("[*] Stopping mainloop\n");
+    g_print ("[*] Stopping mainloop\n");
     g_main_loop_quit (loop);
     return FALSE;
 }
@@ -660,25 +1026,79 @@ rstrnt_uploader_override (AppData *app_data)
     app_data->uploader_interval = interval;
 }
 
+/*
+ * Reads the log budget, in MB, from the [log-retention] group of
+ * log_manager.conf.  A head of 0, the default, keeps the logs whole.
+ */
+static void
+rstrnt_log_retention_override (AppData *app_data)
+{
+    g_autofree gchar     *file = NULL;
+    g_autoptr (GError)    err = NULL;
+    g_autoptr (GKeyFile)  key_file = NULL;
+    gint                  head;
+    gint                  tail;
+
+    g_return_if_fail (NULL != app_data);
+
+    key_file = g_key_file_new ();
+
+    file = g_build_filename (ETC_PATH, "log_manager.conf", NULL);
+
+    if (!g_key_file_load_from_file (key_file, file, G_KEY_FILE_NONE, &err)) {
+        g_debug ("%s(): %s: %s", __func__, file, err->message);
+
+        return;
+    }
+
+    head = g_key_file_get_integer (key_file, "log-retention", "head_mb", &err);
+
+    if (NULL != err || head <= 0) {
+        return;
+    }
+
+    // Without a tail the end of the log is dropped along with the rest.
+    tail = g_key_file_get_integer (key_file, "log-retention", "tail_mb", NULL);
+
+    g_debug ("%s(): Keeping the first %d MB and last %d MB of task logs",
+             __func__, head, MAX (tail, 0));
+
+    app_data->log_head = (gsize) head * 1024 * 1024;
+    app_data->log_tail = (gsize) MAX (tail, 0) * 1024 * 1024;
+}
+
 int main(int argc, char *argv[]) {
   AppData *app_data;
   const gchar *config = "config.conf";
   SoupServer *soup_server = NULL;
   GError *error = NULL;
+  gchar *framing = NULL;
+  gint stall_threshold = STALL_THRESHOLD;
 
   app_data = g_slice_new0 (AppData);
   app_data->cancellable = g_cancellable_new ();
   app_data->aborted = ABORTED_NONE;
   app_data->config_file = NULL;
+  app_data->snapshot_file = g_strdup (RECIPE_SNAPSHOT_FILE);
   app_data->port = 0;
   app_data->uploader_source_id = 0;
   app_data->uploader_interval = LOG_UPLOAD_INTERVAL;
+  app_data->task_slots = 1;
 
   rstrnt_uploader_override (app_data);
+  rstrnt_log_retention_override (app_data);
 
   GOptionEntry entries [] = {
     { "port", 'p', 0, G_OPTION_ARG_INT, &app_data->port, "Port to listen on", "PORT" },
     { "stdin", 's', 0, G_OPTION_ARG_NONE, &app_data->stdin, "Run from STDIN/STDOUT", NULL },
+    { "framing", 0, 0, G_OPTION_ARG_STRING, &framing,
+      "Message framing on STDOUT with --stdin, json (default) or binary", "FRAMING" },
+    { "stall-threshold", 0, 0, G_OPTION_ARG_INT, &stall_threshold,
+      "Report main loop iterations longer than this, 0 disables (default 500)", "MS" },
+    { "task-slots", 0, 0, G_OPTION_ARG_INT, &app_data->task_slots,
+      "Run up to this many parallel tasks at once (default 1)", "SLOTS" },
+    { "native-preamble", 0, 0, G_OPTION_ARG_NONE, &app_data->native_preamble,
+      "Do the work of the standard task_run.d plugins without running them", NULL },
     { NULL }
   };
   GOptionContext *context = g_option_context_new(NULL);
@@ -688,7 +1108,23 @@ int main(int argc, char *argv[]) {
   gboolean parse_succeeded = g_option_context_parse(context, &argc, &argv, &app_data->error);
   g_option_context_free(context);
 
+  if (parse_succeeded && framing != NULL) {
+    parse_succeeded = rstrnt_framing_parse (framing, &app_data->framing,
+                                            &app_data->error);
+  }
+  g_free (framing);
+  if (parse_succeeded && stall_threshold < 0) {
+    g_set_error (&app_data->error, RESTRAINT_ERROR, RESTRAINT_CMDLINE_ERROR,
+                 "--stall-threshold must be 0 or more, not %d", stall_threshold);
+    parse_succeeded = FALSE;
+  }
+
+  app_data->task_slots = MAX (app_data->task_slots, 1);
+
   if (!parse_succeeded) {
+    if (app_data->error != NULL) {
+      g_printerr ("%s\n", app_data->error->message);
+    }
     exit (PARSE_ARGS_FAILED);
   }
 
@@ -711,11 +1147,13 @@ int main(int argc, char *argv[]) {
   if (app_data->recipe_url) {
     app_data->queue_message = (QueueMessage) restraint_queue_message;
     app_data->fetch_retries = 0;
-    app_data->state = RECIPE_FETCH;
+    // Straight from the snapshot if there is one, as after a reboot
+    app_data->state = RECIPE_RESUME;
     app_data->recipe_handler_id = g_idle_add_full(G_PRIORITY_DEFAULT_IDLE,
                                                   recipe_handler,
                                                   app_data,
                                                   recipe_handler_finish);
+    g_source_set_name_by_id (app_data->recipe_handler_id, "recipe_handler");
   }
 
   soup_session = soup_session_new();
@@ -726,6 +1164,10 @@ int main(int argc, char *argv[]) {
 
   soup_server_add_handler (soup_server, "/recipes",
                            server_recipe_callback, app_data, NULL);
+  soup_server_add_handler (soup_server, "/metrics",
+                           server_metrics_callback, app_data, NULL);
+  app_data->loop_latency = g_new0 (RstrntSummary, 1);
+  rstrnt_metrics_probe_loop (app_data->loop_latency, LOOP_PROBE_INTERVAL);
 
   /* Tell our soup server to listen on any local interface. This includes
      IPv4 and IPv6 if available */
@@ -739,6 +1181,11 @@ int main(int argc, char *argv[]) {
   app_data->restraint_url = g_strdup_printf ("http://localhost:%d", app_data->port);
   g_print ("Listening on %s\n", app_data->restraint_url);
 
+  recipes = g_list_append (recipes, app_data);
+  if (!app_data->stdin) {
+      server_recipes_load (app_data);
+  }
+
   g_unix_signal_add (SIGINT, on_sigint_term, app_data);
   g_unix_signal_add (SIGTERM, on_sigterm_term, app_data);
   g_unix_signal_add (SIGHUP, on_sighup_term, app_data);
@@ -755,6 +1202,8 @@ int main(int argc, char *argv[]) {
       g_log_set_writer_func (null_log_writer, NULL, NULL);
   }
 
+  rstrnt_stall_monitor_start (stall_threshold, "restraintd");
+
   /* enter mainloop */
   loop = g_main_loop_new (NULL, FALSE);
   g_main_loop_run (loop);
@@ -782,7 +1231,7 @@ int main(int argc, char *argv[]) {
       g_object_unref (log_manager);
   }
 
-  restraint_free_app_data (app_data);
+  g_list_free_full (recipes, (GDestroyNotify) restraint_free_app_data);
 
   return 0;
 }
@@ -19,16 +19,21 @@
 #define _RESTRAINT_SERVER_H
 
 #include <libxml/tree.h>
+#include "frame.h"
+#include "metrics.h"
 
 #define ETC_PATH "/etc/restraint"
 #define PLUGIN_SCRIPT "/usr/share/restraint/plugins/run_plugins"
 #define TASK_PLUGIN_SCRIPT "/usr/share/restraint/plugins/run_task_plugins"
 #define PLUGIN_DIR "/usr/share/restraint/plugins"
+#define RECIPES_DIR ETC_PATH "/recipes.d"
 
 #define LOG_UPLOAD_INTERVAL 15  /* Seconds */
 #define LOG_UPLOAD_MIN_INTERVAL 3  /* Seconds */
 #define LOG_UPLOAD_MAX_INTERVAL 60  /* Seconds */
 
+#define LOOP_PROBE_INTERVAL 250  /* Milliseconds */
+
 typedef enum {
   ABORTED_NONE,
   ABORTED_RECIPE,
@@ -39,13 +44,19 @@ typedef struct RstrntServerAppData {
   RecipeSetupState state;
   guint port;
   guint recipe_handler_id;
-  guint task_handler_id;
   gchar *recipe_url;
-  xmlDoc *recipe_xmldoc;
   Recipe *recipe;
-  GList *tasks;
+  GList *tasks; /* The task being set up, or the last one started */
+  GList *running; /* Task * started and not finished, tasks' included */
+  gint task_slots; /* Most parallel tasks to run at once */
+  gboolean task_parked; /* The task at tasks is waiting in TASK_SLOT */
   GError *error;
   gchar *config_file;
+  gchar *snapshot_file; /* Where the recipe is checkpointed */
+  gboolean hosted; /* One of the recipes in RECIPES_DIR */
+  GDestroyNotify hosted_done; /* Drops a hosted recipe once it has finished */
+  gint ref_count; /* Hosted: held by the recipe list and by requests in flight */
+  GDestroyNotify free_func; /* Called once the last reference is dropped */
   gchar *restraint_url;
   GCancellable *cancellable;
   QueueMessage queue_message;
@@ -57,9 +68,14 @@ typedef struct RstrntServerAppData {
   StateAborted aborted;
   guint fetch_retries;
   gboolean stdin;
+  RstrntFraming framing;
   guint last_signal;
   guint uploader_source_id; /* Event source ID for log uploader */
   guint uploader_interval; /* In seconds. 0 disables the log manager */
+  gsize log_head; /* Bytes kept from the start of a task's log, 0 keeps all */
+  gsize log_tail; /* Bytes kept from the end of a log past log_head */
+  gboolean native_preamble; /* Do the standard task_run.d plugins' work */
+  RstrntSummary *loop_latency; /* Main loop dispatch latency, for /metrics */
 } AppData;
 
 #endif
@@ -0,0 +1,329 @@
+/*
+    This file is part of Restraint.
+
+    Restraint is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Restraint is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Restraint.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#define _GNU_SOURCE
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <glib-unix.h>
+#include <execinfo.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "metrics.h"
+#include "stall.h"
+
+#define STALL_SIGNAL SIGPROF
+// The handler's own frame and the signal trampoline
+#define STALL_HANDLER_FRAMES 2
+#define STALL_NAME_SIZE 64
+
+typedef struct {
+    guint64 stalls;
+    gdouble seconds;
+} StallCount;
+
+static const gdouble stall_bounds[] = {
+    0.001, 0.005, 0.01, 0.05, 0.1, 0.5, 1, 5, 10
+};
+
+static GPollFunc stall_next_poll = NULL;
+static gint64 stall_threshold = 0;
+static pthread_t stall_loop_thread;
+static RstrntHistogram *stall_histogram = NULL;
+static GHashTable *stall_counts = NULL;
+
+// Shared with the watch thread
+static GMutex stall_lock;
+static gint64 stall_busy_since = 0;
+static guint stall_iteration = 0;
+static guint stall_signalled = 0;
+
+// Filled in by the signal handler, on the loop thread.  Only the raw
+// frames are taken there, they are named once the iteration is over.
+static volatile sig_atomic_t stall_sampled = 0;
+static void *stall_frames[STALL_FRAMES];
+static volatile sig_atomic_t stall_n_frames = 0;
+static gchar stall_source[STALL_NAME_SIZE];
+
+/*
+ * g_main_current_source () only reads a thread-local, which is set up
+ * before the handler is installed.  The source's name is copied as the
+ * source may be gone by the time the iteration ends.
+ */
+static void
+stall_sample (int sig)
+{
+    GSource *source = g_main_current_source ();
+    const gchar *name = source != NULL ? g_source_get_name (source) : NULL;
+    gsize i = 0;
+
+    for (; name != NULL && name[i] != '\0' && i < STALL_NAME_SIZE - 1; i++) {
+        stall_source[i] = name[i];
+    }
+    stall_source[i] = '\0';
+    stall_n_frames = backtrace (stall_frames, STALL_FRAMES);
+    stall_sampled++;
+}
+
+/*
+ * Finds the innermost frame in the program itself, as the libraries' are
+ * only where it waited.  Its function is named when the symbol is
+ * exported, otherwise the offset is given for addr2line.
+ */
+static gchar *
+stall_culprit (gchar **symbols, gint n_symbols)
+{
+    for (gint i = 0; i < n_symbols; i++) {
+        // Formatted as object(function+offset) [address]
+        const gchar *open = strchr (symbols[i], '(');
+        const gchar *end;
+        gchar *object;
+        gboolean library;
+
+        if (open == NULL) {
+            continue;
+        }
+        object = g_strndup (symbols[i], open - symbols[i]);
+        library = strstr (object, ".so") != NULL;
+        g_free (object);
+        if (library) {
+            continue;
+        }
+        end = strpbrk (open + 1, "+)");
+        if (end != NULL && end > open + 1) {
+            return g_strndup (open + 1, end - open - 1);
+        }
+        end = strchr (open, ')');
+        return g_strndup (symbols[i], end != NULL ? end - symbols[i] + 1 : strlen (symbols[i]));
+    }
+    return NULL;
+}
+
+static void
+stall_report (gint64 busy)
+{
+    gdouble seconds = busy / (gdouble) G_USEC_PER_SEC;
+    GString *trace = g_string_new (NULL);
+    gchar *culprit = NULL;
+    StallCount *count;
+
+    if (stall_sampled && stall_n_frames > STALL_HANDLER_FRAMES) {
+        gint n_symbols = stall_n_frames - STALL_HANDLER_FRAMES;
+        gchar **symbols = backtrace_symbols (stall_frames + STALL_HANDLER_FRAMES,
+                                             n_symbols);
+
+        if (symbols != NULL) {
+            culprit = stall_culprit (symbols, n_symbols);
+            for (gint i = 0; i < n_symbols; i++) {
+                g_string_append_printf (trace, "\n  #%d %s", i, symbols[i]);
+            }
+            free (symbols);
+        }
+    }
+    if (culprit == NULL) {
+        culprit = g_strdup ("unknown");
+    }
+
+    // Stalls are counted by source, or by function for unnamed sources
+    if (stall_sampled && stall_source[0] != '\0') {
+        g_warning ("Main loop stalled for %.3fs in source %s, at %s%s",
+                   seconds, stall_source, culprit, trace->str);
+        g_free (culprit);
+        culprit = g_strdup (stall_source);
+    } else {
+        g_warning ("Main loop stalled for %.3fs in %s%s", seconds, culprit, trace->str);
+    }
+
+    count = g_hash_table_lookup (stall_counts, culprit);
+    if (count == NULL) {
+        count = g_new0 (StallCount, 1);
+        g_hash_table_insert (stall_counts, culprit, count);
+    } else {
+        g_free (culprit);
+    }
+    count->stalls++;
+    count->seconds += seconds;
+
+    g_string_free (trace, TRUE);
+}
+
+static void
+stall_iteration_end (void)
+{
+    gint64 busy_since;
+    gint64 busy;
+
+    g_mutex_lock (&stall_lock);
+    busy_since = stall_busy_since;
+    stall_busy_since = 0;
+    g_mutex_unlock (&stall_lock);
+
+    if (busy_since == 0) {
+        return;
+    }
+    busy = g_get_monotonic_time () - busy_since;
+    rstrnt_histogram_observe (stall_histogram, busy / (gdouble) G_USEC_PER_SEC);
+    if (busy >= stall_threshold) {
+        stall_report (busy);
+    }
+}
+
+static void
+stall_iteration_begin (void)
+{
+    // A sample of the last iteration may land while polling
+    stall_sampled = 0;
+
+    g_mutex_lock (&stall_lock);
+    stall_busy_since = g_get_monotonic_time ();
+    stall_iteration++;
+    g_mutex_unlock (&stall_lock);
+}
+
+/* Everything between two polls is one iteration of the loop. */
+static gint
+stall_poll (GPollFD *fds, guint n_fds, gint timeout)
+{
+    gint ready;
+
+    stall_iteration_end ();
+    ready = stall_next_poll (fds, n_fds, timeout);
+    stall_iteration_begin ();
+
+    return ready;
+}
+
+static gpointer
+stall_watch (gpointer user_data)
+{
+    gulong tick = MAX (stall_threshold / 4, 1000);
+
+    for (;;) {
+        g_usleep (tick);
+
+        g_mutex_lock (&stall_lock);
+        if (stall_busy_since != 0 &&
+            g_get_monotonic_time () - stall_busy_since >= stall_threshold &&
+            stall_signalled != stall_iteration) {
+            stall_signalled = stall_iteration;
+            pthread_kill (stall_loop_thread, STALL_SIGNAL);
+        }
+        g_mutex_unlock (&stall_lock);
+    }
+
+    return NULL;
+}
+
+/* Prints the metrics for SIGUSR1, to a file too as stderr may be gone. */
+static gboolean
+stall_dump (gpointer prefix)
+{
+    GString *out = g_string_new (NULL);
+    gchar *name = g_strdup_printf ("%s-stalls.%d", (gchar *) prefix, (gint) getpid ());
+    gchar *path = g_build_filename (g_get_tmp_dir (), name, NULL);
+    GError *error = NULL;
+
+    rstrnt_stall_append_metrics (out, prefix);
+    g_printerr ("%s", out->str);
+    if (!g_file_set_contents (path, out->str, out->len, &error)) {
+        g_warning ("Failed to write %s: %s", path, error->message);
+        g_clear_error (&error);
+    }
+
+    g_free (path);
+    g_free (name);
+    g_string_free (out, TRUE);
+
+    return G_SOURCE_CONTINUE;
+}
+
+void
+rstrnt_stall_monitor_start (guint threshold, const gchar *prefix)
+{
+    struct sigaction action;
+    void *frame;
+
+    g_return_if_fail (stall_histogram == NULL);
+
+    if (threshold == 0) {
+        return;
+    }
+
+    stall_threshold = threshold * (gint64) 1000;
+    stall_loop_thread = pthread_self ();
+    stall_histogram = rstrnt_histogram_new (stall_bounds,
+                                            G_N_ELEMENTS (stall_bounds));
+    stall_counts = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                          g_free, g_free);
+
+    // The first backtrace () loads libgcc, and the first
+    // g_main_current_source () allocates, which the handler must not do.
+    backtrace (&frame, 1);
+    g_main_current_source ();
+    memset (&action, 0, sizeof (action));
+    action.sa_handler = stall_sample;
+    action.sa_flags = SA_RESTART;
+    sigemptyset (&action.sa_mask);
+    sigaction (STALL_SIGNAL, &action, NULL);
+
+    stall_next_poll = g_main_context_get_poll_func (NULL);
+    g_main_context_set_poll_func (NULL, stall_poll);
+
+    g_thread_unref (g_thread_new ("stall-watch", stall_watch, NULL));
+    g_unix_signal_add (SIGUSR1, stall_dump, (gpointer) prefix);
+}
+
+void
+rstrnt_stall_append_metrics (GString *out, const gchar *prefix)
+{
+    gchar *name;
+    GHashTableIter iter;
+    gpointer culprit;
+    gpointer value;
+
+    if (stall_histogram == NULL) {
+        return;
+    }
+
+    name = g_strdup_printf ("%s_main_loop_iteration_seconds", prefix);
+    rstrnt_metrics_describe (out, name, RSTRNT_METRIC_HISTOGRAM,
+                             "Time spent dispatching between two polls of the main loop.");
+    rstrnt_metrics_append_histogram (out, name, stall_histogram);
+    g_free (name);
+
+    name = g_strdup_printf ("%s_main_loop_stalls_total", prefix);
+    rstrnt_metrics_describe (out, name, RSTRNT_METRIC_COUNTER,
+                             "Iterations over the stall threshold, by the source or function they were stuck in.");
+    g_hash_table_iter_init (&iter, stall_counts);
+    while (g_hash_table_iter_next (&iter, &culprit, &value)) {
+        rstrnt_metrics_append (out, name, "in", culprit,
+                               ((StallCount *) value)->stalls);
+    }
+    g_free (name);
+
+    name = g_strdup_printf ("%s_main_loop_stall_seconds_total", prefix);
+    rstrnt_metrics_describe (out, name, RSTRNT_METRIC_COUNTER,
+                             "Time spent in stalled iterations, by the source or function they were stuck in.");
+    g_hash_table_iter_init (&iter, stall_counts);
+    while (g_hash_table_iter_next (&iter, &culprit, &value)) {
+        rstrnt_metrics_append (out, name, "in", culprit,
+                               ((StallCount *) value)->seconds);
+    }
+    g_free (name);
+}
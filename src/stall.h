@@ -0,0 +1,59 @@
+/*
+    This file is part of Restraint.
+
+    Restraint is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Restraint is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Restraint.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef _RESTRAINT_STALL_H
+#define _RESTRAINT_STALL_H
+
+#include <glib.h>
+
+#define STALL_THRESHOLD 500  /* Milliseconds */
+// Frames kept of where the main loop was stuck
+#define STALL_FRAMES 16
+
+/**
+ * rstrnt_stall_monitor_start:
+ * @threshold: milliseconds a main loop iteration may take before it is
+ * reported as a stall, 0 leaves the monitor off.
+ * @prefix: prefix of the metric names, such as "restraintd".
+ *
+ * Times the work between polls of the default main context, from the
+ * thread running it, into a histogram.  An iteration still running after
+ * @threshold is sampled by signalling that thread, which records a
+ * backtrace and the name of the source being dispatched.  When the
+ * iteration ends a warning names the source and the function it was
+ * stuck in, and for how long.  Stalls are counted by source name, or by
+ * function for sources without one.
+ *
+ * SIGUSR1 then prints the metrics to stderr and to
+ * $TMPDIR/@prefix-stalls.PID, which is still there when stderr isn't.
+ *
+ * Must be called from the thread which runs the main loop, once.
+ */
+void rstrnt_stall_monitor_start (guint threshold, const gchar *prefix);
+
+/**
+ * rstrnt_stall_append_metrics:
+ * @out: where the metrics are being written.
+ * @prefix: prefix of the metric names, such as "restraintd".
+ *
+ * Appends the iteration histogram and the stalls by what they were stuck
+ * in, in the Prometheus text format.  Nothing is appended unless the
+ * monitor was started.
+ */
+void rstrnt_stall_append_metrics (GString *out, const gchar *prefix);
+
+#endif
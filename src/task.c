@@ -21,7 +21,9 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <glib.h>
+#include <glib-unix.h>
 #include <gio/gio.h>
+#include <fcntl.h>
 #include <time.h>
 #include <sys/types.h>
 #include <signal.h>
@@ -35,6 +37,7 @@
 #include "role.h"
 #include "metadata.h"
 #include "process.h"
+#include "preamble.h"
 #include "message.h"
 #include "dependency.h"
 #include "config.h"
@@ -50,14 +53,28 @@ void
 restraint_task_result (Task *task, AppData *app_data, gchar *result,
                        gint int_score, gchar *path, gchar *message);
 
+static void task_log_finish (Task *task);
+static void start_uploader (AppData *app_data, Task *task);
+static void task_phases_checkpoint (AppData *app_data, Task *task);
+
+/* Each task in flight has a task_handler () of its own. */
+static void
+task_handler_add (Task *task)
+{
+    guint id = g_idle_add_full(G_PRIORITY_DEFAULT_IDLE, task_handler, task, NULL);
+
+    // Named for the stall monitor
+    g_source_set_name_by_id (id, "task_handler");
+}
+
 void
 archive_entry_callback (const gchar *entry, gpointer user_data)
 {
-    AppData *app_data = (AppData *) user_data;
+    Task *task = (Task *) user_data;
     GString *message = g_string_new (NULL);
 
     g_string_printf (message, "** Extracting %s\n", entry);
-    restraint_log_task (app_data, RSTRNT_LOG_TYPE_HARNESS, message->str, message->len);
+    restraint_log_task (task, RSTRNT_LOG_TYPE_HARNESS, message->str, message->len);
     g_string_free (message, TRUE);
 }
 
@@ -65,36 +82,28 @@ void
 taskrun_archive_entry_callback (const gchar *entry, gpointer user_data)
 {
     TaskRunData *task_run_data = (TaskRunData *) user_data;
-    return archive_entry_callback (entry, task_run_data->app_data);
+    return archive_entry_callback (entry, task_run_data->task);
 }
 
 static gboolean
 fetch_retry (gpointer user_data)
 {
-    AppData *app_data = (AppData *) user_data;
-    Task *task = (Task *) app_data->tasks->data;
+    Task *task = (Task *) user_data;
 
     task->state = TASK_FETCH;
+    task_handler_add (task);
 
-    app_data->task_handler_id = g_idle_add_full(G_PRIORITY_DEFAULT_IDLE,
-                                                task_handler,
-                                                app_data,
-                                                NULL);
     return FALSE;
 }
 
 static gboolean
 refresh_role_retry (gpointer user_data)
 {
-    AppData *app_data = (AppData *) user_data;
-    Task *task = (Task *) app_data->tasks->data;
+    Task *task = (Task *) user_data;
 
     task->state = TASK_REFRESH_ROLES;
+    task_handler_add (task);
 
-    app_data->task_handler_id = g_idle_add_full(G_PRIORITY_DEFAULT_IDLE,
-                                                task_handler,
-                                                app_data,
-                                                NULL);
     return FALSE;
 }
 
@@ -102,16 +111,16 @@ void
 fetch_finish_callback (GError *error, guint32 match_cnt,
                        guint32 nonmatch_cnt, gpointer user_data)
 {
-    AppData *app_data = (AppData *) user_data;
-    Task *task = (Task *) app_data->tasks->data;
+    Task *task = (Task *) user_data;
     GString *message = g_string_new (NULL);
 
     if (error) {
-        if (app_data->fetch_retries < TASK_FETCH_RETRIES) {
-            g_warning("* RETRY fetch [%d]**:%s\n", ++app_data->fetch_retries,
+        if (task->retries < TASK_FETCH_RETRIES) {
+            g_warning("* RETRY fetch [%d]**:%s\n", ++task->retries,
                     error->message);
+            task->fetch_retries++;
             g_clear_error(&error);
-            g_timeout_add_seconds (TASK_FETCH_INTERVAL, fetch_retry, app_data);
+            g_timeout_add_seconds (TASK_FETCH_INTERVAL, fetch_retry, task);
             return;
         } else {
             g_propagate_error (&task->error, error);
@@ -124,22 +133,19 @@ fetch_finish_callback (GError *error, guint32 match_cnt,
             g_string_printf (message, "** Fetch Summary: Match %d, "
                              "Nonmatch %d\n",
                              match_cnt, nonmatch_cnt);
-            restraint_log_task (app_data, RSTRNT_LOG_TYPE_HARNESS, message->str, message->len);
+            restraint_log_task (task, RSTRNT_LOG_TYPE_HARNESS, message->str, message->len);
             g_string_free (message, TRUE);
         }
     }
 
-    app_data->task_handler_id = g_idle_add_full(G_PRIORITY_DEFAULT_IDLE,
-                                                task_handler,
-                                                app_data,
-                                                NULL);
+    task_handler_add (task);
 }
 
 void
-restraint_task_fetch(AppData *app_data) {
-    g_return_if_fail(app_data != NULL);
+restraint_task_fetch(Task *task) {
+    g_return_if_fail(task != NULL);
     GError *error = NULL;
-    Task *task = (Task *) app_data->tasks->data;
+    AppData *app_data = task->app_data;
 
     switch (task->fetch_method) {
         case TASK_FETCH_UNPACK:
@@ -151,7 +157,7 @@ restraint_task_fetch(AppData *app_data) {
                                      task->keepchanges,
                                      archive_entry_callback,
                                      fetch_finish_callback,
-                                     app_data);
+                                     task);
             } else if (g_strcmp0(scheme, "http") == 0 ||
                        g_strcmp0(scheme, "https") == 0  ||
                        g_strcmp0(scheme, "file") == 0) {
@@ -161,13 +167,13 @@ restraint_task_fetch(AppData *app_data) {
                                       task->ssl_verify,
                                       archive_entry_callback,
                                       fetch_finish_callback,
-                                      app_data);
+                                      task);
             } else {
                 g_set_error (&error, RESTRAINT_ERROR,
                              RESTRAINT_TASK_RUNNER_SCHEMA_ERROR,
                              "Unimplemented schema method %s",
                              task->fetch.url->scheme);
-                fetch_finish_callback (error, 0, 0, app_data);
+                fetch_finish_callback (error, 0, 0, task);
                 return;
             }
             break;
@@ -185,12 +191,13 @@ restraint_task_fetch(AppData *app_data) {
             // Use appropriate package install command
             TaskRunData *task_run_data = g_slice_new0(TaskRunData);
             task_run_data->app_data = app_data;
+            task_run_data->task = task;
             task_run_data->pass_state = TASK_METADATA_PARSE;
             task_run_data->fail_state = TASK_COMPLETE;
             task_run_data->log_type = RSTRNT_LOG_TYPE_HARNESS;
             process_run ((const gchar *)command, NULL, NULL, FALSE, 0,
                          NULL, task_io_callback, task_handler_callback,
-                         NULL, 0, FALSE, app_data->cancellable, task_run_data);
+                         NULL, 0, FALSE, task->cancellable, NULL, NULL, task_run_data);
             g_free (command);
             break;
         default:
@@ -198,7 +205,7 @@ restraint_task_fetch(AppData *app_data) {
             g_set_error (&error, RESTRAINT_ERROR,
                          RESTRAINT_TASK_RUNNER_FETCH_ERROR,
                          "Unknown fetch method");
-            fetch_finish_callback (error, 0, 0, app_data);
+            fetch_finish_callback (error, 0, 0, task);
             g_return_if_reached();
     }
 }
@@ -209,7 +216,7 @@ io_callback (GIOChannel    *io,
              RstrntLogType  log_type,
              gpointer       user_data)
 {
-    AppData *app_data = (AppData *) user_data;
+    Task *task = (Task *) user_data;
     GError *tmp_error = NULL;
 
     gchar buf[IO_BUFFER_SIZE] = { 0 };
@@ -223,7 +230,7 @@ io_callback (GIOChannel    *io,
                G_MESSAGES_DEBUG is used. */
             g_debug ("%s", buf);
 
-            restraint_log_task (app_data, log_type, buf, bytes_read);
+            restraint_log_task (task, log_type, buf, bytes_read);
 
             return G_SOURCE_CONTINUE;
 
@@ -252,10 +259,81 @@ io_callback (GIOChannel    *io,
     return G_SOURCE_REMOVE;
 }
 
+static void
+task_splice_end (TaskRunData *task_run_data)
+{
+    task_run_data->splice = FALSE;
+    for (gint i = 0; i < 2; i++) {
+        if (task_run_data->tee_pipe[i] != -1) {
+            close (task_run_data->tee_pipe[i]);
+            task_run_data->tee_pipe[i] = -1;
+        }
+    }
+}
+
+/*
+ * Moves task output from its pipe into task.log with splice (), so it is
+ * never copied through restraintd. If the log can't be spliced into, the
+ * rest of the output is read by io_callback () instead.
+ */
+static gboolean
+task_splice_callback (GIOChannel   *io,
+                      GIOCondition  condition,
+                      TaskRunData  *task_run_data)
+{
+    Task *task = task_run_data->task;
+    gint tee_fd = task_run_data->tee_pipe[1];
+    GError *tmp_error = NULL;
+    gssize moved;
+    gint log_fd;
+
+    if (!(condition & G_IO_IN)) {
+        return G_SOURCE_REMOVE;
+    }
+
+    log_fd = rstrnt_log_get_splice_fd (task, RSTRNT_LOG_TYPE_TASK, &tmp_error);
+    if (log_fd == -1) {
+        g_warning ("%s", tmp_error->message);
+        g_clear_error (&tmp_error);
+        task_splice_end (task_run_data);
+        return io_callback (io, condition, task_run_data->log_type, task);
+    }
+
+    moved = process_splice (g_io_channel_unix_get_fd (io), log_fd, tee_fd,
+                            tee_fd == -1 ? SPLICE_BUFFER_SIZE : IO_BUFFER_SIZE - 1);
+    if (moved > 0) {
+        if (tee_fd != -1) {
+            gchar buf[IO_BUFFER_SIZE] = { 0 };
+
+            if (read (task_run_data->tee_pipe[0], buf, IO_BUFFER_SIZE - 1) > 0) {
+                g_debug ("%s", buf);
+            }
+        }
+        // The uploader takes the new length of task.log from the file
+        if (0 == task->app_data->uploader_source_id)
+            start_uploader (task->app_data, task);
+
+        return G_SOURCE_CONTINUE;
+    }
+    if (moved == 0) {
+        return G_SOURCE_REMOVE;
+    }
+    if (errno == EAGAIN || errno == EINTR) {
+        return G_SOURCE_CONTINUE;
+    }
+
+    g_debug ("Unable to splice task output, reading it instead: %s", g_strerror (errno));
+    task_splice_end (task_run_data);
+    return io_callback (io, condition, task_run_data->log_type, task);
+}
+
 gboolean
 task_io_callback (GIOChannel *io, GIOCondition condition, gpointer user_data) {
     TaskRunData *task_run_data = (TaskRunData *) user_data;
-    return io_callback(io, condition, task_run_data->log_type, task_run_data->app_data);
+    if (task_run_data->splice) {
+        return task_splice_callback (io, condition, task_run_data);
+    }
+    return io_callback(io, condition, task_run_data->log_type, task_run_data->task);
 }
 
 gboolean
@@ -267,21 +345,97 @@ void
 task_finish_plugins_callback (gint pid_result, gboolean localwatchdog, gpointer user_data, GError *error)
 {
     TaskRunData *task_run_data = (TaskRunData *) user_data;
-    AppData *app_data = task_run_data->app_data;
 
-    app_data->task_handler_id = g_idle_add_full(G_PRIORITY_DEFAULT_IDLE,
-                                                task_handler,
-                                                app_data,
-                                                NULL);
+    task_handler_add (task_run_data->task);
     g_slice_free(TaskRunData, task_run_data);
 }
 
+/*
+ * Puts the task in a cgroup of its own for accounting, with the limits it
+ * asked for.  Without cgroup2 the task runs as before.
+ */
+static void
+task_cgroup_setup (Task *task)
+{
+    GError *error = NULL;
+    GString *message = g_string_new (NULL);
+    gchar *name = g_strdup_printf ("task-%s", task->task_id);
+    const gchar *limits[][2] = {
+        { "memory.max", task->metadata->memory_max },
+        { "cpu.max", task->metadata->cpu_max },
+    };
+
+    g_clear_pointer (&task->cgroup, g_free);
+    g_clear_pointer (&task->cgroup_stats, g_free);
+    task->cgroup = rstrnt_cgroup_create (CGROUP_MOUNT, name, &error);
+    g_free (name);
+    if (task->cgroup == NULL &&
+            !g_error_matches (error, G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED)) {
+        g_warning ("Unable to create cgroup for task %s: %s", task->task_id,
+                   error->message);
+    }
+
+    for (guint i = 0; i < G_N_ELEMENTS (limits); i++) {
+        if (limits[i][1] == NULL) {
+            continue;
+        }
+        if (task->cgroup == NULL) {
+            g_string_printf (message, "** Not setting %s, no cgroup: %s\n",
+                             limits[i][0], error->message);
+            restraint_log_task (task, RSTRNT_LOG_TYPE_HARNESS,
+                                message->str, message->len);
+        } else if (!rstrnt_cgroup_set (task->cgroup, limits[i][0],
+                                       limits[i][1], &error)) {
+            g_string_printf (message, "** %s\n", error->message);
+            restraint_log_task (task, RSTRNT_LOG_TYPE_HARNESS,
+                                message->str, message->len);
+            g_clear_error (&error);
+        }
+    }
+
+    g_clear_error (&error);
+    g_string_free (message, TRUE);
+}
+
+/*
+ * Records what the task used in harness.log and for the status update,
+ * then removes its cgroup.
+ */
+static void
+task_cgroup_account (Task *task)
+{
+    GString *message = g_string_new (NULL);
+    gchar *usage;
+
+    task->cgroup_stats = g_new (RstrntCgroupStats, 1);
+    rstrnt_cgroup_read_stats (task->cgroup, task->cgroup_stats);
+    usage = rstrnt_cgroup_stats_format (task->cgroup_stats);
+    if (*usage != '\0') {
+        g_string_printf (message, "** Resource usage: %s\n", usage);
+        restraint_log_task (task, RSTRNT_LOG_TYPE_HARNESS,
+                            message->str, message->len);
+    }
+
+    rstrnt_cgroup_remove (task->cgroup);
+    g_clear_pointer (&task->cgroup, g_free);
+    g_free (usage);
+    g_string_free (message, TRUE);
+}
+
 void
 task_finish_callback (gint pid_result, gboolean localwatchdog, gpointer user_data, GError *error)
 {
     TaskRunData *task_run_data = (TaskRunData *) user_data;
     AppData *app_data = task_run_data->app_data;
-    Task *task = app_data->tasks->data;
+    Task *task = task_run_data->task;
+
+    if (task_run_data->splice) {
+        task_splice_end (task_run_data);
+    }
+
+    if (task->cgroup != NULL) {
+        task_cgroup_account (task);
+    }
 
     // Did the command Succeed?
     if (pid_result == 0) {
@@ -353,7 +507,9 @@ task_finish_callback (gint pid_result, gboolean localwatchdog, gpointer user_dat
                  NULL,
                  0,
                  FALSE,
-                 app_data->cancellable,
+                 task->cancellable,
+                 NULL,
+                 restraint_task_preamble (task, TRUE),
                  task_run_data);
     g_free (command);
 }
@@ -385,13 +541,19 @@ check_param_for_override (Param *param, Task *task)
         task->metadata->use_pty = STREQ (value, "TRUE");
 
         g_free (value);
+    } else if (STREQ (name, "RSTRNT_MEMORY_MAX")) {
+        g_free (task->metadata->memory_max);
+        task->metadata->memory_max = g_strdup (param->value);
+    } else if (STREQ (name, "RSTRNT_CPU_MAX")) {
+        g_free (task->metadata->cpu_max);
+        task->metadata->cpu_max = g_strdup (param->value);
     }
 }
 
 void metadata_finish_cb(gpointer user_data, GError *error)
 {
-    AppData *app_data = (AppData *)user_data;
-    Task *task = app_data->tasks->data;
+    Task *task = (Task *) user_data;
+    AppData *app_data = task->app_data;
 
     if (error) {
         g_propagate_error(&task->error, error);
@@ -401,7 +563,7 @@ void metadata_finish_cb(gpointer user_data, GError *error)
         task->state = TASK_COMPLETE;
     } else {
         task->state = TASK_REFRESH_ROLES;
-        app_data->fetch_retries = 0;
+        task->retries = 0;
 
         // Set values from metadata first
         task->remaining_time = task->metadata->max_time;
@@ -423,17 +585,13 @@ void metadata_finish_cb(gpointer user_data, GError *error)
         }
     }
 
-    app_data->task_handler_id = g_idle_add_full(G_PRIORITY_DEFAULT_IDLE,
-                                                task_handler,
-                                                app_data,
-                                                NULL);
+    task_handler_add (task);
 }
 
 void dependency_finish_cb (gpointer user_data, GError *error)
 {
     TaskRunData *task_run_data = (TaskRunData *) user_data;
-    AppData *app_data = (AppData *) task_run_data->app_data;
-    Task *task = app_data->tasks->data;
+    Task *task = task_run_data->task;
 
     if (error) {
         g_propagate_error(&task->error, error);
@@ -442,10 +600,7 @@ void dependency_finish_cb (gpointer user_data, GError *error)
         task->state = TASK_RUN;
     }
     g_slice_free (TaskRunData, task_run_data);
-    app_data->task_handler_id = g_idle_add_full(G_PRIORITY_DEFAULT_IDLE,
-                                                task_handler,
-                                                app_data,
-                                                NULL);
+    task_handler_add (task);
 }
 
 void
@@ -457,8 +612,7 @@ task_handler_callback (gint pid_result, gboolean localwatchdog, gpointer user_da
      * then re-add the task_handler
      */
     TaskRunData *task_run_data = (TaskRunData *) user_data;
-    AppData *app_data = task_run_data->app_data;
-    Task *task = app_data->tasks->data;
+    Task *task = task_run_data->task;
     GError *tmp_error = NULL;
 
     task->version = get_package_version(task->fetch.package_name, &tmp_error);
@@ -483,14 +637,11 @@ task_handler_callback (gint pid_result, gboolean localwatchdog, gpointer user_da
     // free the task_run_data
     g_slice_free (TaskRunData, task_run_data);
 
-    app_data->task_handler_id = g_idle_add_full(G_PRIORITY_DEFAULT_IDLE,
-                                                task_handler,
-                                                app_data,
-                                                NULL);
+    task_handler_add (task);
 }
 
 static void
-restraint_log_lwd_message (AppData *app_data,
+restraint_log_lwd_message (Task *task,
                            gchar *expire_time,
                            gboolean modified_wd)
 {
@@ -499,7 +650,7 @@ restraint_log_lwd_message (AppData *app_data,
     gchar currtime[80];
     GString *message;
 
-    g_return_if_fail(app_data != NULL && expire_time != NULL);
+    g_return_if_fail(task != NULL && expire_time != NULL);
 
     message = g_string_new(NULL);
     rawtime = time(NULL);
@@ -511,7 +662,7 @@ restraint_log_lwd_message (AppData *app_data,
                     expire_time);
 
     g_printerr ("%s", message->str);
-    restraint_log_task (app_data, RSTRNT_LOG_TYPE_HARNESS, message->str, message->len);
+    restraint_log_task (task, RSTRNT_LOG_TYPE_HARNESS, message->str, message->len);
     g_string_free (message, TRUE);
 }
 
@@ -546,7 +697,7 @@ task_heartbeat_callback (gpointer user_data)
 {
     TaskRunData *task_run_data = (TaskRunData *) user_data;
     AppData *app_data = task_run_data->app_data;
-    Task *task = (Task *) app_data->tasks->data;
+    Task *task = task_run_data->task;
 
     time_t rawtime;
     double delta_sec = 0;
@@ -583,8 +734,9 @@ task_heartbeat_callback (gpointer user_data)
     restraint_config_set (app_data->config_file, task->task_id,
                           "remaining_time", NULL,
                           G_TYPE_UINT64, task->remaining_time);
+    task_phases_checkpoint (app_data, task);
 
-    restraint_log_lwd_message(task_run_data->app_data,
+    restraint_log_lwd_message(task,
                               task_run_data->expire_time,
                               modified_wd);
 
@@ -594,8 +746,7 @@ task_heartbeat_callback (gpointer user_data)
 void task_timeout_cb(gpointer user_data, guint64 *time_remain)
 {
     TaskRunData *task_run_data = (TaskRunData *) user_data;
-    AppData *app_data = task_run_data->app_data;
-    Task *task = (Task *) app_data->tasks->data;
+    Task *task = task_run_data->task;
     gboolean result;
 
     result = task_heartbeat_callback(task_run_data);
@@ -607,11 +758,11 @@ void task_timeout_cb(gpointer user_data, guint64 *time_remain)
 }
 
 void
-task_run (AppData *app_data)
+task_run (Task *task)
 {
-    Task *task = (Task *) app_data->tasks->data;
     TaskRunData *task_run_data = g_slice_new0 (TaskRunData);
-    task_run_data->app_data = app_data;
+    task_run_data->app_data = task->app_data;
+    task_run_data->task = task;
     task_run_data->pass_state = TASK_COMPLETE;
     task_run_data->fail_state = TASK_COMPLETE;
 
@@ -626,9 +777,24 @@ task_run (AppData *app_data)
     }
 
     task_run_data->log_type = RSTRNT_LOG_TYPE_TASK;
+    task_run_data->tee_pipe[0] = task_run_data->tee_pipe[1] = -1;
+    // A pipe's output can be spliced into task.log unless it is cut by a
+    // log budget. It is only teed when restraintd shows it as debug output.
+    task_run_data->splice = !task->metadata->use_pty &&
+                            task->app_data->log_head == 0 &&
+                            rstrnt_log_manager_enabled (task->app_data);
+    if (task_run_data->splice && g_getenv ("G_MESSAGES_DEBUG") != NULL) {
+        if (g_unix_open_pipe (task_run_data->tee_pipe, FD_CLOEXEC, NULL)) {
+            g_unix_set_fd_nonblocking (task_run_data->tee_pipe[0], TRUE, NULL);
+        } else {
+            task_run_data->tee_pipe[0] = task_run_data->tee_pipe[1] = -1;
+            task_run_data->splice = FALSE;
+        }
+    }
+    task_cgroup_setup (task);
     restraint_start_heartbeat(task_run_data, task->remaining_time, NULL);
     if (task->metadata->nolocalwatchdog) {
-        restraint_log_lwd_message(task_run_data->app_data,
+        restraint_log_lwd_message(task,
                                   task_run_data->expire_time,
                                   FALSE);
     }
@@ -644,7 +810,9 @@ task_run (AppData *app_data)
                  NULL,
                  0,
                  FALSE,
-                 app_data->cancellable,
+                 task->cancellable,
+                 task->cgroup,
+                 restraint_task_preamble (task, FALSE),
                  task_run_data);
 
     g_free (entry_point);
@@ -654,11 +822,7 @@ static void
 task_message_complete (SoupSession *session, SoupMessage *msg, gpointer user_data)
 {
     // Add the task_handler back to the main loop
-    AppData *app_data = (AppData *) user_data;
-    app_data->task_handler_id = g_idle_add_full(G_PRIORITY_DEFAULT_IDLE,
-                                                task_handler,
-                                                app_data,
-                                                NULL);
+    task_handler_add ((Task *) user_data);
 }
 
 void
@@ -720,6 +884,7 @@ restraint_task_status (Task *task, AppData *app_data, gchar *status,
 
     gchar *data = NULL;
     GHashTable *data_table = g_hash_table_new (NULL, NULL);
+    GHashTable *stats_table = NULL;
     g_hash_table_insert(data_table, "status", status);
     g_hash_table_insert(data_table, "stime", stime);
     g_hash_table_insert(data_table, "etime", etime);
@@ -730,12 +895,25 @@ restraint_task_status (Task *task, AppData *app_data, gchar *status,
         g_hash_table_insert(data_table, "etime", etime);
         g_message("%s task %s due to error: %s", status, task->task_id, reason->message);
     }
+    if (task->cgroup_stats != NULL) {
+        GHashTableIter iter;
+        gpointer key, value;
+
+        stats_table = rstrnt_cgroup_stats_table (task->cgroup_stats);
+        g_hash_table_iter_init (&iter, stats_table);
+        while (g_hash_table_iter_next (&iter, &key, &value)) {
+            g_hash_table_insert (data_table, key, value);
+        }
+    }
     data = soup_form_encode_hash(data_table);
 
     soup_message_set_request(server_msg, "application/x-www-form-urlencoded",
             SOUP_MEMORY_TAKE, data, strlen(data));
 
     g_hash_table_destroy(data_table);
+    if (stats_table != NULL) {
+        g_hash_table_destroy (stats_table);
+    }
     g_free(etime);
     g_free(stime);
 
@@ -744,7 +922,7 @@ restraint_task_status (Task *task, AppData *app_data, gchar *status,
                             app_data->message_data,
                             task_message_complete,
                             app_data->cancellable,
-                            app_data);
+                            task);
 }
 
 void
@@ -776,7 +954,7 @@ restraint_task_watchdog (Task *task, AppData *app_data, guint64 seconds)
                             app_data->message_data,
                             task_message_complete,
                             app_data->cancellable,
-                            app_data);
+                            task);
 
     g_free(seconds_char);
 }
@@ -786,6 +964,7 @@ Task *restraint_task_new(void) {
     task->remaining_time = -1;
     task->offsets = g_hash_table_new_full(g_str_hash, g_str_equal, g_free,
                                           g_free);
+    task->cancellable = g_cancellable_new ();
     return task;
 }
 
@@ -799,6 +978,8 @@ void restraint_task_free(Task *task) {
     g_free(task->name);
     g_free(task->version);
     g_free(task->path);
+    g_free(task->cgroup);
+    g_free(task->cgroup_stats);
     g_hash_table_destroy(task->offsets);
     switch (task->fetch_method) {
         case TASK_FETCH_INSTALL_PACKAGE:
@@ -811,32 +992,182 @@ void restraint_task_free(Task *task) {
         default:
             g_return_if_reached();
     }
-    g_list_free_full(task->params, (GDestroyNotify) restraint_param_free);
+    // A parsed recipe keeps the strings of its tasks' params
+    if (task->recipe != NULL && task->recipe->strings != NULL) {
+        g_list_free_full(task->params, (GDestroyNotify) restraint_param_free_interned);
+    } else {
+        g_list_free_full(task->params, (GDestroyNotify) restraint_param_free);
+    }
     g_list_free_full(task->roles, (GDestroyNotify) restraint_role_free);
     //g_strfreev (task->env);
     if (task->env)
         g_ptr_array_free (task->env, TRUE);
     restraint_metadata_free(task->metadata);
+    for (gint i = 0; i < RSTRNT_LOG_TYPES; i++)
+        rstrnt_retention_free(task->retention[i]);
+    g_object_unref(task->cancellable);
     g_slice_free(Task, task);
 }
 
+static void
+task_cancelled (GCancellable *cancellable, gpointer user_data)
+{
+    Task *task = (Task *) user_data;
+
+    g_cancellable_cancel (task->cancellable);
+}
+
+/* Makes item the task being set up, and sets it going. */
+static void
+task_launch (AppData *app_data, GList *item)
+{
+    Task *task = (Task *) item->data;
+
+    app_data->tasks = item;
+    task->app_data = app_data;
+    g_cancellable_reset (task->cancellable);
+    task->cancelled_id = g_cancellable_connect (app_data->cancellable,
+                                                G_CALLBACK (task_cancelled),
+                                                task, NULL);
+    app_data->running = g_list_append (app_data->running, task);
+    task_handler_add (task);
+}
+
+static void
+task_retire (AppData *app_data, Task *task)
+{
+    g_cancellable_disconnect (app_data->cancellable, task->cancelled_id);
+    task->cancelled_id = 0;
+    app_data->running = g_list_remove (app_data->running, task);
+}
+
+void
+restraint_tasks_run (AppData *app_data)
+{
+    if (app_data->tasks != NULL) {
+        task_launch (app_data, app_data->tasks);
+    }
+}
+
+Task *
+restraint_task_lookup (AppData *app_data, const gchar *task_id)
+{
+    for (GList *item = app_data->running; item != NULL; item = item->next) {
+        Task *task = (Task *) item->data;
+
+        if (g_strcmp0 (task->task_id, task_id) == 0) {
+            return task;
+        }
+    }
+    return NULL;
+}
+
+/*
+ * The external watchdog is for the recipe, so it has to cover the tasks
+ * running alongside task as well.
+ */
+guint64
+restraint_task_watchdog_seconds (AppData *app_data, Task *task, guint64 seconds)
+{
+    for (GList *item = app_data->running; item != NULL; item = item->next) {
+        Task *other = (Task *) item->data;
+
+        if (other != task && other->remaining_time > 0 &&
+                (guint64) other->remaining_time > seconds) {
+            seconds = other->remaining_time;
+        }
+    }
+    return seconds + EWD_TIME;
+}
+
+/* What process_run () does in place of task_run.d, if restraintd does it */
+const ProcessPreamble *
+restraint_task_preamble (Task *task, gboolean plugins)
+{
+    if (task->app_data == NULL || !task->app_data->native_preamble) {
+        return NULL;
+    }
+    return rstrnt_preamble_get (plugins);
+}
+
+static gboolean
+task_is_parallel (AppData *app_data, Task *task)
+{
+    return app_data->task_slots > 1 && task->metadata != NULL &&
+           task->metadata->parallel;
+}
+
+/*
+ * The task running from the same path as task, if any.  Fetching task
+ * would wipe that path from under it, as when the same test runs twice
+ * with different params.
+ */
+static Task *
+task_path_user (AppData *app_data, Task *task)
+{
+    for (GList *item = app_data->running; item != NULL; item = item->next) {
+        Task *other = (Task *) item->data;
+
+        if (other != task && task->path != NULL &&
+                g_strcmp0 (other->path, task->path) == 0) {
+            return other;
+        }
+    }
+    return NULL;
+}
+
+/*
+ * Whether task can go on from TASK_SLOT.  Parallel tasks share the slots,
+ * any other task waits to have the system to itself.  No task shares its
+ * path with one running.
+ */
+static gboolean
+task_slot_free (AppData *app_data, Task *task)
+{
+    guint others = 0;
+
+    if (task_path_user (app_data, task) != NULL) {
+        return FALSE;
+    }
+    for (GList *item = app_data->running; item != NULL; item = item->next) {
+        Task *other = (Task *) item->data;
+
+        if (other == task) {
+            continue;
+        }
+        if (!task_is_parallel (app_data, task) ||
+                !task_is_parallel (app_data, other)) {
+            return FALSE;
+        }
+        others++;
+    }
+    return others < (guint) app_data->task_slots;
+}
+
 gboolean
 restraint_next_task (AppData *app_data, TaskSetupState task_state) {
-    Task *task = NULL;
+    GList *next = g_list_next (app_data->tasks);
 
-    while ((app_data->tasks = g_list_next (app_data->tasks)) != NULL) {
-        task = (Task *) app_data->tasks->data;
-        task->state = task_state;
+    if (next != NULL) {
+        ((Task *) next->data)->state = task_state;
+        task_launch (app_data, next);
         return TRUE;
     }
 
+    // The last task running finishes the recipe.
+    if (app_data->running != NULL) {
+        return FALSE;
+    }
+
     // No more tasks, let the recipe_handler know we are done.
+    app_data->tasks = NULL;
     app_data->state = RECIPE_COMPLETE;
     app_data->aborted = ABORTED_NONE;
     app_data->recipe_handler_id = g_idle_add_full(G_PRIORITY_DEFAULT_IDLE,
                                                   recipe_handler,
                                                   app_data,
                                                   recipe_handler_finish);
+    g_source_set_name_by_id (app_data->recipe_handler_id, "recipe_handler");
     return FALSE;
 }
 
@@ -940,12 +1271,213 @@ task_config_get_offsets (const gchar  *config_file,
     g_strfreev (pathv);
 }
 
+static const gchar *task_phase_names[TASK_PHASES] = {
+    "fetch",
+    "metadata",
+    "roles",
+    "env",
+    "watchdog",
+    "dependencies",
+    "run",
+    "complete",
+    "upload",
+    "beaker_wait",
+    "slot_wait",
+};
+
+static gint
+task_state_phase (TaskSetupState state)
+{
+    switch (state) {
+      case TASK_FETCH:
+          return TASK_PHASE_FETCH;
+      case TASK_METADATA_PARSE:
+          return TASK_PHASE_METADATA;
+      case TASK_REFRESH_ROLES:
+          return TASK_PHASE_ROLES;
+      case TASK_SLOT:
+          return TASK_PHASE_SLOT;
+      case TASK_ENV:
+          return TASK_PHASE_ENV;
+      case TASK_WATCHDOG:
+          return TASK_PHASE_WATCHDOG;
+      case TASK_DEPENDENCIES:
+          return TASK_PHASE_DEPENDENCIES;
+      case TASK_RUN:
+          return TASK_PHASE_RUN;
+      case TASK_ABORTED:
+      case TASK_CANCEL:
+      case TASK_CANCELLED:
+      case TASK_COMPLETE:
+          return TASK_PHASE_COMPLETE;
+      case TASK_COMPLETED:
+          return TASK_PHASE_UPLOAD;
+      default:
+          // TASK_IDLE and TASK_NEXT only move between tasks
+          return -1;
+    }
+}
+
+/*
+ * Charges the time since the last charge to the state being timed, which
+ * is the one task_handler () last saw, and starts timing the current one.
+ * Asynchronous work started in a state is charged to it until its callback
+ * brings task_handler () back.
+ */
+static void
+task_phase_charge (Task *task)
+{
+    gint64 now = g_get_monotonic_time ();
+    gint phase = task_state_phase (task->timed_state);
+
+    if (task->timed_since != 0 && phase >= 0) {
+        task->phase_usec[phase] += now - task->timed_since;
+    }
+    task->timed_state = task->state;
+    task->timed_since = now;
+}
+
+static gboolean
+task_wait_on_beaker (Task *task, AppData *app_data, const gchar *state_tag)
+{
+    gboolean waited;
+
+    if (app_data->stdin) {
+        return FALSE;
+    }
+
+    task_phase_charge (task);
+    waited = recipe_wait_on_beaker (app_data->recipe_url, state_tag);
+    task->phase_usec[TASK_PHASE_BEAKER_WAIT] += g_get_monotonic_time () - task->timed_since;
+    task->timed_since = g_get_monotonic_time ();
+
+    return waited;
+}
+
+gchar *
+restraint_task_phases_format (const gint64 *phase_usec)
+{
+    GString *formatted = g_string_new (NULL);
+
+    for (guint i = 0; i < TASK_PHASES; i++) {
+        if (phase_usec[i] == 0) {
+            continue;
+        }
+        g_string_append_printf (formatted, "%s%s=%" G_GINT64_FORMAT "ms",
+                                formatted->len > 0 ? " " : "",
+                                task_phase_names[i], phase_usec[i] / 1000);
+    }
+
+    return g_string_free (formatted, FALSE);
+}
+
+/* Phases are kept in the config as name=usec pairs, to survive reboots. */
+static gchar *
+task_phases_to_config (const gint64 *phase_usec)
+{
+    GString *value = g_string_new (NULL);
+
+    for (guint i = 0; i < TASK_PHASES; i++) {
+        g_string_append_printf (value, "%s%s=%" G_GINT64_FORMAT,
+                                i > 0 ? " " : "", task_phase_names[i],
+                                phase_usec[i]);
+    }
+
+    return g_string_free (value, FALSE);
+}
+
+static void
+task_phases_from_config (const gchar *value, gint64 *phase_usec)
+{
+    gchar **pairs;
+
+    if (value == NULL) {
+        return;
+    }
+    pairs = g_strsplit (value, " ", -1);
+    for (gchar **pair = pairs; *pair != NULL; pair++) {
+        gchar *equals = strchr (*pair, '=');
+
+        if (equals == NULL) {
+            continue;
+        }
+        *equals = '\0';
+        for (guint i = 0; i < TASK_PHASES; i++) {
+            if (STREQ (*pair, task_phase_names[i])) {
+                phase_usec[i] = g_ascii_strtoll (equals + 1, NULL, 10);
+                break;
+            }
+        }
+    }
+    g_strfreev (pairs);
+}
+
+static void
+task_phases_save (AppData *app_data, Task *task)
+{
+    gchar *value = task_phases_to_config (task->phase_usec);
+
+    restraint_config_set (app_data->config_file, task->task_id,
+                          "phases", NULL, G_TYPE_STRING, value);
+    g_free (value);
+}
+
+/*
+ * Charges the time so far to the state being timed, which keeps being
+ * timed, and saves the phases so that a reboot doesn't lose it.
+ */
+static void
+task_phases_checkpoint (AppData *app_data, Task *task)
+{
+    gint64 now = g_get_monotonic_time ();
+    gint phase = task_state_phase (task->timed_state);
+
+    if (task->timed_since != 0 && phase >= 0) {
+        task->phase_usec[phase] += now - task->timed_since;
+        task->timed_since = now;
+    }
+    task_phases_save (app_data, task);
+}
+
+/* Adds a finished task's phases to the recipe's, kept in the config too. */
+static void
+recipe_phases_add (AppData *app_data, Task *task)
+{
+    Recipe *recipe = app_data->recipe;
+    gboolean added = FALSE;
+    gchar *value;
+
+    if (recipe->task_phase_usec == NULL) {
+        recipe->task_phase_usec = g_new0 (gint64, TASK_PHASES);
+        value = restraint_config_get_string (app_data->config_file,
+                                             "restraint", "task_phases",
+                                             NULL);
+        task_phases_from_config (value, recipe->task_phase_usec);
+        g_free (value);
+    }
+
+    for (guint i = 0; i < TASK_PHASES; i++) {
+        added |= task->phase_usec[i] != 0;
+        recipe->task_phase_usec[i] += task->phase_usec[i];
+    }
+    // Nothing to write for tasks finished before a reboot
+    if (!added) {
+        return;
+    }
+
+    value = task_phases_to_config (recipe->task_phase_usec);
+    restraint_config_set (app_data->config_file, "restraint",
+                          "task_phases", NULL, G_TYPE_STRING, value);
+    g_free (value);
+}
+
 static gboolean
 parse_task_config (gchar   *config_file,
                    Task    *task,
                    GError **error)
 {
     GError *tmp_error = NULL;
+    gchar *phases;
 
     task->reboots = restraint_config_get_uint64 (config_file,
                                                  task->task_id,
@@ -976,6 +1508,12 @@ parse_task_config (gchar   *config_file,
     if (NULL != tmp_error)
         goto error;
 
+    // Time spent before a reboot
+    phases = restraint_config_get_string (config_file, task->task_id,
+                                          "phases", NULL);
+    task_phases_from_config (phases, task->phase_usec);
+    g_free (phases);
+
     return TRUE;
 
   error:
@@ -987,65 +1525,64 @@ parse_task_config (gchar   *config_file,
 }
 
 static void
-recipe_fetch_complete(GError *error, xmlDoc *doc, gpointer user_data)
+recipe_roles_refreshed (GError *error, gboolean modified, gpointer user_data)
 {
-    AppData *app_data = (AppData *)user_data;
-    Task *task = app_data->tasks->data;
+    Task *task = (Task *) user_data;
 
-    if (error) {
-        if (app_data->fetch_retries < ROLE_REFRESH_RETRIES) {
-            g_print("* RETRY refresh roles [%d]**:%s\n", ++app_data->fetch_retries,
+    if (error && error->domain == RESTRAINT_RECIPE_PARSE_ERROR) {
+        g_propagate_error(&task->error, g_error_copy (error));
+        task->state = TASK_COMPLETE;
+    } else if (error) {
+        if (task->retries < ROLE_REFRESH_RETRIES) {
+            g_print("* RETRY refresh roles [%d]**:%s\n", ++task->retries,
                     error->message);
-            g_timeout_add_seconds (ROLE_REFRESH_INTERVAL, refresh_role_retry, app_data);
+            g_timeout_add_seconds (ROLE_REFRESH_INTERVAL, refresh_role_retry, task);
             return;
         } else {
-            g_warn_if_fail(!doc);
-            g_propagate_error(&task->error, error);
+            g_propagate_error(&task->error, g_error_copy (error));
             task->state = TASK_COMPLETE;
         }
     } else {
-        g_warn_if_fail(doc != NULL);
-        GError *tmp_error = NULL;
-        restraint_recipe_update_roles(app_data->recipe, doc, &tmp_error);
-        if (tmp_error) {
-            g_propagate_error(&task->error, tmp_error);
-            task->state = TASK_COMPLETE;
-        } else {
-            task->state = TASK_ENV;
+        if (!modified) {
+            g_debug ("Recipe unchanged, roles of task %s are current", task->task_id);
         }
+        task->state = TASK_SLOT;
     }
 
-    app_data->task_handler_id = g_idle_add_full(G_PRIORITY_DEFAULT_IDLE,
-            task_handler, app_data, NULL);
+    task_handler_add (task);
+}
+
+static void
+task_linger_done (gpointer user_data)
+{
+    task_handler_add ((Task *) user_data);
 }
 
 static gboolean
 uploader_func (gpointer user_data)
 {
     AppData *app_data;
-    Task    *task;
 
     g_return_val_if_fail (NULL != user_data, G_SOURCE_REMOVE);
 
     app_data = user_data;
 
-    g_return_val_if_fail (NULL != app_data->tasks, G_SOURCE_REMOVE);
-    g_return_val_if_fail (NULL != app_data->tasks->data, G_SOURCE_REMOVE);
+    g_return_val_if_fail (NULL != app_data->running, G_SOURCE_REMOVE);
 
-    task = app_data->tasks->data;
+    for (GList *item = app_data->running; item != NULL; item = item->next) {
+        Task *task = item->data;
 
-    g_debug ("%s(): Upload event for task %s", __func__, task->task_id);
+        g_debug ("%s(): Upload event for task %s", __func__, task->task_id);
 
-    rstrnt_upload_logs (task, app_data, soup_session, app_data->cancellable);
+        rstrnt_upload_logs (task, app_data, soup_session, app_data->cancellable);
+    }
 
     return G_SOURCE_CONTINUE;
 }
 
 static void
-start_uploader (AppData *app_data)
+start_uploader (AppData *app_data, Task *task)
 {
-    Task  *task;
-
     g_return_if_fail (NULL != app_data);
     g_return_if_fail (app_data->uploader_interval > 0);
 
@@ -1053,24 +1590,18 @@ start_uploader (AppData *app_data)
                                                           uploader_func,
                                                           app_data);
 
-    task = app_data->tasks->data;
-
     g_debug ("%s(): Added upload event source %d for task %s",
              __func__, app_data->uploader_source_id, task->task_id);
 }
 
 static void
-stop_uploader (AppData *app_data)
+stop_uploader (AppData *app_data, Task *task)
 {
-    Task *task;
-
     g_return_if_fail (NULL != app_data);
     g_return_if_fail (0 != app_data->uploader_source_id);
 
     g_source_remove (app_data->uploader_source_id);
 
-    task = app_data->tasks->data;
-
     g_debug ("%s(): Removed upload event source %d for task %s",
              __func__, app_data->uploader_source_id, task->task_id);
 
@@ -1080,21 +1611,18 @@ stop_uploader (AppData *app_data)
 gboolean
 task_handler (gpointer user_data)
 {
-  AppData *app_data = (AppData *) user_data;
-
-  // No More tasks, return false so this handler gets removed.
-  if (app_data->tasks == NULL) {
-      g_message ("no more tasks..");
-      return G_SOURCE_REMOVE;
-  }
-
-  Task *task = app_data->tasks->data;
+  Task *task = (Task *) user_data;
+  AppData *app_data = task->app_data;
   GString *message = g_string_new(NULL);
   gboolean result = G_SOURCE_CONTINUE;
+  Task *other;
+
+  task_phase_charge (task);
 
   /*
    *  - Fetch the task
    *  - Update metadata
+   *  - Wait for a slot
    *  - Build env variables
    *  - Update external Watchdog
    *  - Add localwatchdog timeout
@@ -1105,12 +1633,12 @@ task_handler (gpointer user_data)
    */
   switch (task->state) {
     case TASK_IDLE:
-      // Read in previous state..
-      if (parse_task_config (app_data->config_file, task, &task->error)) {
-          if (task->finished) {
-              // If the task is finished skip to the next task.
-              task->state = TASK_NEXT;
-          } else if (g_cancellable_is_cancelled (app_data->cancellable)) {
+      // Read in previous state, there is none left of a finished task.
+      if (task->finished) {
+          // If the task is finished skip to the next task.
+          task->state = TASK_NEXT;
+      } else if (parse_task_config (app_data->config_file, task, &task->error)) {
+          if (g_cancellable_is_cancelled (task->cancellable)) {
               task->state = TASK_COMPLETE;
           } else if (task->localwatchdog) {
               // If the task is not finished but localwatchdog expired.
@@ -1125,7 +1653,7 @@ task_handler (gpointer user_data)
               restraint_task_status (task, app_data, "Running", NULL, NULL);
               result = G_SOURCE_REMOVE;
               g_string_printf(message, "** Fetching task: %s [%s]\n", task->task_id, task->path);
-              app_data->fetch_retries = 0;
+              task->retries = 0;
               task->state = TASK_FETCH;
           }
       } else {
@@ -1133,37 +1661,62 @@ task_handler (gpointer user_data)
       }
       break;
     case TASK_FETCH:
-        if (!app_data->stdin && recipe_wait_on_beaker (app_data->recipe_url, "** Task fetch"))
+        if (task_wait_on_beaker (task, app_data, "** Task fetch"))
+            break;
+
+        // Parked until the task running from the same path finishes
+        other = task_path_user (app_data, task);
+        if (other != NULL) {
+            g_string_printf(message, "** Waiting for task %s to finish with %s\n",
+                            other->task_id, task->path);
+            app_data->task_parked = TRUE;
+            result = G_SOURCE_REMOVE;
             break;
+        }
 
         // Fetch Task from rpm or url
-        if (app_data->fetch_retries > 0) {
+        if (task->retries > 0) {
             g_string_printf(message, "** Fetching task: Retries %" G_GINT32_FORMAT "\n",
-                            app_data->fetch_retries);
+                            task->retries);
         }
-        restraint_task_fetch (app_data);
+        restraint_task_fetch (task);
         result = G_SOURCE_REMOVE;
         break;
     case TASK_METADATA_PARSE:
       g_string_printf (message, "** Preparing metadata\n");
       task->rhts_compat = restraint_get_metadata(task->path,
                             task->recipe->osmajor, &task->metadata,
-                            app_data->cancellable, metadata_finish_cb,
-                            metadata_io_callback, app_data);
+                            task->cancellable, metadata_finish_cb,
+                            metadata_io_callback, task);
       result = G_SOURCE_REMOVE;
       break;
     case TASK_REFRESH_ROLES:
       if (app_data->recipe_url) {
-          if (!app_data->stdin && recipe_wait_on_beaker (app_data->recipe_url, "** Task role refresh"))
+          if (task_wait_on_beaker (task, app_data, "** Task role refresh"))
               break;
 
           g_string_printf(message, "** Refreshing peer role hostnames: Retries %"
-                                     G_GINT32_FORMAT "\n", app_data->fetch_retries);
-          restraint_xml_parse_from_url(soup_session, app_data->recipe_url,
-                  recipe_fetch_complete, app_data);
+                                     G_GINT32_FORMAT "\n", task->retries);
+          restraint_recipe_refresh_roles(app_data->recipe, app_data->recipe_url,
+                  recipe_roles_refreshed, task);
           result = G_SOURCE_REMOVE;
       } else {
-          task->state = TASK_ENV;
+          task->state = TASK_SLOT;
+      }
+      break;
+    case TASK_SLOT:
+      // Parked until a task running finishes
+      if (!task_slot_free (app_data, task)) {
+          g_string_printf(message, "** Waiting for a task slot\n");
+          app_data->task_parked = TRUE;
+          result = G_SOURCE_REMOVE;
+          break;
+      }
+      task->state = TASK_ENV;
+      // The next task is set up while a parallel one runs
+      if (task_is_parallel (app_data, task)) {
+          g_string_printf(message, "** Running in parallel: %s\n", task->task_id);
+          restraint_next_task (app_data, TASK_IDLE);
       }
       break;
     case TASK_ENV:
@@ -1174,12 +1727,20 @@ task_handler (gpointer user_data)
       g_string_printf(message, "** Updating env vars\n");
       build_env(app_data->restraint_url, app_data->port, task);
       task->state = TASK_WATCHDOG;
+      // The task's XDG_RUNTIME_DIR has to be there before it runs
+      if (app_data->native_preamble &&
+              rstrnt_preamble_linger (task->env, task_linger_done, task)) {
+          g_string_printf(message, "** Waiting for linger\n");
+          result = G_SOURCE_REMOVE;
+      }
       break;
     case TASK_WATCHDOG:
       // Setup external watchdog
       if (!task->started) {
-          g_string_printf(message, "** Updating external watchdog: %" G_GINT64_FORMAT " seconds\n", task->remaining_time + EWD_TIME);
-          restraint_task_watchdog (task, app_data, task->remaining_time + EWD_TIME);
+          guint64 seconds = restraint_task_watchdog_seconds (app_data, task, task->remaining_time);
+
+          g_string_printf(message, "** Updating external watchdog: %" G_GUINT64_FORMAT " seconds\n", seconds);
+          restraint_task_watchdog (task, app_data, seconds);
           result = G_SOURCE_REMOVE;
       }
       task->state = TASK_DEPENDENCIES;
@@ -1189,18 +1750,19 @@ task_handler (gpointer user_data)
       // All dependencies are installed with system package command
       // All repodependencies are installed via fetch_git
       if (!task->started) {
-          if (!app_data->stdin && recipe_wait_on_beaker (app_data->recipe_url, "** Task dependencies"))
+          if (task_wait_on_beaker (task, app_data, "** Task dependencies"))
               break;
 
           g_string_printf(message, "** Installing dependencies\n");
           TaskRunData *task_run_data = g_slice_new0(TaskRunData);
           task_run_data->app_data = app_data;
+          task_run_data->task = task;
           task_run_data->log_type = RSTRNT_LOG_TYPE_HARNESS;
           restraint_start_heartbeat(task_run_data, 0, NULL);
           restraint_install_dependencies (task, task_io_callback,
                                           taskrun_archive_entry_callback,
                                           dependency_finish_cb,
-                                          app_data->cancellable,
+                                          task->cancellable,
                                           task_run_data);
           result = G_SOURCE_REMOVE;
       }
@@ -1212,11 +1774,12 @@ task_handler (gpointer user_data)
       //       io_handler
       //       timeout_handler
       //       heartbeat_handler
-      if (g_cancellable_is_cancelled (app_data->cancellable)) {
+      if (g_cancellable_is_cancelled (task->cancellable)) {
           task->state = TASK_COMPLETE;
       } else {
           g_string_printf(message, "** Running task: %s [%s]\n", task->task_id, task->name);
-          task_run (app_data);
+          task_phases_save (app_data, task);
+          task_run (task);
           task->starttime = time(NULL);
           result = G_SOURCE_REMOVE;
           task->started = TRUE;
@@ -1235,7 +1798,7 @@ task_handler (gpointer user_data)
       break;
     case TASK_COMPLETE:
       // Set task finished
-      if (g_cancellable_is_cancelled(app_data->cancellable) &&
+      if (g_cancellable_is_cancelled(task->cancellable) &&
           app_data->aborted != ABORTED_NONE) {
         g_clear_error(&task->error);
         g_set_error(&task->error, RESTRAINT_ERROR,
@@ -1249,14 +1812,28 @@ task_handler (gpointer user_data)
       } else {
           g_string_printf(message, "** Completed Task : %s\n", task->task_id);
       }
+      {
+          gchar *phases = restraint_task_phases_format (task->phase_usec);
+
+          g_string_append_printf (message, "** Task phases: %s", phases);
+          if (task->fetch_retries > 0) {
+              g_string_append_printf (message, " (%u fetch retries)",
+                                      task->fetch_retries);
+          }
+          g_string_append (message, "\n");
+          task_phases_save (app_data, task);
+          g_free (phases);
+      }
       task->endtime = time(NULL);
       task->state = TASK_COMPLETED;
       break;
     case TASK_COMPLETED:
     {
+      task_log_finish (task);
       if (rstrnt_log_manager_enabled (app_data)) {
-          if (0 != app_data->uploader_source_id)
-              stop_uploader (app_data);
+          // The uploader carries on for the other tasks running
+          if (0 != app_data->uploader_source_id && app_data->running->next == NULL)
+              stop_uploader (app_data, task);
 
           rstrnt_upload_logs (task, app_data, soup_session, app_data->cancellable);
           rstrnt_close_logs (task);
@@ -1268,21 +1845,36 @@ task_handler (gpointer user_data)
       } else {
         restraint_task_status(task, app_data, "Completed", task->version, NULL);
       }
-      // Rmeove the entire [task] section from the config.
+      // Checkpointed as finished before its [task] section goes, so a
+      // reboot in between doesn't run it again from the start.
+      task->finished = TRUE;
+      restraint_recipe_checkpoint (app_data->recipe, app_data->recipe_url,
+                                   app_data->snapshot_file);
+      // Remove the entire [task] section from the config.
       restraint_config_set (app_data->config_file, task->task_id, NULL, NULL, -1);
       task->state = TASK_NEXT;
 
-      if (g_cancellable_is_cancelled(app_data->cancellable) &&
+      // Only this task was cancelled
+      if (g_cancellable_is_cancelled(task->cancellable) &&
           app_data->aborted == ABORTED_TASK) {
           app_data->aborted = ABORTED_NONE;
-        g_cancellable_reset(app_data->cancellable);
       }
       result = G_SOURCE_REMOVE;
       break;
     }
     case TASK_NEXT:
-      // Get the next task and run it.
-      result = restraint_next_task (app_data, TASK_IDLE);
+      // Upload and status update included
+      recipe_phases_add (app_data, task);
+      task_retire (app_data, task);
+      // Get the next task and run it, unless one running in parallel
+      // already did. Otherwise a task waiting for a slot may have one now.
+      if (app_data->tasks->data == task || app_data->running == NULL) {
+          restraint_next_task (app_data, TASK_IDLE);
+      } else if (app_data->task_parked) {
+          app_data->task_parked = FALSE;
+          task_handler_add (app_data->tasks->data);
+      }
+      result = G_SOURCE_REMOVE;
       break;
     default:
       result = G_SOURCE_CONTINUE;
@@ -1291,7 +1883,7 @@ task_handler (gpointer user_data)
 
   if (message->len > 0) {
       g_printerr ("%s", message->str);
-      restraint_log_task (app_data, RSTRNT_LOG_TYPE_HARNESS, message->str, message->len);
+      restraint_log_task (task, RSTRNT_LOG_TYPE_HARNESS, message->str, message->len);
   }
 
   g_string_free (message, TRUE);
@@ -1300,22 +1892,21 @@ task_handler (gpointer user_data)
 }
 
 static void
-connections_write (AppData     *app_data,
+connections_write (Task        *task,
                    const gchar *path,
                    const gchar *msg_data,
                    gsize        msg_len)
 {
+    AppData             *app_data = task->app_data;
     SoupMessage         *server_msg;
-    Task                *task;
     goffset             *offset;
     g_autoptr (SoupURI)  task_output_uri = NULL;
     g_autofree gchar    *section = NULL;
     g_autoptr (GError)   err = NULL;
 
-    if (app_data->tasks == NULL || g_cancellable_is_cancelled (app_data->cancellable))
+    if (g_cancellable_is_cancelled (task->cancellable))
         return;
 
-    task = (Task *) app_data->tasks->data;
     task_output_uri = soup_uri_new_with_base (task->task_uri, path);
     server_msg = soup_message_new_from_uri ("PUT", task_output_uri);
 
@@ -1345,29 +1936,85 @@ connections_write (AppData     *app_data,
     }
 }
 
+static void
+task_log_write (Task          *task,
+                RstrntLogType  type,
+                const char    *data,
+                gsize          size)
+{
+    const char *log_path = NULL;
+
+    if (rstrnt_log_manager_enabled (task->app_data)) {
+        rstrnt_log_bytes (task, type, data, size);
+
+        if (0 == task->app_data->uploader_source_id)
+            start_uploader (task->app_data, task);
+
+        return;
+    }
+
+    log_path = rstrnt_log_type_get_path (type);
+
+    g_return_if_fail (NULL != log_path);
+
+    connections_write (task, log_path, data, size);
+}
+
 void
-restraint_log_task (AppData       *app_data,
+restraint_log_task (Task          *task,
                     RstrntLogType  type,
                     const char    *data,
                     gsize          size)
 {
-    const char *log_path = NULL;
+    AppData *app_data;
 
-    g_return_if_fail (app_data != NULL);
+    g_return_if_fail (task != NULL);
     g_return_if_fail (data != NULL && size > 0);
 
-    if (rstrnt_log_manager_enabled (app_data)) {
-        rstrnt_log_bytes (app_data->tasks->data, type, data, size);
+    app_data = task->app_data;
 
-        if (0 == app_data->uploader_source_id)
-            start_uploader (app_data);
+    // Past the head of the budget only the tail is kept, until the end
+    if (app_data->log_head > 0) {
+        if (task->retention[type] == NULL) {
+            g_autofree gchar *tail_path = rstrnt_log_get_tail_path (task, type);
+            guint64 written;
 
-        return;
+            // The log manager may not have uploaded all it wrote before
+            // a reboot, so its offset would leave too much room for the head
+            if (rstrnt_log_manager_enabled (app_data)) {
+                written = rstrnt_log_get_size (task, type);
+            } else {
+                written = *restraint_task_get_offset (task,
+                                                      rstrnt_log_type_get_path (type));
+            }
+            // Saved as it goes, so a reboot doesn't lose the tail
+            task->retention[type] = rstrnt_retention_new_saved (app_data->log_head,
+                                                                app_data->log_tail,
+                                                                written, tail_path);
+        }
+        size = rstrnt_retention_feed (task->retention[type], data, size);
+        if (size == 0)
+            return;
     }
 
-    log_path = rstrnt_log_type_get_path (type);
+    task_log_write (task, type, data, size);
+}
 
-    g_return_if_fail (NULL != log_path);
+/* Logs the tails held back, after the number of bytes dropped. */
+static void
+task_log_finish (Task *task)
+{
+    for (gint type = 0; type < RSTRNT_LOG_TYPES; type++) {
+        gchar *kept;
+        gsize length;
+
+        if (task->retention[type] == NULL)
+            continue;
 
-    connections_write (app_data, log_path, data, size);
+        kept = rstrnt_retention_finish (task->retention[type], &length);
+        if (kept != NULL) {
+            task_log_write (task, type, kept, length);
+            g_free (kept);
+        }
+    }
 }
@@ -29,6 +29,9 @@
 #include "server.h"
 #include "metadata.h"
 #include "utils.h"
+#include "cgroup.h"
+#include "retention.h"
+#include "process.h"
 
 #define DEFAULT_MAX_TIME 10 * 60 // default amount of time before local watchdog kills process
 #define DEFAULT_ENTRY_POINT "make run"
@@ -49,6 +52,7 @@ typedef enum {
     TASK_FETCH,
     TASK_METADATA_PARSE,
     TASK_REFRESH_ROLES,
+    TASK_SLOT,
     TASK_ENV,
     TASK_WATCHDOG,
     TASK_DEPENDENCIES,
@@ -61,6 +65,25 @@ typedef enum {
     TASK_COMPLETED,
 } TaskSetupState;
 
+/* Where a task's turnaround goes, timed across its TaskSetupState */
+typedef enum {
+    TASK_PHASE_FETCH,
+    TASK_PHASE_METADATA,
+    TASK_PHASE_ROLES,
+    TASK_PHASE_ENV,
+    TASK_PHASE_WATCHDOG,
+    TASK_PHASE_DEPENDENCIES,
+    TASK_PHASE_RUN,
+    TASK_PHASE_COMPLETE,
+    // log upload and final status update
+    TASK_PHASE_UPLOAD,
+    // recipe_wait_on_beaker (), whichever state it was called in
+    TASK_PHASE_BEAKER_WAIT,
+    // waiting in TASK_SLOT for the tasks running to make room
+    TASK_PHASE_SLOT,
+    TASK_PHASES,
+} TaskPhase;
+
 typedef enum {
     TASK_FETCH_INSTALL_PACKAGE,
     TASK_FETCH_UNPACK,
@@ -123,21 +146,50 @@ typedef struct RstrntTask {
     /* Start stop times */
     time_t starttime;
     time_t endtime;
+    /* cgroup the task runs in, NULL without cgroup2 */
+    gchar *cgroup;
+    /* What the task used, from its cgroup once it finished */
+    RstrntCgroupStats *cgroup_stats;
+    /* Microseconds spent in each TaskPhase */
+    gint64 phase_usec[TASK_PHASES];
+    /* State being timed, and the monotonic time it was last charged */
+    TaskSetupState timed_state;
+    gint64 timed_since;
+    /* Times fetching the task was retried */
+    guint fetch_retries;
+    /* Retries of the fetch or role refresh in progress */
+    guint retries;
+    /* restraintd state the task runs under, set when it is started */
+    AppData *app_data;
+    /* Cancelled with the recipe, or on its own by rstrnt-abort */
+    GCancellable *cancellable;
+    gulong cancelled_id;
+    /* Head and tail kept of each log, with a log budget */
+    RstrntRetention *retention[RSTRNT_LOG_TYPES];
 } Task;
 
 typedef struct {
     AppData *app_data;
+    Task *task;
     TaskSetupState pass_state;
     TaskSetupState fail_state;
     gchar expire_time[80];
     RstrntLogType log_type;
+    /* Task output goes into its log by splice (), not through restraintd */
+    gboolean splice;
+    /* Pipe the output is teed into for debug output, or -1 */
+    gint tee_pipe[2];
 } TaskRunData;
 
 Task *restraint_task_new(void);
 gboolean task_handler (gpointer user_data);
 void task_finish (gpointer user_data);
+void restraint_tasks_run (AppData *app_data);
+Task *restraint_task_lookup (AppData *app_data, const gchar *task_id);
+guint64 restraint_task_watchdog_seconds (AppData *app_data, Task *task, guint64 seconds);
+const ProcessPreamble *restraint_task_preamble (Task *task, gboolean plugins);
 void
-restraint_task_fetch(AppData *app_data);
+restraint_task_fetch(Task *task);
 gboolean restraint_build_env(Task *task, GError **error);
 void restraint_task_status (Task *task, AppData *app_data, gchar *, gchar *, GError *reason);
 void restraint_task_run(Task *task);
@@ -150,7 +202,8 @@ gboolean idle_task_setup (gpointer user_data);
 
 gboolean task_config_set_offset (const gchar *config_file, Task *task, const gchar *path, goffset value, GError **error);
 
-void restraint_log_task (AppData *app_data, RstrntLogType type, const char *data, gsize size);
+void restraint_log_task (Task *task, RstrntLogType type, const char *data, gsize size);
+gchar *restraint_task_phases_format (const gint64 *phase_usec);
 
 extern SoupSession *soup_session;
 
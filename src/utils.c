@@ -258,3 +258,37 @@ get_install_dir_exit:
     }
     return install_dir_value;
 }
+
+static gint
+compare_paths (gconstpointer a, gconstpointer b)
+{
+    return g_strcmp0 (*(const gchar **) a, *(const gchar **) b);
+}
+
+/* get_dir_files()
+ *
+ * Lists the files in path ending in suffix, sorted by name.
+ *
+ * Returns NULL if path can't be opened.
+ */
+GPtrArray *
+get_dir_files (const gchar *path, const gchar *suffix)
+{
+    GDir *dir = g_dir_open (path, 0, NULL);
+    GPtrArray *files;
+    const gchar *name;
+
+    if (dir == NULL) {
+        return NULL;
+    }
+    files = g_ptr_array_new_with_free_func (g_free);
+    while ((name = g_dir_read_name (dir)) != NULL) {
+        if (g_str_has_suffix (name, suffix)) {
+            g_ptr_array_add (files, g_build_filename (path, name, NULL));
+        }
+    }
+    g_dir_close (dir);
+
+    g_ptr_array_sort (files, compare_paths);
+    return files;
+}
@@ -39,5 +39,6 @@ guint64 parse_time_string (gchar *time_string, GError **error);
 gboolean file_exists (gchar *filename);
 gchar *get_package_version(gchar *pkg_name, GError **error);
 gchar * get_install_dir(const gchar *filename, GError **error);
+GPtrArray *get_dir_files (const gchar *path, const gchar *suffix);
 
 #endif
@@ -18,8 +18,38 @@ typedef struct {
     gchar *url;
     RestraintXmlRequestCompletionCallback completion_callback;
     gpointer completion_callback_user_data;
+    // Set by restraint_xml_sax_from_url () instead of completion_callback
+    RestraintXmlSaxCompletionCallback sax_callback;
+    xmlSAXHandler *sax;
+    gpointer sax_data;
+    RestraintXmlValidators *validators;
+    RestraintXmlValidators fetched; /* Of the copy being read */
 } RestraintXmlRequestContext;
 
+void
+restraint_xml_validators_clear (RestraintXmlValidators *validators)
+{
+    g_clear_pointer (&validators->etag, g_free);
+    g_clear_pointer (&validators->last_modified, g_free);
+}
+
+/* Ends a restraint_xml_sax_from_url () request and frees ctxt */
+static void
+restraint_xml_sax_finish (RestraintXmlRequestContext *ctxt, gboolean modified)
+{
+    if (ctxt->error == NULL && modified && ctxt->validators != NULL) {
+        restraint_xml_validators_clear (ctxt->validators);
+        *ctxt->validators = ctxt->fetched;
+    } else {
+        restraint_xml_validators_clear (&ctxt->fetched);
+    }
+    ctxt->sax_callback (ctxt->error, modified, ctxt->completion_callback_user_data);
+
+    g_clear_error (&ctxt->error);
+    g_free (ctxt->url);
+    g_slice_free (RestraintXmlRequestContext, ctxt);
+}
+
 static void
 restraint_xml_read_callback(GObject *source, GAsyncResult *result, gpointer user_data)
 {
@@ -40,7 +70,13 @@ restraint_xml_read_callback(GObject *source, GAsyncResult *result, gpointer user
     // We only initialise the XML parsing context after we have read some
     // bytes, not sooner, because it uses the initial bytes for charset detection.
     if (ctxt->parser_ctxt == NULL) {
-        ctxt->parser_ctxt = xmlCreatePushParserCtxt(NULL, NULL, ctxt->buf, size, ctxt->url);
+        if (size == 0 && ctxt->sax_callback != NULL) {
+            g_set_error_literal(&ctxt->error, RESTRAINT_XML_PARSE_ERROR,
+                    RESTRAINT_XML_PARSE_ERROR_BAD_SYNTAX, "Empty XML document");
+            goto finished;
+        }
+        ctxt->parser_ctxt = xmlCreatePushParserCtxt(ctxt->sax, ctxt->sax_data,
+                ctxt->buf, size, ctxt->url);
         if (ctxt->parser_ctxt == NULL) {
             g_set_error_literal(&ctxt->error, RESTRAINT_XML_PARSE_ERROR,
                     RESTRAINT_XML_PARSE_ERROR_BAD_SYNTAX,
@@ -71,6 +107,14 @@ finished:
     g_input_stream_close(stream, /* cancellable */ NULL, &ctxt->error);
     g_object_unref(stream);
 
+    if (ctxt->sax_callback != NULL) {
+        if (ctxt->parser_ctxt) {
+            xmlFreeParserCtxt(ctxt->parser_ctxt);
+        }
+        restraint_xml_sax_finish(ctxt, TRUE);
+        return;
+    }
+
     if (ctxt->error) {
         if (ctxt->parser_ctxt) {
             xmlFreeDoc(ctxt->parser_ctxt->myDoc);
@@ -112,6 +156,31 @@ restraint_xml_parse_from_stream(
             restraint_xml_read_callback, ctxt);
 }
 
+void
+restraint_xml_sax_from_stream(
+    GInputStream *stream,
+    const gchar *url,
+    xmlSAXHandler *sax,
+    gpointer sax_data,
+    RestraintXmlSaxCompletionCallback completion_callback,
+    gpointer user_data)
+{
+    g_return_if_fail(stream != NULL);
+    g_return_if_fail(sax != NULL);
+    g_return_if_fail(completion_callback != NULL);
+
+    RestraintXmlRequestContext *ctxt = g_slice_new0(RestraintXmlRequestContext);
+    ctxt->url = g_strdup(url);
+    ctxt->sax_callback = completion_callback;
+    ctxt->completion_callback_user_data = user_data;
+    ctxt->sax = sax;
+    ctxt->sax_data = sax_data;
+
+    g_input_stream_read_async(stream, ctxt->buf, sizeof(ctxt->buf),
+            G_PRIORITY_DEFAULT, /* cancellable */ NULL,
+            restraint_xml_read_callback, ctxt);
+}
+
 static void
 restraint_xml_request_callback(GObject *source, GAsyncResult *res, gpointer user_data)
 {
@@ -119,10 +188,37 @@ restraint_xml_request_callback(GObject *source, GAsyncResult *res, gpointer user
 
     GInputStream *stream = soup_request_send_finish(SOUP_REQUEST(source), res, &ctxt->error);
     if (!stream) {
+        if (ctxt->sax_callback != NULL) {
+            restraint_xml_sax_finish(ctxt, FALSE);
+            return;
+        }
         ctxt->completion_callback(ctxt->error, NULL, ctxt->completion_callback_user_data);
         return;
     }
 
+    if (ctxt->sax_callback != NULL && SOUP_IS_REQUEST_HTTP(source)) {
+        SoupMessage *msg = soup_request_http_get_message(SOUP_REQUEST_HTTP(source));
+        guint status = msg->status_code;
+
+        if (SOUP_STATUS_IS_SUCCESSFUL(status)) {
+            ctxt->fetched.etag = g_strdup(soup_message_headers_get_one(
+                        msg->response_headers, "ETag"));
+            ctxt->fetched.last_modified = g_strdup(soup_message_headers_get_one(
+                        msg->response_headers, "Last-Modified"));
+        } else if (status != SOUP_STATUS_NOT_MODIFIED) {
+            g_set_error(&ctxt->error, SOUP_HTTP_ERROR, status,
+                    "Fetching %s failed: %s", ctxt->url, msg->reason_phrase);
+        }
+        g_object_unref(msg);
+
+        if (ctxt->error != NULL || status == SOUP_STATUS_NOT_MODIFIED) {
+            g_input_stream_close(stream, /* cancellable */ NULL, NULL);
+            g_object_unref(stream);
+            restraint_xml_sax_finish(ctxt, FALSE);
+            return;
+        }
+    }
+
     g_input_stream_read_async(stream, ctxt->buf, sizeof(ctxt->buf),
             G_PRIORITY_DEFAULT, /* cancellable */ NULL,
             restraint_xml_read_callback, ctxt);
@@ -157,6 +253,55 @@ restraint_xml_parse_from_url(
     g_object_unref(request);
 }
 
+void
+restraint_xml_sax_from_url(
+    SoupSession *soup_session,
+    const gchar *url,
+    RestraintXmlValidators *validators,
+    xmlSAXHandler *sax,
+    gpointer sax_data,
+    RestraintXmlSaxCompletionCallback completion_callback,
+    gpointer user_data)
+{
+    g_return_if_fail(soup_session != NULL);
+    g_return_if_fail(url != NULL);
+    g_return_if_fail(sax != NULL);
+    g_return_if_fail(completion_callback != NULL);
+
+    RestraintXmlRequestContext *ctxt = g_slice_new0(RestraintXmlRequestContext);
+    ctxt->url = g_strdup(url);
+    ctxt->sax_callback = completion_callback;
+    ctxt->completion_callback_user_data = user_data;
+    ctxt->sax = sax;
+    ctxt->sax_data = sax_data;
+    ctxt->validators = validators;
+
+    SoupRequest *request = soup_session_request(soup_session, url, &ctxt->error);
+    if (!request) {
+        restraint_xml_sax_finish(ctxt, FALSE);
+        return;
+    }
+
+    // Only transfer the document if it changed since the copy we have
+    if (validators != NULL && SOUP_IS_REQUEST_HTTP(request)) {
+        SoupMessage *msg = soup_request_http_get_message(SOUP_REQUEST_HTTP(request));
+
+        if (validators->etag != NULL) {
+            soup_message_headers_replace(msg->request_headers, "If-None-Match",
+                                         validators->etag);
+        }
+        if (validators->last_modified != NULL) {
+            soup_message_headers_replace(msg->request_headers, "If-Modified-Since",
+                                         validators->last_modified);
+        }
+        g_object_unref(msg);
+    }
+
+    soup_request_send_async(request, /* cancellable */ NULL,
+            restraint_xml_request_callback, ctxt);
+    g_object_unref(request);
+}
+
 xmlNodePtr
 first_child_with_name(xmlNodePtr parent_ptr, const gchar *name,
                       gboolean create)
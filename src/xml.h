@@ -15,6 +15,18 @@ typedef enum {
 } RestraintXmlParseError;
 
 typedef void (*RestraintXmlRequestCompletionCallback)(GError *error, xmlDoc *doc, gpointer user_data);
+typedef void (*RestraintXmlSaxCompletionCallback)(GError *error, gboolean modified, gpointer user_data);
+
+/*
+ * The ETag and Last-Modified of the copy of a document last fetched, so
+ * that fetching it again only transfers it if it changed.
+ */
+typedef struct {
+    gchar *etag;
+    gchar *last_modified;
+} RestraintXmlValidators;
+
+void restraint_xml_validators_clear (RestraintXmlValidators *validators);
 
 /**
  * restraint_xml_parse_stream:
@@ -46,6 +58,52 @@ void restraint_xml_parse_from_url(
     RestraintXmlRequestCompletionCallback completion_callback,
     gpointer user_data);
 
+/**
+ * restraint_xml_sax_from_url:
+ * @soup_session: the session to fetch @url with.
+ * @url: the URL of the XML document.
+ * @validators: (nullable): of the copy of the document last fetched, to
+ *   ask for it only if it changed.  Updated once a new copy is parsed.
+ * @sax: SAX handler called as the document is read, instead of building
+ *   an xmlDoc.
+ * @sax_data: user data for @sax.
+ * @completion_callback: called once the document has been parsed, or
+ *   with %FALSE for modified if the server says it did not change since
+ *   @validators, or with an error.
+ * @user_data (closure): extra argument for the completion callback.
+ *
+ * A handler in @sax which finds the document wrong can xmlStopParser () to
+ * fail the parse; it keeps its own reason.
+ */
+void restraint_xml_sax_from_url(
+    SoupSession *soup_session,
+    const gchar *url,
+    RestraintXmlValidators *validators,
+    xmlSAXHandler *sax,
+    gpointer sax_data,
+    RestraintXmlSaxCompletionCallback completion_callback,
+    gpointer user_data);
+
+/**
+ * restraint_xml_sax_from_stream:
+ * @stream (transfer full): an input stream containing XML to be read.
+ * @url: the URL from which the XML was retrieved.
+ * @sax: SAX handler called as the stream is read.
+ * @sax_data: user data for @sax.
+ * @completion_callback: called with %TRUE for modified once the stream has
+ *   been read and parsed, or with an error.
+ * @user_data (closure): extra argument for the completion callback.
+ *
+ * As restraint_xml_sax_from_url (), for XML which is already at hand.
+ */
+void restraint_xml_sax_from_stream(
+    GInputStream *stream,
+    const gchar *url,
+    xmlSAXHandler *sax,
+    gpointer sax_data,
+    RestraintXmlSaxCompletionCallback completion_callback,
+    gpointer user_data);
+
 xmlNodePtr
 first_child_with_name(xmlNodePtr parent_ptr, const gchar *name, gboolean create);
 xmlXPathObjectPtr
@@ -0,0 +1,133 @@
+/*
+    This file is part of Restraint.
+
+    Restraint is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Restraint is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Restraint.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <glib.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "bench.h"
+
+BenchTimer *
+bench_timer_new (guint iterations)
+{
+    BenchTimer *timer = g_slice_new0 (BenchTimer);
+
+    timer->times = g_new (gint64, iterations);
+    timer->iterations = iterations;
+
+    return timer;
+}
+
+void
+bench_timer_start (BenchTimer *timer)
+{
+    timer->started = g_get_monotonic_time ();
+}
+
+void
+bench_timer_stop (BenchTimer *timer)
+{
+    bench_timer_add (timer, g_get_monotonic_time () - timer->started);
+}
+
+void
+bench_timer_add (BenchTimer *timer, gint64 usec)
+{
+    g_return_if_fail (timer->done < timer->iterations);
+
+    timer->times[timer->done++] = usec;
+}
+
+static gint
+compare_times (gconstpointer a, gconstpointer b)
+{
+    gint64 time_a = *(const gint64 *) a;
+    gint64 time_b = *(const gint64 *) b;
+
+    return (time_a > time_b) - (time_a < time_b);
+}
+
+void
+bench_timer_report (BenchTimer *timer,
+                    const gchar *benchmark,
+                    const gchar *params,
+                    guint64 bytes)
+{
+    gint64 total = 0;
+    guint done = timer->done;
+
+    g_return_if_fail (done > 0);
+
+    qsort (timer->times, done, sizeof (gint64), compare_times);
+    for (guint i = 0; i < done; i++) {
+        total += timer->times[i];
+    }
+
+    printf ("{\"benchmark\": \"%s\", ", benchmark);
+    if (params != NULL) {
+        printf ("%s, ", params);
+    }
+    printf ("\"iterations\": %u, \"mean_us\": %.1f, "
+            "\"p50_us\": %" G_GINT64_FORMAT ", \"p99_us\": %" G_GINT64_FORMAT,
+            done, (gdouble) total / done,
+            timer->times[done / 2], timer->times[(done * 99) / 100]);
+    // Bytes per microsecond are MB per second.
+    if (bytes > 0) {
+        printf (", \"mb_per_s\": %.1f",
+                total > 0 ? (gdouble) bytes * done / total : 0.0);
+    }
+    printf ("}\n");
+    fflush (stdout);
+}
+
+void
+bench_timer_free (BenchTimer *timer)
+{
+    g_free (timer->times);
+    g_slice_free (BenchTimer, timer);
+}
+
+gboolean
+bench_parse_options (int *argc, char ***argv,
+                     gint *iterations,
+                     const GOptionEntry *entries)
+{
+    gchar *description = g_strdup_printf ("Iterations of each benchmark [Default: %d]",
+                                          *iterations);
+    GOptionEntry common[] = {
+        { "iterations", 'n', 0, G_OPTION_ARG_INT, iterations, description, "N" },
+        { NULL }
+    };
+    GOptionContext *context = g_option_context_new (NULL);
+    GError *error = NULL;
+    gboolean success;
+
+    g_option_context_add_main_entries (context, common, NULL);
+    if (entries != NULL) {
+        g_option_context_add_main_entries (context, entries, NULL);
+    }
+    success = g_option_context_parse (context, argc, argv, &error);
+    g_option_context_free (context);
+    g_free (description);
+
+    if (!success || *iterations <= 0) {
+        g_printerr ("%s\n", error != NULL ? error->message : "Invalid arguments");
+        g_clear_error (&error);
+        return FALSE;
+    }
+    return TRUE;
+}
@@ -0,0 +1,57 @@
+/*
+    This file is part of Restraint.
+
+    Restraint is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Restraint is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Restraint.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef _RESTRAINT_BENCH_H
+#define _RESTRAINT_BENCH_H
+
+/*
+ * For benchmarks: times each iteration and prints a summary as one JSON
+ * object per line, so that runs can be compared by tools.
+ */
+
+#include <glib.h>
+
+typedef struct {
+    gint64 *times;
+    guint iterations;
+    guint done;
+    gint64 started;
+} BenchTimer;
+
+BenchTimer *bench_timer_new (guint iterations);
+void bench_timer_start (BenchTimer *timer);
+void bench_timer_stop (BenchTimer *timer);
+// For iterations timed elsewhere, such as from a callback.
+void bench_timer_add (BenchTimer *timer, gint64 usec);
+
+/*
+ * Prints the summary of the iterations done so far.  params is a JSON
+ * fragment such as "\"sections\": 100" or NULL, and bytes what each
+ * iteration processed, for "mb_per_s", or 0.
+ */
+void bench_timer_report (BenchTimer *timer,
+                         const gchar *benchmark,
+                         const gchar *params,
+                         guint64 bytes);
+void bench_timer_free (BenchTimer *timer);
+
+// Parses the options common to all benchmarks plus entries.
+gboolean bench_parse_options (int *argc, char ***argv,
+                              gint *iterations,
+                              const GOptionEntry *entries);
+
+#endif
@@ -0,0 +1,224 @@
+/*
+    This file is part of Restraint.
+
+    Restraint is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Restraint is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Restraint.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+ * Time the client's handling of the messages restraintd writes to it,
+ * decoding included, in either framing.  The callbacks are stand-ins so
+ * that the numbers are those of parsing and dispatch alone.
+ */
+
+#include <glib.h>
+
+#define main restraint_client_main
+#include "client.c"
+#undef main
+
+#include "bench.h"
+
+// Messages handled per iteration, one alone is too quick to time.
+#define BATCH_MESSAGES 100
+
+typedef struct {
+    const gchar *kind;
+    const gchar *path;
+    const gchar *method;
+    gchar *body;
+    gsize body_length;
+} BenchMessage;
+
+static guint dispatched;
+
+static void
+bench_cb (const char *path, GHashTable *headers, GHashTable *body,
+          const gchar *data, gsize data_length, gpointer user_data)
+{
+    dispatched++;
+}
+
+// The paths restraint registers, in the same order.
+static GSList *
+register_paths (void)
+{
+    const gchar *patterns[] = {
+        "/start$",
+        "/recipes/[[:alnum:]]+/tasks/[[:digit:]]+/status$",
+        "/recipes/[[:alnum:]]+/tasks/[[:digit:]]+/results/$",
+        "/recipes/[[:alnum:]]+/watchdog$",
+        "/recipes/[[:alnum:]]+/tasks/[[:digit:]]+/logs/",
+        "/recipes/[[:alnum:]]+/tasks/[[:digit:]]+/results/[[:digit:]]+/logs/",
+    };
+    GSList *regexes = NULL;
+
+    for (guint i = 0; i < G_N_ELEMENTS (patterns); i++) {
+        regexes = register_path (regexes, (gchar *) patterns[i], bench_cb);
+    }
+    return regexes;
+}
+
+static void
+append_json_field (gpointer name, gpointer value, gpointer user_data)
+{
+    json_object_object_add (user_data, name, json_object_new_string (value));
+}
+
+// What restraint_stdout_message () writes with JSON framing.
+static gchar *
+encode_json (const BenchMessage *message)
+{
+    struct json_object *jobj = json_object_new_object ();
+    struct json_object *jobj_headers = json_object_new_object ();
+    struct json_object *jobj_body;
+    gchar *json_text;
+
+    json_object_object_add (jobj, "headers", jobj_headers);
+    json_object_object_add (jobj_headers, "rstrnt-path",
+                            json_object_new_string (message->path));
+    json_object_object_add (jobj_headers, "rstrnt-method",
+                            json_object_new_string (message->method));
+    json_object_object_add (jobj_headers, "body-length",
+                            json_object_new_int (message->body_length));
+    if (g_strrstr (message->path, "/logs/")) {
+        gchar *encoded = g_base64_encode ((guchar *) message->body,
+                                          message->body_length);
+        jobj_body = json_object_new_string (encoded);
+        g_free (encoded);
+    } else {
+        GHashTable *table = soup_form_decode (message->body);
+
+        jobj_body = json_object_new_object ();
+        g_hash_table_foreach (table, append_json_field, jobj_body);
+        g_hash_table_destroy (table);
+    }
+    json_object_object_add (jobj, "body", jobj_body);
+
+    json_text = g_strdup (json_object_to_json_string_ext (jobj, JSON_C_TO_STRING_PLAIN));
+    json_object_put (jobj);
+    return json_text;
+}
+
+// What restraint_stdout_message () writes with binary framing.
+static GByteArray *
+encode_frame (const BenchMessage *message)
+{
+    const gchar *names[] = { "rstrnt-path", "rstrnt-method", NULL };
+    const gchar *values[] = { message->path, message->method, NULL };
+
+    return rstrnt_frame_encode (names, values, message->body,
+                                message->body_length);
+}
+
+static void
+bench_json (RecipeData *recipe_data, const BenchMessage *message,
+            guint iterations)
+{
+    BenchTimer *timer = bench_timer_new (iterations);
+    gchar *json_text = encode_json (message);
+    gchar *params = g_strdup_printf ("\"framing\": \"json\", \"kind\": \"%s\", "
+                                     "\"body_bytes\": %" G_GSIZE_FORMAT
+                                     ", \"messages\": %u",
+                                     message->kind, message->body_length,
+                                     BATCH_MESSAGES);
+
+    dispatched = 0;
+    for (guint i = 0; i < iterations; i++) {
+        bench_timer_start (timer);
+        for (guint m = 0; m < BATCH_MESSAGES; m++) {
+            handle_message (json_text, recipe_data);
+        }
+        bench_timer_stop (timer);
+    }
+    g_assert_cmpuint (dispatched, ==, iterations * BATCH_MESSAGES);
+    bench_timer_report (timer, "handle_message", params,
+                        (guint64) message->body_length * BATCH_MESSAGES);
+
+    g_free (params);
+    g_free (json_text);
+    bench_timer_free (timer);
+}
+
+static void
+bench_frame (RecipeData *recipe_data, const BenchMessage *message,
+             guint iterations)
+{
+    BenchTimer *timer = bench_timer_new (iterations);
+    GByteArray *encoded = encode_frame (message);
+    RstrntFrameReader *reader = rstrnt_frame_reader_new ();
+    gchar *params = g_strdup_printf ("\"framing\": \"binary\", \"kind\": \"%s\", "
+                                     "\"body_bytes\": %" G_GSIZE_FORMAT
+                                     ", \"messages\": %u",
+                                     message->kind, message->body_length,
+                                     BATCH_MESSAGES);
+
+    dispatched = 0;
+    for (guint i = 0; i < iterations; i++) {
+        bench_timer_start (timer);
+        for (guint m = 0; m < BATCH_MESSAGES; m++) {
+            RstrntFrame *frame;
+
+            rstrnt_frame_reader_feed (reader, (const gchar *) encoded->data,
+                                      encoded->len);
+            frame = rstrnt_frame_reader_next (reader, NULL);
+            handle_frame (frame, recipe_data);
+            rstrnt_frame_free (frame);
+        }
+        bench_timer_stop (timer);
+    }
+    g_assert_cmpuint (dispatched, ==, iterations * BATCH_MESSAGES);
+    bench_timer_report (timer, "handle_frame", params,
+                        (guint64) message->body_length * BATCH_MESSAGES);
+
+    g_free (params);
+    rstrnt_frame_reader_free (reader);
+    g_byte_array_unref (encoded);
+    bench_timer_free (timer);
+}
+
+int
+main (int argc, char *argv[])
+{
+    gint iterations = 200;
+    AppData app_data = { 0 };
+    RecipeData recipe_data = { .app_data = &app_data, .rhost = "bench" };
+    BenchMessage messages[] = {
+        { "status", "/recipes/1/tasks/1/status", "POST",
+          g_strdup ("status=Running&message=Task+started"), 0 },
+        { "log", "/recipes/1/tasks/1/logs/taskout.log", "PUT",
+          g_malloc (4096), 4096 },
+        { "log", "/recipes/1/tasks/1/logs/taskout.log", "PUT",
+          g_malloc (64 * 1024), 64 * 1024 },
+    };
+
+    if (!bench_parse_options (&argc, &argv, &iterations, NULL)) {
+        return 1;
+    }
+
+    app_data.regexes = register_paths ();
+    messages[0].body_length = strlen (messages[0].body);
+    for (guint i = 1; i < G_N_ELEMENTS (messages); i++) {
+        memset (messages[i].body, 'x', messages[i].body_length);
+        messages[i].body[messages[i].body_length - 1] = '\n';
+    }
+
+    for (guint i = 0; i < G_N_ELEMENTS (messages); i++) {
+        bench_json (&recipe_data, &messages[i], iterations);
+        bench_frame (&recipe_data, &messages[i], iterations);
+        g_free (messages[i].body);
+    }
+    g_slist_free_full (app_data.regexes, clear_regex);
+
+    return 0;
+}
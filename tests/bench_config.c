@@ -0,0 +1,105 @@
+/*
+    This file is part of Restraint.
+
+    Restraint is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Restraint is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Restraint.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+ * Time restraint_config_set () and restraint_config_get_uint64 () on
+ * configs the size of long recipes, where every task has a section.
+ * Each call loads the whole file and each set writes it out again.
+ */
+
+#include <glib.h>
+#include <glib/gstdio.h>
+
+#include "bench.h"
+#include "config.h"
+
+static const guint section_counts[] = { 10, 100, 1000 };
+
+static gchar *
+make_config (const gchar *dir, guint sections)
+{
+    gchar *config_file = g_strdup_printf ("%s/config-%u.conf", dir, sections);
+    GString *contents = g_string_new ("[restraint]\nrecipe_url=http://lab/recipes/1/\n");
+
+    for (guint i = 0; i < sections; i++) {
+        g_string_append_printf (contents,
+                                "\n[%u]\nstarted=true\noffset=%u\n"
+                                "reboots=0\nphases=fetch=1500000 run=60000000\n",
+                                i, i * 4096);
+    }
+    g_assert_true (g_file_set_contents (config_file, contents->str,
+                                        contents->len, NULL));
+    g_string_free (contents, TRUE);
+
+    return config_file;
+}
+
+static void
+bench_config (const gchar *dir, guint sections, guint iterations)
+{
+    gchar *config_file = make_config (dir, sections);
+    gchar *section = g_strdup_printf ("%u", sections / 2);
+    gchar *params = g_strdup_printf ("\"sections\": %u", sections);
+    BenchTimer *set_timer = bench_timer_new (iterations);
+    BenchTimer *get_timer = bench_timer_new (iterations);
+    GError *error = NULL;
+
+    for (guint i = 0; i < iterations; i++) {
+        guint64 offset;
+
+        bench_timer_start (set_timer);
+        restraint_config_set (config_file, section, "offset", &error,
+                              G_TYPE_UINT64, (guint64) i);
+        bench_timer_stop (set_timer);
+        g_assert_no_error (error);
+
+        bench_timer_start (get_timer);
+        offset = restraint_config_get_uint64 (config_file, section, "offset", &error);
+        bench_timer_stop (get_timer);
+        g_assert_no_error (error);
+        g_assert_cmpuint (offset, ==, i);
+    }
+    bench_timer_report (set_timer, "restraint_config_set", params, 0);
+    bench_timer_report (get_timer, "restraint_config_get", params, 0);
+
+    g_remove (config_file);
+    bench_timer_free (set_timer);
+    bench_timer_free (get_timer);
+    g_free (params);
+    g_free (section);
+    g_free (config_file);
+}
+
+int
+main (int argc, char *argv[])
+{
+    gint iterations = 200;
+    gchar *dir;
+
+    if (!bench_parse_options (&argc, &argv, &iterations, NULL)) {
+        return 1;
+    }
+
+    dir = g_dir_make_tmp ("bench_config_XXXXXX", NULL);
+    for (guint i = 0; i < G_N_ELEMENTS (section_counts); i++) {
+        bench_config (dir, section_counts[i], iterations);
+    }
+    g_rmdir (dir);
+    g_free (dir);
+
+    return 0;
+}
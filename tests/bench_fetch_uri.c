@@ -0,0 +1,158 @@
+/*
+    This file is part of Restraint.
+
+    Restraint is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Restraint is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Restraint.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+ * Time restraint_fetch_uri () fetching and extracting file:// tarballs
+ * of many small files, which is what most tasks are, so that the cost
+ * per archive entry shows rather than that of the transfer.
+ */
+
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <archive.h>
+#include <archive_entry.h>
+#include <string.h>
+
+#include "bench.h"
+#include "fetch.h"
+#include "fetch_uri.h"
+
+#define ENTRY_LENGTH 1024
+
+static const guint entry_counts[] = { 100, 1000 };
+
+typedef struct {
+    GMainLoop *loop;
+    GError *error;
+    guint32 extracted;
+} BenchRun;
+
+static void
+bench_finish_cb (GError *error, guint32 match_cnt,
+                 guint32 nonmatch_cnt, gpointer user_data)
+{
+    BenchRun *run = user_data;
+
+    run->extracted = match_cnt;
+    if (error != NULL) {
+        g_propagate_error (&run->error, error);
+    }
+    g_main_loop_quit (run->loop);
+}
+
+// Spread over directories of 100 entries, like a task with its data.
+static gchar *
+make_tarball (const gchar *dir, guint entries)
+{
+    gchar *tarball = g_strdup_printf ("%s/task-%u.tar.gz", dir, entries);
+    struct archive *a = archive_write_new ();
+    gchar content[ENTRY_LENGTH];
+
+    memset (content, 'x', sizeof (content));
+    archive_write_add_filter_gzip (a);
+    archive_write_set_format_pax_restricted (a);
+    g_assert_cmpint (archive_write_open_filename (a, tarball), ==, ARCHIVE_OK);
+
+    for (guint i = 0; i < entries; i++) {
+        struct archive_entry *entry = archive_entry_new ();
+        gchar *pathname = g_strdup_printf ("data%02u/file%04u", i / 100, i);
+
+        archive_entry_set_pathname (entry, pathname);
+        archive_entry_set_size (entry, sizeof (content));
+        archive_entry_set_filetype (entry, AE_IFREG);
+        archive_entry_set_perm (entry, 0644);
+        g_assert_cmpint (archive_write_header (a, entry), ==, ARCHIVE_OK);
+        archive_write_data (a, content, sizeof (content));
+
+        archive_entry_free (entry);
+        g_free (pathname);
+    }
+    archive_write_close (a);
+    archive_write_free (a);
+
+    return tarball;
+}
+
+static gboolean
+bench_fetch_uri (const gchar *dir, guint entries, guint iterations)
+{
+    BenchRun run = { .loop = g_main_loop_new (NULL, FALSE) };
+    BenchTimer *timer = bench_timer_new (iterations);
+    gchar *tarball = make_tarball (dir, entries);
+    gchar *uri_string = g_strconcat ("file://", tarball, NULL);
+    gchar *base_path = g_build_filename (dir, "fetched", NULL);
+    SoupURI *url = soup_uri_new (uri_string);
+    gchar *params = g_strdup_printf ("\"entries\": %u, \"entry_bytes\": %u",
+                                     entries, ENTRY_LENGTH);
+
+    for (guint i = 0; i < iterations && run.error == NULL; i++) {
+        bench_timer_start (timer);
+        restraint_fetch_uri (url, base_path, FALSE, TRUE, NULL,
+                             bench_finish_cb, &run);
+        g_main_loop_run (run.loop);
+        bench_timer_stop (timer);
+
+        if (run.error == NULL && run.extracted != entries) {
+            g_set_error (&run.error, G_FILE_ERROR, G_FILE_ERROR_FAILED,
+                         "Extracted %u of %u entries", run.extracted, entries);
+        }
+        rmrf (base_path);
+    }
+
+    if (run.error == NULL) {
+        bench_timer_report (timer, "restraint_fetch_uri", params,
+                            (guint64) entries * ENTRY_LENGTH);
+    } else {
+        g_printerr ("%s: %s\n", uri_string, run.error->message);
+    }
+
+    g_remove (tarball);
+    soup_uri_free (url);
+    g_free (params);
+    g_free (base_path);
+    g_free (uri_string);
+    g_free (tarball);
+    bench_timer_free (timer);
+    g_main_loop_unref (run.loop);
+
+    if (run.error != NULL) {
+        g_clear_error (&run.error);
+        return FALSE;
+    }
+    return TRUE;
+}
+
+int
+main (int argc, char *argv[])
+{
+    gint iterations = 20;
+    gboolean success = TRUE;
+    gchar *dir;
+
+    if (!bench_parse_options (&argc, &argv, &iterations, NULL)) {
+        return 1;
+    }
+
+    dir = g_dir_make_tmp ("bench_fetch_uri_XXXXXX", NULL);
+    for (guint i = 0; success && i < G_N_ELEMENTS (entry_counts); i++) {
+        success = bench_fetch_uri (dir, entry_counts[i], iterations);
+    }
+    rmrf (dir);
+    g_free (dir);
+
+    return success ? 0 : 1;
+}
@@ -0,0 +1,143 @@
+/*
+    This file is part of Restraint.
+
+    Restraint is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Restraint is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Restraint.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+ * Time the task log path: rstrnt_log_bytes () through the writer thread
+ * to disk, for the short lines of chatty tasks and the larger reads of
+ * bulk output, and rstrnt_chunk_log () splitting logs for upload.
+ */
+
+#include <glib.h>
+
+#define LOG_MANAGER_DIR "./bench_logging_logs"
+
+#include "logging.c"
+#include "bench.h"
+#include "fetch.h"
+
+SoupSession *soup_session;
+
+// Written per iteration of the rstrnt_log_bytes () benchmark.
+#define LOG_VOLUME (4 * 1024 * 1024)
+
+static const gsize line_lengths[] = { 128, 4096 };
+static const gsize content_lengths[] = { 1024 * 1024, 64 * 1024 * 1024 };
+
+/*
+ * Waits for the writer thread to get through everything queued so far.
+ * rstrnt_flush_logs () does the same, polling too coarsely to time with.
+ */
+static void
+drain_logs (const RstrntTask *task)
+{
+    RstrntTaskLogData *data;
+
+    data = rstrnt_log_manager_get_task_data (rstrnt_log_manager_get_instance (),
+                                             task, NULL);
+    (void) g_thread_pool_push (data->thread_pool,
+                               g_new0 (RstrntLogWriterData, 1), NULL);
+    while (g_thread_pool_unprocessed (data->thread_pool) > 0) {
+        g_usleep (100);
+    }
+    rstrnt_flush_log_data (data->task_log_data, NULL);
+}
+
+static void
+bench_log_bytes (RstrntTask *task, gsize line_length, guint iterations)
+{
+    BenchTimer *timer = bench_timer_new (iterations);
+    gchar *line = g_malloc (line_length);
+    gchar *params = g_strdup_printf ("\"line_bytes\": %" G_GSIZE_FORMAT, line_length);
+
+    memset (line, 'x', line_length);
+    line[line_length - 1] = '\n';
+
+    for (guint i = 0; i < iterations; i++) {
+        bench_timer_start (timer);
+        for (gsize written = 0; written < LOG_VOLUME; written += line_length) {
+            rstrnt_log_bytes (task, RSTRNT_LOG_TYPE_TASK, line, line_length);
+        }
+        drain_logs (task);
+        bench_timer_stop (timer);
+    }
+    bench_timer_report (timer, "rstrnt_log_bytes", params, LOG_VOLUME);
+
+    g_free (params);
+    g_free (line);
+    bench_timer_free (timer);
+}
+
+static void
+bench_chunk_log (SoupURI *uri, gsize content_length, guint iterations)
+{
+    BenchTimer *timer = bench_timer_new (iterations);
+    gchar *content = g_malloc (content_length);
+    gchar *params = g_strdup_printf ("\"content_bytes\": %" G_GSIZE_FORMAT,
+                                     content_length);
+
+    memset (content, 'x', content_length);
+
+    for (guint i = 0; i < iterations; i++) {
+        SoupMessage **msgv;
+        int msgc;
+
+        bench_timer_start (timer);
+        msgv = rstrnt_chunk_log (uri, content, 0, content_length,
+                                 BKR_MAX_CONTENT_LENGTH, &msgc);
+        for (int m = 0; m < msgc; m++) {
+            g_object_unref (msgv[m]);
+        }
+        g_free (msgv);
+        bench_timer_stop (timer);
+    }
+    bench_timer_report (timer, "rstrnt_chunk_log", params, content_length);
+
+    g_free (params);
+    g_free (content);
+    bench_timer_free (timer);
+}
+
+int
+main (int argc, char *argv[])
+{
+    g_autoptr (RstrntLogManager) log_manager = NULL;
+    gint iterations = 20;
+    RstrntTask *task;
+    SoupURI *uri;
+
+    if (!bench_parse_options (&argc, &argv, &iterations, NULL)) {
+        return 1;
+    }
+
+    log_manager = rstrnt_log_manager_get_instance ();
+    task = restraint_task_new ();
+    task->task_id = g_strdup ("1");
+    for (guint i = 0; i < G_N_ELEMENTS (line_lengths); i++) {
+        bench_log_bytes (task, line_lengths[i], iterations);
+    }
+    rstrnt_close_logs (task);
+    restraint_task_free (task);
+    rmrf (LOG_MANAGER_DIR);
+
+    uri = soup_uri_new ("http://localhost:8000/recipes/1/tasks/1/" LOG_PATH_TASK);
+    for (guint i = 0; i < G_N_ELEMENTS (content_lengths); i++) {
+        bench_chunk_log (uri, content_lengths[i], iterations);
+    }
+    soup_uri_free (uri);
+
+    return 0;
+}
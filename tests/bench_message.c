@@ -0,0 +1,146 @@
+/*
+    This file is part of Restraint.
+
+    Restraint is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Restraint is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Restraint.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+ * Time restraint_queue_message () from the call until the finish
+ * callback, against httpserver.py on port 8000 as started by
+ * run-bench.sh.  Messages are sent one at a time, so a burst shows the
+ * queue's throughput and a single message its latency.
+ */
+
+#include <glib.h>
+#include <libsoup/soup.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bench.h"
+#include "message.h"
+
+#define BENCH_URL "http://127.0.0.1:8000/recipes/1/tasks/1/logs/taskout.log"
+#define BURST_MESSAGES 100
+// Failed messages are retried forever, give up on the server instead.
+#define BENCH_TIMEOUT 60
+
+static const gsize body_lengths[] = { 256, 64 * 1024 };
+
+typedef struct {
+    GMainLoop *loop;
+    guint pending;
+    guint failed;
+} BenchRun;
+
+static void
+bench_finish_cb (SoupSession *session, SoupMessage *msg, gpointer user_data)
+{
+    BenchRun *run = user_data;
+
+    if (!SOUP_STATUS_IS_SUCCESSFUL (msg->status_code)) {
+        run->failed++;
+    }
+    if (--run->pending == 0) {
+        g_main_loop_quit (run->loop);
+    }
+}
+
+static gboolean
+bench_timeout_cb (gpointer user_data)
+{
+    g_printerr ("No answer from " BENCH_URL " in %d seconds\n", BENCH_TIMEOUT);
+    exit (1);
+}
+
+static void
+queue_messages (SoupSession *session, BenchRun *run,
+                const gchar *body, gsize body_length, guint count)
+{
+    guint timeout_id = g_timeout_add_seconds (BENCH_TIMEOUT, bench_timeout_cb, NULL);
+
+    run->pending = count;
+    for (guint i = 0; i < count; i++) {
+        SoupMessage *msg = soup_message_new ("PUT", BENCH_URL);
+
+        soup_message_set_request (msg, "text/plain", SOUP_MEMORY_TEMPORARY,
+                                  body, body_length);
+        restraint_queue_message (session, msg, NULL, bench_finish_cb,
+                                 NULL, run);
+    }
+    g_main_loop_run (run->loop);
+    g_source_remove (timeout_id);
+}
+
+static gboolean
+bench_queue_message (SoupSession *session, gsize body_length, guint iterations)
+{
+    BenchRun run = { .loop = g_main_loop_new (NULL, FALSE) };
+    BenchTimer *single = bench_timer_new (iterations);
+    BenchTimer *burst = bench_timer_new (iterations);
+    gchar *body = g_malloc (body_length);
+    gchar *params;
+
+    memset (body, 'x', body_length);
+
+    for (guint i = 0; i < iterations; i++) {
+        bench_timer_start (single);
+        queue_messages (session, &run, body, body_length, 1);
+        bench_timer_stop (single);
+
+        bench_timer_start (burst);
+        queue_messages (session, &run, body, body_length, BURST_MESSAGES);
+        bench_timer_stop (burst);
+    }
+
+    if (run.failed == 0) {
+        params = g_strdup_printf ("\"body_bytes\": %" G_GSIZE_FORMAT
+                                  ", \"messages\": 1", body_length);
+        bench_timer_report (single, "restraint_queue_message", params, body_length);
+        g_free (params);
+
+        params = g_strdup_printf ("\"body_bytes\": %" G_GSIZE_FORMAT
+                                  ", \"messages\": %u", body_length, BURST_MESSAGES);
+        bench_timer_report (burst, "restraint_queue_message", params,
+                            (guint64) body_length * BURST_MESSAGES);
+        g_free (params);
+    } else {
+        g_printerr ("%u of the PUTs to " BENCH_URL " failed\n", run.failed);
+    }
+
+    g_free (body);
+    bench_timer_free (single);
+    bench_timer_free (burst);
+    g_main_loop_unref (run.loop);
+    return run.failed == 0;
+}
+
+int
+main (int argc, char *argv[])
+{
+    gint iterations = 20;
+    SoupSession *session;
+    gboolean success = TRUE;
+
+    if (!bench_parse_options (&argc, &argv, &iterations, NULL)) {
+        return 1;
+    }
+
+    session = soup_session_new ();
+    for (guint i = 0; success && i < G_N_ELEMENTS (body_lengths); i++) {
+        success = bench_queue_message (session, body_lengths[i], iterations);
+    }
+    g_object_unref (session);
+
+    return success ? 0 : 1;
+}
@@ -0,0 +1,211 @@
+/*
+    This file is part of Restraint.
+
+    Restraint is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Restraint is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Restraint.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+ * Time process_run () from the call until the finish callback for "true",
+ * once with each launcher.  restraintd's resident size is what makes
+ * fork () slow, so the benchmark grows its own first.
+ *
+ * Then time the task preamble: "true" run through a chain of task_run.d
+ * plugins, against "true" run with the ProcessPreamble restraintd uses
+ * with --native-preamble.  The chain is the shape of the standard one,
+ * seven bash scripts exec'ing each other, one of them a login shell,
+ * unless --task-plugins names a real run_task_plugins.
+ */
+
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <string.h>
+
+#include "bench.h"
+#include "process.h"
+
+typedef struct {
+    GMainLoop *loop;
+    gint pid_result;
+    GError *error;
+} BenchRun;
+
+static void
+bench_finish_cb (gint pid_result, gboolean localwatchdog,
+                 gpointer user_data, GError *error)
+{
+    BenchRun *run = user_data;
+
+    run->pid_result = pid_result;
+    if (error != NULL) {
+        run->error = g_error_copy (error);
+    }
+    g_main_loop_quit (run->loop);
+}
+
+static gboolean
+bench_command (const gchar *command, const ProcessPreamble *preamble,
+               const gchar *bench, const gchar *params, guint iterations)
+{
+    BenchRun run = { .loop = g_main_loop_new (NULL, FALSE) };
+    BenchTimer *timer = bench_timer_new (iterations);
+
+    for (guint i = 0; i < iterations; i++) {
+        bench_timer_start (timer);
+        process_run (command, NULL, NULL, FALSE, 0, NULL, NULL,
+                     bench_finish_cb, NULL, 0, FALSE, NULL, NULL, preamble, &run);
+        g_main_loop_run (run.loop);
+        bench_timer_stop (timer);
+
+        if (run.error != NULL || run.pid_result != 0) {
+            g_printerr ("%s: %s failed: %s\n", bench, command,
+                        run.error != NULL ? run.error->message : "non-zero exit");
+            g_clear_error (&run.error);
+            bench_timer_free (timer);
+            g_main_loop_unref (run.loop);
+            return FALSE;
+        }
+    }
+
+    bench_timer_report (timer, bench, params, 0);
+
+    bench_timer_free (timer);
+    g_main_loop_unref (run.loop);
+    return TRUE;
+}
+
+static gboolean
+bench_launcher (ProcessLauncher launcher, const gchar *name,
+                guint iterations, guint rss_mb)
+{
+    gchar *params;
+    gboolean success;
+
+    process_set_launcher (launcher);
+    params = g_strdup_printf ("\"launcher\": \"%s\", \"rss_mb\": %u", name, rss_mb);
+    success = bench_command ("true", NULL, "process_run", params, iterations);
+
+    g_free (params);
+    return success;
+}
+
+static gboolean
+write_plugin (const gchar *dir, const gchar *name, const gchar *contents)
+{
+    gchar *path = g_build_filename (dir, name, NULL);
+    gboolean written;
+
+    written = g_file_set_contents (path, contents, -1, NULL) &&
+              g_chmod (path, 0755) == 0;
+    g_free (path);
+    return written;
+}
+
+/* Makes a run_task_plugins and task_run.d like the standard ones */
+static gchar *
+make_task_plugins (const gchar *dir)
+{
+    const gchar *plugins[] = { "05_linger", "15_beakerlib", "20_unconfined",
+                               "25_environment", "30_restore_events", "35_oom_adj" };
+    gchar *plugins_dir = g_build_filename (dir, "task_run.d", NULL);
+    gchar *runner = g_strdup_printf ("#!/bin/bash\nexec %s/* \"$@\"\n", plugins_dir);
+    gboolean written;
+
+    written = g_mkdir (plugins_dir, 0755) == 0 &&
+              write_plugin (dir, "run_task_plugins", runner) &&
+              write_plugin (plugins_dir, "10_bash_login",
+                            "#!/bin/bash -l\nsetsid \"$@\"\n");
+    for (guint i = 0; written && i < G_N_ELEMENTS (plugins); i++) {
+        written = write_plugin (plugins_dir, plugins[i], "#!/bin/bash\nexec \"$@\"\n");
+    }
+
+    g_free (runner);
+    g_free (plugins_dir);
+    return written ? g_build_filename (dir, "run_task_plugins", NULL) : NULL;
+}
+
+static gboolean
+bench_preamble (const gchar *task_plugins, guint iterations)
+{
+    ProcessPreamble preamble = { .setsid = TRUE, .reset_oom_score = TRUE };
+    gchar *dir = NULL;
+    gchar *runner;
+    gchar *command;
+    gboolean success;
+
+    if (task_plugins != NULL) {
+        runner = g_strdup (task_plugins);
+    } else {
+        dir = g_dir_make_tmp ("bench_preamble-XXXXXX", NULL);
+        runner = dir != NULL ? make_task_plugins (dir) : NULL;
+        if (runner == NULL) {
+            g_printerr ("preamble: failed to write the task plugins\n");
+            return FALSE;
+        }
+    }
+    command = g_strdup_printf ("%s true", runner);
+
+    process_set_launcher (PROCESS_LAUNCHER_SPAWN);
+    success = bench_command (command, NULL, "preamble",
+                             "\"preamble\": \"plugins\"", iterations) &&
+              bench_command ("true", &preamble, "preamble",
+                             "\"preamble\": \"native\"", iterations);
+
+    if (dir != NULL) {
+        gchar *remove = g_strdup_printf ("rm -rf %s", dir);
+
+        g_spawn_command_line_sync (remove, NULL, NULL, NULL, NULL);
+        g_free (remove);
+        g_free (dir);
+    }
+    g_free (command);
+    g_free (runner);
+    return success;
+}
+
+int
+main (int argc, char *argv[])
+{
+    gint iterations = 200;
+    gint rss_mb = 256;
+    gchar *task_plugins = NULL;
+    gchar *ballast;
+    gboolean success;
+    GOptionEntry entries[] = {
+        { "rss", 0, 0, G_OPTION_ARG_INT, &rss_mb,
+          "Resident memory to hold while spawning [Default: 256]", "MB" },
+        { "task-plugins", 0, 0, G_OPTION_ARG_FILENAME, &task_plugins,
+          "run_task_plugins to time instead of a made up one", "PATH" },
+        { NULL }
+    };
+
+    if (!bench_parse_options (&argc, &argv, &iterations, entries)) {
+        return 1;
+    }
+    if (rss_mb < 0) {
+        g_printerr ("Invalid arguments\n");
+        return 1;
+    }
+
+    // Touch every page so that it is really resident.
+    ballast = g_malloc ((gsize) rss_mb * 1024 * 1024 + 1);
+    memset (ballast, 1, (gsize) rss_mb * 1024 * 1024 + 1);
+
+    success = bench_launcher (PROCESS_LAUNCHER_FORK, "fork", iterations, rss_mb) &&
+              bench_launcher (PROCESS_LAUNCHER_SPAWN, "spawn", iterations, rss_mb) &&
+              bench_preamble (task_plugins, iterations);
+
+    g_free (task_plugins);
+    g_free (ballast);
+    return success ? 0 : 1;
+}
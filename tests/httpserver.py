@@ -15,6 +15,10 @@ class TestsHandler(SimpleHTTPServer.SimpleHTTPRequestHandler):
 
     def do_PUT(self):
         """This is a dummy request that always returns 200 responses."""
+        # Read the body, closing with it unread resets the connection.
+        length = int(self.headers.get('Content-Length', 0))
+        while length > 0:
+            length -= len(self.rfile.read(min(length, 65536)))
         self.send_response_only(200)
         self.end_headers()
 
@@ -0,0 +1,296 @@
+"""
+A fake lab controller for load testing restraintd.
+
+It serves a recipe and the task tarballs from a directory, accepts
+everything restraintd sends for the recipe and keeps count of it.  Each
+request can be slowed down, capped in bandwidth or failed, to see how
+restraintd copes with a lab controller that is far away or struggling.
+
+Task output carrying "T=<microseconds since the epoch>" markers, as
+emitted by the synthetic task, is used to measure how long output takes
+to reach the lab controller.
+"""
+
+import argparse
+import json
+import os
+import random
+import re
+import signal
+import sys
+import threading
+import time
+from http.server import BaseHTTPRequestHandler, ThreadingHTTPServer
+from urllib.parse import parse_qs, urlparse
+
+MARKER = re.compile(rb'T=(\d{16})')
+TASK_PATH = re.compile(r'^/recipes/\d+/tasks/(\d+)/')
+CHUNK = 64 * 1024
+
+
+class TokenBucket(object):
+    """Caps the bytes per second of all connections together."""
+
+    def __init__(self, rate):
+        self.rate = rate
+        self.tokens = rate
+        self.stamp = time.monotonic()
+        self.lock = threading.Lock()
+
+    def consume(self, count):
+        if not self.rate:
+            return
+        with self.lock:
+            now = time.monotonic()
+            self.tokens = min(self.rate,
+                              self.tokens + (now - self.stamp) * self.rate)
+            self.stamp = now
+            self.tokens -= count
+            wait = -self.tokens / self.rate if self.tokens < 0 else 0
+        if wait > 0:
+            time.sleep(wait)
+
+
+class LabStats(object):
+    """What the lab controller has seen, safe to update from any thread."""
+
+    def __init__(self):
+        self.lock = threading.Lock()
+        self.started = time.time()
+        self.requests = {}
+        self.bytes = {}
+        self.errors_injected = 0
+        self.results = 0
+        self.task_status = {}
+        self.first_output = None
+        self.last_output = None
+        self.lags = []
+        self.done = threading.Event()
+        self.expected_tasks = 0
+
+    def count(self, kind, length):
+        with self.lock:
+            self.requests[kind] = self.requests.get(kind, 0) + 1
+            self.bytes[kind] = self.bytes.get(kind, 0) + length
+
+    def output(self, body):
+        now = time.time()
+        with self.lock:
+            if self.first_output is None:
+                self.first_output = now
+            self.last_output = now
+            # The oldest line in the chunk is the one that waited longest.
+            match = MARKER.search(body)
+            if match:
+                self.lags.append(now - int(match.group(1)) / 1e6)
+
+    def status(self, task_id, status):
+        with self.lock:
+            self.task_status[task_id] = status
+            finished = [s for s in self.task_status.values()
+                        if s in ('Completed', 'Aborted')]
+            if self.expected_tasks and len(finished) >= self.expected_tasks:
+                self.done.set()
+
+    def result(self):
+        with self.lock:
+            self.results += 1
+            return self.results
+
+    def summary(self):
+        with self.lock:
+            lags = sorted(self.lags)
+            output_seconds = 0
+            if self.first_output is not None:
+                output_seconds = self.last_output - self.first_output
+            return {
+                'requests': dict(self.requests),
+                'bytes': dict(self.bytes),
+                'errors_injected': self.errors_injected,
+                'results': self.results,
+                'task_status': dict(self.task_status),
+                'output_seconds': round(output_seconds, 3),
+                'log_lag_seconds': {
+                    'samples': len(lags),
+                    'p50': percentile(lags, 50),
+                    'p99': percentile(lags, 99),
+                    'max': round(lags[-1], 3) if lags else None,
+                },
+            }
+
+
+def percentile(values, pct):
+    if not values:
+        return None
+    return round(values[min(len(values) - 1, len(values) * pct // 100)], 3)
+
+
+def request_kind(path):
+    if path.endswith('/logs/taskout.log'):
+        return 'task_log'
+    if path.endswith('/logs/harness.log'):
+        return 'harness_log'
+    if '/logs/' in path:
+        return 'log'
+    if path.endswith('/results/'):
+        return 'result'
+    if path.endswith('/status'):
+        return 'status'
+    if path.endswith('/watchdog'):
+        return 'watchdog'
+    return 'other'
+
+
+class LabHandler(BaseHTTPRequestHandler):
+    protocol_version = 'HTTP/1.1'
+
+    def log_message(self, format, *args):
+        if self.server.options.verbose:
+            BaseHTTPRequestHandler.log_message(self, format, *args)
+
+    def read_body(self):
+        length = int(self.headers.get('Content-Length', 0))
+        chunks = []
+        while length > 0:
+            chunk = self.rfile.read(min(length, CHUNK))
+            if not chunk:
+                break
+            self.server.bucket.consume(len(chunk))
+            chunks.append(chunk)
+            length -= len(chunk)
+        return b''.join(chunks)
+
+    def respond(self, status, body=b'', headers=None):
+        self.send_response(status)
+        for name, value in (headers or {}).items():
+            self.send_header(name, value)
+        self.send_header('Content-Length', str(len(body)))
+        self.end_headers()
+        for offset in range(0, len(body), CHUNK):
+            self.server.bucket.consume(min(CHUNK, len(body) - offset))
+            self.wfile.write(body[offset:offset + CHUNK])
+
+    def delay(self):
+        if self.server.options.latency:
+            time.sleep(self.server.options.latency / 1000.0)
+
+    def inject_error(self):
+        options = self.server.options
+        if options.error_rate and random.random() < options.error_rate:
+            with self.server.stats.lock:
+                self.server.stats.errors_injected += 1
+            self.respond(options.error_status)
+            return True
+        return False
+
+    def do_GET(self):
+        self.delay()
+        path = urlparse(self.path).path
+        if path == '/stats':
+            body = json.dumps(self.server.stats.summary()).encode()
+            self.respond(200, body, {'Content-Type': 'application/json'})
+            return
+        if re.match(r'^/recipes/\d+/?$', path):
+            self.respond(200, self.server.recipe, {'Content-Type': 'text/xml'})
+            return
+        filename = os.path.join(self.server.options.serve_dir,
+                                os.path.basename(path))
+        if not os.path.isfile(filename):
+            self.respond(404)
+            return
+        with open(filename, 'rb') as f:
+            self.respond(200, f.read(),
+                         {'Content-Type': 'application/octet-stream'})
+
+    def do_PUT(self):
+        body = self.read_body()
+        self.delay()
+        if self.inject_error():
+            return
+        path = urlparse(self.path).path
+        kind = request_kind(path)
+        self.server.stats.count(kind, len(body))
+        if kind == 'task_log':
+            self.server.stats.output(body)
+        self.respond(204)
+
+    def do_POST(self):
+        body = self.read_body()
+        self.delay()
+        if self.inject_error():
+            return
+        path = urlparse(self.path).path
+        kind = request_kind(path)
+        self.server.stats.count(kind, len(body))
+        headers = {}
+        if kind == 'result':
+            result_id = self.server.stats.result()
+            headers['Location'] = 'http://%s:%d%s%d' % (
+                self.server.server_address[0], self.server.server_address[1],
+                path, result_id)
+            self.respond(201, headers=headers)
+            return
+        if kind == 'status':
+            match = TASK_PATH.match(path)
+            form = parse_qs(body.decode('utf-8', 'replace'))
+            if match and 'status' in form:
+                self.server.stats.status(match.group(1), form['status'][0])
+        self.respond(204)
+
+
+class FakeLab(ThreadingHTTPServer):
+    daemon_threads = True
+    allow_reuse_address = True
+
+    def __init__(self, options, recipe):
+        ThreadingHTTPServer.__init__(self, (options.host, options.port),
+                                     LabHandler)
+        self.options = options
+        self.recipe = recipe
+        self.stats = LabStats()
+        self.bucket = TokenBucket(options.bandwidth * 1024)
+
+
+def add_arguments(parser):
+    parser.add_argument('--host', default='127.0.0.1',
+                        help='Network interface to bind to')
+    parser.add_argument('--port', type=int, default=8001,
+                        help='Port to listen on')
+    parser.add_argument('--serve-dir', default='.',
+                        help='Directory the task tarballs are served from')
+    parser.add_argument('--latency', type=int, default=0, metavar='MS',
+                        help='Delay every answer by this many milliseconds')
+    parser.add_argument('--bandwidth', type=int, default=0, metavar='KB/S',
+                        help='Cap the bandwidth of all requests together, '
+                             '0 for no cap')
+    parser.add_argument('--error-rate', type=float, default=0.0,
+                        metavar='FRACTION',
+                        help='Fail this fraction of PUTs and POSTs')
+    parser.add_argument('--error-status', type=int, default=503,
+                        help='HTTP status of injected failures')
+    parser.add_argument('--verbose', action='store_true',
+                        help='Log every request')
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.strip().split('\n')[0])
+    add_arguments(parser)
+    parser.add_argument('recipe', help='Recipe XML to serve as /recipes/<id>/')
+    options = parser.parse_args()
+
+    with open(options.recipe, 'rb') as f:
+        lab = FakeLab(options, f.read())
+
+    def stop(signum, frame):
+        raise SystemExit(0)
+
+    signal.signal(signal.SIGTERM, stop)
+    try:
+        lab.serve_forever()
+    finally:
+        json.dump(lab.stats.summary(), sys.stdout, indent=2)
+        sys.stdout.write('\n')
+
+
+if __name__ == '__main__':
+    main()
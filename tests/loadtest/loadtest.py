@@ -0,0 +1,262 @@
+"""
+End-to-end load test of restraintd against a fake lab controller.
+
+Runs a recipe of synthetic tasks producing output, results and logs at
+the given rates through restraintd, and reports as JSON what got through
+and what it cost: throughput, log delivery lag, restraintd's RSS and CPU
+time and the distribution of its main loop iterations.
+
+restraintd takes its recipe URL from /etc/restraint/config.conf and runs
+the tasks for real, so run this as root on a machine that is there to be
+tested.  Any existing config.conf is put back afterwards.
+"""
+
+import argparse
+import json
+import os
+import re
+import shutil
+import signal
+import subprocess
+import sys
+import tarfile
+import tempfile
+import threading
+import time
+import urllib.request
+from xml.sax.saxutils import quoteattr
+
+sys.path.insert(0, os.path.dirname(os.path.abspath(__file__)))
+import fakelab  # noqa: E402
+
+HERE = os.path.dirname(os.path.abspath(__file__))
+CONFIG_DIR = '/etc/restraint'
+CONFIG_FILE = os.path.join(CONFIG_DIR, 'config.conf')
+RECIPE_ID = 1
+BUCKET = re.compile(r'^restraintd_main_loop_iteration_seconds_bucket\{le="([^"]+)"\} (\S+)$')
+STALLS = re.compile(r'^restraintd_main_loop_stalls_total(?:\{[^}]*\})? (\S+)$')
+
+
+def make_task_tarball(directory):
+    tarball = os.path.join(directory, 'synthetic.tar.gz')
+    with tarfile.open(tarball, 'w:gz') as tar:
+        tar.add(os.path.join(HERE, 'synthetic'), arcname='synthetic')
+    return tarball
+
+
+def make_recipe(options, lab_url):
+    params = {
+        'LOAD_RATE': options.rate,
+        'LOAD_LINE_BYTES': options.line_bytes,
+        'LOAD_SECONDS': options.seconds,
+        'LOAD_RESULTS': options.results,
+        'LOAD_LOG_MB': options.log_mb,
+    }
+    param_xml = ''.join('<param name=%s value=%s/>' % (quoteattr(k), quoteattr(str(v)))
+                        for k, v in sorted(params.items()))
+    tasks = []
+    for i in range(options.tasks):
+        tasks.append(
+            '<task id="%d" name="/restraint/load/synthetic" role="STANDALONE" '
+            'status="Waiting" result="New">'
+            '<fetch url="%s/synthetic.tar.gz#synthetic"/>'
+            '<params>%s</params></task>' % (i + 1, lab_url, param_xml))
+    return (
+        '<job id="1"><recipeSet id="1">'
+        '<recipe id="%d" job_id="1" recipe_set_id="1" status="Running" '
+        'result="New" whiteboard="load test">'
+        '<roles/><params/>%s</recipe></recipeSet></job>'
+        % (RECIPE_ID, ''.join(tasks))).encode()
+
+
+class ProcessSampler(threading.Thread):
+    """Samples the RSS and CPU time of a process every interval."""
+
+    def __init__(self, pid, interval):
+        threading.Thread.__init__(self, daemon=True)
+        self.pid = pid
+        self.interval = interval
+        self.rss = []
+        self.cpu_seconds = 0.0
+        self.stop = threading.Event()
+        self.ticks = os.sysconf('SC_CLK_TCK')
+
+    def sample(self):
+        try:
+            with open('/proc/%d/status' % self.pid) as f:
+                for line in f:
+                    if line.startswith('VmRSS:'):
+                        self.rss.append(int(line.split()[1]) * 1024)
+            with open('/proc/%d/stat' % self.pid) as f:
+                # The command may have spaces, the fields after it don't.
+                fields = f.read().rsplit(')', 1)[1].split()
+                self.cpu_seconds = (int(fields[11]) + int(fields[12])) / self.ticks
+        except (IOError, IndexError, ValueError):
+            pass
+
+    def run(self):
+        while not self.stop.wait(self.interval):
+            self.sample()
+
+    def summary(self):
+        rss = self.rss or [0]
+        return {
+            'rss_peak_bytes': max(rss),
+            'rss_mean_bytes': sum(rss) // len(rss),
+            'cpu_seconds': round(self.cpu_seconds, 2),
+        }
+
+
+def scrape_metrics(port):
+    """The main loop histogram from restraintd's /metrics."""
+    url = 'http://127.0.0.1:%d/metrics' % port
+    try:
+        text = urllib.request.urlopen(url, timeout=10).read().decode()
+    except (IOError, ValueError) as e:
+        return {'error': str(e)}
+    buckets = {}
+    stalls = 0
+    for line in text.splitlines():
+        match = BUCKET.match(line)
+        if match:
+            buckets[match.group(1)] = int(float(match.group(2)))
+        match = STALLS.match(line)
+        if match:
+            stalls += int(float(match.group(1)))
+    return {'iteration_seconds_buckets': buckets, 'stalls': stalls}
+
+
+class Config(object):
+    """Points restraintd at the fake lab, keeping what was there before."""
+
+    def __init__(self, recipe_url):
+        self.recipe_url = recipe_url
+        self.backup = None
+
+    def __enter__(self):
+        if not os.path.isdir(CONFIG_DIR):
+            os.makedirs(CONFIG_DIR)
+        if os.path.exists(CONFIG_FILE):
+            self.backup = CONFIG_FILE + '.loadtest'
+            shutil.move(CONFIG_FILE, self.backup)
+        with open(CONFIG_FILE, 'w') as f:
+            f.write('[restraint]\nrecipe_url=%s\n' % self.recipe_url)
+        return self
+
+    def __exit__(self, *args):
+        os.remove(CONFIG_FILE)
+        if self.backup is not None:
+            shutil.move(self.backup, CONFIG_FILE)
+
+
+def run(options):
+    workdir = tempfile.mkdtemp(prefix='restraint-loadtest-')
+    options.serve_dir = workdir
+    make_task_tarball(workdir)
+    lab_url = 'http://%s:%d' % (options.host, options.port)
+    recipe_url = '%s/recipes/%d/' % (lab_url, RECIPE_ID)
+
+    lab = fakelab.FakeLab(options, make_recipe(options, lab_url))
+    lab.stats.expected_tasks = options.tasks
+    threading.Thread(target=lab.serve_forever, daemon=True).start()
+
+    report = {
+        'parameters': {
+            'tasks': options.tasks,
+            'rate_mb_per_s': options.rate,
+            'line_bytes': options.line_bytes,
+            'seconds': options.seconds,
+            'results': options.results,
+            'log_mb': options.log_mb,
+            'latency_ms': options.latency,
+            'bandwidth_kb_per_s': options.bandwidth,
+            'error_rate': options.error_rate,
+        },
+    }
+    try:
+        with Config(recipe_url):
+            started = time.time()
+            restraintd = subprocess.Popen(
+                [options.restraintd, '--port', str(options.restraintd_port),
+                 '--stall-threshold', str(options.stall_threshold)],
+                stdout=subprocess.DEVNULL if not options.verbose else None,
+                stderr=subprocess.DEVNULL if not options.verbose else None)
+            sampler = ProcessSampler(restraintd.pid, options.sample_interval)
+            sampler.start()
+
+            finished = lab.stats.done.wait(options.timeout)
+            elapsed = time.time() - started
+            sampler.sample()
+            main_loop = scrape_metrics(options.restraintd_port)
+
+            restraintd.send_signal(signal.SIGTERM)
+            try:
+                restraintd.wait(30)
+            except subprocess.TimeoutExpired:
+                restraintd.kill()
+                restraintd.wait()
+            sampler.stop.set()
+    finally:
+        lab.shutdown()
+        shutil.rmtree(workdir, ignore_errors=True)
+
+    lab_summary = lab.stats.summary()
+    output_bytes = lab_summary['bytes'].get('task_log', 0)
+    output_seconds = lab_summary['output_seconds']
+    report.update({
+        'finished': finished,
+        'elapsed_seconds': round(elapsed, 3),
+        'output_bytes': output_bytes,
+        'expected_output_bytes': int(options.tasks * options.seconds *
+                                     options.rate * 1024 * 1024),
+        'throughput_mb_per_s': round(output_bytes / output_seconds / 1024 / 1024, 3)
+        if output_seconds > 0 else None,
+        'lab': lab_summary,
+        'restraintd': sampler.summary(),
+        'main_loop': main_loop,
+    })
+    return report
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.strip().split('\n')[0])
+    fakelab.add_arguments(parser)
+    parser.add_argument('--restraintd', default=os.path.join(HERE, '..', '..', 'src', 'restraintd'),
+                        help='restraintd to test [Default: the one built in src]')
+    parser.add_argument('--restraintd-port', type=int, default=8091,
+                        help='Port for restraintd to listen on')
+    parser.add_argument('--stall-threshold', type=int, default=100, metavar='MS',
+                        help="restraintd's --stall-threshold")
+    parser.add_argument('--tasks', type=int, default=4,
+                        help='Synthetic tasks in the recipe')
+    parser.add_argument('--rate', type=float, default=1.0, metavar='MB/S',
+                        help='Output of each task')
+    parser.add_argument('--line-bytes', type=int, default=128,
+                        help='Length of each line of output')
+    parser.add_argument('--seconds', type=float, default=30,
+                        help='How long each task produces output for')
+    parser.add_argument('--results', type=int, default=1000,
+                        help='Results reported by each task')
+    parser.add_argument('--log-mb', type=int, default=50,
+                        help='Size of the log each task uploads')
+    parser.add_argument('--timeout', type=int, default=3600,
+                        help='Give up on the recipe after this many seconds')
+    parser.add_argument('--sample-interval', type=float, default=1.0,
+                        help='Seconds between samples of RSS and CPU time')
+    parser.add_argument('--output', help='Write the report here as well')
+    options = parser.parse_args()
+
+    if os.geteuid() != 0:
+        parser.error('restraintd runs the tasks for real, run this as root')
+
+    report = run(options)
+    text = json.dumps(report, indent=2, sort_keys=True)
+    print(text)
+    if options.output:
+        with open(options.output, 'w') as f:
+            f.write(text + '\n')
+    return 0 if report['finished'] else 1
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -0,0 +1,44 @@
+"""
+Writes lines of output at a steady rate, each starting with the time it
+was written as T=<microseconds since the epoch>, so that whoever
+receives the output can tell how long it took to get there.
+"""
+
+import argparse
+import sys
+import time
+
+TICK = 0.01
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.strip().split('\n')[0])
+    parser.add_argument('--rate', type=float, default=1.0, help='MB/s')
+    parser.add_argument('--line-bytes', type=int, default=128)
+    parser.add_argument('--seconds', type=float, default=10.0)
+    options = parser.parse_args()
+
+    # The marker, a space and the newline take 19 bytes.
+    padding = b'x' * max(0, options.line_bytes - 19)
+    out = sys.stdout.buffer
+    start = time.monotonic()
+    written = 0
+
+    while True:
+        elapsed = time.monotonic() - start
+        if elapsed >= options.seconds:
+            break
+        due = int(elapsed * options.rate * 1024 * 1024)
+        lines = []
+        while written < due:
+            stamp = b'T=%016d ' % int(time.time() * 1e6)
+            lines.append(stamp + padding + b'\n')
+            written += len(lines[-1])
+        if lines:
+            out.write(b''.join(lines))
+            out.flush()
+        time.sleep(TICK)
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,27 @@
+#!/bin/bash
+
+# Synthetic load for restraintd, shaped by the task parameters:
+#
+#   LOAD_RATE        task output in MB/s
+#   LOAD_LINE_BYTES  length of each line of output
+#   LOAD_SECONDS     how long to produce output for
+#   LOAD_RESULTS     results to report afterwards
+#   LOAD_LOG_MB      size of the log uploaded at the end
+
+cd "$(dirname "$0")" || exit 1
+
+python3 ./emit.py --rate "${LOAD_RATE:-1}" --line-bytes "${LOAD_LINE_BYTES:-128}" \
+    --seconds "${LOAD_SECONDS:-10}"
+
+for i in $(seq 1 "${LOAD_RESULTS:-0}") ; do
+    rstrnt-report-result --no-plugins "${RSTRNT_TASKNAME}/result-${i}" PASS "${i}" > /dev/null
+done
+
+if [ "${LOAD_LOG_MB:-0}" -gt 0 ] ; then
+    log=$(mktemp /tmp/load-log.XXXXXX)
+    head -c "$((LOAD_LOG_MB * 1024 * 1024))" /dev/urandom | base64 > "${log}"
+    rstrnt-report-log -l "${log}"
+    rm -f "${log}"
+fi
+
+rstrnt-report-result --no-plugins "${RSTRNT_TASKNAME}" PASS 0
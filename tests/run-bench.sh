@@ -0,0 +1,35 @@
+#!/bin/bash
+
+# Runs the benchmarks given, each printing its results as JSON, one
+# object per line, against the same HTTP server as the tests.
+
+set -e
+
+HTTPD_PID_FILE=bench-http-daemon.pid
+HTTPD_LOG_FILE=bench-httpserver.log
+
+cleanup()
+{
+    if [ -f "${HTTPD_PID_FILE}" ] ; then
+        kill -TERM "$(cat "${HTTPD_PID_FILE}")" || :
+        rm -f "${HTTPD_PID_FILE}" || :
+    fi
+    rm -f "${HTTPD_LOG_FILE}" || :
+}
+trap cleanup EXIT
+
+python=python3
+if ! command -v ${python} >/dev/null ; then
+    python=/usr/libexec/platform-python
+fi
+
+pidfile=$PWD/${HTTPD_PID_FILE}
+httpd=$PWD/httpserver.py
+httpd_log=$PWD/${HTTPD_LOG_FILE}
+
+(cd test-data/http-remote && ${python} "${httpd}" -i "${pidfile}" -p 8000 --host 127.0.0.1 &> "${httpd_log}") \
+    || (cat "${httpd_log}" && exit 1)
+
+for bench in "$@" ; do
+    ./"${bench}"
+done
@@ -0,0 +1,187 @@
+/*
+    This file is part of Restraint.
+
+    Restraint is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Restraint is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Restraint.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <gio/gio.h>
+
+#include "cgroup.h"
+
+/*
+ * The tests run against a directory dressed up as a cgroup2 mount, the
+ * interface files being plain files.
+ */
+static gchar *
+make_mount (void)
+{
+    gchar *mount = g_dir_make_tmp ("test_cgroup_XXXXXX", NULL);
+    gchar *controllers = g_build_filename (mount, "cgroup.controllers", NULL);
+
+    g_assert_true (g_file_set_contents (controllers, "cpu io memory pids\n", -1, NULL));
+    g_free (controllers);
+
+    return mount;
+}
+
+static void
+write_file (const gchar *cgroup, const gchar *file, const gchar *contents)
+{
+    gchar *filename = g_build_filename (cgroup, file, NULL);
+
+    g_assert_true (g_file_set_contents (filename, contents, -1, NULL));
+    g_free (filename);
+}
+
+static void
+remove_files (const gchar *dir, const gchar * const *files)
+{
+    for (; *files != NULL; files++) {
+        gchar *filename = g_build_filename (dir, *files, NULL);
+        g_remove (filename);
+        g_free (filename);
+    }
+    g_rmdir (dir);
+}
+
+static void
+test_cgroup_not_cgroup2 (void)
+{
+    g_autoptr (GError) error = NULL;
+    gchar *mount = g_dir_make_tmp ("test_cgroup_XXXXXX", NULL);
+    gchar *cgroup;
+
+    cgroup = rstrnt_cgroup_create (mount, "task-1", &error);
+    g_assert_null (cgroup);
+    g_assert_error (error, G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED);
+
+    g_rmdir (mount);
+    g_free (mount);
+}
+
+static void
+test_cgroup_create (void)
+{
+    const gchar *mount_files[] = { "cgroup.controllers", NULL };
+    g_autoptr (GError) error = NULL;
+    gchar *mount = make_mount ();
+    gchar *slice = g_build_filename (mount, CGROUP_SLICE, NULL);
+    gchar *expected = g_build_filename (slice, "task-1", NULL);
+    gchar *cgroup;
+
+    cgroup = rstrnt_cgroup_create (mount, "task-1", &error);
+    g_assert_no_error (error);
+    g_assert_cmpstr (cgroup, ==, expected);
+    g_assert_true (g_file_test (cgroup, G_FILE_TEST_IS_DIR));
+
+    // An empty leaf from before is replaced, not an error.
+    g_free (cgroup);
+    cgroup = rstrnt_cgroup_create (mount, "task-1", &error);
+    g_assert_no_error (error);
+    g_assert_cmpstr (cgroup, ==, expected);
+
+    rstrnt_cgroup_remove (cgroup);
+    g_assert_false (g_file_test (cgroup, G_FILE_TEST_EXISTS));
+
+    g_rmdir (slice);
+    remove_files (mount, mount_files);
+    g_free (cgroup);
+    g_free (expected);
+    g_free (slice);
+    g_free (mount);
+}
+
+static void
+test_cgroup_set (void)
+{
+    const gchar *files[] = { "memory.max", NULL };
+    g_autoptr (GError) error = NULL;
+    gchar *cgroup = g_dir_make_tmp ("test_cgroup_XXXXXX", NULL);
+    gchar *filename = g_build_filename (cgroup, "memory.max", NULL);
+    gchar *contents;
+
+    write_file (cgroup, "memory.max", "max\n");
+    g_assert_true (rstrnt_cgroup_set (cgroup, "memory.max", "512M", &error));
+    g_assert_no_error (error);
+    g_assert_true (g_file_get_contents (filename, &contents, NULL, NULL));
+    g_assert_cmpstr (contents, ==, "512M");
+    g_free (contents);
+
+    // Interface files are never created.
+    g_assert_false (rstrnt_cgroup_set (cgroup, "cpu.max", "50000 100000", &error));
+    g_assert_error (error, G_FILE_ERROR, G_FILE_ERROR_NOENT);
+
+    remove_files (cgroup, files);
+    g_free (filename);
+    g_free (cgroup);
+}
+
+static void
+test_cgroup_stats (void)
+{
+    const gchar *files[] = { "cpu.stat", "memory.peak", "io.stat", NULL };
+    gchar *cgroup = g_dir_make_tmp ("test_cgroup_XXXXXX", NULL);
+    RstrntCgroupStats stats;
+    GHashTable *table;
+    gchar *formatted;
+
+    write_file (cgroup, "cpu.stat",
+                "usage_usec 1500\nuser_usec 1000\nsystem_usec 500\n"
+                "nr_periods 0\nnr_throttled 0\nthrottled_usec 0\n");
+    write_file (cgroup, "memory.peak", "10485760\n");
+    write_file (cgroup, "io.stat",
+                "8:0 rbytes=4096 wbytes=8192 rios=1 wios=2 dbytes=0 dios=0\n"
+                "253:0 rbytes=4096 wbytes=0 rios=1 wios=0 dbytes=0 dios=0\n");
+
+    rstrnt_cgroup_read_stats (cgroup, &stats);
+    g_assert_cmpint (stats.cpu_usage_usec, ==, 1500);
+    g_assert_cmpint (stats.cpu_user_usec, ==, 1000);
+    g_assert_cmpint (stats.cpu_system_usec, ==, 500);
+    g_assert_cmpint (stats.memory_peak, ==, 10485760);
+    g_assert_cmpint (stats.io_rbytes, ==, 8192);
+    g_assert_cmpint (stats.io_wbytes, ==, 8192);
+    // No pids.peak in this kernel.
+    g_assert_cmpint (stats.pids_peak, ==, -1);
+
+    formatted = rstrnt_cgroup_stats_format (&stats);
+    g_assert_cmpstr (formatted, ==,
+                     "cpu_usage_usec=1500 cpu_user_usec=1000 cpu_system_usec=500 "
+                     "memory_peak=10485760 io_rbytes=8192 io_wbytes=8192");
+
+    table = rstrnt_cgroup_stats_table (&stats);
+    g_assert_cmpuint (g_hash_table_size (table), ==, 6);
+    g_assert_cmpstr (g_hash_table_lookup (table, "memory_peak"), ==, "10485760");
+    g_assert_false (g_hash_table_contains (table, "pids_peak"));
+
+    g_hash_table_destroy (table);
+    g_free (formatted);
+    remove_files (cgroup, files);
+    g_free (cgroup);
+}
+
+int
+main (int   argc,
+      char *argv[])
+{
+    g_test_init (&argc, &argv, NULL);
+
+    g_test_add_func ("/cgroup/not_cgroup2", test_cgroup_not_cgroup2);
+    g_test_add_func ("/cgroup/create", test_cgroup_create);
+    g_test_add_func ("/cgroup/set", test_cgroup_set);
+    g_test_add_func ("/cgroup/stats", test_cgroup_stats);
+
+    return g_test_run ();
+}
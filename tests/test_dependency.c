@@ -845,6 +845,11 @@ static void test_http_rec_repodeps_fail (void)
 }
 
 int main(int argc, char *argv[]) {
+    gchar *cache_dir = g_dir_make_tmp("test_dependency_cache_XXXXXX", NULL);
+    int ret;
+
+    // Stay out of the real metadata cache, even as root
+    restraint_metadata_set_cache_dir(cache_dir);
     putenv("RSTRNT_PKG_CMD=fakeyum");
     putenv("RSTRNT_PKG_MANUAL_INSTALL=fakerpm --nodigest -ivh");
     g_test_init(&argc, &argv, NULL);
@@ -860,5 +865,10 @@ int main(int argc, char *argv[]) {
     g_test_add_func("/repodeps/recursive/git/fail", test_git_rec_repodeps_fail);
     g_test_add_func("/repodeps/recursive/http/success", test_http_rec_repodeps_success);
     g_test_add_func("/repodeps/recursive/http/fail", test_http_rec_repodeps_fail);
-    return g_test_run();
+    ret = g_test_run();
+
+    restraint_metadata_set_cache_dir(NULL);
+    rmrf(cache_dir);
+    g_free(cache_dir);
+    return ret;
 }
@@ -0,0 +1,167 @@
+/*
+    This file is part of Restraint.
+
+    Restraint is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Restraint is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Restraint.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <glib.h>
+#include <string.h>
+
+#include "errors.h"
+#include "frame.h"
+
+static const gchar *log_names[] = { "rstrnt-path", "Content-Range", "log-level", NULL };
+static const gchar *log_values[] = { "/recipes/1/tasks/2/logs/taskout.log",
+                                     "bytes 0-5/6", "1", NULL };
+// Raw log content, neither text nor valid UTF-8.
+static const gchar log_body[] = { 'o', 'k', '\0', '\xff', '\r', '\n' };
+
+static void
+assert_log_frame (RstrntFrame *frame)
+{
+    g_assert_nonnull (frame);
+    g_assert_cmpuint (g_hash_table_size (frame->headers), ==, 3);
+    for (gint i = 0; log_names[i] != NULL; i++) {
+        g_assert_cmpstr (g_hash_table_lookup (frame->headers, log_names[i]),
+                         ==, log_values[i]);
+    }
+    g_assert_cmpuint (frame->body_length, ==, sizeof (log_body));
+    g_assert_cmpmem (frame->body, frame->body_length,
+                     log_body, sizeof (log_body));
+    g_assert_cmpint (frame->body[frame->body_length], ==, '\0');
+}
+
+static void
+test_frame_roundtrip (void)
+{
+    g_autoptr (GError) err = NULL;
+    const gchar *no_names[] = { NULL };
+    RstrntFrameReader *reader = rstrnt_frame_reader_new ();
+    GByteArray *first;
+    GByteArray *second;
+    RstrntFrame *frame;
+
+    first = rstrnt_frame_encode (log_names, log_values,
+                                 log_body, sizeof (log_body));
+    second = rstrnt_frame_encode (no_names, no_names, "Listening\n", 10);
+
+    rstrnt_frame_reader_feed (reader, (gchar *) first->data, first->len);
+    rstrnt_frame_reader_feed (reader, (gchar *) second->data, second->len);
+
+    frame = rstrnt_frame_reader_next (reader, &err);
+    g_assert_no_error (err);
+    assert_log_frame (frame);
+    rstrnt_frame_free (frame);
+
+    frame = rstrnt_frame_reader_next (reader, &err);
+    g_assert_no_error (err);
+    g_assert_nonnull (frame);
+    g_assert_cmpuint (g_hash_table_size (frame->headers), ==, 0);
+    g_assert_cmpstr (frame->body, ==, "Listening\n");
+    rstrnt_frame_free (frame);
+
+    g_assert_null (rstrnt_frame_reader_next (reader, &err));
+    g_assert_no_error (err);
+
+    g_byte_array_free (first, TRUE);
+    g_byte_array_free (second, TRUE);
+    rstrnt_frame_reader_free (reader);
+}
+
+/*
+ * Reads from the pipe can end anywhere, including in the middle of the
+ * length prefix.
+ */
+static void
+test_frame_split (void)
+{
+    g_autoptr (GError) err = NULL;
+    RstrntFrameReader *reader = rstrnt_frame_reader_new ();
+    GByteArray *encoded;
+    RstrntFrame *frame = NULL;
+
+    encoded = rstrnt_frame_encode (log_names, log_values,
+                                   log_body, sizeof (log_body));
+
+    for (guint i = 0; i < encoded->len; i++) {
+        g_assert_null (frame);
+        rstrnt_frame_reader_feed (reader, (gchar *) encoded->data + i, 1);
+        frame = rstrnt_frame_reader_next (reader, &err);
+        g_assert_no_error (err);
+    }
+    assert_log_frame (frame);
+    rstrnt_frame_free (frame);
+
+    g_byte_array_free (encoded, TRUE);
+    rstrnt_frame_reader_free (reader);
+}
+
+static void
+test_frame_invalid (void)
+{
+    g_autoptr (GError) err = NULL;
+    RstrntFrameReader *reader = rstrnt_frame_reader_new ();
+    // Header claims 4 bytes but holds a name without a value.
+    const gchar unpaired[] = { 0, 0, 0, 4, 0, 0, 0, 0, 'a', 0, 'b', 0x20 };
+    const gchar too_large[] = { 0x7f, 0, 0, 0, 0, 0, 0, 0 };
+
+    rstrnt_frame_reader_feed (reader, unpaired, sizeof (unpaired));
+    g_assert_null (rstrnt_frame_reader_next (reader, &err));
+    g_assert_error (err, RESTRAINT_ERROR, RESTRAINT_PARSE_ERROR_BAD_SYNTAX);
+    g_clear_error (&err);
+
+    // Nothing after a bad frame can be trusted.
+    g_assert_null (rstrnt_frame_reader_next (reader, &err));
+    g_assert_error (err, RESTRAINT_ERROR, RESTRAINT_PARSE_ERROR_BAD_SYNTAX);
+    g_clear_error (&err);
+    rstrnt_frame_reader_free (reader);
+
+    reader = rstrnt_frame_reader_new ();
+    rstrnt_frame_reader_feed (reader, too_large, sizeof (too_large));
+    g_assert_null (rstrnt_frame_reader_next (reader, &err));
+    g_assert_error (err, RESTRAINT_ERROR, RESTRAINT_PARSE_ERROR_BAD_SYNTAX);
+    rstrnt_frame_reader_free (reader);
+}
+
+static void
+test_framing_parse (void)
+{
+    g_autoptr (GError) err = NULL;
+    RstrntFraming framing = RSTRNT_FRAMING_JSON;
+
+    g_assert_true (rstrnt_framing_parse ("binary", &framing, &err));
+    g_assert_no_error (err);
+    g_assert_cmpint (framing, ==, RSTRNT_FRAMING_BINARY);
+
+    g_assert_true (rstrnt_framing_parse ("json", &framing, &err));
+    g_assert_no_error (err);
+    g_assert_cmpint (framing, ==, RSTRNT_FRAMING_JSON);
+
+    g_assert_false (rstrnt_framing_parse ("xml", &framing, &err));
+    g_assert_error (err, RESTRAINT_ERROR, RESTRAINT_CMDLINE_ERROR);
+}
+
+int
+main (int   argc,
+      char *argv[])
+{
+    g_test_init (&argc, &argv, NULL);
+
+    g_test_add_func ("/frame/roundtrip", test_frame_roundtrip);
+    g_test_add_func ("/frame/split", test_frame_split);
+    g_test_add_func ("/frame/invalid", test_frame_invalid);
+    g_test_add_func ("/framing/parse", test_framing_parse);
+
+    return g_test_run ();
+}
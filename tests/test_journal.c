@@ -0,0 +1,180 @@
+/*
+    This file is part of Restraint.
+
+    Restraint is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Restraint is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Restraint.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <string.h>
+
+#include "journal.h"
+
+static gchar *tmp_test_dir = NULL;
+
+static struct json_object *
+new_record (const gchar *op, const gchar *task)
+{
+    struct json_object *record = json_object_new_object ();
+
+    json_object_object_add (record, "op", json_object_new_string (op));
+    json_object_object_add (record, "task", json_object_new_string (task));
+    return record;
+}
+
+static void
+collect_record (struct json_object *record, gpointer user_data)
+{
+    GString *tasks = user_data;
+    struct json_object *task = NULL;
+
+    g_assert_true (json_object_object_get_ex (record, "task", &task));
+    g_string_append (tasks, json_object_get_string (task));
+}
+
+static void
+append_records (RstrntJournal *journal, const gchar *tasks)
+{
+    g_autoptr (GError) err = NULL;
+
+    for (const gchar *t = tasks; *t != '\0'; t++) {
+        gchar task[2] = { *t, '\0' };
+        struct json_object *record = new_record ("status", task);
+
+        g_assert_true (rstrnt_journal_append (journal, record, &err));
+        g_assert_no_error (err);
+        json_object_put (record);
+    }
+}
+
+static void
+test_journal_replay (void)
+{
+    g_autofree gchar *filename = NULL;
+    g_autoptr (GError) err = NULL;
+    GString *tasks = g_string_new (NULL);
+    RstrntJournal *journal;
+
+    filename = g_build_filename (tmp_test_dir, "replay.journal", NULL);
+
+    journal = rstrnt_journal_open (filename, &err);
+    g_assert_no_error (err);
+    g_assert_nonnull (journal);
+
+    append_records (journal, "123");
+    g_assert_cmpuint (rstrnt_journal_get_records (journal), ==, 3);
+    rstrnt_journal_close (journal);
+
+    /* Reopening appends to what is there already. */
+    journal = rstrnt_journal_open (filename, &err);
+    g_assert_no_error (err);
+    append_records (journal, "45");
+    g_assert_cmpuint (rstrnt_journal_get_records (journal), ==, 2);
+
+    g_assert_cmpint (rstrnt_journal_replay (filename, collect_record,
+                                            tasks, &err), ==, 5);
+    g_assert_no_error (err);
+    g_assert_cmpstr (tasks->str, ==, "12345");
+
+    /* Nothing is left after a checkpoint. */
+    g_string_truncate (tasks, 0);
+    g_assert_true (rstrnt_journal_truncate (journal, &err));
+    g_assert_no_error (err);
+    g_assert_cmpuint (rstrnt_journal_get_records (journal), ==, 0);
+    g_assert_cmpint (rstrnt_journal_replay (filename, collect_record,
+                                            tasks, &err), ==, 0);
+    g_assert_cmpstr (tasks->str, ==, "");
+
+    /* And appending after the truncate starts from the beginning. */
+    append_records (journal, "6");
+    g_assert_cmpint (rstrnt_journal_replay (filename, collect_record,
+                                            tasks, &err), ==, 1);
+    g_assert_cmpstr (tasks->str, ==, "6");
+
+    rstrnt_journal_close (journal);
+    g_string_free (tasks, TRUE);
+    g_remove (filename);
+}
+
+static void
+test_journal_replay_missing (void)
+{
+    g_autoptr (GError) err = NULL;
+    GString *tasks = g_string_new (NULL);
+
+    g_assert_cmpint (rstrnt_journal_replay ("the/file/that/doesnt/exist",
+                                            collect_record, tasks, &err), ==, 0);
+    g_assert_no_error (err);
+    g_assert_cmpstr (tasks->str, ==, "");
+
+    g_string_free (tasks, TRUE);
+}
+
+/*
+ * A record cut short by a crash, and anything following a corrupt
+ * record, must not be replayed.
+ */
+static void
+test_journal_replay_torn (void)
+{
+    g_autofree gchar *filename = NULL;
+    g_autoptr (GError) err = NULL;
+    GString *tasks = g_string_new (NULL);
+    const gchar *torn = "{\"op\":\"status\",\"task\":\"1\"}\n"
+                        "{\"op\":\"status\",\"task\":\"2\"}\n"
+                        "{\"op\":\"status\",\"task\":\"3\"}";
+    const gchar *corrupt = "{\"op\":\"status\",\"task\":\"1\"}\n"
+                           "{\"op\":\"sta\n"
+                           "{\"op\":\"status\",\"task\":\"3\"}\n";
+
+    filename = g_build_filename (tmp_test_dir, "torn.journal", NULL);
+
+    g_assert_true (g_file_set_contents (filename, torn, -1, NULL));
+    g_assert_cmpint (rstrnt_journal_replay (filename, collect_record,
+                                            tasks, &err), ==, 2);
+    g_assert_no_error (err);
+    g_assert_cmpstr (tasks->str, ==, "12");
+
+    g_string_truncate (tasks, 0);
+    g_assert_true (g_file_set_contents (filename, corrupt, -1, NULL));
+    g_assert_cmpint (rstrnt_journal_replay (filename, collect_record,
+                                            tasks, &err), ==, 1);
+    g_assert_no_error (err);
+    g_assert_cmpstr (tasks->str, ==, "1");
+
+    g_string_free (tasks, TRUE);
+    g_remove (filename);
+}
+
+int
+main (int   argc,
+      char *argv[])
+{
+    gboolean success;
+
+    tmp_test_dir = g_dir_make_tmp ("test_journal_XXXXXX", NULL);
+
+    g_test_init (&argc, &argv, NULL);
+
+    g_test_add_func ("/journal/replay", test_journal_replay);
+    g_test_add_func ("/journal/replay/missing", test_journal_replay_missing);
+    g_test_add_func ("/journal/replay/torn", test_journal_replay_torn);
+
+    success = g_test_run ();
+
+    g_remove (tmp_test_dir);
+    g_free (tmp_test_dir);
+
+    return success;
+}
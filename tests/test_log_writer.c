@@ -0,0 +1,121 @@
+/*
+    This file is part of Restraint.
+
+    Restraint is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Restraint is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Restraint.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <string.h>
+
+#include "log_writer.h"
+
+static gchar *tmp_test_dir = NULL;
+
+static void
+assert_file_contents (const gchar *filename, const gchar *expected)
+{
+    g_autofree gchar *contents = NULL;
+    gsize length;
+
+    g_assert_true (g_file_get_contents (filename, &contents, &length, NULL));
+    g_assert_cmpmem (contents, length, expected, strlen (expected));
+}
+
+/*
+ * Chunks of more files than may be open at once, arriving out of order
+ * and into directories which don't exist yet.
+ */
+static void
+test_log_writer_chunks (void)
+{
+    g_autoptr (GError) err = NULL;
+    const gchar *names[] = { "a/taskout.log", "b/c/taskout.log", "d/harness.log" };
+    gchar *filenames[G_N_ELEMENTS (names)];
+    RstrntLogWriter *writer;
+
+    writer = rstrnt_log_writer_new (2, &err);
+    g_assert_no_error (err);
+    g_assert_nonnull (writer);
+
+    for (guint i = 0; i < G_N_ELEMENTS (names); i++) {
+        filenames[i] = g_build_filename (tmp_test_dir, "recipes", names[i],
+                                         NULL);
+    }
+    for (guint i = 0; i < G_N_ELEMENTS (names); i++) {
+        rstrnt_log_writer_write (writer, filenames[i], "world\n", 6, 6, 12);
+    }
+    for (guint i = 0; i < G_N_ELEMENTS (names); i++) {
+        rstrnt_log_writer_write (writer, filenames[i], "hello ", 6, 0, 12);
+    }
+    rstrnt_log_writer_free (writer);
+
+    for (guint i = 0; i < G_N_ELEMENTS (names); i++) {
+        assert_file_contents (filenames[i], "hello world\n");
+        g_remove (filenames[i]);
+        g_free (filenames[i]);
+    }
+}
+
+/*
+ * A log uploaded again from the start replaces what was there, whether
+ * the file is still open or not.
+ */
+static void
+test_log_writer_truncate (void)
+{
+    g_autoptr (GError) err = NULL;
+    g_autofree gchar *filename = NULL;
+    RstrntLogWriter *writer;
+
+    filename = g_build_filename (tmp_test_dir, "truncate.log", NULL);
+    g_assert_true (g_file_set_contents (filename, "stale contents\n", -1, NULL));
+
+    writer = rstrnt_log_writer_new (1, &err);
+    g_assert_no_error (err);
+    rstrnt_log_writer_write (writer, filename, "new\n", 4, 0, 4);
+    rstrnt_log_writer_free (writer);
+    assert_file_contents (filename, "new\n");
+
+    writer = rstrnt_log_writer_new (1, &err);
+    g_assert_no_error (err);
+    rstrnt_log_writer_write (writer, filename, "newer\n", 6, 0, 6);
+    rstrnt_log_writer_write (writer, filename, "x\n", 2, 0, 2);
+    // Without a total length the file is left as is.
+    rstrnt_log_writer_write (writer, filename, "y", 1, 1, -1);
+    rstrnt_log_writer_free (writer);
+    assert_file_contents (filename, "xy");
+
+    g_remove (filename);
+}
+
+int
+main (int   argc,
+      char *argv[])
+{
+    gboolean success;
+
+    tmp_test_dir = g_dir_make_tmp ("test_log_writer_XXXXXX", NULL);
+
+    g_test_init (&argc, &argv, NULL);
+
+    g_test_add_func ("/log_writer/chunks", test_log_writer_chunks);
+    g_test_add_func ("/log_writer/truncate", test_log_writer_truncate);
+
+    success = g_test_run ();
+
+    g_free (tmp_test_dir);
+
+    return success;
+}
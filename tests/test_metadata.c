@@ -17,6 +17,7 @@
 
 
 #include <glib.h>
+#include <glib/gstdio.h>
 #include <gio/gio.h>
 
 #include "metadata.h"
@@ -437,6 +438,187 @@ static void test_metadata_environment(void) {
     restraint_metadata_free (metadata);
 }
 
+typedef struct {
+    GMainLoop *loop;
+    GError *error;
+} GetMetadataData;
+
+static gboolean
+get_metadata_io_cb (GIOChannel *io, GIOCondition condition, gpointer user_data)
+{
+    gchar buf[1024];
+    gsize bytes_read;
+
+    if (condition & G_IO_IN) {
+        if (g_io_channel_read_chars (io, buf, sizeof (buf), &bytes_read,
+                                     NULL) == G_IO_STATUS_NORMAL) {
+            return TRUE;
+        }
+    }
+    return FALSE;
+}
+
+static void
+get_metadata_finish_cb (gpointer user_data, GError *error)
+{
+    GetMetadataData *data = user_data;
+
+    data->error = error;
+    g_main_loop_quit (data->loop);
+}
+
+static MetaData *
+get_metadata (gchar *path)
+{
+    GetMetadataData data = { g_main_loop_new (NULL, FALSE), NULL };
+    MetaData *metadata = NULL;
+
+    restraint_get_metadata (path, "RedHatEnterpriseLinux6", &metadata, NULL,
+                            get_metadata_finish_cb, get_metadata_io_cb, &data);
+    // Only make is run in the background.
+    if (data.error == NULL && metadata == NULL) {
+        g_main_loop_run (data.loop);
+    }
+    g_assert_no_error (data.error);
+    g_main_loop_unref (data.loop);
+
+    return metadata;
+}
+
+static void
+write_file (const gchar *dir, const gchar *file, const gchar *contents)
+{
+    gchar *filename = g_build_filename (dir, file, NULL);
+
+    g_assert_true (g_file_set_contents (filename, contents, -1, NULL));
+    g_free (filename);
+}
+
+static void
+remove_files (const gchar *dir, const gchar * const *files)
+{
+    for (; *files != NULL; files++) {
+        gchar *filename = g_build_filename (dir, *files, NULL);
+        g_remove (filename);
+        g_free (filename);
+    }
+    g_rmdir (dir);
+}
+
+static void
+remove_cache (gchar *cache_dir)
+{
+    GDir *dir = g_dir_open (cache_dir, 0, NULL);
+    const gchar *name;
+
+    while (dir != NULL && (name = g_dir_read_name (dir)) != NULL) {
+        gchar *filename = g_build_filename (cache_dir, name, NULL);
+        g_remove (filename);
+        g_free (filename);
+    }
+    if (dir != NULL) {
+        g_dir_close (dir);
+    }
+    g_rmdir (cache_dir);
+    g_free (cache_dir);
+    restraint_metadata_set_cache_dir (NULL);
+}
+
+static void test_metadata_cache_round_trip(void) {
+    const gchar *files[] = { "metadata", NULL };
+    gchar *cache_dir = g_dir_make_tmp ("test_metadata_cache_XXXXXX", NULL);
+    gchar *path = g_dir_make_tmp ("test_metadata_task_XXXXXX", NULL);
+    MetaData *metadata;
+    Param *param;
+
+    restraint_metadata_set_cache_dir (cache_dir);
+    write_file (path, "metadata",
+                "[General]\n"
+                "name=/restraint/cache\n"
+                "[restraint]\n"
+                "entry_point=./runtest.sh\n"
+                "dependencies=gcc;make\n"
+                "softDependencies=lshw\n"
+                "repoRequires=general/common\n"
+                "environment=FOO=bar;BAZ=qux\n"
+                "max_time=5m\n"
+                "no_localwatchdog=true\n"
+                "use_pty=true\n"
+                "parallel=true\n"
+                "memory_max=512M\n");
+
+    // Parsed the first time, from the cache the second.
+    restraint_metadata_free (get_metadata (path));
+    metadata = get_metadata (path);
+
+    g_assert_cmpstr (metadata->name, ==, "/restraint/cache");
+    g_assert_cmpstr (metadata->entry_point, ==, "./runtest.sh");
+    g_assert_cmpuint (g_slist_length (metadata->dependencies), ==, 2);
+    g_assert_cmpstr (g_slist_nth_data (metadata->dependencies, 0), ==, "make");
+    g_assert_cmpstr (g_slist_nth_data (metadata->dependencies, 1), ==, "gcc");
+    g_assert_cmpstr (g_slist_nth_data (metadata->softdependencies, 0), ==, "lshw");
+    g_assert_cmpstr (g_slist_nth_data (metadata->repodeps, 0), ==, "general/common");
+    g_assert_cmpuint (g_slist_length (metadata->envvars), ==, 2);
+    param = g_slist_nth_data (metadata->envvars, 0);
+    g_assert_cmpstr (param->name, ==, "BAZ");
+    g_assert_cmpstr (param->value, ==, "qux");
+    g_assert_cmpint (metadata->max_time, ==, 300);
+    g_assert_true (metadata->nolocalwatchdog);
+    g_assert_true (metadata->use_pty);
+    g_assert_true (metadata->parallel);
+    g_assert_cmpstr (metadata->memory_max, ==, "512M");
+    g_assert_null (metadata->cpu_max);
+    restraint_metadata_free (metadata);
+
+    // Changing the file invalidates its entry.
+    write_file (path, "metadata", "[General]\nname=/restraint/changed\n[restraint]\n");
+    metadata = get_metadata (path);
+    g_assert_cmpstr (metadata->name, ==, "/restraint/changed");
+    g_assert_null (metadata->dependencies);
+    g_assert_false (metadata->parallel);
+    restraint_metadata_free (metadata);
+
+    remove_files (path, files);
+    g_free (path);
+    remove_cache (cache_dir);
+}
+
+static void test_metadata_cache_makefile(void) {
+    const gchar *files[] = { "Makefile", "runs", "testinfo.desc", NULL };
+    gchar *cache_dir = g_dir_make_tmp ("test_metadata_cache_XXXXXX", NULL);
+    gchar *path = g_dir_make_tmp ("test_metadata_task_XXXXXX", NULL);
+    gchar *testinfo_file = g_build_filename (path, "testinfo.desc", NULL);
+    gchar *runs_file = g_build_filename (path, "runs", NULL);
+    gchar *runs;
+    MetaData *metadata;
+
+    restraint_metadata_set_cache_dir (cache_dir);
+    write_file (path, "Makefile",
+                "testinfo.desc:\n"
+                "\techo run >> runs\n"
+                "\techo 'Name: /restraint/make' > $@\n");
+
+    metadata = get_metadata (path);
+    g_assert_cmpstr (metadata->name, ==, "/restraint/make");
+    restraint_metadata_free (metadata);
+
+    // As after a reboot into a freshly fetched task.
+    g_remove (testinfo_file);
+    metadata = get_metadata (path);
+    g_assert_cmpstr (metadata->name, ==, "/restraint/make");
+    restraint_metadata_free (metadata);
+
+    g_assert_true (g_file_get_contents (runs_file, &runs, NULL, NULL));
+    g_assert_cmpstr (runs, ==, "run\n");
+    g_free (runs);
+
+    remove_files (path, files);
+    g_free (runs_file);
+    g_free (testinfo_file);
+    g_free (path);
+    remove_cache (cache_dir);
+}
+
 int main(int argc, char *argv[]) {
     g_test_init(&argc, &argv, NULL);
     g_test_add_func("/testinfo.desc/testtime/day", test_testinfo_testtime_day);
@@ -460,5 +642,7 @@ int main(int argc, char *argv[]) {
     g_test_add_func("/metadata/use_pty", test_metadata_use_pty);
     g_test_add_func("/metadata/no_localwatchdog", test_metadata_no_localwatchdog);
     g_test_add_func("/metadata/environment", test_metadata_environment);
+    g_test_add_func("/metadata/cache/round_trip", test_metadata_cache_round_trip);
+    g_test_add_func("/metadata/cache/makefile", test_metadata_cache_makefile);
     return g_test_run();
 }
@@ -0,0 +1,161 @@
+/*
+    This file is part of Restraint.
+
+    Restraint is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Restraint is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Restraint.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <glib.h>
+
+#include "metrics.h"
+
+static void
+test_metrics_append (void)
+{
+    GString *out = g_string_new (NULL);
+
+    rstrnt_metrics_describe (out, "restraintd_bytes_total",
+                             RSTRNT_METRIC_COUNTER, "Bytes sent.");
+    rstrnt_metrics_append (out, "restraintd_bytes_total", NULL, NULL, 1048576);
+    rstrnt_metrics_append (out, "restraintd_bytes_total", "type", "a\"b\\c\nd", 0.25);
+
+    g_assert_cmpstr (out->str, ==,
+                     "# HELP restraintd_bytes_total Bytes sent.\n"
+                     "# TYPE restraintd_bytes_total counter\n"
+                     "restraintd_bytes_total 1048576\n"
+                     "restraintd_bytes_total{type=\"a\\\"b\\\\c\\nd\"} 0.25\n");
+
+    g_string_free (out, TRUE);
+}
+
+static void
+test_metrics_summary (void)
+{
+    RstrntSummary *summary = g_new0 (RstrntSummary, 1);
+    GString *out = g_string_new (NULL);
+
+    g_assert_cmpfloat (rstrnt_summary_quantile (summary, 0.5), ==, 0);
+
+    for (gint i = 100; i > 0; i--) {
+        rstrnt_summary_observe (summary, i);
+    }
+    g_assert_cmpfloat (rstrnt_summary_quantile (summary, 0.5), ==, 50);
+    g_assert_cmpfloat (rstrnt_summary_quantile (summary, 0.9), ==, 90);
+    g_assert_cmpfloat (rstrnt_summary_quantile (summary, 0.99), ==, 99);
+    g_assert_cmpfloat (rstrnt_summary_quantile (summary, 1), ==, 100);
+
+    rstrnt_metrics_append_summary (out, "restraintd_latency_seconds", summary);
+    g_assert_cmpstr (out->str, ==,
+                     "restraintd_latency_seconds{quantile=\"0.5\"} 50\n"
+                     "restraintd_latency_seconds{quantile=\"0.9\"} 90\n"
+                     "restraintd_latency_seconds{quantile=\"0.99\"} 99\n"
+                     "restraintd_latency_seconds_sum 5050\n"
+                     "restraintd_latency_seconds_count 100\n");
+
+    g_string_free (out, TRUE);
+    g_free (summary);
+}
+
+static void
+test_metrics_summary_window (void)
+{
+    RstrntSummary *summary = g_new0 (RstrntSummary, 1);
+
+    // Old observations leave the quantiles but stay in sum and count.
+    for (gint i = 0; i < METRICS_SUMMARY_SAMPLES; i++) {
+        rstrnt_summary_observe (summary, 1000);
+    }
+    for (gint i = 0; i < METRICS_SUMMARY_SAMPLES; i++) {
+        rstrnt_summary_observe (summary, 1);
+    }
+    g_assert_cmpfloat (rstrnt_summary_quantile (summary, 0.99), ==, 1);
+    g_assert_cmpuint (summary->count, ==, 2 * METRICS_SUMMARY_SAMPLES);
+    g_assert_cmpfloat (summary->sum, ==, 1001 * METRICS_SUMMARY_SAMPLES);
+
+    g_free (summary);
+}
+
+static void
+test_metrics_histogram (void)
+{
+    static const gdouble bounds[] = { 0.125, 1 };
+    RstrntHistogram *histogram = rstrnt_histogram_new (bounds, G_N_ELEMENTS (bounds));
+    GString *out = g_string_new (NULL);
+
+    rstrnt_histogram_observe (histogram, 0.0625);
+    // Bounds are inclusive.
+    rstrnt_histogram_observe (histogram, 0.125);
+    rstrnt_histogram_observe (histogram, 0.5);
+    rstrnt_histogram_observe (histogram, 2);
+
+    rstrnt_metrics_append_histogram (out, "restraintd_iteration_seconds", histogram);
+    g_assert_cmpstr (out->str, ==,
+                     "restraintd_iteration_seconds_bucket{le=\"0.125\"} 2\n"
+                     "restraintd_iteration_seconds_bucket{le=\"1\"} 3\n"
+                     "restraintd_iteration_seconds_bucket{le=\"+Inf\"} 4\n"
+                     "restraintd_iteration_seconds_sum 2.6875\n"
+                     "restraintd_iteration_seconds_count 4\n");
+
+    g_string_free (out, TRUE);
+    rstrnt_histogram_free (histogram);
+}
+
+static gboolean
+block_loop (gpointer user_data)
+{
+    g_usleep (G_USEC_PER_SEC / 5);
+    return G_SOURCE_REMOVE;
+}
+
+static gboolean
+quit_loop (gpointer user_data)
+{
+    g_main_loop_quit (user_data);
+    return G_SOURCE_REMOVE;
+}
+
+static void
+test_metrics_probe_loop (void)
+{
+    RstrntSummary *summary = g_new0 (RstrntSummary, 1);
+    GMainLoop *loop = g_main_loop_new (NULL, FALSE);
+    guint probe;
+
+    probe = rstrnt_metrics_probe_loop (summary, 10);
+    g_timeout_add (5, block_loop, NULL);
+    g_timeout_add (500, quit_loop, loop);
+    g_main_loop_run (loop);
+    g_source_remove (probe);
+
+    g_assert_cmpuint (summary->count, >, 1);
+    // The probe due while the loop was blocked came late.
+    g_assert_cmpfloat (rstrnt_summary_quantile (summary, 1), >=, 0.1);
+
+    g_main_loop_unref (loop);
+    g_free (summary);
+}
+
+int
+main (int   argc,
+      char *argv[])
+{
+    g_test_init (&argc, &argv, NULL);
+
+    g_test_add_func ("/metrics/append", test_metrics_append);
+    g_test_add_func ("/metrics/summary", test_metrics_summary);
+    g_test_add_func ("/metrics/summary_window", test_metrics_summary_window);
+    g_test_add_func ("/metrics/histogram", test_metrics_histogram);
+    g_test_add_func ("/metrics/probe_loop", test_metrics_probe_loop);
+
+    return g_test_run ();
+}
@@ -0,0 +1,120 @@
+/*
+    This file is part of Restraint.
+
+    Restraint is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Restraint is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Restraint.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <glib.h>
+
+// Leave linger alone on the machine running the tests
+#define LOGINCTL "rstrnt-test-no-loginctl"
+#include "preamble.c"
+
+static guint
+env_count (GPtrArray *env, const gchar *name)
+{
+    guint count = 0;
+
+    for (guint i = 0; i < env->len; i++) {
+        if (g_str_has_prefix (env->pdata[i], name) &&
+            ((gchar *) env->pdata[i])[strlen (name)] == '=') {
+            count++;
+        }
+    }
+    return count;
+}
+
+static void
+test_preamble_os_major (void)
+{
+    gchar *os_major;
+
+    os_major = rstrnt_preamble_os_major ("Red Hat Enterprise Linux release 9.2 (Plow)\n");
+    g_assert_cmpstr (os_major, ==, "RedHatEnterpriseLinux9");
+    g_free (os_major);
+
+    os_major = rstrnt_preamble_os_major ("Fedora release 39 (Thirty Nine)");
+    g_assert_cmpstr (os_major, ==, "Fedora39");
+    g_free (os_major);
+
+    os_major = rstrnt_preamble_os_major ("CentOS Stream release 9\n");
+    g_assert_cmpstr (os_major, ==, "CentOSStream9");
+    g_free (os_major);
+
+    g_assert_null (rstrnt_preamble_os_major ("Debian GNU/Linux 12"));
+}
+
+static void
+linger_not_done (gpointer user_data)
+{
+    g_assert_not_reached ();
+}
+
+static void
+test_preamble_env (void)
+{
+    GPtrArray *env = g_ptr_array_new_with_free_func (g_free);
+
+    g_ptr_array_add (env, g_strdup ("TESTID=42"));
+    g_ptr_array_add (env, g_strdup ("REBOOTCOUNT=1"));
+    g_ptr_array_add (env, g_strdup ("HOSTNAME="));
+    g_ptr_array_add (env, g_strdup ("RSTRNT_OSARCH=s390x"));
+    g_ptr_array_add (env, g_strdup ("BEAKERLIB_COMMAND_SUBMIT_LOG=/bin/false"));
+
+    rstrnt_preamble_env (env);
+
+    // Only empty or missing variables get a default
+    g_assert_cmpstr (env_get (env, "HOSTNAME"), ==, g_get_host_name ());
+    g_assert_cmpstr (env_get (env, "RSTRNT_OSARCH"), ==, "s390x");
+    g_assert_cmpuint (env_count (env, "HOSTNAME"), ==, 1);
+
+    g_assert_cmpstr (env_get (env, "BEAKERLIB_COMMAND_REPORT_RESULT"), ==,
+                     "/usr/bin/rstrnt-report-result --rhts");
+    g_assert_cmpstr (env_get (env, "BEAKERLIB_COMMAND_SUBMIT_LOG"), ==,
+                     "/usr/bin/rstrnt-report-log");
+    g_assert_cmpuint (env_count (env, "BEAKERLIB_COMMAND_SUBMIT_LOG"), ==, 1);
+
+    // There is no loginctl to enable linger with, nor anything to wait for
+    g_assert_null (env_get (env, "XDG_RUNTIME_DIR"));
+    g_assert_false (rstrnt_preamble_linger (env, linger_not_done, NULL));
+    g_assert_cmpstr (env_get (env, "RSTRNT_NATIVE_PLUGINS"), ==, PREAMBLE_PLUGINS);
+
+    g_ptr_array_free (env, TRUE);
+}
+
+static void
+test_preamble_get (void)
+{
+    const ProcessPreamble *task = rstrnt_preamble_get (FALSE);
+    const ProcessPreamble *plugins = rstrnt_preamble_get (TRUE);
+
+    g_assert_true (task->setsid);
+    g_assert_true (task->reset_oom_score);
+    g_assert_true (plugins->setsid);
+    g_assert_false (plugins->reset_oom_score);
+    g_assert_true (task->exec_context == plugins->exec_context);
+}
+
+int
+main (int   argc,
+      char *argv[])
+{
+    g_test_init (&argc, &argv, NULL);
+
+    g_test_add_func ("/preamble/os_major", test_preamble_os_major);
+    g_test_add_func ("/preamble/env", test_preamble_env);
+    g_test_add_func ("/preamble/get", test_preamble_get);
+
+    return g_test_run ();
+}
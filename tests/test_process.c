@@ -17,7 +17,13 @@
 
 #include <glib.h>
 #include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/wait.h>
 
+#include "common.h"
 #include "process.h"
 #include "errors.h"
 
@@ -94,6 +100,8 @@ static void test_process_success(void) {
                  0,
                  FALSE,
                  NULL,
+                 NULL,
+                 NULL,
                  run_data);
 
     // run event loop while process is running.
@@ -125,6 +133,8 @@ static void test_process_failure(void) {
                  0,
                  FALSE,
                  NULL,
+                 NULL,
+                 NULL,
                  run_data);
 
     // run event loop while process is running.
@@ -158,6 +168,8 @@ static void test_watchdog_success(void) {
                  0,
                  FALSE,
                  NULL,
+                 NULL,
+                 NULL,
                  run_data);
 
     // run event loop while process is running.
@@ -193,6 +205,8 @@ static void test_watchdog_failure(void) {
                  0,
                  FALSE,
                  NULL,
+                 NULL,
+                 NULL,
                  run_data);
 
     // run event loop while process is running.
@@ -240,6 +254,8 @@ static void test_no_hang(void) {
                  0,
                  FALSE,
                  NULL,
+                 NULL,
+                 NULL,
                  run_data);
 
     guint toid = g_timeout_add(20000, hang_quit_loop, run_data);
@@ -292,6 +308,8 @@ static void test_use_pty(void) {
                  0,
                  FALSE,
                  NULL,
+                 NULL,
+                 NULL,
                  run_data);
 
     // run event loop while process is running.
@@ -329,6 +347,8 @@ static void test_dont_use_pty(void) {
                  0,
                  FALSE,
                  NULL,
+                 NULL,
+                 NULL,
                  run_data);
 
     // run event loop while process is running.
@@ -372,6 +392,8 @@ test_process_read_empty_stdin (void)
                  0,
                  FALSE,
                  NULL,
+                 NULL,
+                 NULL,
                  run_data);
 
     g_main_loop_run (run_data->loop);
@@ -416,6 +438,8 @@ test_process_read_content_input (void)
                  strlen (expected),
                  FALSE,
                  NULL,
+                 NULL,
+                 NULL,
                  run_data);
 
     g_main_loop_run (run_data->loop);
@@ -458,6 +482,8 @@ test_process_read_empty_stdin_pty (void)
                  0,
                  FALSE,
                  NULL,
+                 NULL,
+                 NULL,
                  run_data);
 
     g_main_loop_run (run_data->loop);
@@ -472,6 +498,280 @@ test_process_read_empty_stdin_pty (void)
     g_slice_free (RunData, run_data);
 }
 
+static void
+run_command (RunData *run_data, const gchar *command, const gchar *path)
+{
+    run_data->loop = g_main_loop_new (NULL, TRUE);
+    run_data->output = g_string_new (NULL);
+
+    process_run (command,
+                 NULL,
+                 path,
+                 FALSE,
+                 10,
+                 NULL,
+                 test_process_io_cb,
+                 test_process_finish_cb,
+                 NULL,
+                 0,
+                 FALSE,
+                 NULL,
+                 NULL,
+                 NULL,
+                 run_data);
+
+    g_main_loop_run (run_data->loop);
+}
+
+/* Only stdin, stdout and stderr are passed on, leaked fds are closed. */
+static void
+test_process_no_inherited_fds (void)
+{
+    RunData *run_data = g_slice_new0 (RunData);
+    gint leaked = open ("/dev/null", O_RDONLY);
+
+    g_assert_cmpint (leaked, >=, 3);
+    // ls itself has the directory open as fd 3.
+    run_command (run_data, "ls /proc/self/fd", NULL);
+
+    g_assert_no_error (run_data->error);
+    g_assert_cmpint (run_data->pid_result, ==, 0);
+    g_assert_cmpstr (run_data->output->str, ==,
+                     "use_pty:FALSE ls /proc/self/fd\n0\n1\n2\n3\n");
+
+    close (leaked);
+    g_string_free (run_data->output, TRUE);
+    g_slice_free (RunData, run_data);
+}
+
+static void
+test_process_exec_failure (void)
+{
+    RunData *run_data = g_slice_new0 (RunData);
+
+    run_command (run_data, "no-such-command --flag", NULL);
+
+    g_assert_no_error (run_data->error);
+    g_assert_true (WIFEXITED (run_data->pid_result));
+    g_assert_cmpint (WEXITSTATUS (run_data->pid_result), ==, SPAWN_COMMAND_FAILED);
+    g_assert_true (g_str_has_prefix (run_data->output->str,
+                                     "use_pty:FALSE no-such-command --flag\n"));
+    g_assert_nonnull (strstr (run_data->output->str,
+                              "Failed to exec() no-such-command"));
+
+    g_string_free (run_data->output, TRUE);
+    g_slice_free (RunData, run_data);
+}
+
+static void
+test_process_chdir_failure (void)
+{
+    RunData *run_data = g_slice_new0 (RunData);
+
+    run_command (run_data, "true", "/nonexistent/path");
+
+    g_assert_no_error (run_data->error);
+    g_assert_true (WIFEXITED (run_data->pid_result));
+    g_assert_cmpint (WEXITSTATUS (run_data->pid_result), ==, INVALID_COMMAND_PATH);
+    g_assert_nonnull (strstr (run_data->output->str,
+                              "Failed to chdir() to /nonexistent/path"));
+
+    g_string_free (run_data->output, TRUE);
+    g_slice_free (RunData, run_data);
+}
+
+/* Signals ignored by restraintd are not ignored by what it runs. */
+static void
+test_process_signals_reset (void)
+{
+    RunData *run_data = g_slice_new0 (RunData);
+    void (*old_handler) (int) = signal (SIGPIPE, SIG_IGN);
+
+    // SigIgn is the mask of ignored signals, all zeros for none.
+    run_command (run_data, "grep -c ^SigIgn:.0*$ /proc/self/status", NULL);
+
+    g_assert_no_error (run_data->error);
+    g_assert_cmpstr (run_data->output->str, ==,
+                     "use_pty:FALSE grep -c ^SigIgn:.0*$ /proc/self/status\n1\n");
+
+    signal (SIGPIPE, old_handler);
+    g_string_free (run_data->output, TRUE);
+    g_slice_free (RunData, run_data);
+}
+
+static void
+test_process_fork_launcher (void)
+{
+    RunData *run_data = g_slice_new0 (RunData);
+
+    process_set_launcher (PROCESS_LAUNCHER_FORK);
+    run_command (run_data, "echo forked", "/");
+    process_set_launcher (PROCESS_LAUNCHER_SPAWN);
+
+    g_assert_no_error (run_data->error);
+    g_assert_cmpint (run_data->pid_result, ==, 0);
+    g_assert_cmpstr (run_data->output->str, ==,
+                     "use_pty:FALSE echo forked\nforked\n");
+
+    g_string_free (run_data->output, TRUE);
+    g_slice_free (RunData, run_data);
+}
+
+/* The pid is gone or a zombie waiting for init. */
+static gboolean
+process_gone (pid_t pid)
+{
+    g_autofree gchar *stat_path = g_strdup_printf ("/proc/%d/stat", pid);
+    g_autofree gchar *stat = NULL;
+    gchar *state;
+
+    for (guint i = 0; i < 50; i++) {
+        if (!g_file_get_contents (stat_path, &stat, NULL, NULL)) {
+            return TRUE;
+        }
+        state = strrchr (stat, ')');
+        if (state != NULL && g_str_has_prefix (state, ") Z")) {
+            return TRUE;
+        }
+        g_clear_pointer (&stat, g_free);
+        g_usleep (G_USEC_PER_SEC / 10);
+    }
+    return FALSE;
+}
+
+/* The localwatchdog kills what the command left running too. */
+static void
+assert_watchdog_kills_group (gboolean use_pty)
+{
+    RunData *run_data = g_slice_new0 (RunData);
+    gchar **lines;
+    gint64 sleeper;
+
+    run_data->loop = g_main_loop_new (NULL, TRUE);
+    run_data->output = g_string_new (NULL);
+
+    process_run ("leave_sleeper", NULL, NULL, use_pty, 1, NULL,
+                 test_process_io_cb, test_process_finish_cb, NULL, 0,
+                 FALSE, NULL, NULL, NULL, run_data);
+    g_main_loop_run (run_data->loop);
+
+    g_assert_no_error (run_data->error);
+    g_assert_true (run_data->localwatchdog);
+    lines = g_strsplit (run_data->output->str, "\n", -1);
+    g_assert_cmpuint (g_strv_length (lines), >=, 2);
+    sleeper = g_ascii_strtoll (g_strstrip (lines[1]), NULL, 10);
+    g_assert_cmpint (sleeper, >, 0);
+    g_assert_true (process_gone (sleeper));
+
+    g_strfreev (lines);
+    g_string_free (run_data->output, TRUE);
+    g_slice_free (RunData, run_data);
+}
+
+/* What the command left running goes with it when it exits by itself. */
+static void
+assert_exit_kills_group (gboolean use_pty)
+{
+    RunData *run_data = g_slice_new0 (RunData);
+    gchar **lines;
+    gint64 sleeper;
+
+    run_data->loop = g_main_loop_new (NULL, TRUE);
+    run_data->output = g_string_new (NULL);
+
+    process_run ("leave_stray", NULL, NULL, use_pty, 0, NULL,
+                 test_process_io_cb, test_process_finish_cb, NULL, 0,
+                 FALSE, NULL, NULL, NULL, run_data);
+    g_main_loop_run (run_data->loop);
+
+    g_assert_no_error (run_data->error);
+    g_assert_false (run_data->localwatchdog);
+    g_assert_cmpint (run_data->pid_result, ==, 0);
+    lines = g_strsplit (run_data->output->str, "\n", -1);
+    g_assert_cmpuint (g_strv_length (lines), >=, 2);
+    sleeper = g_ascii_strtoll (g_strstrip (lines[1]), NULL, 10);
+    g_assert_cmpint (sleeper, >, 0);
+    g_assert_true (process_gone (sleeper));
+
+    g_strfreev (lines);
+    g_string_free (run_data->output, TRUE);
+    g_slice_free (RunData, run_data);
+}
+
+static void
+test_process_exit_kills_group (void)
+{
+    assert_exit_kills_group (FALSE);
+}
+
+static void
+test_process_exit_kills_session (void)
+{
+    assert_exit_kills_group (TRUE);
+}
+
+static void
+test_process_watchdog_kills_group (void)
+{
+    assert_watchdog_kills_group (FALSE);
+}
+
+static void
+test_process_watchdog_kills_session (void)
+{
+    assert_watchdog_kills_group (TRUE);
+}
+
+static void
+test_process_fork_launcher_group (void)
+{
+    process_set_launcher (PROCESS_LAUNCHER_FORK);
+    assert_watchdog_kills_group (FALSE);
+    process_set_launcher (PROCESS_LAUNCHER_SPAWN);
+}
+
+static void
+test_process_splice (void)
+{
+    gchar template[] = "test_process_splice_XXXXXX";
+    g_autofree gchar *contents = NULL;
+    gchar teed[32] = { 0 };
+    gint output[2];
+    gint tee[2];
+    gint log_fd;
+
+    g_assert_cmpint (pipe (output), ==, 0);
+    g_assert_cmpint (pipe (tee), ==, 0);
+    fcntl (output[0], F_SETFL, O_NONBLOCK);
+    log_fd = g_mkstemp (template);
+    g_assert_cmpint (log_fd, !=, -1);
+
+    // Nothing waiting yet
+    g_assert_cmpint (process_splice (output[0], log_fd, -1, SPLICE_BUFFER_SIZE), ==, -1);
+    g_assert_cmpint (errno, ==, EAGAIN);
+
+    g_assert_cmpint (write (output[1], "forked\n", 7), ==, 7);
+    g_assert_cmpint (process_splice (output[0], log_fd, -1, SPLICE_BUFFER_SIZE), ==, 7);
+
+    // Teed bytes are moved too, and only once
+    g_assert_cmpint (write (output[1], "teed\n", 5), ==, 5);
+    g_assert_cmpint (process_splice (output[0], log_fd, tee[1], IO_BUFFER_SIZE - 1), ==, 5);
+    g_assert_cmpint (read (tee[0], teed, sizeof (teed) - 1), ==, 5);
+    g_assert_cmpstr (teed, ==, "teed\n");
+
+    close (output[1]);
+    g_assert_cmpint (process_splice (output[0], log_fd, -1, SPLICE_BUFFER_SIZE), ==, 0);
+
+    g_assert_true (g_file_get_contents (template, &contents, NULL, NULL));
+    g_assert_cmpstr (contents, ==, "forked\nteed\n");
+
+    close (output[0]);
+    close (tee[0]);
+    close (tee[1]);
+    close (log_fd);
+    unlink (template);
+}
+
 int main(int argc, char *argv[]) {
     g_test_init(&argc, &argv, NULL);
     g_test_add_func("/process/success", test_process_success);
@@ -485,6 +785,17 @@ int main(int argc, char *argv[]) {
     g_test_add_func ("/process/read_content_input", test_process_read_content_input);
     g_test_add_func ("/process/read_empty_stdin", test_process_read_empty_stdin);
     g_test_add_func ("/process/read_empty_stdin_pty", test_process_read_empty_stdin_pty);
+    g_test_add_func ("/process/no_inherited_fds", test_process_no_inherited_fds);
+    g_test_add_func ("/process/exec_failure", test_process_exec_failure);
+    g_test_add_func ("/process/chdir_failure", test_process_chdir_failure);
+    g_test_add_func ("/process/signals_reset", test_process_signals_reset);
+    g_test_add_func ("/process/fork_launcher", test_process_fork_launcher);
+    g_test_add_func ("/process/watchdog_kills_group", test_process_watchdog_kills_group);
+    g_test_add_func ("/process/watchdog_kills_session", test_process_watchdog_kills_session);
+    g_test_add_func ("/process/fork_launcher_group", test_process_fork_launcher_group);
+    g_test_add_func ("/process/exit_kills_group", test_process_exit_kills_group);
+    g_test_add_func ("/process/exit_kills_session", test_process_exit_kills_session);
+    g_test_add_func ("/process/splice", test_process_splice);
 
     return g_test_run();
 }
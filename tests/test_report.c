@@ -0,0 +1,121 @@
+/*
+    This file is part of Restraint.
+
+    Restraint is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Restraint is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Restraint.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <libxml/parser.h>
+
+#include "report.h"
+
+static gchar *tmp_test_dir = NULL;
+
+/*
+ * The expected files are what xsltproc makes of the job with
+ * client/job2html.xml and client/job2junit.xml.
+ */
+static void
+assert_reports (const gchar *name)
+{
+    g_autoptr (GError) err = NULL;
+    g_autofree gchar *job = g_strdup_printf ("./test-data/report/%s.xml", name);
+    g_autofree gchar *expected_html = g_strdup_printf ("./test-data/report/%s.html", name);
+    g_autofree gchar *expected_junit = g_strdup_printf ("./test-data/report/%s.junit.xml", name);
+    g_autofree gchar *html = g_build_filename (tmp_test_dir, "index.html", NULL);
+    g_autofree gchar *junit = g_build_filename (tmp_test_dir, "junit.xml", NULL);
+    g_autofree gchar *expected = NULL;
+    g_autofree gchar *contents = NULL;
+    gsize expected_length;
+    gsize length;
+    xmlDocPtr doc;
+
+    // Parsed the way the client reads job.xml.
+    doc = xmlReadFile (job, NULL, XML_PARSE_NOBLANKS);
+    g_assert_nonnull (doc);
+
+    g_assert_true (rstrnt_report_write_html (doc, html, &err));
+    g_assert_no_error (err);
+    g_assert_true (g_file_get_contents (html, &contents, &length, NULL));
+    g_assert_true (g_file_get_contents (expected_html, &expected,
+                                        &expected_length, NULL));
+    g_assert_cmpstr (contents, ==, expected);
+    g_clear_pointer (&contents, g_free);
+    g_clear_pointer (&expected, g_free);
+
+    g_assert_true (rstrnt_report_write_junit (doc, junit, &err));
+    g_assert_no_error (err);
+    g_assert_true (g_file_get_contents (junit, &contents, &length, NULL));
+    g_assert_true (g_file_get_contents (expected_junit, &expected,
+                                        &expected_length, NULL));
+    g_assert_cmpstr (contents, ==, expected);
+
+    g_remove (html);
+    g_remove (junit);
+    xmlFreeDoc (doc);
+}
+
+static void
+test_report_job (void)
+{
+    assert_reports ("job");
+}
+
+/*
+ * Quotes, markup, tabs, newlines, non-ASCII and "]]>" in names and paths,
+ * and durations which need more than two digits or have fractions.
+ */
+static void
+test_report_escaping (void)
+{
+    assert_reports ("escaping");
+}
+
+static void
+test_report_unwritable (void)
+{
+    g_autoptr (GError) err = NULL;
+    g_autofree gchar *filename = g_build_filename (tmp_test_dir, "missing",
+                                                   "index.html", NULL);
+    xmlDocPtr doc = xmlReadFile ("./test-data/report/job.xml", NULL,
+                                 XML_PARSE_NOBLANKS);
+
+    g_assert_false (rstrnt_report_write_html (doc, filename, &err));
+    g_assert_error (err, G_FILE_ERROR, G_FILE_ERROR_NOENT);
+
+    xmlFreeDoc (doc);
+}
+
+int
+main (int   argc,
+      char *argv[])
+{
+    gboolean success;
+
+    tmp_test_dir = g_dir_make_tmp ("test_report_XXXXXX", NULL);
+
+    g_test_init (&argc, &argv, NULL);
+
+    g_test_add_func ("/report/job", test_report_job);
+    g_test_add_func ("/report/escaping", test_report_escaping);
+    g_test_add_func ("/report/unwritable", test_report_unwritable);
+
+    success = g_test_run ();
+
+    g_rmdir (tmp_test_dir);
+    g_free (tmp_test_dir);
+
+    return success;
+}
@@ -0,0 +1,159 @@
+/*
+    This file is part of Restraint.
+
+    Restraint is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Restraint is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Restraint.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <string.h>
+
+#include "retention.h"
+
+static void
+test_retention_under_budget (void)
+{
+    RstrntRetention *retention = rstrnt_retention_new (10, 4, 0);
+    gsize length;
+
+    g_assert_cmpuint (rstrnt_retention_feed (retention, "hello", 5), ==, 5);
+    g_assert_cmpuint (rstrnt_retention_feed (retention, "world", 5), ==, 5);
+    g_assert_null (rstrnt_retention_finish (retention, &length));
+    g_assert_cmpuint (length, ==, 0);
+
+    rstrnt_retention_free (retention);
+}
+
+static void
+test_retention_head_and_tail (void)
+{
+    RstrntRetention *retention = rstrnt_retention_new (4, 6, 0);
+    gchar *kept;
+    gsize length;
+
+    // The head is passed on as soon as it is logged.
+    g_assert_cmpuint (rstrnt_retention_feed (retention, "abcdef", 6), ==, 4);
+    // The tail rolls, over the end of the ring and then a write larger
+    // than all of it.
+    g_assert_cmpuint (rstrnt_retention_feed (retention, "ghij", 4), ==, 0);
+    g_assert_cmpuint (rstrnt_retention_feed (retention, "klm", 3), ==, 0);
+    g_assert_cmpuint (rstrnt_retention_dropped (retention), ==, 3);
+    g_assert_cmpuint (rstrnt_retention_feed (retention, "nopqrstu", 8), ==, 0);
+    g_assert_cmpuint (rstrnt_retention_dropped (retention), ==, 11);
+
+    kept = rstrnt_retention_finish (retention, &length);
+    g_assert_nonnull (kept);
+    g_assert_cmpuint (length, ==, strlen (kept));
+    g_assert_nonnull (strstr (kept, " 11 bytes of output dropped"));
+    g_assert_true (g_str_has_suffix (kept, "\npqrstu"));
+    g_free (kept);
+
+    // Anything after the end goes straight through.
+    g_assert_cmpuint (rstrnt_retention_feed (retention, "vwxyz", 5), ==, 5);
+
+    rstrnt_retention_free (retention);
+}
+
+static void
+test_retention_no_tail (void)
+{
+    RstrntRetention *retention = rstrnt_retention_new (4, 0, 0);
+    gchar *kept;
+    gsize length;
+
+    g_assert_cmpuint (rstrnt_retention_feed (retention, "abcdef", 6), ==, 4);
+    kept = rstrnt_retention_finish (retention, &length);
+    g_assert_true (g_str_has_suffix (kept, "the last 0 bytes follow ***\n"));
+    g_free (kept);
+
+    rstrnt_retention_free (retention);
+}
+
+static void
+test_retention_resumed (void)
+{
+    // After a reboot what is already in the log counts against the head.
+    RstrntRetention *retention = rstrnt_retention_new (8, 4, 6);
+    gchar *kept;
+    gsize length;
+
+    g_assert_cmpuint (rstrnt_retention_feed (retention, "abcd", 4), ==, 2);
+    kept = rstrnt_retention_finish (retention, &length);
+    g_assert_cmpstr (kept, ==, "cd");
+    g_assert_cmpuint (rstrnt_retention_dropped (retention), ==, 0);
+    g_free (kept);
+
+    rstrnt_retention_free (retention);
+}
+
+static void
+test_retention_saved (void)
+{
+    gchar *dir = g_dir_make_tmp ("test_retention_XXXXXX", NULL);
+    gchar *log_dir = g_build_filename (dir, "42", NULL);
+    gchar *path = g_build_filename (log_dir, "task.tail", NULL);
+    RstrntRetention *retention = rstrnt_retention_new_saved (4, 6, 0, path);
+    gchar *kept;
+    gsize length;
+
+    // Nothing is saved while the log is within its head
+    g_assert_cmpuint (rstrnt_retention_feed (retention, "ab", 2), ==, 2);
+    g_assert_false (g_file_test (log_dir, G_FILE_TEST_EXISTS));
+
+    g_assert_cmpuint (rstrnt_retention_feed (retention, "cdefghijk", 9), ==, 2);
+    g_assert_cmpuint (rstrnt_retention_dropped (retention), ==, 1);
+    // Freed without finishing, as when restraintd goes down for a reboot
+    rstrnt_retention_free (retention);
+    g_assert_true (g_file_test (path, G_FILE_TEST_EXISTS));
+
+    // The head was logged before the reboot, the tail picks up again
+    retention = rstrnt_retention_new_saved (4, 6, 4, path);
+    g_assert_cmpuint (rstrnt_retention_dropped (retention), ==, 1);
+    g_assert_cmpuint (rstrnt_retention_feed (retention, "lm", 2), ==, 0);
+    kept = rstrnt_retention_finish (retention, &length);
+    g_assert_nonnull (strstr (kept, " 3 bytes of output dropped"));
+    g_assert_true (g_str_has_suffix (kept, "\nhijklm"));
+    g_free (kept);
+    rstrnt_retention_free (retention);
+    g_assert_false (g_file_test (path, G_FILE_TEST_EXISTS));
+
+    // A log still within its head starts over
+    g_assert_true (g_file_set_contents (path, "stale", -1, NULL));
+    retention = rstrnt_retention_new_saved (4, 6, 2, path);
+    g_assert_false (g_file_test (path, G_FILE_TEST_EXISTS));
+    g_assert_cmpuint (rstrnt_retention_feed (retention, "ab", 2), ==, 2);
+    g_assert_null (rstrnt_retention_finish (retention, &length));
+    rstrnt_retention_free (retention);
+
+    g_rmdir (log_dir);
+    g_rmdir (dir);
+    g_free (path);
+    g_free (log_dir);
+    g_free (dir);
+}
+
+int
+main (int   argc,
+      char *argv[])
+{
+    g_test_init (&argc, &argv, NULL);
+
+    g_test_add_func ("/retention/under_budget", test_retention_under_budget);
+    g_test_add_func ("/retention/head_and_tail", test_retention_head_and_tail);
+    g_test_add_func ("/retention/no_tail", test_retention_no_tail);
+    g_test_add_func ("/retention/resumed", test_retention_resumed);
+    g_test_add_func ("/retention/saved", test_retention_saved);
+
+    return g_test_run ();
+}
@@ -0,0 +1,113 @@
+/*
+    This file is part of Restraint.
+
+    Restraint is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Restraint is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Restraint.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "stall.c"
+
+static void
+test_stall_culprit (void)
+{
+    gchar *libraries[] = {
+        "/lib64/libc.so.6(clock_nanosleep+0x61) [0x7f0e2b2d4a51]",
+        "/lib64/libglib-2.0.so.0(g_usleep+0x3d) [0x7f0e2b4bc0fd]",
+    };
+    gchar *exported[] = {
+        "/lib64/libglib-2.0.so.0(g_usleep+0x3d) [0x7f0e2b4bc0fd]",
+        "restraintd(task_handler+0x1c2) [0x40a3f2]",
+        "restraintd(main+0x51) [0x404061]",
+    };
+    gchar *unexported[] = {
+        "/lib64/libglib-2.0.so.0(g_usleep+0x3d) [0x7f0e2b4bc0fd]",
+        "restraintd(+0x1a3f2) [0x41a3f2]",
+    };
+    gchar *culprit;
+
+    g_assert_null (stall_culprit (libraries, G_N_ELEMENTS (libraries)));
+
+    culprit = stall_culprit (exported, G_N_ELEMENTS (exported));
+    g_assert_cmpstr (culprit, ==, "task_handler");
+    g_free (culprit);
+
+    culprit = stall_culprit (unexported, G_N_ELEMENTS (unexported));
+    g_assert_cmpstr (culprit, ==, "restraintd(+0x1a3f2)");
+    g_free (culprit);
+}
+
+static gboolean
+stall_loop (gpointer user_data)
+{
+    g_usleep (G_USEC_PER_SEC / 5);
+    return G_SOURCE_REMOVE;
+}
+
+static gboolean
+quit_loop (gpointer user_data)
+{
+    g_main_loop_quit (user_data);
+    return G_SOURCE_REMOVE;
+}
+
+static void
+test_stall_off (void)
+{
+    struct sigaction action;
+
+    // A threshold of 0 leaves the signal handler out altogether
+    rstrnt_stall_monitor_start (0, "test");
+    g_assert_null (stall_histogram);
+    g_assert_cmpint (sigaction (STALL_SIGNAL, NULL, &action), ==, 0);
+    g_assert_true (action.sa_handler == SIG_DFL);
+}
+
+static void
+test_stall_monitor (void)
+{
+    GMainLoop *loop = g_main_loop_new (NULL, FALSE);
+    GString *out = g_string_new (NULL);
+
+    rstrnt_stall_monitor_start (50, "test");
+
+    g_source_set_name_by_id (g_idle_add (stall_loop, NULL), "stall_loop");
+    g_timeout_add (400, quit_loop, loop);
+
+    g_test_expect_message (G_LOG_DOMAIN, G_LOG_LEVEL_WARNING,
+                           "Main loop stalled for * in source stall_loop, at *");
+    g_main_loop_run (loop);
+    g_test_assert_expected_messages ();
+
+    g_assert_cmpuint (stall_histogram->count, >=, 1);
+    g_assert_cmpuint (g_hash_table_size (stall_counts), ==, 1);
+
+    rstrnt_stall_append_metrics (out, "test");
+    g_assert_nonnull (strstr (out->str, "test_main_loop_iteration_seconds_bucket{le=\"+Inf\"}"));
+    g_assert_nonnull (strstr (out->str, "test_main_loop_stalls_total{in=\"stall_loop\"}"));
+
+    g_string_free (out, TRUE);
+    g_main_loop_unref (loop);
+}
+
+int
+main (int   argc,
+      char *argv[])
+{
+    g_test_init (&argc, &argv, NULL);
+
+    g_test_add_func ("/stall/culprit", test_stall_culprit);
+    g_test_add_func ("/stall/off", test_stall_off);
+    g_test_add_func ("/stall/monitor", test_stall_monitor);
+
+    return g_test_run ();
+}
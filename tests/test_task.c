@@ -69,6 +69,105 @@ test_parse_task_config_file_exists (void)
     restraint_task_free (task);
 }
 
+static void
+test_parse_task_config_phases (void)
+{
+    Task   *task;
+    GError *err = NULL;
+
+    task = restraint_task_new ();
+    task->task_id = g_strdup ("43");
+
+    g_assert_true (parse_task_config ("test-data/task43.conf", task, &err));
+    g_assert_no_error (err);
+
+    // Unknown phases are skipped.
+    g_assert_cmpint (task->phase_usec[TASK_PHASE_FETCH], ==, 1500000);
+    g_assert_cmpint (task->phase_usec[TASK_PHASE_RUN], ==, 60000000);
+    g_assert_cmpint (task->phase_usec[TASK_PHASE_UPLOAD], ==, 0);
+
+    restraint_task_free (task);
+}
+
+
+static void
+test_task_phases (void)
+{
+    gint64 phase_usec[TASK_PHASES] = { 0 };
+    gint64 restored[TASK_PHASES] = { 0 };
+    gchar *formatted;
+    gchar *value;
+
+    phase_usec[TASK_PHASE_FETCH] = 1234567;
+    phase_usec[TASK_PHASE_RUN] = 42000;
+    phase_usec[TASK_PHASE_BEAKER_WAIT] = 60000000;
+
+    // Phases that took no time are left out.
+    formatted = restraint_task_phases_format (phase_usec);
+    g_assert_cmpstr (formatted, ==, "fetch=1234ms run=42ms beaker_wait=60000ms");
+
+    value = task_phases_to_config (phase_usec);
+    task_phases_from_config (value, restored);
+    for (gint i = 0; i < TASK_PHASES; i++) {
+        g_assert_cmpint (restored[i], ==, phase_usec[i]);
+    }
+
+    g_free (value);
+    g_free (formatted);
+}
+
+static void
+test_task_phase_charge (void)
+{
+    Task *task = restraint_task_new ();
+
+    // Nothing is charged until a state has been seen.
+    task->state = TASK_FETCH;
+    task_phase_charge (task);
+    g_assert_cmpint (task->phase_usec[TASK_PHASE_FETCH], ==, 0);
+
+    g_usleep (1000);
+    task->state = TASK_COMPLETED;
+    task_phase_charge (task);
+    g_assert_cmpint (task->phase_usec[TASK_PHASE_FETCH], >=, 1000);
+
+    // The upload is charged once we move on.
+    task->state = TASK_NEXT;
+    task_phase_charge (task);
+    g_assert_cmpint (task->phase_usec[TASK_PHASE_UPLOAD], >, 0);
+
+    restraint_task_free (task);
+}
+
+static void
+test_task_phases_checkpoint (void)
+{
+    AppData app_data = { 0 };
+    Task *task = restraint_task_new ();
+    gint64 saved[TASK_PHASES] = { 0 };
+    gchar *value;
+
+    app_data.config_file = g_build_filename (tmp_test_dir, "checkpoint.conf", NULL);
+    task->task_id = g_strdup ("43");
+
+    task->state = TASK_RUN;
+    task_phase_charge (task);
+    g_usleep (1000);
+
+    // The run so far is saved, in case we reboot, and is still timed.
+    task_phases_checkpoint (&app_data, task);
+    g_assert_cmpint (task->phase_usec[TASK_PHASE_RUN], >=, 1000);
+    g_assert_cmpint (task->timed_state, ==, TASK_RUN);
+    value = restraint_config_get_string (app_data.config_file, "43",
+                                         "phases", NULL);
+    task_phases_from_config (value, saved);
+    g_assert_cmpint (saved[TASK_PHASE_RUN], ==, task->phase_usec[TASK_PHASE_RUN]);
+
+    g_remove (app_data.config_file);
+    g_free (app_data.config_file);
+    g_free (value);
+    restraint_task_free (task);
+}
 
 static void
 test_parse_task_config_no_file (void)
@@ -353,13 +452,529 @@ test_param_override_use_pty (gconstpointer user_data)
     g_assert_true (metadata.use_pty == test_case->expected);
 }
 
+static Task *
+snapshot_test_task (Recipe *recipe, const gchar *task_id)
+{
+    Task *task = restraint_task_new ();
+    Param *param = restraint_param_new ();
+
+    task->recipe = recipe;
+    task->task_id = g_strdup (task_id);
+    task->name = g_strdup ("/distribution/check-install");
+    task->path = g_strdup ("/mnt/tests/example.com/check-install");
+    task->fetch_method = TASK_FETCH_UNPACK;
+    task->fetch.url = soup_uri_new ("https://example.com/check-install.tgz#check-install");
+    task->ssl_verify = TRUE;
+    param->name = g_strdup ("KILLTIMEOVERRIDE");
+    param->value = g_strdup ("300");
+    task->params = g_list_append (task->params, param);
+
+    return task;
+}
+
+static void
+test_recipe_snapshot (void)
+{
+    const gchar *recipe_url = "http://lab.example.com:8000/recipes/10/";
+    g_autofree gchar *filename = g_build_filename (tmp_test_dir, "recipe.snapshot", NULL);
+    GError *err = NULL;
+    Recipe *recipe = g_slice_new0 (Recipe);
+    Recipe *loaded;
+    Task *task;
+    Role *role = restraint_role_new ();
+    g_autofree gchar *url = NULL;
+
+    recipe->recipe_id = g_strdup ("10");
+    recipe->osmajor = g_strdup ("RedHatEnterpriseLinux8");
+    recipe->base_path = g_strdup ("/mnt/tests");
+    recipe->recipe_uri = soup_uri_new (recipe_url);
+    role->value = g_strdup ("SERVERS");
+    role->systems = g_strdup ("host1 host2");
+    recipe->roles = g_list_append (recipe->roles, role);
+    task = snapshot_test_task (recipe, "1");
+    task->started = TRUE;
+    task->finished = TRUE;
+    recipe->tasks = g_list_append (recipe->tasks, task);
+    task = snapshot_test_task (recipe, "2");
+    task->fetch_method = TASK_FETCH_INSTALL_PACKAGE;
+    soup_uri_free (task->fetch.url);
+    task->fetch.package_name = g_strdup ("restraint-rhts");
+    task->order = 2;
+    recipe->tasks = g_list_append (recipe->tasks, task);
+
+    g_assert_true (restraint_recipe_snapshot_save (recipe, recipe_url, filename, &err));
+    g_assert_no_error (err);
+    restraint_recipe_free (recipe);
+
+    loaded = restraint_recipe_snapshot_load (filename, recipe_url, &err);
+    g_assert_no_error (err);
+    g_assert_nonnull (loaded);
+    g_assert_cmpstr (loaded->recipe_id, ==, "10");
+    g_assert_cmpstr (loaded->osmajor, ==, "RedHatEnterpriseLinux8");
+    g_assert_null (loaded->job_id);
+    g_assert_cmpstr (loaded->base_path, ==, "/mnt/tests");
+    g_assert_cmpuint (g_list_length (loaded->roles), ==, 1);
+    role = loaded->roles->data;
+    g_assert_cmpstr (role->systems, ==, "host1 host2");
+    g_assert_cmpuint (g_list_length (loaded->tasks), ==, 2);
+
+    task = loaded->tasks->data;
+    g_assert_true (task->recipe == loaded);
+    g_assert_cmpstr (task->task_id, ==, "1");
+    url = soup_uri_to_string (task->task_uri, FALSE);
+    g_assert_cmpstr (url, ==, "http://lab.example.com:8000/recipes/10/tasks/1/");
+    g_assert_cmpint (task->fetch_method, ==, TASK_FETCH_UNPACK);
+    g_assert_cmpstr (task->fetch.url->fragment, ==, "check-install");
+    g_assert_cmpstr (task->path, ==, "/mnt/tests/example.com/check-install");
+    g_assert_true (task->ssl_verify);
+    g_assert_true (task->finished);
+    g_assert_cmpuint (g_list_length (task->params), ==, 1);
+    g_assert_cmpstr (((Param *) task->params->data)->value, ==, "300");
+
+    task = loaded->tasks->next->data;
+    g_assert_cmpint (task->fetch_method, ==, TASK_FETCH_INSTALL_PACKAGE);
+    g_assert_cmpstr (task->fetch.package_name, ==, "restraint-rhts");
+    g_assert_cmpint (task->order, ==, 2);
+    g_assert_false (task->started);
+    g_assert_false (task->finished);
+    restraint_recipe_free (loaded);
+
+    // A snapshot of another recipe is never resumed from.
+    loaded = restraint_recipe_snapshot_load (filename, "http://lab.example.com:8000/recipes/11/", &err);
+    g_assert_null (loaded);
+    g_assert_error (err, RESTRAINT_RECIPE_PARSE_ERROR, RESTRAINT_RECIPE_PARSE_ERROR_UNRECOGNISED);
+    g_clear_error (&err);
+
+    // Nor one that isn't a snapshot.
+    g_assert_true (g_file_set_contents (filename, "[restraint]\n", -1, NULL));
+    loaded = restraint_recipe_snapshot_load (filename, recipe_url, &err);
+    g_assert_null (loaded);
+    g_assert_nonnull (err);
+    g_clear_error (&err);
+
+    g_remove (filename);
+    loaded = restraint_recipe_snapshot_load (filename, recipe_url, &err);
+    g_assert_null (loaded);
+    g_assert_error (err, G_FILE_ERROR, G_FILE_ERROR_NOENT);
+    g_clear_error (&err);
+}
+
+#define ROLES_ETAG "\"796557-1\""
+
+typedef struct {
+    GMainLoop *loop;
+    guint requests;
+    guint not_modified;
+    gboolean modified;
+    GError *error;
+} RolesRefresh;
+
+static void
+roles_server_callback (SoupServer        *server,
+                       SoupMessage       *msg,
+                       const char        *path,
+                       GHashTable        *query,
+                       SoupClientContext *client,
+                       gpointer           user_data)
+{
+    RolesRefresh *refresh = user_data;
+    gchar *contents;
+    gsize length;
+
+    refresh->requests++;
+    if (g_strcmp0 (soup_message_headers_get_one (msg->request_headers, "If-None-Match"),
+                   ROLES_ETAG) == 0) {
+        refresh->not_modified++;
+        soup_message_set_status (msg, SOUP_STATUS_NOT_MODIFIED);
+        return;
+    }
+    g_assert_true (g_file_get_contents ("test-data/recipe.xml", &contents, &length, NULL));
+    soup_message_headers_replace (msg->response_headers, "ETag", ROLES_ETAG);
+    soup_message_set_response (msg, "text/xml", SOUP_MEMORY_TAKE, contents, length);
+    soup_message_set_status (msg, SOUP_STATUS_OK);
+}
+
+static void
+roles_refreshed_cb (GError *error, gboolean modified, gpointer user_data)
+{
+    RolesRefresh *refresh = user_data;
+
+    refresh->modified = modified;
+    refresh->error = error != NULL ? g_error_copy (error) : NULL;
+    g_main_loop_quit (refresh->loop);
+}
+
+static void
+test_recipe_refresh_roles (void)
+{
+    const gchar *task_ids[] = { "10722631", "10722632", "10722633", "10722634" };
+    RolesRefresh refresh = { .loop = g_main_loop_new (NULL, FALSE) };
+    SoupServer *server = soup_server_new (NULL, NULL);
+    Recipe *recipe = g_slice_new0 (Recipe);
+    GError *err = NULL;
+    GSList *uris;
+    gchar *url;
+    Task *task;
+    Role *role;
+
+    soup_server_add_handler (server, "/recipes/796557/", roles_server_callback,
+                             &refresh, NULL);
+    soup_server_listen_local (server, 0, SOUP_SERVER_LISTEN_IPV4_ONLY, &err);
+    g_assert_no_error (err);
+    uris = soup_server_get_uris (server);
+    url = g_strdup_printf ("http://127.0.0.1:%u/recipes/796557/",
+                           soup_uri_get_port (uris->data));
+    g_slist_free_full (uris, (GDestroyNotify) soup_uri_free);
+
+    recipe->recipe_id = g_strdup ("796557");
+    for (guint i = 0; i < G_N_ELEMENTS (task_ids); i++) {
+        recipe->tasks = g_list_append (recipe->tasks, snapshot_test_task (recipe, task_ids[i]));
+    }
+    role = restraint_role_new ();
+    role->value = g_strdup ("STANDALONE");
+    role->systems = g_strdup ("stale.example.com");
+    task = recipe->tasks->data;
+    task->roles = g_list_append (NULL, role);
+
+    restraint_recipe_refresh_roles (recipe, url, roles_refreshed_cb, &refresh);
+    g_main_loop_run (refresh.loop);
+    g_assert_no_error (refresh.error);
+    g_assert_true (refresh.modified);
+    g_assert_cmpstr (recipe->roles_validators.etag, ==, ROLES_ETAG);
+
+    g_assert_cmpuint (g_list_length (recipe->roles), ==, 1);
+    role = recipe->roles->data;
+    g_assert_cmpstr (role->value, ==, "SERVERS");
+    g_assert_cmpstr (role->systems, ==, "hostname1.example.com hostname2.example.com");
+    g_assert_cmpuint (g_list_length (task->roles), ==, 1);
+    role = task->roles->data;
+    g_assert_cmpstr (role->systems, ==, "hostname1.example.com hostname2.example.com");
+    task = recipe->tasks->next->data;
+    g_assert_null (task->roles);
+
+    // Unchanged, the recipe costs a 304 and the roles stay as they were
+    restraint_recipe_refresh_roles (recipe, url, roles_refreshed_cb, &refresh);
+    g_main_loop_run (refresh.loop);
+    g_assert_no_error (refresh.error);
+    g_assert_false (refresh.modified);
+    g_assert_cmpuint (refresh.requests, ==, 2);
+    g_assert_cmpuint (refresh.not_modified, ==, 1);
+    g_assert_cmpuint (g_list_length (recipe->roles), ==, 1);
+
+    restraint_recipe_free (recipe);
+    g_free (url);
+    soup_server_disconnect (server);
+    g_object_unref (server);
+    g_main_loop_unref (refresh.loop);
+}
+
+typedef struct {
+    SoupServer *server;
+    SoupMessage *msg;
+} HeldRefresh;
+
+static gboolean hosted_freed;
+
+static void
+held_server_callback (SoupServer        *server,
+                      SoupMessage       *msg,
+                      const char        *path,
+                      GHashTable        *query,
+                      SoupClientContext *client,
+                      gpointer           user_data)
+{
+    HeldRefresh *held = user_data;
+
+    held->msg = msg;
+    soup_server_pause_message (server, msg);
+}
+
+static void
+hosted_test_free (AppData *app_data)
+{
+    g_free (app_data->snapshot_file);
+    g_free (app_data->config_file);
+    g_clear_object (&app_data->cancellable);
+    g_slice_free (AppData, app_data);
+    hosted_freed = TRUE;
+}
+
+static void
+test_recipe_hosted_done (void)
+{
+    HeldRefresh held = { .server = soup_server_new (NULL, NULL) };
+    AppData *app_data = g_slice_new0 (AppData);
+    Recipe *recipe = g_slice_new0 (Recipe);
+    GError *err = NULL;
+    GSList *uris;
+    gchar *url;
+    gchar *contents;
+    gsize length;
+
+    soup_server_add_handler (held.server, "/recipes/10/", held_server_callback,
+                             &held, NULL);
+    soup_server_listen_local (held.server, 0, SOUP_SERVER_LISTEN_IPV4_ONLY, &err);
+    g_assert_no_error (err);
+    uris = soup_server_get_uris (held.server);
+    url = g_strdup_printf ("http://127.0.0.1:%u/recipes/10/",
+                           soup_uri_get_port (uris->data));
+    g_slist_free_full (uris, (GDestroyNotify) soup_uri_free);
+
+    app_data->hosted = TRUE;
+    app_data->ref_count = 1;
+    app_data->free_func = (GDestroyNotify) hosted_test_free;
+    app_data->hosted_done = restraint_app_data_unref;
+    app_data->cancellable = g_cancellable_new ();
+    app_data->recipe_url = g_strdup (url);
+    app_data->snapshot_file = g_build_filename (tmp_test_dir, "hosted.snapshot", NULL);
+    app_data->config_file = g_build_filename (tmp_test_dir, "hosted.conf", NULL);
+
+    recipe->recipe_id = g_strdup ("10");
+    recipe->base_path = g_strdup ("/mnt/tests");
+    recipe->recipe_uri = soup_uri_new (url);
+    recipe->tasks = g_list_append (recipe->tasks, snapshot_test_task (recipe, "1"));
+    g_assert_true (restraint_recipe_snapshot_save (recipe, url, app_data->snapshot_file, &err));
+    g_assert_no_error (err);
+    restraint_recipe_free (recipe);
+
+    // Resuming asks the lab controller for the recipe, which is held back
+    app_data->state = RECIPE_RESUME;
+    recipe_handler (app_data);
+    g_assert_cmpint (app_data->state, ==, RECIPE_RUN);
+    while (held.msg == NULL) {
+        g_main_context_iteration (NULL, TRUE);
+    }
+
+    // The recipe finishing leaves the AppData to the refresh in flight
+    hosted_freed = FALSE;
+    app_data->state = RECIPE_COMPLETE;
+    recipe_handler (app_data);
+    recipe_handler_finish (app_data);
+    g_assert_false (hosted_freed);
+
+    g_assert_true (g_file_get_contents ("test-data/recipe.xml", &contents, &length, NULL));
+    soup_message_set_response (held.msg, "text/xml", SOUP_MEMORY_TAKE, contents, length);
+    soup_message_set_status (held.msg, SOUP_STATUS_OK);
+    soup_server_unpause_message (held.server, held.msg);
+    while (!hosted_freed) {
+        g_main_context_iteration (NULL, TRUE);
+    }
+
+    g_free (url);
+    soup_server_disconnect (held.server);
+    g_object_unref (held.server);
+}
+
+#define PARSE_STREAM_RECIPE \
+    "<job owner=\"owner@example.com\" checkpoint_file=\"restraint/10.conf\">" \
+    "<recipeSet><recipe id=\"10\" job_id=\"5\" family=\"Fedora39\">" \
+    "<params><param name=\"GLOBAL\" value=\"foo\"/></params>" \
+    "<task id=\"1\" name=\"/a\" status=\"Completed\">" \
+    "<rpm name=\"a\" path=\"/mnt/tests/a\"/>" \
+    "<fetch url=\"https://example.com/tests.tgz#a\" ssl_verify=\"off\"/>" \
+    "<params><param name=\"RECIPE_BLOB\" value=\"0123456789\"/></params>" \
+    "<roles><role value=\"SERVERS\"><system value=\"host1\"/></role></roles>" \
+    "</task>" \
+    "<task id=\"2\" name=\"/b\" keepchanges=\"yes\">" \
+    "<rpm name=\"b\" path=\"/mnt/tests/b\"/>" \
+    "<params><param name=\"RECIPE_BLOB\" value=\"0123456789\"/></params>" \
+    "</task>" \
+    "</recipe></recipeSet></job>"
+
+static void
+parse_stream_wait (AppData *app_data, const gchar *xml)
+{
+    GInputStream *stream = g_memory_input_stream_new_from_data (xml, -1, NULL);
+
+    app_data->state = RECIPE_FETCHING;
+    restraint_recipe_parse_stream (stream, app_data);
+    while (app_data->state == RECIPE_FETCHING) {
+        g_main_context_iteration (NULL, TRUE);
+    }
+}
+
+static void
+test_recipe_parse_stream (void)
+{
+    AppData app_data = { 0 };
+    Recipe *recipe;
+    Task *task, *task2;
+    Param *param, *param2;
+    Role *role;
+
+    parse_stream_wait (&app_data, PARSE_STREAM_RECIPE);
+    g_assert_no_error (app_data.error);
+    g_assert_cmpint (app_data.state, ==, RECIPE_PARSE);
+    g_assert_cmpstr (app_data.config_file, ==, ETC_PATH "/restraint/10.conf");
+
+    recipe = app_data.recipe;
+    g_assert_cmpstr (recipe->recipe_id, ==, "10");
+    g_assert_cmpstr (recipe->job_id, ==, "5");
+    g_assert_cmpstr (recipe->osmajor, ==, "Fedora39");
+    g_assert_cmpstr (recipe->owner, ==, "owner@example.com");
+    g_assert_cmpuint (g_list_length (recipe->params), ==, 1);
+    param = recipe->params->data;
+    g_assert_cmpstr (param->name, ==, "GLOBAL");
+    g_assert_cmpuint (g_list_length (recipe->tasks), ==, 2);
+
+    // A <fetch/> wins over an <rpm/>, wherever it is
+    task = recipe->tasks->data;
+    g_assert_cmpstr (task->task_id, ==, "1");
+    g_assert_cmpint (task->fetch_method, ==, TASK_FETCH_UNPACK);
+    g_assert_cmpstr (task->fetch.url->fragment, ==, "a");
+    g_assert_false (task->ssl_verify);
+    g_assert_true (task->finished);
+    g_assert_cmpuint (g_list_length (task->roles), ==, 1);
+    role = task->roles->data;
+    g_assert_cmpstr (role->systems, ==, "host1");
+
+    task2 = recipe->tasks->next->data;
+    g_assert_cmpstr (task2->task_id, ==, "2");
+    g_assert_cmpint (task2->order, ==, 2);
+    g_assert_cmpint (task2->fetch_method, ==, TASK_FETCH_INSTALL_PACKAGE);
+    g_assert_cmpstr (task2->fetch.package_name, ==, "b");
+    g_assert_cmpstr (task2->path, ==, "/mnt/tests/b");
+    g_assert_true (task2->keepchanges);
+
+    // The tasks share one copy of the param they both have
+    param = task->params->data;
+    param2 = task2->params->data;
+    g_assert_cmpstr (param->value, ==, "0123456789");
+    g_assert_true (param->name == param2->name);
+    g_assert_true (param->value == param2->value);
+
+    restraint_recipe_free (app_data.recipe);
+    g_free (app_data.config_file);
+
+    // A hosted recipe installs its tasks apart from the other recipes,
+    // under its id
+    app_data = (AppData) { 0 };
+    app_data.hosted = TRUE;
+    app_data.config_file = g_build_filename (tmp_test_dir, "0123456789abcdef.conf", NULL);
+    parse_stream_wait (&app_data, PARSE_STREAM_RECIPE);
+    g_assert_no_error (app_data.error);
+    recipe = app_data.recipe;
+    g_assert_true (g_str_has_suffix (recipe->base_path, "/10"));
+    task = recipe->tasks->data;
+    g_assert_true (g_str_has_prefix (task->path, recipe->base_path));
+    restraint_recipe_free (app_data.recipe);
+    g_free (app_data.config_file);
+
+    // A wrong recipe fails to parse without a retry
+    app_data = (AppData) { 0 };
+    parse_stream_wait (&app_data, "<job><recipeSet><recipe id=\"10\">"
+                                  "<task id=\"1\"><params><param name=\"A\"/></params>"
+                                  "</task></recipe></recipeSet></job>");
+    g_assert_error (app_data.error, RESTRAINT_RECIPE_PARSE_ERROR,
+                    RESTRAINT_RECIPE_PARSE_ERROR_UNRECOGNISED);
+    g_assert_cmpstr (app_data.error->message, ==,
+                     "Task 1 has 'param' element without 'value' attribute");
+    g_assert_cmpint (app_data.state, ==, RECIPE_COMPLETE);
+    g_assert_null (app_data.recipe);
+    g_clear_error (&app_data.error);
+}
+
+static Task *
+slot_task_new (gboolean parallel)
+{
+    Task *task = restraint_task_new ();
+
+    task->metadata = g_slice_new0 (MetaData);
+    task->metadata->parallel = parallel;
+    return task;
+}
+
+static void
+test_task_slots (void)
+{
+    AppData app_data = { .task_slots = 2 };
+    Task *parallel1 = slot_task_new (TRUE);
+    Task *parallel2 = slot_task_new (TRUE);
+    Task *parallel3 = slot_task_new (TRUE);
+    Task *serial = slot_task_new (FALSE);
+
+    // The first task always has a slot.
+    g_assert_true (task_slot_free (&app_data, serial));
+    g_assert_true (task_slot_free (&app_data, parallel1));
+
+    // Parallel tasks share the slots, up to task_slots of them running.
+    app_data.running = g_list_append (app_data.running, parallel1);
+    g_assert_true (task_is_parallel (&app_data, parallel2));
+    g_assert_true (task_slot_free (&app_data, parallel2));
+    g_assert_false (task_slot_free (&app_data, serial));
+    app_data.running = g_list_append (app_data.running, parallel2);
+    g_assert_false (task_slot_free (&app_data, parallel3));
+
+    // A serial task running keeps every other task waiting.
+    g_list_free (app_data.running);
+    app_data.running = g_list_append (NULL, serial);
+    g_assert_false (task_slot_free (&app_data, parallel1));
+
+    // With one slot even parallel tasks run one at a time.
+    app_data.task_slots = 1;
+    g_list_free (app_data.running);
+    app_data.running = g_list_append (NULL, parallel1);
+    g_assert_false (task_is_parallel (&app_data, parallel2));
+    g_assert_false (task_slot_free (&app_data, parallel2));
+
+    g_list_free (app_data.running);
+    restraint_task_free (parallel1);
+    restraint_task_free (parallel2);
+    restraint_task_free (parallel3);
+    restraint_task_free (serial);
+}
+
+static void
+test_task_slots_same_path (void)
+{
+    AppData app_data = { .task_slots = 2 };
+    Task *first = slot_task_new (TRUE);
+    Task *again = slot_task_new (TRUE);
+    Task *other = slot_task_new (TRUE);
+    Task *task;
+
+    // The same test twice, with different params, fetches to the same path
+    for (guint i = 0; i < 2; i++) {
+        task = i == 0 ? first : again;
+        task->fetch_method = TASK_FETCH_UNPACK;
+        task->fetch.url = soup_uri_new ("https://example.com/tests.tgz#check-install");
+        task->path = g_build_filename ("/mnt/tests", task->fetch.url->host,
+                                       task->fetch.url->path,
+                                       task->fetch.url->fragment, NULL);
+    }
+    other->path = g_strdup ("/mnt/tests/example.com/tests.tgz/other");
+
+    // Fetching again waits for the task running from there to retire
+    app_data.running = g_list_append (NULL, first);
+    g_assert_true (task_path_user (&app_data, again) == first);
+    g_assert_false (task_slot_free (&app_data, again));
+    g_assert_null (task_path_user (&app_data, other));
+    g_assert_true (task_slot_free (&app_data, other));
+
+    app_data.running = g_list_append (app_data.running, again);
+    g_assert_true (task_path_user (&app_data, again) == first);
+    app_data.running = g_list_remove (app_data.running, first);
+    g_assert_null (task_path_user (&app_data, again));
+    g_assert_true (task_slot_free (&app_data, again));
+
+    g_list_free (app_data.running);
+    restraint_task_free (first);
+    restraint_task_free (again);
+    restraint_task_free (other);
+}
+
 int
 main (int   argc,
       char *argv[])
 {
     gboolean success;
+    gchar *cache_dir;
 
     tmp_test_dir = g_dir_make_tmp ("test_task_XXXXXX", NULL);
+    cache_dir = g_dir_make_tmp ("test_task_cache_XXXXXX", NULL);
+    // Stay out of the real cache, even as root
+    restraint_metadata_set_cache_dir (cache_dir);
+    soup_session = soup_session_new ();
 
     g_test_init (&argc, &argv, NULL);
 
@@ -368,17 +983,30 @@ main (int   argc,
     g_test_add_func ("/task/parse_task_config/no_file", test_parse_task_config_no_file);
     g_test_add_func ("/task/parse_task_config/file_exists", test_parse_task_config_file_exists);
     g_test_add_func ("/task/parse_task_config/bad_file", test_parse_task_config_bad_file);
+    g_test_add_func ("/task/parse_task_config/phases", test_parse_task_config_phases);
+    g_test_add_func ("/task/phases", test_task_phases);
+    g_test_add_func ("/task/phase_charge", test_task_phase_charge);
+    g_test_add_func ("/task/phases_checkpoint", test_task_phases_checkpoint);
     g_test_add_func ("/task/restraint_task_get_offset", test_restraint_task_get_offset);
     g_test_add_func ("/task/task_config_set_offset", test_task_config_set_offset);
     g_test_add_func ("/task/task_config_get_offsets/file_exists", test_task_config_get_offsets_file_exists);
     g_test_add_func ("/task/task_config_get_offsets/no_file", test_task_config_get_offsets_no_file);
     g_test_add_func ("/task/task_config_get_offsets/bad_file", test_task_config_get_offsets_bad_file);
+    g_test_add_func ("/task/recipe_snapshot", test_recipe_snapshot);
+    g_test_add_func ("/task/recipe_refresh_roles", test_recipe_refresh_roles);
+    g_test_add_func ("/task/recipe_hosted_done", test_recipe_hosted_done);
+    g_test_add_func ("/task/recipe_parse_stream", test_recipe_parse_stream);
+    g_test_add_func ("/task/slots", test_task_slots);
+    g_test_add_func ("/task/slots/same_path", test_task_slots_same_path);
 
     rstrnt_test_add_cases (test_param_override_max_time, param_override_max_time_cases);
     rstrnt_test_add_cases (test_param_override_use_pty, param_override_use_pty_cases);
 
     success = g_test_run ();
 
+    restraint_metadata_set_cache_dir (NULL);
+    rmrf (cache_dir);
+    g_free (cache_dir);
     g_remove (tmp_test_dir);
     g_free (tmp_test_dir);
 
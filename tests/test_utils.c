@@ -429,6 +429,41 @@ test_parse_time_string (void)
     g_assert_no_error (tmp_error);
 }
 
+static void
+test_get_dir_files (void)
+{
+    const gchar *names[] = { "b.conf", "c.conf", "notes.txt", "a.conf" };
+    gchar *dir = g_dir_make_tmp ("test_utils_XXXXXX", NULL);
+    GPtrArray *files;
+
+    g_assert_nonnull (dir);
+    for (guint i = 0; i < G_N_ELEMENTS (names); i++) {
+        gchar *file = g_build_filename (dir, names[i], NULL);
+        g_assert_true (g_file_set_contents (file, "", -1, NULL));
+        g_free (file);
+    }
+
+    files = get_dir_files (dir, ".conf");
+    g_assert_nonnull (files);
+    g_assert_cmpuint (files->len, ==, 3);
+    for (guint i = 0; i < files->len; i++) {
+        gchar *expected = g_strdup_printf ("%s/%c.conf", dir, 'a' + i);
+        g_assert_cmpstr (files->pdata[i], ==, expected);
+        g_free (expected);
+    }
+    g_ptr_array_free (files, TRUE);
+
+    for (guint i = 0; i < G_N_ELEMENTS (names); i++) {
+        gchar *file = g_build_filename (dir, names[i], NULL);
+        g_unlink (file);
+        g_free (file);
+    }
+    g_rmdir (dir);
+    g_free (dir);
+
+    g_assert_null (get_dir_files ("/nonexistent/recipes.d", ".conf"));
+}
+
 int
 main (int   argc,
       char *argv[])
@@ -455,6 +490,8 @@ main (int   argc,
                      test_parse_time_string_wrong_unit);
     g_test_add_func ("/utils/parse_time_string/wrong_string",
                      test_parse_time_string_wrong_string);
+    g_test_add_func ("/utils/get_dir_files",
+                     test_get_dir_files);
 
     return g_test_run ();
 }